@@ -324,6 +324,7 @@ fi
 %doc AUTHORS NEWS README
 %{_bindir}/%{name}
 %{_bindir}/%{name}-sessiond
+%{_bindir}/%{name}-sessiond-lite
 %{_bindir}/%{name}-client
 %{_bindir}/%{name}-launcher
 %{_libdir}/lib%{name}*.so.*
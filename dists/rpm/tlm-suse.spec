@@ -77,6 +77,7 @@ rm -rf %{buildroot}
 %doc AUTHORS COPYING INSTALL NEWS README
 %{_bindir}/%{name}
 %{_bindir}/%{name}-sessiond
+%{_bindir}/%{name}-sessiond-lite
 %{_bindir}/%{name}-client
 %{_bindir}/%{name}-weston-launch
 %{_libdir}/lib%{name}*.so.*
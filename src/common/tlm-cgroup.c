@@ -0,0 +1,610 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2013-2015 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *          Jussi Laako <jussi.laako@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "tlm-cgroup.h"
+#include "tlm-log.h"
+#include "tlm-utils.h"
+#include "tlm-config-general.h"
+
+/* Rounds of cgroup.procs scanning when cgroup.kill is not supported
+ * by the kernel (< 5.14); processes forking while we walk the list are
+ * caught by the next round, started once they had time to show up. */
+#define KILL_FALLBACK_ROUNDS 8
+#define KILL_FALLBACK_INTERVAL_MS 10
+
+typedef struct {
+    gchar *cgroup;
+    GHashTable *killed;
+    gint round;
+} KillFallback;
+
+typedef struct {
+    gchar *cgroup;
+    TlmCgroupCb cb;
+    gpointer userdata;
+    guint events_id; /* shared file watcher of tlm-utils */
+    guint idle_id;
+} CgroupWatch;
+
+static GHashTable *_watches = NULL; /* { id: CgroupWatch* } */
+static guint _last_watch_id = 0;
+
+static gboolean
+_write_file (
+        const gchar *cgroup,
+        const gchar *name,
+        const gchar *value)
+{
+    gchar *file_path = g_build_filename (cgroup, name, NULL);
+    gssize len = strlen (value);
+    gboolean res = FALSE;
+    int fd;
+
+    fd = open (file_path, O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        res = (write (fd, value, len) == len);
+        close (fd);
+    }
+    if (!res) {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        int err = errno;
+        DBG ("write('%s', '%s'): %s", file_path, value,
+             strerror_r(err, strerr_buf, MAX_STRERROR_LEN));
+        errno = err;
+    }
+    g_free (file_path);
+
+    return res;
+}
+
+gchar *
+tlm_cgroup_get_for_pid (pid_t pid)
+{
+    gchar *proc_path = NULL;
+    gchar *contents = NULL;
+    gchar *cgroup = NULL;
+    gchar *events = NULL;
+    gchar **lines = NULL;
+    gchar **line = NULL;
+
+    if (pid > 0)
+        proc_path = g_strdup_printf ("/proc/%d/cgroup", pid);
+    else
+        proc_path = g_strdup ("/proc/self/cgroup");
+
+    if (!g_file_get_contents (proc_path, &contents, NULL, NULL)) {
+        WARN ("Failed to read '%s'", proc_path);
+        g_free (proc_path);
+        return NULL;
+    }
+    g_free (proc_path);
+
+    /* the unified hierarchy entry is of form "0::<path>" */
+    lines = g_strsplit (contents, "\n", -1);
+    for (line = lines; *line; line++) {
+        if (g_str_has_prefix (*line, "0::")) {
+            cgroup = g_build_filename (TLM_CGROUP_MOUNT, *line + 3, NULL);
+            break;
+        }
+    }
+    g_strfreev (lines);
+    g_free (contents);
+
+    if (!cgroup)
+        return NULL;
+
+    events = g_build_filename (cgroup, "cgroup.events", NULL);
+    if (g_access (events, R_OK)) {
+        DBG ("'%s' is not on a cgroup v2 hierarchy", cgroup);
+        g_clear_string (&cgroup);
+    }
+    g_free (events);
+
+    return cgroup;
+}
+
+static gboolean
+_is_sessiond_leaf (const gchar *cgroup)
+{
+    gchar *name = g_path_get_basename (cgroup);
+    gboolean res = g_strcmp0 (name, TLM_CGROUP_SESSIOND_LEAF) == 0;
+
+    g_free (name);
+    return res;
+}
+
+gchar *
+tlm_cgroup_get_session_path (
+        TlmConfig *config,
+        const gchar *seat_id,
+        pid_t sessiond_pid)
+{
+    gboolean enabled;
+    const gchar *parent_path = NULL;
+    gchar *parent = NULL;
+    gchar *name = NULL;
+    gchar *cgroup = NULL;
+
+    g_return_val_if_fail (config, NULL);
+
+    if (tlm_config_has_key (config,
+                            seat_id,
+                            TLM_CONFIG_GENERAL_SESSION_CGROUP)) {
+        enabled = tlm_config_get_boolean (config,
+                                          seat_id,
+                                          TLM_CONFIG_GENERAL_SESSION_CGROUP,
+                                          FALSE);
+    } else {
+        enabled = tlm_config_get_boolean (config,
+                                          TLM_CONFIG_GENERAL,
+                                          TLM_CONFIG_GENERAL_SESSION_CGROUP,
+                                          FALSE);
+    }
+    if (!enabled)
+        return NULL;
+
+    parent_path = tlm_config_get_string (config,
+                                         seat_id,
+                                         TLM_CONFIG_GENERAL_CGROUP_PARENT);
+    if (!parent_path)
+        parent_path = tlm_config_get_string (config,
+                                             TLM_CONFIG_GENERAL,
+                                             TLM_CONFIG_GENERAL_CGROUP_PARENT);
+    if (parent_path)
+        parent = g_build_filename (TLM_CGROUP_MOUNT, parent_path, NULL);
+    else
+        /* the scope logind placed the session into */
+        parent = tlm_cgroup_get_for_pid (sessiond_pid);
+    if (!parent)
+        return NULL;
+    if (!parent_path && _is_sessiond_leaf (parent)) {
+        /* sessiond already left the scope, see tlm_cgroup_leave_parent() */
+        name = parent;
+        parent = g_path_get_dirname (name);
+        g_free (name);
+    }
+
+    name = g_strdup_printf ("tlm-session-%d", sessiond_pid);
+    cgroup = g_build_filename (parent, name, NULL);
+    g_free (name);
+    g_free (parent);
+
+    return cgroup;
+}
+
+gboolean
+tlm_cgroup_create (const gchar *cgroup)
+{
+    g_return_val_if_fail (cgroup, FALSE);
+
+    if (g_mkdir (cgroup, 0755) && errno != EEXIST) {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        WARN ("mkdir(\"%s\"): %s", cgroup,
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        return FALSE;
+    }
+    DBG ("session cgroup '%s'", cgroup);
+
+    return TRUE;
+}
+
+gboolean
+tlm_cgroup_attach (
+        const gchar *cgroup,
+        pid_t pid)
+{
+    gchar pid_str[16];
+
+    g_return_val_if_fail (cgroup, FALSE);
+
+    g_snprintf (pid_str, sizeof (pid_str), "%d", pid);
+    return _write_file (cgroup, "cgroup.procs", pid_str);
+}
+
+/*
+ * A cgroup holding processes cannot enable controllers for its children,
+ * moves @pid into a leaf next to @cgroup if it is in the parent of @cgroup
+ */
+gboolean
+tlm_cgroup_leave_parent (
+        const gchar *cgroup,
+        pid_t pid)
+{
+    gchar *parent = NULL;
+    gchar *own = NULL;
+    gchar *leaf = NULL;
+    gboolean res = TRUE;
+
+    g_return_val_if_fail (cgroup, FALSE);
+
+    parent = g_path_get_dirname (cgroup);
+    own = tlm_cgroup_get_for_pid (pid);
+    if (g_strcmp0 (own, parent) == 0) {
+        leaf = g_build_filename (parent, TLM_CGROUP_SESSIOND_LEAF, NULL);
+        res = tlm_cgroup_create (leaf) && tlm_cgroup_attach (leaf, pid);
+        g_free (leaf);
+    }
+    g_free (own);
+    g_free (parent);
+
+    return res;
+}
+
+gboolean
+tlm_cgroup_is_populated (const gchar *cgroup)
+{
+    gchar *events = NULL;
+    gchar *contents = NULL;
+    gboolean populated = FALSE;
+
+    if (!cgroup)
+        return FALSE;
+
+    events = g_build_filename (cgroup, "cgroup.events", NULL);
+    if (g_file_get_contents (events, &contents, NULL, NULL))
+        populated = (strstr (contents, "populated 1") != NULL);
+    g_free (contents);
+    g_free (events);
+
+    return populated;
+}
+
+/* Sends @sig to the processes of @cgroup not in @signalled yet, returns
+ * how many were new */
+static guint
+_signal_listed_procs (
+        const gchar *cgroup,
+        int sig,
+        GHashTable *signalled)
+{
+    gchar *procs = g_build_filename (cgroup, "cgroup.procs", NULL);
+    gchar *contents = NULL;
+    gchar **pids = NULL;
+    gchar **pid = NULL;
+    guint count = 0;
+
+    if (g_file_get_contents (procs, &contents, NULL, NULL)) {
+        pids = g_strsplit (contents, "\n", -1);
+        for (pid = pids; *pid; pid++) {
+            gpointer key;
+            if (!**pid) continue;
+            key = GINT_TO_POINTER (atoi (*pid));
+            /* never fall back to signalling our own process group */
+            if (GPOINTER_TO_INT (key) <= 0 ||
+                (signalled && g_hash_table_contains (signalled, key)))
+                continue;
+            kill ((pid_t) GPOINTER_TO_INT (key), sig);
+            if (signalled)
+                g_hash_table_add (signalled, key);
+            count++;
+        }
+        g_strfreev (pids);
+    }
+    g_free (contents);
+    g_free (procs);
+
+    return count;
+}
+
+gboolean
+tlm_cgroup_signal (
+        const gchar *cgroup,
+        int sig)
+{
+    g_return_val_if_fail (cgroup, FALSE);
+
+    DBG ("sending signal %d to the processes in '%s'", sig, cgroup);
+    return _signal_listed_procs (cgroup, sig, NULL) > 0;
+}
+
+static void
+_kill_fallback_free (gpointer userdata)
+{
+    KillFallback *fallback = (KillFallback *) userdata;
+
+    g_hash_table_unref (fallback->killed);
+    g_free (fallback->cgroup);
+    g_slice_free (KillFallback, fallback);
+}
+
+/* The killed processes take a while to leave the list, done once a round
+ * finds no process that was not killed yet */
+static gboolean
+_kill_fallback_round (gpointer userdata)
+{
+    KillFallback *fallback = (KillFallback *) userdata;
+
+    if (_signal_listed_procs (fallback->cgroup, SIGKILL,
+                              fallback->killed) == 0)
+        return G_SOURCE_REMOVE;
+    if (++fallback->round < KILL_FALLBACK_ROUNDS)
+        return G_SOURCE_CONTINUE;
+
+    WARN ("processes in '%s' keep respawning", fallback->cgroup);
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Kills every process of @cgroup. Without cgroup.kill the first round is
+ * done right away and the rest from the main loop, the caller learns about
+ * the outcome from tlm_cgroup_watch_empty().
+ */
+gboolean
+tlm_cgroup_kill (const gchar *cgroup)
+{
+    KillFallback *fallback = NULL;
+
+    g_return_val_if_fail (cgroup, FALSE);
+
+    DBG ("killing all processes in '%s'", cgroup);
+    if (_write_file (cgroup, "cgroup.kill", "1"))
+        return TRUE;
+
+    if (errno != ENOENT)
+        return FALSE;
+
+    fallback = g_slice_new0 (KillFallback);
+    fallback->cgroup = g_strdup (cgroup);
+    fallback->killed = g_hash_table_new (g_direct_hash, g_direct_equal);
+    if (_kill_fallback_round (fallback) == G_SOURCE_CONTINUE)
+        g_timeout_add_full (G_PRIORITY_DEFAULT, KILL_FALLBACK_INTERVAL_MS,
+                _kill_fallback_round, fallback, _kill_fallback_free);
+    else
+        _kill_fallback_free (fallback);
+
+    return TRUE;
+}
+
+static void
+_cgroup_watch_free (CgroupWatch *watch)
+{
+    if (!watch) return;
+
+    tlm_utils_unwatch_files (watch->events_id);
+    if (watch->idle_id) g_source_remove (watch->idle_id);
+    g_free (watch->cgroup);
+    g_slice_free (CgroupWatch, watch);
+}
+
+/* The watch is over, it is forgotten before the callback may start a new
+ * one */
+static void
+_cgroup_watch_done (guint id)
+{
+    CgroupWatch *watch = g_hash_table_lookup (_watches, GUINT_TO_POINTER (id));
+
+    g_hash_table_steal (_watches, GUINT_TO_POINTER (id));
+    if (watch->cb) watch->cb (watch->cgroup, watch->userdata);
+    _cgroup_watch_free (watch);
+}
+
+static gboolean
+_cgroup_empty_idle_cb (gpointer userdata)
+{
+    guint id = GPOINTER_TO_UINT (userdata);
+    CgroupWatch *watch = g_hash_table_lookup (_watches, userdata);
+
+    watch->idle_id = 0;
+    _cgroup_watch_done (id);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_cgroup_events_cb (
+        const gchar *path,
+        gboolean is_final,
+        GError *error,
+        gpointer userdata)
+{
+    guint id = GPOINTER_TO_UINT (userdata);
+    CgroupWatch *watch = g_hash_table_lookup (_watches, userdata);
+
+    (void) path;
+    (void) error;
+
+    if (is_final)
+        watch->events_id = 0;
+    if (tlm_cgroup_is_populated (watch->cgroup))
+        return;
+
+    _cgroup_watch_done (id);
+}
+
+/*
+ * Calls @cb once @cgroup has no process left, from the main loop even when
+ * it is empty already. Returns the id to pass to tlm_cgroup_unwatch().
+ */
+guint
+tlm_cgroup_watch_empty (
+        const gchar *cgroup,
+        TlmCgroupCb cb,
+        gpointer userdata)
+{
+    CgroupWatch *watch = NULL;
+    gchar *events = NULL;
+    gpointer id;
+
+    g_return_val_if_fail (cgroup, 0);
+
+    if (!_watches)
+        _watches = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                NULL, (GDestroyNotify) _cgroup_watch_free);
+    do {
+        id = GUINT_TO_POINTER (++_last_watch_id);
+    } while (!_last_watch_id || g_hash_table_contains (_watches, id));
+
+    watch = g_slice_new0 (CgroupWatch);
+    watch->cgroup = g_strdup (cgroup);
+    watch->cb = cb;
+    watch->userdata = userdata;
+    g_hash_table_insert (_watches, id, watch);
+
+    /* cgroup.events is modified on every "populated" transition */
+    events = g_build_filename (cgroup, "cgroup.events", NULL);
+    watch->events_id = tlm_utils_watch_file_changes (events,
+            _cgroup_events_cb, id);
+    g_free (events);
+
+    /* the watch is in place, so checking now cannot miss the transition */
+    if (!tlm_cgroup_is_populated (cgroup)) {
+        tlm_utils_unwatch_files (watch->events_id);
+        watch->events_id = 0;
+        watch->idle_id = g_idle_add (_cgroup_empty_idle_cb, id);
+    }
+
+    return GPOINTER_TO_UINT (id);
+}
+
+/* Stops the watch @watch_id, its callback is not called anymore */
+void
+tlm_cgroup_unwatch (guint watch_id)
+{
+    if (!watch_id || !_watches)
+        return;
+    g_hash_table_remove (_watches, GUINT_TO_POINTER (watch_id));
+}
+
+gboolean
+tlm_cgroup_remove (const gchar *cgroup)
+{
+    g_return_val_if_fail (cgroup, FALSE);
+
+    if (g_rmdir (cgroup) && errno != ENOENT) {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        WARN ("rmdir(\"%s\"): %s", cgroup,
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean
+tlm_cgroup_set_attribute (
+        const gchar *cgroup,
+        const gchar *name,
+        const gchar *value)
+{
+    g_return_val_if_fail (cgroup && name && value, FALSE);
+
+    return _write_file (cgroup, name, value);
+}
+
+/* Returns the stripped contents of an interface file of @cgroup */
+gchar *
+tlm_cgroup_get_attribute (
+        const gchar *cgroup,
+        const gchar *name)
+{
+    gchar *file_path = NULL;
+    gchar *contents = NULL;
+
+    g_return_val_if_fail (cgroup && name, NULL);
+
+    file_path = g_build_filename (cgroup, name, NULL);
+    if (!g_file_get_contents (file_path, &contents, NULL, NULL))
+        DBG ("Failed to read '%s'", file_path);
+    g_free (file_path);
+
+    return contents ? g_strstrip (contents) : NULL;
+}
+
+/* Enables @controller for the children of @cgroup unless it already is */
+static gboolean
+_enable_subtree_controller (
+        const gchar *cgroup,
+        const gchar *controller)
+{
+    gchar *enabled = NULL;
+    gchar **names = NULL;
+    gchar **name = NULL;
+    gchar *request = NULL;
+    gboolean res = FALSE;
+
+    enabled = tlm_cgroup_get_attribute (cgroup, "cgroup.subtree_control");
+    if (enabled) {
+        names = g_strsplit (enabled, " ", -1);
+        for (name = names; *name && !res; name++)
+            res = g_strcmp0 (*name, controller) == 0;
+        g_strfreev (names);
+    }
+    if (!res) {
+        request = g_strconcat ("+", controller, NULL);
+        res = _write_file (cgroup, "cgroup.subtree_control", request);
+        g_free (request);
+    }
+    if (!res)
+        WARN ("'%s' controller not available in '%s'", controller, cgroup);
+    g_free (enabled);
+
+    return res;
+}
+
+/*
+ * Makes @controller available to @cgroup, a controller reaches a cgroup
+ * only if every ancestor down from the root enables it for its children
+ */
+gboolean
+tlm_cgroup_enable_controller (
+        const gchar *cgroup,
+        const gchar *controller)
+{
+    GSList *ancestors = NULL, *l = NULL;
+    gchar *parent = NULL;
+    gboolean res = TRUE;
+
+    g_return_val_if_fail (cgroup && controller, FALSE);
+
+    parent = g_path_get_dirname (cgroup);
+    while (g_str_has_prefix (parent, TLM_CGROUP_MOUNT "/")) {
+        ancestors = g_slist_prepend (ancestors, parent);
+        parent = g_path_get_dirname (parent);
+    }
+    if (g_strcmp0 (parent, TLM_CGROUP_MOUNT) != 0) {
+        WARN ("'%s' is not below %s", cgroup, TLM_CGROUP_MOUNT);
+        g_free (parent);
+        g_slist_free_full (ancestors, g_free);
+        return FALSE;
+    }
+    ancestors = g_slist_prepend (ancestors, parent);
+
+    for (l = ancestors; l && res; l = l->next)
+        res = _enable_subtree_controller ((const gchar *) l->data, controller);
+    g_slist_free_full (ancestors, g_free);
+
+    return res;
+}
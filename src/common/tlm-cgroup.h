@@ -0,0 +1,90 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2013-2015 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *          Jussi Laako <jussi.laako@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef _TLM_CGROUP_H
+#define _TLM_CGROUP_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+#include "tlm-config.h"
+
+G_BEGIN_DECLS
+
+#define TLM_CGROUP_MOUNT    "/sys/fs/cgroup"
+#define TLM_CGROUP_SESSIOND_LEAF "tlm-sessiond"
+
+typedef void (*TlmCgroupCb) (const gchar *cgroup, gpointer userdata);
+
+gchar *
+tlm_cgroup_get_for_pid (pid_t pid);
+
+gchar *
+tlm_cgroup_get_session_path (TlmConfig *config, const gchar *seat_id,
+                             pid_t sessiond_pid);
+
+gboolean
+tlm_cgroup_create (const gchar *cgroup);
+
+gboolean
+tlm_cgroup_attach (const gchar *cgroup, pid_t pid);
+
+gboolean
+tlm_cgroup_leave_parent (const gchar *cgroup, pid_t pid);
+
+gboolean
+tlm_cgroup_is_populated (const gchar *cgroup);
+
+gboolean
+tlm_cgroup_signal (const gchar *cgroup, int sig);
+
+gboolean
+tlm_cgroup_kill (const gchar *cgroup);
+
+guint
+tlm_cgroup_watch_empty (const gchar *cgroup, TlmCgroupCb cb,
+                        gpointer userdata);
+
+void
+tlm_cgroup_unwatch (guint watch_id);
+
+gboolean
+tlm_cgroup_remove (const gchar *cgroup);
+
+gboolean
+tlm_cgroup_set_attribute (const gchar *cgroup, const gchar *name,
+                          const gchar *value);
+
+gchar *
+tlm_cgroup_get_attribute (const gchar *cgroup, const gchar *name);
+
+gboolean
+tlm_cgroup_enable_controller (const gchar *cgroup, const gchar *controller);
+
+G_END_DECLS
+
+#endif /* _TLM_CGROUP_H */
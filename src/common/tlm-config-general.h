@@ -77,6 +77,90 @@
  */
 #define TLM_CONFIG_GENERAL_SESSION_PATH     "SESSION_PATH"
 
+/**
+ * TLM_CONFIG_GENERAL_SESSION_READY:
+ *
+ * Condition that makes a started session usable, the session is reported
+ * as created only once it holds. Default value: none (created right after
+ * the session command is executed)
+ *
+ * "notify" waits for the session to write "READY=1" to the descriptor named
+ * in its TLM_NOTIFY_FD environment variable, "socket:PATH" for a socket
+ * bound to PATH to be listening and "file:PATH" for PATH to appear. A
+ * relative PATH is taken relative to XDG_RUNTIME_DIR. The socket is looked
+ * up by the path it was bound to, no connection is made to it.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_READY    "SESSION_READY"
+
+/**
+ * TLM_CONFIG_GENERAL_SESSION_READY_TIMEOUT_MS:
+ *
+ * Time in milliseconds to wait for #TLM_CONFIG_GENERAL_SESSION_READY, after
+ * which the session is reported as created anyway, 0 waits indefinitely.
+ * Default value: 10000
+ */
+#define TLM_CONFIG_GENERAL_SESSION_READY_TIMEOUT_MS "SESSION_READY_TIMEOUT_MS"
+
+/**
+ * TLM_CONFIG_GENERAL_LOGIN_BOOST_NICE:
+ *
+ * Nice value sessiond and the session it starts run at during the login
+ * boost, e.g. -10. Can be overridden per seat. Default value: 0 (none)
+ *
+ * The login boost starts when the session is requested and ends once the
+ * session is ready (see #TLM_CONFIG_GENERAL_SESSION_READY) or after
+ * #TLM_CONFIG_GENERAL_LOGIN_BOOST_TIMEOUT_MS. Threads of the session still
+ * at the boosted priority then go back to the priority of sessiond.
+ */
+#define TLM_CONFIG_GENERAL_LOGIN_BOOST_NICE "LOGIN_BOOST_NICE"
+
+/**
+ * TLM_CONFIG_GENERAL_LOGIN_BOOST_IOPRIO:
+ *
+ * I/O priority during the login boost: "realtime:LEVEL",
+ * "best-effort:LEVEL" or a plain best-effort LEVEL from 0 (highest) to 7.
+ * Can be overridden per seat. Default value: none
+ */
+#define TLM_CONFIG_GENERAL_LOGIN_BOOST_IOPRIO "LOGIN_BOOST_IOPRIO"
+
+/**
+ * TLM_CONFIG_GENERAL_LOGIN_BOOST_CPU_WEIGHT:
+ *
+ * cpu.weight of the session cgroup during the login boost, from 1 to 10000
+ * where 100 is the kernel default. Needs #TLM_CONFIG_GENERAL_SESSION_CGROUP,
+ * the cpu controller is enabled in the parent cgroup if necessary. Can be
+ * overridden per seat. Default value: 0 (none)
+ */
+#define TLM_CONFIG_GENERAL_LOGIN_BOOST_CPU_WEIGHT "LOGIN_BOOST_CPU_WEIGHT"
+
+/**
+ * TLM_CONFIG_GENERAL_LOGIN_BOOST_TIMEOUT_MS:
+ *
+ * Maximum duration of the login boost in milliseconds, 0 keeps it until
+ * the session is ready. Can be overridden per seat. Default value: 10000
+ */
+#define TLM_CONFIG_GENERAL_LOGIN_BOOST_TIMEOUT_MS "LOGIN_BOOST_TIMEOUT_MS"
+
+/**
+ * TLM_CONFIG_GENERAL_PREFETCH_FILES:
+ *
+ * Files read into the page cache while a session of the seat is being
+ * authenticated, separated by ';'. The program of
+ * #TLM_CONFIG_GENERAL_SESSION_CMD is added when prefetching is enabled by
+ * this or #TLM_CONFIG_GENERAL_PREFETCH_LIST. Can be overridden per seat.
+ * Default value: none
+ */
+#define TLM_CONFIG_GENERAL_PREFETCH_FILES   "PREFETCH_FILES"
+
+/**
+ * TLM_CONFIG_GENERAL_PREFETCH_LIST:
+ *
+ * File listing further files to prefetch, one path per line, as recorded
+ * from a traced session start by tools/tlm-prefetch-learn.sh. Can be
+ * overridden per seat. Default value: none
+ */
+#define TLM_CONFIG_GENERAL_PREFETCH_LIST    "PREFETCH_LIST"
+
 /**
  * TLM_CONFIG_GENERAL_DATA_DIRS:
  *
@@ -156,6 +240,50 @@
  */
 #define TLM_CONFIG_GENERAL_RUNTIME_MODE     "RUNTIME_MODE"
 
+/**
+ * TLM_CONFIG_GENERAL_RUNTIME_DIR_CLEANUP
+ *
+ * How the XDG_RUNTIME_DIR left by a previous session is handled when
+ * #TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR is set: "delete", "rename" or "reuse".
+ * Default value: "delete"
+ *
+ * "delete" removes the old directory before creating the new one. "rename"
+ * moves it aside in one step, creates a fresh directory right away and
+ * removes the old contents in the background. "reuse" keeps the directory
+ * when it belongs to the same user and is neither removed at logout; other
+ * cases are handled as "rename".
+ */
+#define TLM_CONFIG_GENERAL_RUNTIME_DIR_CLEANUP "RUNTIME_DIR_CLEANUP"
+
+/**
+ * TLM_CONFIG_GENERAL_RUNTIME_DIR_TMPFS
+ *
+ * Mount a private tmpfs on the XDG_RUNTIME_DIR of each session: TRUE/FALSE
+ * (FALSE if not set).
+ *
+ * The mount is owned by the user with #TLM_CONFIG_GENERAL_RUNTIME_MODE and
+ * is detached when the last session of the user logs out, whatever it
+ * contains. Sessions of the user on other seats share it while it is up,
+ * otherwise the directory is never reused across sessions in this mode.
+ */
+#define TLM_CONFIG_GENERAL_RUNTIME_DIR_TMPFS "RUNTIME_DIR_TMPFS"
+
+/**
+ * TLM_CONFIG_GENERAL_RUNTIME_DIR_SIZE
+ *
+ * Size limit of the runtime directory tmpfs, in the syntax of the tmpfs
+ * size= mount option, e.g. "64M" or "5%". Default: the tmpfs default.
+ */
+#define TLM_CONFIG_GENERAL_RUNTIME_DIR_SIZE "RUNTIME_DIR_SIZE"
+
+/**
+ * TLM_CONFIG_GENERAL_RUNTIME_DIR_INODES
+ *
+ * Inode limit of the runtime directory tmpfs, in the syntax of the tmpfs
+ * nr_inodes= mount option. Default: the tmpfs default.
+ */
+#define TLM_CONFIG_GENERAL_RUNTIME_DIR_INODES "RUNTIME_DIR_INODES"
+
 /**
  * TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT
  *
@@ -166,6 +294,68 @@
  */
 #define TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT "TERMINATE_TIMEOUT" 
 
+/**
+ * TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT_MS
+ *
+ * Timeout for session termination in milliseconds. Overrides
+ * #TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT when set.
+ */
+#define TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT_MS "TERMINATE_TIMEOUT_MS"
+
+/**
+ * TLM_CONFIG_GENERAL_SHUTDOWN_TIMEOUT
+ *
+ * Overall time budget in milliseconds for stopping all seats when tlm is
+ * terminated. Default value: 0 (no budget)
+ *
+ * All sessions are signalled at once. Each step of a session termination
+ * gets at most #TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT_MS, shortened so that
+ * the remaining steps still fit in the budget. Seats not stopped when the
+ * budget runs out are reported and abandoned.
+ */
+#define TLM_CONFIG_GENERAL_SHUTDOWN_TIMEOUT "SHUTDOWN_TIMEOUT"
+
+/**
+ * TLM_CONFIG_GENERAL_PAM_SLOW_THRESHOLD_MS
+ *
+ * Report PAM calls taking at least this many milliseconds. Default value: 0
+ * (off)
+ *
+ * The warning names the PAM stage and service and the last conversation
+ * message received during the call, which usually identifies the module.
+ * Timings of all calls are collected by the daemon regardless, and logged
+ * as per-service histograms on SIGUSR1.
+ */
+#define TLM_CONFIG_GENERAL_PAM_SLOW_THRESHOLD_MS "PAM_SLOW_THRESHOLD_MS"
+
+/**
+ * TLM_CONFIG_GENERAL_PAM_AUTHENTICATE_TIMEOUT_MS
+ *
+ * Deadline in milliseconds for pam_authenticate(). Default value: 0 (none)
+ *
+ * This and the other PAM deadlines can be overridden for a PAM service in a
+ * group named after the service. When a PAM call runs past its deadline,
+ * tlm-sessiond exits with a status naming the stage, the daemon reports a
+ * #TLM_ERROR_PAM_TIMEOUT error for it and the seat handles it like any other
+ * failed login.
+ */
+#define TLM_CONFIG_GENERAL_PAM_AUTHENTICATE_TIMEOUT_MS "PAM_AUTHENTICATE_TIMEOUT_MS"
+
+/**
+ * TLM_CONFIG_GENERAL_PAM_SETCRED_TIMEOUT_MS
+ *
+ * Deadline in milliseconds for each pam_setcred() call. Default value: 0
+ * (none)
+ */
+#define TLM_CONFIG_GENERAL_PAM_SETCRED_TIMEOUT_MS "PAM_SETCRED_TIMEOUT_MS"
+
+/**
+ * TLM_CONFIG_GENERAL_PAM_OPEN_SESSION_TIMEOUT_MS
+ *
+ * Deadline in milliseconds for pam_open_session(). Default value: 0 (none)
+ */
+#define TLM_CONFIG_GENERAL_PAM_OPEN_SESSION_TIMEOUT_MS "PAM_OPEN_SESSION_TIMEOUT_MS"
+
 /**
  * TLM_CONFIG_GENERAL_X11_SESSION
  *
@@ -192,4 +382,73 @@
  */
 #define TLM_CONFIG_GENERAL_SESSION_TYPE     "SESSION_TYPE"
 
+/**
+ * TLM_CONFIG_GENERAL_SESSION_CGROUP
+ *
+ * Place the user session into its own cgroup v2 subtree: TRUE/FALSE
+ * (FALSE if not set).
+ *
+ * When enabled, session teardown sends SIGHUP to the session and, after
+ * #TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, kills every remaining process of the
+ * subtree through cgroup.kill. The session is reported terminated once
+ * cgroup.events reports the subtree as unpopulated.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_CGROUP   "SESSION_CGROUP"
+
+/**
+ * TLM_CONFIG_GENERAL_CGROUP_PARENT
+ *
+ * Parent cgroup for the session cgroups, relative to the cgroup v2 mount
+ * point, for example "/tlm.slice". The cgroup must be delegated to tlm. If
+ * not set, the session cgroup is created inside the scope logind placed the
+ * session into, and tlm-sessiond moves itself into a "tlm-sessiond" leaf of
+ * that scope so that the scope can enable controllers for the session.
+ */
+#define TLM_CONFIG_GENERAL_CGROUP_PARENT    "CGROUP_PARENT"
+
+/**
+ * TLM_CONFIG_GENERAL_SESSION_BACKEND
+ *
+ * Backend used by the seats to run sessions: "sessiond" (default) spawns
+ * tlm-sessiond for every session, "lite" spawns tlm-sessiond-lite instead,
+ * which runs the session the same way but talks to the daemon over a plain
+ * line protocol rather than D-Bus and never connects to the system bus, so
+ * the logind session id is only known when PAM or libsystemd provide it. It
+ * still runs on the GLib main loop. "fake" runs an in-process session that never forks,
+ * authenticates or executes anything and is configured from the
+ * "FakeSession" group; it is only honored in builds configured with
+ * --enable-debug and is meant for tests and benchmarks.
+ */
+#define TLM_CONFIG_GENERAL_SESSION_BACKEND  "SESSION_BACKEND"
+
+/**
+ * TLM_CONFIG_GENERAL_WATCH_CONFIG
+ *
+ * Reload the configuration file by itself when it changes, as on SIGHUP.
+ * Changes that follow each other within a second are reloaded once. Default
+ * value: FALSE
+ *
+ * A reload only replaces the configuration when the new one is valid. The
+ * changed keys are logged and applied to the seats they affect when their
+ * next session starts; the plugins are loaded again only when their own
+ * configuration changes. Seats that are not running yet are added when the
+ * new configuration activates them or raises #TLM_CONFIG_GENERAL_NSEATS.
+ * Deactivating a running seat, changing its watches or lowering
+ * #TLM_CONFIG_GENERAL_NSEATS takes effect on restart only.
+ */
+#define TLM_CONFIG_GENERAL_WATCH_CONFIG     "WATCH_CONFIG"
+
+/**
+ * TLM_CONFIG_GENERAL_USER_CACHE_TTL
+ *
+ * Seconds the daemon reuses the passwd entry and groups of a user it looked
+ * up, 0 disables the cache. Default value: 60
+ *
+ * The cache is dropped whenever /etc/passwd or /etc/group changes, and the
+ * entry of a guest user when an account plugin sets it up or cleans it, so
+ * the TTL only bounds how stale users from network NSS sources can get.
+ * Hits and misses are logged on SIGUSR1.
+ */
+#define TLM_CONFIG_GENERAL_USER_CACHE_TTL   "USER_CACHE_TTL"
+
 #endif /* __TLM_GENERAL_CONFIG_H_ */
@@ -67,4 +67,70 @@
  */
 #define TLM_CONFIG_SEAT_VTNR            "VTNR"
 
+/**
+ * TLM_CONFIG_SEAT_CPU_AFFINITY:
+ *
+ * CPUs the sessions of the seat may run on, in the cpuset list format
+ * such as "2-3,6". With #TLM_CONFIG_GENERAL_SESSION_CGROUP it is enforced
+ * through cpuset.cpus of the session cgroup, otherwise only the CPU
+ * affinity of the session process is set, which the session may change.
+ * Default value: none
+ *
+ * The resource policy keys of a seat are applied before the session
+ * command is executed. A configured policy that cannot be applied fails
+ * the session creation rather than running the session without it.
+ */
+#define TLM_CONFIG_SEAT_CPU_AFFINITY    "CPU_AFFINITY"
+
+/**
+ * TLM_CONFIG_SEAT_CPU_WEIGHT:
+ *
+ * cpu.weight of the session cgroup, from 1 to 10000 where 100 is the
+ * kernel default. Needs #TLM_CONFIG_GENERAL_SESSION_CGROUP.
+ * Default value: none
+ */
+#define TLM_CONFIG_SEAT_CPU_WEIGHT      "CPU_WEIGHT"
+
+/**
+ * TLM_CONFIG_SEAT_CPU_MAX:
+ *
+ * cpu.max of the session cgroup, "QUOTA PERIOD" in microseconds, e.g.
+ * "200000 100000" for two CPUs worth of time. Needs
+ * #TLM_CONFIG_GENERAL_SESSION_CGROUP. Default value: none
+ */
+#define TLM_CONFIG_SEAT_CPU_MAX         "CPU_MAX"
+
+/**
+ * TLM_CONFIG_SEAT_IO_WEIGHT:
+ *
+ * io.weight of the session cgroup, from 1 to 10000. Needs
+ * #TLM_CONFIG_GENERAL_SESSION_CGROUP. Default value: none
+ */
+#define TLM_CONFIG_SEAT_IO_WEIGHT       "IO_WEIGHT"
+
+/**
+ * TLM_CONFIG_SEAT_MEMORY_HIGH:
+ *
+ * memory.high of the session cgroup in bytes, K, M and G suffixes are
+ * accepted; the session is throttled and reclaimed above it. Needs
+ * #TLM_CONFIG_GENERAL_SESSION_CGROUP. Default value: none
+ */
+#define TLM_CONFIG_SEAT_MEMORY_HIGH     "MEMORY_HIGH"
+
+/**
+ * TLM_CONFIG_SEAT_MEMORY_MAX:
+ *
+ * memory.max of the session cgroup, the session is OOM killed above it.
+ * Needs #TLM_CONFIG_GENERAL_SESSION_CGROUP. Default value: none
+ */
+#define TLM_CONFIG_SEAT_MEMORY_MAX      "MEMORY_MAX"
+
+/**
+ * TLM_CONFIG_SEAT_OOM_SCORE_ADJ:
+ *
+ * oom_score_adj of the session process, inherited by its children, from
+ * -1000 (never killed) to 1000. Default value: none
+ */
+#define TLM_CONFIG_SEAT_OOM_SCORE_ADJ   "OOM_SCORE_ADJ"
+
 #endif /* __TLM_CONFIG_SEAT_H_ */
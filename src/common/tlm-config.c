@@ -25,12 +25,14 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib/gstdio.h>
 
 #include "config.h"
 #include "tlm-config.h"
 #include "tlm-config-general.h"
+#include "tlm-config-seat.h"
 #include "tlm-log.h"
 
 /**
@@ -70,6 +72,14 @@
  * Otherwise, the config file location is determined at compilation time as
  * $(sysconfdir) + "tlm.conf"
  *
+ * <refsect1><title>Compiled seat configuration</title></refsect1>
+ *
+ * The keys the daemon consults on every login are also compiled into a
+ * typed #TlmSeatConfig per seat, with the seat group, General group and
+ * built-in default already resolved. tlm_config_validate() compiles all the
+ * seats up front and reports the values that do not parse, with the file
+ * and line they come from.
+ *
  * <refsect1><title>Example configuration file</title></refsect1>
  *
  * See example configuration file here:
@@ -91,10 +101,95 @@
  * Opaque structure for the class.
  */
 
+/**
+ * TlmSeatConfig:
+ * @seat_id: the seat, NULL for the General group alone
+ * @active: #TLM_CONFIG_SEAT_ACTIVE
+ * @auto_login: #TLM_CONFIG_GENERAL_AUTO_LOGIN
+ * @prepare_default: #TLM_CONFIG_GENERAL_PREPARE_DEFAULT
+ * @x11_session: #TLM_CONFIG_GENERAL_X11_SESSION
+ * @pam_service: #TLM_CONFIG_GENERAL_PAM_SERVICE
+ * @default_pam_service: #TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE
+ * @default_user: #TLM_CONFIG_GENERAL_DEFAULT_USER, not expanded
+ * @prefetch_files: #TLM_CONFIG_GENERAL_PREFETCH_FILES, or NULL
+ * @prefetch_list: #TLM_CONFIG_GENERAL_PREFETCH_LIST, or NULL
+ * @nwatch: #TLM_CONFIG_SEAT_NWATCH
+ * @watch: the #TLM_CONFIG_SEAT_WATCHX items, @nwatch long
+ *
+ * Typed configuration of a seat, as resolved by
+ * tlm_config_get_seat_config().
+ */
+
 struct _TlmConfigPrivate
 {
     gchar *config_file_path;
     GHashTable *config_table;
+    GHashTable *key_lines;
+    GHashTable *seat_configs;
+};
+
+typedef enum {
+    CONFIG_STRING,
+    CONFIG_BOOLEAN,
+    CONFIG_UINT
+} ConfigType;
+
+/* where a key is looked up, in this order */
+#define LAYER_SEAT      (1 << 0)
+#define LAYER_GENERAL   (1 << 1)
+
+#define SEAT_FIELD(f)   G_STRUCT_OFFSET (TlmSeatConfig, f)
+/* only validated, the consumer reads it from the key file */
+#define NO_FIELD        -1
+
+static const struct {
+    const gchar *key;
+    ConfigType type;
+    guint layers;
+    glong offset;
+    const gchar *fallback;
+} seat_schema[] = {
+    { TLM_CONFIG_SEAT_ACTIVE, CONFIG_BOOLEAN, LAYER_SEAT,
+      SEAT_FIELD (active), "1" },
+    { TLM_CONFIG_GENERAL_AUTO_LOGIN, CONFIG_BOOLEAN, LAYER_GENERAL,
+      SEAT_FIELD (auto_login), "1" },
+    { TLM_CONFIG_GENERAL_PREPARE_DEFAULT, CONFIG_BOOLEAN, LAYER_GENERAL,
+      SEAT_FIELD (prepare_default), "0" },
+    { TLM_CONFIG_GENERAL_X11_SESSION, CONFIG_BOOLEAN, LAYER_GENERAL,
+      SEAT_FIELD (x11_session), "0" },
+    { TLM_CONFIG_GENERAL_PAM_SERVICE, CONFIG_STRING,
+      LAYER_SEAT | LAYER_GENERAL, SEAT_FIELD (pam_service), "tlm-login" },
+    { TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE, CONFIG_STRING,
+      LAYER_SEAT | LAYER_GENERAL, SEAT_FIELD (default_pam_service),
+      "tlm-default-login" },
+    { TLM_CONFIG_GENERAL_DEFAULT_USER, CONFIG_STRING,
+      LAYER_SEAT | LAYER_GENERAL, SEAT_FIELD (default_user), "guest" },
+    { TLM_CONFIG_GENERAL_PREFETCH_FILES, CONFIG_STRING,
+      LAYER_SEAT | LAYER_GENERAL, SEAT_FIELD (prefetch_files), NULL },
+    { TLM_CONFIG_GENERAL_PREFETCH_LIST, CONFIG_STRING,
+      LAYER_SEAT | LAYER_GENERAL, SEAT_FIELD (prefetch_list), NULL },
+    { TLM_CONFIG_SEAT_NWATCH, CONFIG_UINT, LAYER_SEAT,
+      SEAT_FIELD (nwatch), "0" },
+    { TLM_CONFIG_SEAT_VTNR, CONFIG_UINT, LAYER_SEAT, NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_NSEATS, CONFIG_UINT, LAYER_GENERAL, NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_SHUTDOWN_TIMEOUT, CONFIG_UINT, LAYER_GENERAL,
+      NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_SESSION_READY_TIMEOUT_MS, CONFIG_UINT,
+      LAYER_SEAT | LAYER_GENERAL, NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_PAM_SLOW_THRESHOLD_MS, CONFIG_UINT, LAYER_GENERAL,
+      NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_SETUP_TERMINAL, CONFIG_BOOLEAN,
+      LAYER_SEAT | LAYER_GENERAL, NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_SETUP_RUNTIME_DIR, CONFIG_BOOLEAN,
+      LAYER_SEAT | LAYER_GENERAL, NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_RUNTIME_DIR_TMPFS, CONFIG_BOOLEAN,
+      LAYER_SEAT | LAYER_GENERAL, NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_PAUSE_SESSION, CONFIG_BOOLEAN, LAYER_GENERAL,
+      NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_WATCH_CONFIG, CONFIG_BOOLEAN, LAYER_GENERAL,
+      NO_FIELD, NULL },
+    { TLM_CONFIG_GENERAL_USER_CACHE_TTL, CONFIG_UINT, LAYER_GENERAL,
+      NO_FIELD, NULL },
 };
 
 #define TLM_CONFIG_PRIV(obj) G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
@@ -113,6 +208,44 @@ _check_config_file (const gchar *path)
     return NULL;
 }
 
+static gchar *
+_line_key (const gchar *group, const gchar *key)
+{
+    return g_strconcat (group, "/", key, NULL);
+}
+
+/* Remembers where each key is set, for the validation errors */
+static void
+_index_lines (TlmConfig *self, const gchar *contents)
+{
+    gchar **lines = g_strsplit (contents, "\n", -1);
+    gchar *group = NULL;
+    guint i;
+
+    for (i = 0; lines[i]; i++) {
+        gchar *line = g_strstrip (lines[i]);
+        gchar *sep = NULL;
+
+        if (!*line || *line == '#')
+            continue;
+        if (*line == '[') {
+            sep = strchr (line, ']');
+            g_free (group);
+            group = sep ? g_strndup (line + 1, sep - line - 1) : NULL;
+            continue;
+        }
+        sep = strchr (line, '=');
+        if (!group || !sep)
+            continue;
+        *sep = '\0';
+        g_hash_table_replace (self->priv->key_lines,
+                              _line_key (group, g_strstrip (line)),
+                              GUINT_TO_POINTER (i + 1));
+    }
+    g_free (group);
+    g_strfreev (lines);
+}
+
 static gboolean
 _load_config (TlmConfig *self)
 {
@@ -121,6 +254,8 @@ _load_config (TlmConfig *self)
     gchar **groups = NULL;
     gsize n_groups = 0;
     int i,j;
+    gchar *contents = NULL;
+    gsize length = 0;
     GKeyFile *settings = g_key_file_new ();
 
     const gchar * const *sysconfdirs;
@@ -149,15 +284,19 @@ _load_config (TlmConfig *self)
 
     if (priv->config_file_path) {
         DBG ("loading TLM config from %s", priv->config_file_path);
-        if (!g_key_file_load_from_file (settings,
-                                        priv->config_file_path,
+        if (!g_file_get_contents (priv->config_file_path, &contents, &length,
+                                  &err) ||
+            !g_key_file_load_from_data (settings, contents, length,
                                         G_KEY_FILE_NONE, &err)) {
             WARN ("error reading config file at '%s': %s",
                  priv->config_file_path, err->message);
             g_error_free (err);
+            g_free (contents);
             g_key_file_free (settings);
             return FALSE;
         }
+        _index_lines (self, contents);
+        g_free (contents);
     }
     else {
         WARN ("No valid configuration file found");
@@ -334,6 +473,8 @@ tlm_config_set_string (
         const gchar *key,
         const gchar *value)
 {
+    gchar *line_key = NULL;
+
     g_return_if_fail (self && TLM_IS_CONFIG (self));
     g_return_if_fail (key && key[0]);
 
@@ -354,6 +495,10 @@ tlm_config_set_string (
                          (gpointer) g_strdup (key),
                          (gpointer) g_strdup (value));
 
+    line_key = _line_key (group, key);
+    g_hash_table_remove (self->priv->key_lines, line_key);
+    g_free (line_key);
+    g_hash_table_remove_all (self->priv->seat_configs);
 }
 /**
  * tlm_config_get_int:
@@ -576,6 +721,16 @@ tlm_config_has_key (
 static void
 _cleanup (TlmConfig *self)
 {
+    if (self->priv->seat_configs) {
+        g_hash_table_unref (self->priv->seat_configs);
+        self->priv->seat_configs = NULL;
+    }
+
+    if (self->priv->key_lines) {
+        g_hash_table_unref (self->priv->key_lines);
+        self->priv->key_lines = NULL;
+    }
+
     if (self->priv->config_table) {
         g_hash_table_unref (self->priv->config_table);
         self->priv->config_table = NULL;
@@ -623,7 +778,22 @@ tlm_config_class_init (
 }
 
 static void
-_initialize (TlmConfig *self)
+_free_seat_config (TlmSeatConfig *seat)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (seat_schema); i++) {
+        if (seat_schema[i].type == CONFIG_STRING &&
+            seat_schema[i].offset != NO_FIELD)
+            g_free (G_STRUCT_MEMBER (gchar *, seat, seat_schema[i].offset));
+    }
+    g_strfreev (seat->watch);
+    g_free (seat->seat_id);
+    g_free (seat);
+}
+
+static void
+_create_table (TlmConfig *self)
 {
     self->priv->config_file_path = NULL;
     self->priv->config_table = g_hash_table_new_full (
@@ -631,8 +801,20 @@ _initialize (TlmConfig *self)
                                     g_str_equal,
                                     g_free,
                                     (GDestroyNotify)g_hash_table_unref);
+    self->priv->key_lines = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   g_free,
+                                                   NULL);
+    self->priv->seat_configs = g_hash_table_new_full (
+                                    g_str_hash,
+                                    g_str_equal,
+                                    g_free,
+                                    (GDestroyNotify)_free_seat_config);
+}
 
-
+static void
+_load (TlmConfig *self)
+{
     if (!_load_config (self))
         WARN ("load configuration failed, using default settings");
 
@@ -641,12 +823,19 @@ _initialize (TlmConfig *self)
 #endif
 }
 
+static void
+_initialize (TlmConfig *self)
+{
+    _create_table (self);
+    _load (self);
+}
+
 static void
 tlm_config_init (
         TlmConfig *self)
 {
     self->priv = TLM_CONFIG_PRIV (self);
-    _initialize (self);
+    _create_table (self);
 }
 
 /**
@@ -677,6 +866,500 @@ tlm_config_reload (
 TlmConfig *
 tlm_config_new ()
 {
-    return TLM_CONFIG (g_object_new (TLM_TYPE_CONFIG, NULL));
+    TlmConfig *self = TLM_CONFIG (g_object_new (TLM_TYPE_CONFIG, NULL));
+
+    _load (self);
+    return self;
+}
+
+/**
+ * tlm_config_new_from_variant:
+ * @variant: (transfer none): configuration snapshot of type a{sa{ss}} as
+ * returned by tlm_config_to_variant()
+ *
+ * Create a #TlmConfig object from a configuration snapshot, without reading
+ * the configuration file.
+ *
+ * Returns: an instance of #TlmConfig.
+ */
+TlmConfig *
+tlm_config_new_from_variant (
+        GVariant *variant)
+{
+    TlmConfig *self = TLM_CONFIG (g_object_new (TLM_TYPE_CONFIG, NULL));
+    GVariantIter group_iter;
+    GVariantIter *key_iter = NULL;
+    const gchar *group = NULL;
+    const gchar *key = NULL;
+    const gchar *value = NULL;
+
+    g_return_val_if_fail (variant, self);
+    g_return_val_if_fail (g_variant_is_of_type (variant,
+            G_VARIANT_TYPE ("a{sa{ss}}")), self);
+
+    g_variant_iter_init (&group_iter, variant);
+    while (g_variant_iter_next (&group_iter, "{&sa{ss}}", &group, &key_iter)) {
+        while (g_variant_iter_next (key_iter, "{&s&s}", &key, &value))
+            tlm_config_set_string (self, group, key, value);
+        g_variant_iter_free (key_iter);
+    }
+
+    return self;
+}
+
+/**
+ * tlm_config_to_variant:
+ * @self: (transfer none): an instance of #TlmConfig
+ * @groups: (transfer none) (allow-none): NULL terminated list of the groups to
+ * include, NULL includes all groups
+ *
+ * Takes a snapshot of the configuration, suitable for
+ * tlm_config_new_from_variant(). Groups which do not exist are skipped.
+ *
+ * Returns: (transfer floating): the configuration as a{sa{ss}}.
+ */
+GVariant *
+tlm_config_to_variant (
+        TlmConfig *self,
+        const gchar * const *groups)
+{
+    GVariantBuilder builder;
+    GHashTableIter iter;
+    gpointer group, group_table;
+
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{ss}}"));
+    g_hash_table_iter_init (&iter, self->priv->config_table);
+    while (g_hash_table_iter_next (&iter, &group, &group_table)) {
+        GHashTableIter key_iter;
+        gpointer key, value;
+        gboolean wanted = (groups == NULL);
+        const gchar * const *g;
+
+        for (g = groups; g && *g && !wanted; g++)
+            wanted = g_strcmp0 (*g, group) == 0;
+        if (!wanted)
+            continue;
+
+        g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sa{ss}}"));
+        g_variant_builder_add (&builder, "s", group);
+        g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{ss}"));
+        g_hash_table_iter_init (&key_iter, group_table);
+        while (g_hash_table_iter_next (&key_iter, &key, &value))
+            g_variant_builder_add (&builder, "{ss}", key, value ? value : "");
+        g_variant_builder_close (&builder);
+        g_variant_builder_close (&builder);
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
+
+static gboolean
+_parse_boolean (const gchar *str, gboolean *value)
+{
+    gchar *end = NULL;
+    gint64 number;
+
+    if (g_ascii_strcasecmp (str, "true") == 0 ||
+        g_ascii_strcasecmp (str, "yes") == 0) {
+        *value = TRUE;
+        return TRUE;
+    }
+    if (g_ascii_strcasecmp (str, "false") == 0 ||
+        g_ascii_strcasecmp (str, "no") == 0) {
+        *value = FALSE;
+        return TRUE;
+    }
+    number = g_ascii_strtoll (str, &end, 10);
+    if (end == str || *end)
+        return FALSE;
+    *value = number != 0;
+    return TRUE;
+}
+
+static gboolean
+_parse_uint (const gchar *str, guint *value)
+{
+    gchar *end = NULL;
+    guint64 number;
+
+    if (!g_ascii_isdigit (*str))
+        return FALSE;
+    number = g_ascii_strtoull (str, &end, 10);
+    if (*end || number > G_MAXUINT)
+        return FALSE;
+    *value = (guint) number;
+    return TRUE;
+}
+
+static gboolean
+_store_value (TlmSeatConfig *seat, guint entry, const gchar *value)
+{
+    glong offset = seat_schema[entry].offset;
+    gboolean flag = FALSE;
+    guint number = 0;
+
+    switch (seat_schema[entry].type) {
+        case CONFIG_STRING:
+            if (offset != NO_FIELD)
+                G_STRUCT_MEMBER (gchar *, seat, offset) = g_strdup (value);
+            return TRUE;
+        case CONFIG_BOOLEAN:
+            if (!_parse_boolean (value, &flag))
+                return FALSE;
+            if (offset != NO_FIELD)
+                G_STRUCT_MEMBER (gboolean, seat, offset) = flag;
+            return TRUE;
+        case CONFIG_UINT:
+            if (!_parse_uint (value, &number))
+                return FALSE;
+            if (offset != NO_FIELD)
+                G_STRUCT_MEMBER (guint, seat, offset) = number;
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+_add_error (
+        TlmConfig *self,
+        GPtrArray *errors,
+        const gchar *group,
+        const gchar *key,
+        const gchar *message)
+{
+    gchar *line_key = _line_key (group, key);
+    guint line = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->key_lines,
+                                                        line_key));
+    gchar *error = NULL;
+    guint i;
+
+    g_free (line_key);
+    if (line)
+        error = g_strdup_printf ("%s:%u: %s in [%s]",
+                                 self->priv->config_file_path, line,
+                                 message, group);
+    else
+        error = g_strdup_printf ("%s in [%s]", message, group);
+
+    if (!errors) {
+        WARN ("%s", error);
+        g_free (error);
+        return;
+    }
+    /* General group values show up for every seat */
+    for (i = 0; i < errors->len; i++) {
+        if (g_strcmp0 (g_ptr_array_index (errors, i), error) == 0) {
+            g_free (error);
+            return;
+        }
+    }
+    g_ptr_array_add (errors, error);
+}
+
+static TlmSeatConfig *
+_compile_seat_config (
+        TlmConfig *self,
+        const gchar *seat_id,
+        GPtrArray *errors)
+{
+    static const gchar *type_names[] = { "string", "boolean",
+                                         "unsigned integer" };
+    TlmSeatConfig *seat = g_new0 (TlmSeatConfig, 1);
+    GPtrArray *watch = NULL;
+    guint i;
+
+    seat->seat_id = g_strdup (seat_id);
+
+    for (i = 0; i < G_N_ELEMENTS (seat_schema); i++) {
+        const gchar *group = NULL;
+        const gchar *value = NULL;
+
+        if (seat_id && (seat_schema[i].layers & LAYER_SEAT) &&
+            (value = tlm_config_get_string (self, seat_id,
+                                            seat_schema[i].key)))
+            group = seat_id;
+        else if ((seat_schema[i].layers & LAYER_GENERAL) &&
+                 (value = tlm_config_get_string (self, TLM_CONFIG_GENERAL,
+                                                 seat_schema[i].key)))
+            group = TLM_CONFIG_GENERAL;
+
+        if (value && _store_value (seat, i, value))
+            continue;
+        if (value) {
+            gchar *message = g_strdup_printf ("invalid %s '%s' for %s",
+                    type_names[seat_schema[i].type], value,
+                    seat_schema[i].key);
+            _add_error (self, errors, group, seat_schema[i].key, message);
+            g_free (message);
+        }
+        if (seat_schema[i].fallback)
+            _store_value (seat, i, seat_schema[i].fallback);
+    }
+
+    watch = g_ptr_array_new ();
+    for (i = 0; seat_id && i < seat->nwatch; i++) {
+        gchar *key = g_strdup_printf ("%s%u", TLM_CONFIG_SEAT_WATCHX, i);
+        const gchar *value = tlm_config_get_string (self, seat_id, key);
+
+        if (!value) {
+            gchar *message = g_strdup_printf ("%s is missing for %s=%u", key,
+                    TLM_CONFIG_SEAT_NWATCH, seat->nwatch);
+            _add_error (self, errors, seat_id, TLM_CONFIG_SEAT_NWATCH,
+                        message);
+            g_free (message);
+            g_free (key);
+            seat->nwatch = i;
+            break;
+        }
+        g_ptr_array_add (watch, g_strdup (value));
+        g_free (key);
+    }
+    g_ptr_array_add (watch, NULL);
+    seat->watch = (gchar **) g_ptr_array_free (watch, FALSE);
+
+    return seat;
+}
+
+/**
+ * tlm_config_get_seat_config:
+ * @self: (transfer none): an instance of #TlmConfig
+ * @seat_id: (allow-none): the seat, NULL for the General group alone
+ *
+ * Gets the typed configuration of @seat_id. Each key is taken from the seat
+ * group where the key is per seat, else from the General group, else its
+ * built-in default. Values that do not parse are logged and replaced by the
+ * default; use tlm_config_validate() to catch them up front.
+ *
+ * The result is compiled once and kept until the configuration changes.
+ *
+ * Returns: (transfer none): the configuration of the seat, valid until the
+ * configuration is set or reloaded.
+ */
+const TlmSeatConfig *
+tlm_config_get_seat_config (
+        TlmConfig *self,
+        const gchar *seat_id)
+{
+    TlmSeatConfig *seat = NULL;
+
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
+
+    seat = g_hash_table_lookup (self->priv->seat_configs,
+                                seat_id ? seat_id : TLM_CONFIG_GENERAL);
+    if (!seat) {
+        seat = _compile_seat_config (self, seat_id, NULL);
+        g_hash_table_insert (self->priv->seat_configs,
+                             g_strdup (seat_id ? seat_id : TLM_CONFIG_GENERAL),
+                             seat);
+    }
+    return seat;
+}
+
+/**
+ * tlm_config_validate:
+ * @self: (transfer none): an instance of #TlmConfig
+ * @error: (allow-none): return location for the errors
+ *
+ * Compiles the General group and every seat group of the configuration,
+ * checking the typed keys.
+ *
+ * Returns: TRUE if all the values are valid. Otherwise FALSE, with @error
+ * set to G_KEY_FILE_ERROR_INVALID_VALUE listing every bad value, one per
+ * line, with the file and line number it is set on.
+ */
+gboolean
+tlm_config_validate (
+        TlmConfig *self,
+        GError **error)
+{
+    GPtrArray *errors = NULL;
+    GHashTableIter iter;
+    gpointer group = NULL;
+    gchar *message = NULL;
+    gboolean res = TRUE;
+
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), FALSE);
+
+    errors = g_ptr_array_new_with_free_func (g_free);
+    g_hash_table_remove_all (self->priv->seat_configs);
+    g_hash_table_insert (self->priv->seat_configs,
+                         g_strdup (TLM_CONFIG_GENERAL),
+                         _compile_seat_config (self, NULL, errors));
+
+    /* logind names all the seats seat* */
+    g_hash_table_iter_init (&iter, self->priv->config_table);
+    while (g_hash_table_iter_next (&iter, &group, NULL)) {
+        if (!g_str_has_prefix (group, "seat"))
+            continue;
+        g_hash_table_insert (self->priv->seat_configs, g_strdup (group),
+                             _compile_seat_config (self, group, errors));
+    }
+
+    if (errors->len) {
+        g_ptr_array_add (errors, NULL);
+        message = g_strjoinv ("\n", (gchar **) errors->pdata);
+        g_set_error_literal (error, G_KEY_FILE_ERROR,
+                             G_KEY_FILE_ERROR_INVALID_VALUE, message);
+        g_free (message);
+        res = FALSE;
+    }
+    g_ptr_array_free (errors, TRUE);
+
+    return res;
+}
+
+static gboolean
+_values_equal (const gchar *key, const gchar *old_value,
+               const gchar *new_value)
+{
+    gboolean old_flag = FALSE, new_flag = FALSE;
+    guint old_number = 0, new_number = 0;
+    guint i;
+
+    if (!old_value || !new_value)
+        return old_value == new_value;
+
+    /* "true" and "1" are the same setting */
+    for (i = 0; i < G_N_ELEMENTS (seat_schema); i++) {
+        if (g_strcmp0 (seat_schema[i].key, key) != 0)
+            continue;
+        if (seat_schema[i].type == CONFIG_BOOLEAN &&
+            _parse_boolean (old_value, &old_flag) &&
+            _parse_boolean (new_value, &new_flag))
+            return old_flag == new_flag;
+        if (seat_schema[i].type == CONFIG_UINT &&
+            _parse_uint (old_value, &old_number) &&
+            _parse_uint (new_value, &new_number))
+            return old_number == new_number;
+        break;
+    }
+    return g_strcmp0 (old_value, new_value) == 0;
+}
+
+/* Adds the keys of @group that differ between the tables to @changes */
+static void
+_diff_group (
+        GHashTable *changes,
+        const gchar *group,
+        GHashTable *old_table,
+        GHashTable *new_table)
+{
+    GPtrArray *keys = g_ptr_array_new ();
+    GHashTableIter iter;
+    gpointer key, value;
+
+    if (old_table) {
+        g_hash_table_iter_init (&iter, old_table);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            if (!_values_equal (key, value, new_table ?
+                                g_hash_table_lookup (new_table, key) : NULL))
+                g_ptr_array_add (keys, g_strdup (key));
+        }
+    }
+    if (new_table) {
+        g_hash_table_iter_init (&iter, new_table);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            if (!old_table || !g_hash_table_contains (old_table, key))
+                g_ptr_array_add (keys, g_strdup (key));
+        }
+    }
+
+    if (!keys->len) {
+        g_ptr_array_free (keys, TRUE);
+        return;
+    }
+    g_ptr_array_add (keys, NULL);
+    g_hash_table_insert (changes, g_strdup (group),
+                         g_ptr_array_free (keys, FALSE));
+}
+
+/**
+ * tlm_config_reload_diff:
+ * @self: (transfer none): an instance of #TlmConfig
+ * @error: (allow-none): return location for the error
+ *
+ * Reloads the configuration file, but replaces the current configuration
+ * only if the new one can be read and passes tlm_config_validate(). Values
+ * that have the same meaning, like "true" and "1" for a boolean key, do not
+ * count as changes.
+ *
+ * Returns: (transfer full): the changes, as a #GHashTable of the group names
+ * to NULL terminated arrays of the keys that were added, removed or changed
+ * in them; empty if nothing changed. NULL if the new configuration was
+ * rejected, with @error set.
+ */
+GHashTable *
+tlm_config_reload_diff (
+        TlmConfig *self,
+        GError **error)
+{
+    TlmConfig *next = NULL;
+    GHashTable *changes = NULL;
+    GHashTableIter iter;
+    gpointer group, table;
+
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
+
+    DBG ("reload configuration");
+    next = TLM_CONFIG (g_object_new (TLM_TYPE_CONFIG, NULL));
+    if (!_load_config (next)) {
+        g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_PARSE,
+                     "Unable to read the configuration file");
+        g_object_unref (next);
+        return NULL;
+    }
+#ifdef ENABLE_DEBUG
+    _load_environment (next);
+#endif
+    if (!tlm_config_validate (next, error)) {
+        g_object_unref (next);
+        return NULL;
+    }
+
+    changes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                     (GDestroyNotify) g_strfreev);
+    g_hash_table_iter_init (&iter, self->priv->config_table);
+    while (g_hash_table_iter_next (&iter, &group, &table))
+        _diff_group (changes, group, table,
+                     tlm_config_get_group (next, group));
+    g_hash_table_iter_init (&iter, next->priv->config_table);
+    while (g_hash_table_iter_next (&iter, &group, &table)) {
+        if (!tlm_config_has_group (self, group))
+            _diff_group (changes, group, NULL, table);
+    }
+
+    /* take over the tables of the new configuration */
+    _cleanup (self);
+    self->priv->config_file_path = next->priv->config_file_path;
+    self->priv->config_table = next->priv->config_table;
+    self->priv->key_lines = next->priv->key_lines;
+    self->priv->seat_configs = next->priv->seat_configs;
+    next->priv->config_file_path = NULL;
+    next->priv->config_table = NULL;
+    next->priv->key_lines = NULL;
+    next->priv->seat_configs = NULL;
+    g_object_unref (next);
+
+    return changes;
 }
 
+/**
+ * tlm_config_get_file_path:
+ * @self: (transfer none): an instance of #TlmConfig
+ *
+ * Gets the configuration file in use.
+ *
+ * Returns: (transfer none): the path of the file, NULL if the configuration
+ * was not read from a file.
+ */
+const gchar *
+tlm_config_get_file_path (
+        TlmConfig *self)
+{
+    g_return_val_if_fail (self && TLM_IS_CONFIG (self), NULL);
+
+    return self->priv->config_file_path;
+}
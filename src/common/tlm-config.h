@@ -62,12 +62,39 @@ struct _TlmConfigClass
     GObjectClass parent_class;
 };
 
+typedef struct _TlmSeatConfig TlmSeatConfig;
+
+struct _TlmSeatConfig
+{
+    gchar *seat_id;
+    gboolean active;
+    gboolean auto_login;
+    gboolean prepare_default;
+    gboolean x11_session;
+    gchar *pam_service;
+    gchar *default_pam_service;
+    gchar *default_user;
+    gchar *prefetch_files;
+    gchar *prefetch_list;
+    guint nwatch;
+    gchar **watch;
+};
+
 GType
 tlm_config_get_type (void) G_GNUC_CONST;
 
 TlmConfig *
 tlm_config_new ();
 
+TlmConfig *
+tlm_config_new_from_variant (
+        GVariant *variant);
+
+GVariant *
+tlm_config_to_variant (
+        TlmConfig *self,
+        const gchar * const *groups);
+
 gint
 tlm_config_get_int (
         TlmConfig *self,
@@ -150,6 +177,25 @@ void
 tlm_config_reload (
         TlmConfig *self);
 
+const TlmSeatConfig *
+tlm_config_get_seat_config (
+        TlmConfig *self,
+        const gchar *seat_id);
+
+gboolean
+tlm_config_validate (
+        TlmConfig *self,
+        GError **error);
+
+GHashTable *
+tlm_config_reload_diff (
+        TlmConfig *self,
+        GError **error);
+
+const gchar *
+tlm_config_get_file_path (
+        TlmConfig *self);
+
 G_END_DECLS
 
 #endif /* __TLM_CONFIG_H_ */
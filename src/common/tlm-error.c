@@ -65,6 +65,8 @@
  * @TLM_ERROR_SESSION_TERMINATION_FAILURE: Session termination failed
  * @TLM_ERROR_DBUS_SERVER_START_FAILURE: dbus-server startup failed
  * @TLM_ERROR_PAM_AUTH_FAILURE: PAM authentication failed
+ * @TLM_ERROR_PAM_TIMEOUT: A PAM call did not finish within its deadline
+ * @TLM_ERROR_SESSION_EXEC_FAILURE: The session command could not be executed
  * @TLM_ERROR_DBUS_REQ_ABORTED: Dbus request aborted
  * @TLM_ERROR_DBUS_REQ_NOT_SUPPORTED: Dbus request not supported
  * @TLM_ERROR_DBUS_REQ_UNKNOWN: Dbus request failed with unknown error
@@ -109,6 +111,8 @@ GDBusErrorEntry _tlm_errors[] =
             _ERROR_PREFIX".DBusServerStartFailure"},
     {TLM_ERROR_PAM_AUTH_FAILURE,
             _ERROR_PREFIX".PamAuthFailure"},
+    {TLM_ERROR_PAM_TIMEOUT, _ERROR_PREFIX".PamTimeout"},
+    {TLM_ERROR_SESSION_EXEC_FAILURE, _ERROR_PREFIX".SessionExecFailure"},
     {TLM_ERROR_DBUS_REQ_ABORTED, _ERROR_PREFIX".DBusRequestAborted"},
     {TLM_ERROR_DBUS_REQ_NOT_SUPPORTED, _ERROR_PREFIX".DBusRequestNotSupported"},
     {TLM_ERROR_DBUS_REQ_UNKNOWN, _ERROR_PREFIX".DBusRequestUknown"},
@@ -0,0 +1,407 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2013-2015 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *          Jussi Laako <jussi.laako@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Line protocol spoken between the daemon and tlm-sessiond-lite over the
+ * sessiond pipes. Every message is a single line of space separated fields,
+ * the first one naming the message. Spaces, '%' and control characters
+ * within a field are written as %XX. The payloads carry the same data as
+ * the org.O1.Tlm.Session methods and signals and are converted from and to
+ * the very same GVariant types, so both sessiond flavors feed identical
+ * values to TlmSession and to the seats.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tlm-session-protocol.h"
+#include "tlm-log.h"
+
+#define READ_CHUNK_SIZE 4096
+
+static void
+_append_field (
+        GString *out,
+        const gchar *field)
+{
+    const guchar *p;
+
+    for (p = (const guchar *) field; *p; p++) {
+        if (*p <= ' ' || *p == '%' || *p == 0x7f)
+            g_string_append_printf (out, "%%%02X", *p);
+        else
+            g_string_append_c (out, *p);
+    }
+}
+
+static gchar *
+_decode_field (const gchar *field)
+{
+    gchar *decoded = g_malloc (strlen (field) + 1);
+    gchar *d = decoded;
+    const gchar *p;
+
+    for (p = field; *p; p++) {
+        if (p[0] == '%' && g_ascii_isxdigit (p[1]) &&
+            g_ascii_isxdigit (p[2])) {
+            *d++ = (gchar) (g_ascii_xdigit_value (p[1]) << 4 |
+                            g_ascii_xdigit_value (p[2]));
+            p += 2;
+        } else {
+            *d++ = *p;
+        }
+    }
+    *d = '\0';
+
+    return decoded;
+}
+
+void
+tlm_session_protocol_appendv (
+        GString *out,
+        const gchar * const *fields)
+{
+    const gchar * const *field;
+
+    g_return_if_fail (out && fields && fields[0]);
+
+    for (field = fields; *field; field++) {
+        if (field != fields)
+            g_string_append_c (out, ' ');
+        _append_field (out, *field);
+    }
+    g_string_append_c (out, '\n');
+}
+
+void
+tlm_session_protocol_append (
+        GString *out,
+        const gchar *verb,
+        ...)
+{
+    GPtrArray *fields = g_ptr_array_new ();
+    const gchar *field;
+    va_list args;
+
+    g_ptr_array_add (fields, (gpointer) verb);
+    va_start (args, verb);
+    while ((field = va_arg (args, const gchar *)) != NULL)
+        g_ptr_array_add (fields, (gpointer) field);
+    va_end (args);
+    g_ptr_array_add (fields, NULL);
+
+    tlm_session_protocol_appendv (out, (const gchar * const *) fields->pdata);
+    g_ptr_array_free (fields, TRUE);
+}
+
+/*
+ * Removes the first complete message from @in and returns its decoded
+ * fields, NULL when no complete message has been received yet
+ */
+gchar **
+tlm_session_protocol_pop (GString *in)
+{
+    gchar *end;
+    gchar **fields;
+    gchar **field;
+
+    g_return_val_if_fail (in, NULL);
+
+    end = memchr (in->str, '\n', in->len);
+    if (!end)
+        return NULL;
+
+    *end = '\0';
+    fields = g_strsplit (in->str, " ", -1);
+    g_string_erase (in, 0, end - in->str + 1);
+
+    for (field = fields; *field; field++) {
+        gchar *decoded = _decode_field (*field);
+        g_free (*field);
+        *field = decoded;
+    }
+
+    return fields;
+}
+
+/* Writes and clears @out, the pipes are blocking and messages are small */
+gboolean
+tlm_session_protocol_write (
+        gint fd,
+        GString *out)
+{
+    gsize written = 0;
+
+    g_return_val_if_fail (out, FALSE);
+
+    while (written < out->len) {
+        gssize res = write (fd, out->str + written, out->len - written);
+        if (res < 0) {
+            gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+            if (errno == EINTR)
+                continue;
+            WARN ("write(%d): %s", fd,
+                  strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+            g_string_truncate (out, 0);
+            return FALSE;
+        }
+        written += res;
+    }
+    g_string_truncate (out, 0);
+
+    return TRUE;
+}
+
+/* Appends whatever is available on @fd to @in, FALSE on EOF or error */
+gboolean
+tlm_session_protocol_read (
+        gint fd,
+        GString *in)
+{
+    gchar buf[READ_CHUNK_SIZE];
+    gssize res;
+
+    g_return_val_if_fail (in, FALSE);
+
+    do {
+        res = read (fd, buf, sizeof (buf));
+    } while (res < 0 && errno == EINTR);
+
+    if (res < 0) {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        if (errno == EAGAIN)
+            return TRUE;
+        WARN ("read(%d): %s", fd,
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        return FALSE;
+    }
+    if (res == 0)
+        return FALSE;
+
+    g_string_append_len (in, buf, res);
+    return TRUE;
+}
+
+/* One message per group: config <group> [<key> <value>]... */
+void
+tlm_session_protocol_append_config (
+        GString *out,
+        GVariant *config)
+{
+    GVariantIter iter;
+    GVariantIter *keys = NULL;
+    const gchar *group = NULL;
+
+    g_return_if_fail (out && config);
+    g_return_if_fail (g_variant_is_of_type (config,
+            G_VARIANT_TYPE ("a{sa{ss}}")));
+
+    g_variant_iter_init (&iter, config);
+    while (g_variant_iter_next (&iter, "{&sa{ss}}", &group, &keys)) {
+        GPtrArray *fields = g_ptr_array_new ();
+        const gchar *key = NULL;
+        const gchar *value = NULL;
+
+        g_ptr_array_add (fields, TLM_SESSION_MSG_CONFIG);
+        g_ptr_array_add (fields, (gpointer) group);
+        while (g_variant_iter_next (keys, "{&s&s}", &key, &value)) {
+            g_ptr_array_add (fields, (gpointer) key);
+            g_ptr_array_add (fields, (gpointer) value);
+        }
+        g_ptr_array_add (fields, NULL);
+
+        tlm_session_protocol_appendv (out,
+                (const gchar * const *) fields->pdata);
+        g_ptr_array_free (fields, TRUE);
+        g_variant_iter_free (keys);
+    }
+}
+
+/* Adds the group of a config message to an a{sa{ss}} @config builder */
+gboolean
+tlm_session_protocol_parse_config (
+        gchar **msg,
+        GVariantBuilder *config)
+{
+    gchar **field;
+
+    g_return_val_if_fail (msg && config, FALSE);
+
+    if (g_strcmp0 (msg[0], TLM_SESSION_MSG_CONFIG) != 0 || !msg[1] ||
+        g_strv_length (msg + 2) % 2)
+        return FALSE;
+
+    g_variant_builder_open (config, G_VARIANT_TYPE ("{sa{ss}}"));
+    g_variant_builder_add (config, "s", msg[1]);
+    g_variant_builder_open (config, G_VARIANT_TYPE ("a{ss}"));
+    for (field = msg + 2; *field; field += 2)
+        g_variant_builder_add (config, "{ss}", field[0], field[1]);
+    g_variant_builder_close (config);
+    g_variant_builder_close (config);
+
+    return TRUE;
+}
+
+/* environment [<name> <value>]... */
+void
+tlm_session_protocol_append_environment (
+        GString *out,
+        GHashTable *environment)
+{
+    GPtrArray *fields = g_ptr_array_new ();
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_return_if_fail (out);
+
+    g_ptr_array_add (fields, TLM_SESSION_MSG_ENVIRONMENT);
+    if (environment) {
+        g_hash_table_iter_init (&iter, environment);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            g_ptr_array_add (fields, key);
+            g_ptr_array_add (fields, value);
+        }
+    }
+    g_ptr_array_add (fields, NULL);
+
+    tlm_session_protocol_appendv (out, (const gchar * const *) fields->pdata);
+    g_ptr_array_free (fields, TRUE);
+}
+
+GHashTable *
+tlm_session_protocol_parse_environment (gchar **msg)
+{
+    GHashTable *environment;
+    gchar **field;
+
+    g_return_val_if_fail (msg, NULL);
+
+    if (g_strcmp0 (msg[0], TLM_SESSION_MSG_ENVIRONMENT) != 0 ||
+        g_strv_length (msg + 1) % 2)
+        return NULL;
+
+    environment = g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, g_free);
+    for (field = msg + 1; *field; field += 2)
+        g_hash_table_insert (environment, g_strdup (field[0]),
+                g_strdup (field[1]));
+
+    return environment;
+}
+
+/*
+ * error <domain> <code> <message>, the domain is sent by name as quarks
+ * are only meaningful within a process
+ */
+void
+tlm_session_protocol_append_error (
+        GString *out,
+        GVariant *error)
+{
+    GQuark domain = 0;
+    gint code = 0;
+    const gchar *message = NULL;
+    gchar *code_str;
+
+    g_return_if_fail (out && error);
+    g_return_if_fail (g_variant_is_of_type (error, G_VARIANT_TYPE ("(uis)")));
+
+    g_variant_get (error, "(ui&s)", &domain, &code, &message);
+    code_str = g_strdup_printf ("%d", code);
+    tlm_session_protocol_append (out, TLM_SESSION_MSG_ERROR,
+            g_quark_to_string (domain), code_str, message, NULL);
+    g_free (code_str);
+}
+
+GVariant *
+tlm_session_protocol_parse_error (gchar **msg)
+{
+    g_return_val_if_fail (msg, NULL);
+
+    if (g_strcmp0 (msg[0], TLM_SESSION_MSG_ERROR) != 0 ||
+        g_strv_length (msg) != 4)
+        return NULL;
+
+    return g_variant_new ("(uis)", g_quark_from_string (msg[1]),
+            (gint) g_ascii_strtoll (msg[2], NULL, 10), msg[3]);
+}
+
+/* pam-timings <service> [<stage> <usecs>]... */
+void
+tlm_session_protocol_append_pam_timings (
+        GString *out,
+        const gchar *service,
+        GVariant *timings)
+{
+    GPtrArray *fields;
+    GVariantIter iter;
+    const gchar *stage = NULL;
+    guint64 usecs = 0;
+
+    g_return_if_fail (out && service && timings);
+    g_return_if_fail (g_variant_is_of_type (timings,
+            G_VARIANT_TYPE ("a{st}")));
+
+    fields = g_ptr_array_new_with_free_func (g_free);
+    g_ptr_array_add (fields, g_strdup (TLM_SESSION_MSG_PAM_TIMINGS));
+    g_ptr_array_add (fields, g_strdup (service));
+    g_variant_iter_init (&iter, timings);
+    while (g_variant_iter_next (&iter, "{&st}", &stage, &usecs)) {
+        g_ptr_array_add (fields, g_strdup (stage));
+        g_ptr_array_add (fields,
+                g_strdup_printf ("%" G_GUINT64_FORMAT, usecs));
+    }
+    g_ptr_array_add (fields, NULL);
+
+    tlm_session_protocol_appendv (out, (const gchar * const *) fields->pdata);
+    g_ptr_array_free (fields, TRUE);
+}
+
+GVariant *
+tlm_session_protocol_parse_pam_timings (
+        gchar **msg,
+        const gchar **service)
+{
+    GVariantBuilder builder;
+    gchar **field;
+
+    g_return_val_if_fail (msg, NULL);
+
+    if (g_strcmp0 (msg[0], TLM_SESSION_MSG_PAM_TIMINGS) != 0 || !msg[1] ||
+        g_strv_length (msg + 2) % 2)
+        return NULL;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+    for (field = msg + 2; *field; field += 2)
+        g_variant_builder_add (&builder, "{st}", field[0],
+                (guint64) g_ascii_strtoull (field[1], NULL, 10));
+    if (service)
+        *service = msg[1];
+
+    return g_variant_builder_end (&builder);
+}
@@ -0,0 +1,118 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2013-2015 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *          Jussi Laako <jussi.laako@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_SESSION_PROTOCOL_H
+#define _TLM_SESSION_PROTOCOL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Requests from the daemon to tlm-sessiond-lite, they mirror the methods
+ * of org.O1.Tlm.Session */
+#define TLM_SESSION_MSG_CONFIG          "config"
+#define TLM_SESSION_MSG_ENVIRONMENT     "environment"
+#define TLM_SESSION_MSG_CREATE          "create"
+#define TLM_SESSION_MSG_TERMINATE       "terminate"
+
+/* Notifications from tlm-sessiond-lite, they mirror the signals
+ * of org.O1.Tlm.Session */
+#define TLM_SESSION_MSG_CREATED         "created"
+#define TLM_SESSION_MSG_TERMINATED      "terminated"
+#define TLM_SESSION_MSG_AUTHENTICATED   "authenticated"
+#define TLM_SESSION_MSG_ERROR           "error"
+#define TLM_SESSION_MSG_PAM_TIMINGS     "pam-timings"
+
+/* Exit status of either sessiond when a PAM call ran past its deadline, the
+ * watchdog cannot send anything while the main thread is stuck in PAM */
+#define TLM_SESSION_EXIT_PAM_AUTHENTICATE_TIMEOUT   90
+#define TLM_SESSION_EXIT_PAM_SETCRED_TIMEOUT        91
+#define TLM_SESSION_EXIT_PAM_OPEN_SESSION_TIMEOUT   92
+
+void
+tlm_session_protocol_append (
+        GString *out,
+        const gchar *verb,
+        ...) G_GNUC_NULL_TERMINATED;
+
+void
+tlm_session_protocol_appendv (
+        GString *out,
+        const gchar * const *fields);
+
+gchar **
+tlm_session_protocol_pop (GString *in);
+
+gboolean
+tlm_session_protocol_write (
+        gint fd,
+        GString *out);
+
+gboolean
+tlm_session_protocol_read (
+        gint fd,
+        GString *in);
+
+void
+tlm_session_protocol_append_config (
+        GString *out,
+        GVariant *config);
+
+gboolean
+tlm_session_protocol_parse_config (
+        gchar **msg,
+        GVariantBuilder *config);
+
+void
+tlm_session_protocol_append_environment (
+        GString *out,
+        GHashTable *environment);
+
+GHashTable *
+tlm_session_protocol_parse_environment (gchar **msg);
+
+void
+tlm_session_protocol_append_error (
+        GString *out,
+        GVariant *error);
+
+GVariant *
+tlm_session_protocol_parse_error (gchar **msg);
+
+void
+tlm_session_protocol_append_pam_timings (
+        GString *out,
+        const gchar *service,
+        GVariant *timings);
+
+GVariant *
+tlm_session_protocol_parse_pam_timings (
+        gchar **msg,
+        const gchar **service);
+
+G_END_DECLS
+
+#endif /* _TLM_SESSION_PROTOCOL_H */
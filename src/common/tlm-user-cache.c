@@ -0,0 +1,374 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2013-2015 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *          Jussi Laako <jussi.laako@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Process wide cache of the passwd entries and supplementary groups of the
+ * users, so that a login does not go through NSS for every field it needs.
+ * Entries live for a TTL, and the whole cache is dropped as soon as
+ * /etc/passwd or /etc/group is written or replaced. The inotify descriptor
+ * used for that is only read when the cache is consulted, so it works the
+ * same in the daemon, in sessiond and in threads without a main loop.
+ */
+
+#include <errno.h>
+#include <pwd.h>
+#include <grp.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "tlm-user-cache.h"
+#include "tlm-log.h"
+
+#define USER_DB_DIR         "/etc"
+#define USER_CACHE_MAX      256
+/* not set up yet, or not available */
+#define WATCH_UNSET         -1
+#define WATCH_FAILED        -2
+
+typedef struct {
+    TlmUserInfo *info; /* NULL for a user NSS does not know */
+    gint64 expires;
+} UserCacheEntry;
+
+G_LOCK_DEFINE_STATIC (user_cache);
+static GHashTable *by_name = NULL; /* name -> UserCacheEntry, owns */
+static GHashTable *by_uid = NULL;  /* uid -> UserCacheEntry */
+static guint cache_ttl = TLM_USER_CACHE_DEFAULT_TTL;
+static gint watch_fd = WATCH_UNSET;
+static TlmUserCacheStats cache_stats;
+
+static void
+_free_entry (UserCacheEntry *entry)
+{
+    tlm_user_info_free (entry->info);
+    g_slice_free (UserCacheEntry, entry);
+}
+
+static TlmUserInfo *
+_copy_info (const TlmUserInfo *info)
+{
+    TlmUserInfo *copy = NULL;
+
+    if (!info)
+        return NULL;
+
+    copy = g_slice_new0 (TlmUserInfo);
+    copy->name = g_strdup (info->name);
+    copy->uid = info->uid;
+    copy->gid = info->gid;
+    copy->home_dir = g_strdup (info->home_dir);
+    copy->shell = g_strdup (info->shell);
+    copy->groups = g_memdup (info->groups, info->n_groups * sizeof (gid_t));
+    copy->n_groups = info->n_groups;
+    return copy;
+}
+
+/* Looks the user up by name, or by uid when @username is NULL */
+static TlmUserInfo *
+_resolve_user (const gchar *username, uid_t uid)
+{
+    struct passwd *pwent = NULL;
+    struct passwd buf_pwent;
+    TlmUserInfo *info;
+    gchar *buf = NULL, *tmp = NULL;
+    int ret, n_groups;
+    gsize size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    if (size < sizeof(struct passwd))
+        size = 1024;
+
+    for (; NULL != (tmp = g_realloc(buf, size)); size*=2)
+    {
+        buf = tmp;
+
+        if (username)
+            ret = getpwnam_r(username, &buf_pwent, buf, size, &pwent);
+        else
+            ret = getpwuid_r(uid, &buf_pwent, buf, size, &pwent);
+        if (ERANGE == ret)
+            continue;
+        break;
+    }
+
+    if (!pwent) {
+        g_free (buf);
+        return NULL;
+    }
+
+    info = g_slice_new0 (TlmUserInfo);
+    info->name = g_strdup (pwent->pw_name);
+    info->uid = pwent->pw_uid;
+    info->gid = pwent->pw_gid;
+    info->home_dir = g_strdup (pwent->pw_dir);
+    info->shell = g_strdup (pwent->pw_shell);
+    g_free (buf);
+
+    n_groups = 32;
+    info->groups = g_new (gid_t, n_groups);
+    for (;;) {
+        int allocated = n_groups;
+        if (getgrouplist (info->name, info->gid, info->groups, &n_groups) >= 0)
+            break;
+        /* n_groups holds the required size, but do not trust it to grow */
+        n_groups = MAX (n_groups, allocated * 2);
+        info->groups = g_renew (gid_t, info->groups, n_groups);
+    }
+    info->n_groups = n_groups;
+
+    return info;
+}
+
+static void
+_flush (void)
+{
+    if (!by_name || !g_hash_table_size (by_name))
+        return;
+    g_hash_table_remove_all (by_uid);
+    g_hash_table_remove_all (by_name);
+    cache_stats.invalidations++;
+}
+
+static void
+_remove_entry (const gchar *name, UserCacheEntry *entry)
+{
+    gpointer uid = entry->info ? GUINT_TO_POINTER (entry->info->uid) : NULL;
+
+    /* another name may hold the uid index */
+    if (entry->info && g_hash_table_lookup (by_uid, uid) == entry)
+        g_hash_table_remove (by_uid, uid);
+    g_hash_table_remove (by_name, name);
+}
+
+static void
+_setup_watch (void)
+{
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+
+    watch_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd >= 0 &&
+        inotify_add_watch (watch_fd, USER_DB_DIR, IN_CLOSE_WRITE |
+                           IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE |
+                           IN_DELETE) >= 0)
+        return;
+
+    WARN ("not watching the user database, entries expire after %us: %s",
+          cache_ttl, strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+    if (watch_fd >= 0)
+        close (watch_fd);
+    watch_fd = WATCH_FAILED;
+}
+
+/* Drops the cache if passwd or group changed since the last lookup */
+static void
+_check_user_db (void)
+{
+    gchar buf[4096]
+        __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    gboolean changed = FALSE;
+    ssize_t len;
+
+    if (watch_fd == WATCH_UNSET)
+        _setup_watch ();
+    if (watch_fd < 0)
+        return;
+
+    while ((len = read (watch_fd, buf, sizeof (buf))) > 0) {
+        gchar *ptr = buf;
+        while (ptr < buf + len) {
+            struct inotify_event *ev = (struct inotify_event *) ptr;
+            if ((ev->mask & IN_Q_OVERFLOW) ||
+                (ev->len && (g_strcmp0 (ev->name, "passwd") == 0 ||
+                             g_strcmp0 (ev->name, "group") == 0)))
+                changed = TRUE;
+            ptr += sizeof (struct inotify_event) + ev->len;
+        }
+    }
+
+    if (changed) {
+        DBG ("user database changed, dropping %u cached users",
+             by_name ? g_hash_table_size (by_name) : 0);
+        _flush ();
+    }
+}
+
+static void
+_insert (const gchar *username, TlmUserInfo *info)
+{
+    UserCacheEntry *entry = NULL;
+    const gchar *name = info ? info->name : username;
+
+    if (!cache_ttl)
+        return;
+    if (!by_name) {
+        by_name = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify) _free_entry);
+        by_uid = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+    if (g_hash_table_size (by_name) >= USER_CACHE_MAX)
+        _flush ();
+    /* another thread resolved it meanwhile */
+    if ((entry = g_hash_table_lookup (by_name, name)) != NULL)
+        _remove_entry (name, entry);
+
+    entry = g_slice_new0 (UserCacheEntry);
+    entry->info = _copy_info (info);
+    entry->expires = g_get_monotonic_time () + cache_ttl * G_USEC_PER_SEC;
+    if (info)
+        g_hash_table_replace (by_uid, GUINT_TO_POINTER (info->uid), entry);
+    g_hash_table_insert (by_name, g_strdup (name), entry);
+}
+
+/* Returns the valid entry or NULL, with the cache locked */
+static UserCacheEntry *
+_lookup (const gchar *username, uid_t uid)
+{
+    UserCacheEntry *entry = NULL;
+
+    _check_user_db ();
+    if (!by_name)
+        return NULL;
+
+    entry = username ? g_hash_table_lookup (by_name, username) :
+                       g_hash_table_lookup (by_uid, GUINT_TO_POINTER (uid));
+    if (!entry)
+        return NULL;
+    if (entry->expires > g_get_monotonic_time ())
+        return entry;
+
+    _remove_entry (username ? username : entry->info->name, entry);
+    return NULL;
+}
+
+static TlmUserInfo *
+_get_user (const gchar *username, uid_t uid)
+{
+    UserCacheEntry *entry = NULL;
+    TlmUserInfo *info = NULL;
+
+    G_LOCK (user_cache);
+    entry = _lookup (username, uid);
+    if (entry) {
+        cache_stats.hits++;
+        info = _copy_info (entry->info);
+        G_UNLOCK (user_cache);
+        return info;
+    }
+    cache_stats.misses++;
+    G_UNLOCK (user_cache);
+
+    /* NSS may be slow or remote, do not hold the others up */
+    info = _resolve_user (username, uid);
+
+    G_LOCK (user_cache);
+    /* unknown uids are not cached, a name is needed for the entry */
+    if (info || username)
+        _insert (username, info);
+    G_UNLOCK (user_cache);
+
+    return info;
+}
+
+/**
+ * tlm_user_cache_get_by_name:
+ * @username: name of the user
+ *
+ * Returns: (transfer full): the user, to be freed with
+ * tlm_user_info_free(), or NULL if NSS does not know it
+ */
+TlmUserInfo *
+tlm_user_cache_get_by_name (const gchar *username)
+{
+    if (!username)
+        return NULL;
+    return _get_user (username, 0);
+}
+
+/**
+ * tlm_user_cache_get_by_uid:
+ * @uid: uid of the user
+ *
+ * Returns: (transfer full): the user, to be freed with
+ * tlm_user_info_free(), or NULL if NSS does not know it
+ */
+TlmUserInfo *
+tlm_user_cache_get_by_uid (uid_t uid)
+{
+    return _get_user (NULL, uid);
+}
+
+/**
+ * tlm_user_cache_set_ttl:
+ * @seconds: how long an entry is used, 0 disables the cache
+ *
+ * Sets the lifetime of the entries added from now on.
+ */
+void
+tlm_user_cache_set_ttl (guint seconds)
+{
+    G_LOCK (user_cache);
+    cache_ttl = seconds;
+    if (!seconds)
+        _flush ();
+    G_UNLOCK (user_cache);
+}
+
+/**
+ * tlm_user_cache_invalidate:
+ * @username: (allow-none): the user that changed, NULL for all
+ *
+ * Drops what is cached about @username, for the callers that change the
+ * accounts themselves.
+ */
+void
+tlm_user_cache_invalidate (const gchar *username)
+{
+    UserCacheEntry *entry = NULL;
+
+    G_LOCK (user_cache);
+    if (!username) {
+        _flush ();
+    } else if (by_name &&
+               (entry = g_hash_table_lookup (by_name, username)) != NULL) {
+        _remove_entry (username, entry);
+        cache_stats.invalidations++;
+    }
+    G_UNLOCK (user_cache);
+}
+
+/**
+ * tlm_user_cache_get_stats:
+ * @stats: (out): the counters since the start of the process
+ */
+void
+tlm_user_cache_get_stats (TlmUserCacheStats *stats)
+{
+    g_return_if_fail (stats);
+
+    G_LOCK (user_cache);
+    *stats = cache_stats;
+    stats->entries = by_name ? g_hash_table_size (by_name) : 0;
+    G_UNLOCK (user_cache);
+}
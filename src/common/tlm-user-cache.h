@@ -0,0 +1,63 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2013-2015 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *          Jussi Laako <jussi.laako@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TLM_USER_CACHE_H
+#define _TLM_USER_CACHE_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+#include "tlm-utils.h"
+
+G_BEGIN_DECLS
+
+#define TLM_USER_CACHE_DEFAULT_TTL 60
+
+typedef struct {
+    guint64 hits;
+    guint64 misses;
+    guint64 invalidations;
+    guint entries;
+} TlmUserCacheStats;
+
+TlmUserInfo *
+tlm_user_cache_get_by_name (const gchar *username);
+
+TlmUserInfo *
+tlm_user_cache_get_by_uid (uid_t uid);
+
+void
+tlm_user_cache_set_ttl (guint seconds);
+
+void
+tlm_user_cache_invalidate (const gchar *username);
+
+void
+tlm_user_cache_get_stats (TlmUserCacheStats *stats);
+
+G_END_DECLS
+
+#endif /* _TLM_USER_CACHE_H */
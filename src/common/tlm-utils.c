@@ -26,6 +26,7 @@
 
 #include <sys/types.h>
 #include <pwd.h>
+#include <grp.h>
 #include <sys/stat.h>
 #include <glib/gstdio.h>
 #include <utmp.h>
@@ -35,20 +36,43 @@
 #include <sys/socket.h>
 #include <sys/inotify.h>
 #include <netdb.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
 #include <string.h>
 #include <unistd.h>
 #include <glib/gstdio.h>
 #include <glib-unix.h>
 #include <security/pam_appl.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <signal.h>
 
 #include "tlm-utils.h"
+#include "tlm-user-cache.h"
 #include "tlm-log.h"
 #include "tlm-config.h"
 #include "tlm-config-general.h"
+#include "tlm-error.h"
 
 #define HOST_NAME_SIZE 256
 
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+/* from linux/ioprio.h, glibc has no wrappers for ioprio_get/set */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | (data))
+
 void
 g_clear_string (gchar **str)
 {
@@ -58,222 +82,527 @@ g_clear_string (gchar **str)
     }
 }
 
-gchar *
-tlm_user_get_name (uid_t user_id)
+/*
+ * Resolves the passwd entry and the supplementary groups of @username in one
+ * pass, so that callers needing several of them do not go through NSS again
+ * for each. The result comes from the user cache when it is fresh.
+ */
+TlmUserInfo *
+tlm_user_info_new (const gchar *username)
 {
-    struct passwd *pwent;
-    struct passwd buf_pwent;
-    gchar *buf = NULL, *tmp = NULL, *pw_name = NULL;
-    gsize size = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (size <= sizeof(struct passwd))
-        size = 1024;
+    return tlm_user_cache_get_by_name (username);
+}
 
-    for (; NULL != (tmp = g_realloc(buf, size)); size*=2)
-    {
-        buf = tmp;
+void
+tlm_user_info_free (TlmUserInfo *info)
+{
+    if (!info)
+        return;
+
+    g_free (info->name);
+    g_free (info->home_dir);
+    g_free (info->shell);
+    g_free (info->groups);
+    g_slice_free (TlmUserInfo, info);
+}
 
-        if (ERANGE == getpwuid_r(user_id, &buf_pwent, buf, size, &pwent))
-            continue;
-        break;
-    }
+gchar *
+tlm_user_get_name (uid_t user_id)
+{
+    TlmUserInfo *info = tlm_user_cache_get_by_uid (user_id);
+    gchar *pw_name = NULL;
 
-    if (pwent)
-    {
-        pw_name = g_malloc(strlen(pwent->pw_name)+1);
-        if (pw_name)
-        {
-            memset(pw_name, 0, strlen(pwent->pw_name)+1);
-            strncpy(pw_name, pwent->pw_name, strlen(pwent->pw_name));
-        }
+    if (info) {
+        pw_name = g_strdup (info->name);
+        tlm_user_info_free (info);
     }
-
-    if (buf)
-        g_free(buf);
-
     return pw_name;
 }
 
 uid_t
 tlm_user_get_uid (const gchar *username)
 {
-    struct passwd *pwent;
-    struct passwd buf_pwent;
-    __uid_t pw_uid = -1;
-    int ret = -1;
-    gchar *buf = NULL, *tmp = NULL;
-    gsize size = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (size < sizeof(struct passwd))
-        size = 1024;
-
-    for (; NULL != (tmp = g_realloc(buf, size)); size*=2)
-    {
-        buf = tmp;
-
-        ret = getpwnam_r(username, &buf_pwent, buf, size, &pwent);
-        if (0 == ret)
-            pw_uid = pwent->pw_uid;
-        else if (ERANGE == ret)
-            continue;
-        else
-            pw_uid = -1;
+    TlmUserInfo *info = tlm_user_cache_get_by_name (username);
+    uid_t pw_uid = -1;
 
-        break;
+    if (info) {
+        pw_uid = info->uid;
+        tlm_user_info_free (info);
     }
-
-    if (buf)
-        g_free(buf);
-
     return pw_uid;
 }
 
 gid_t
 tlm_user_get_gid (const gchar *username)
 {
-    struct passwd *pwent;
-    struct passwd buf_pwent;
-    __gid_t pw_gid = -1;
-    int ret = -1;
-    gchar *buf = NULL, *tmp = NULL;
-    gsize size = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (size <= sizeof(struct passwd))
-        size = 1024;
-
-    for (; NULL != (tmp = g_realloc(buf, size)); size*=2)
-    {
-        buf = tmp;
-
-        ret = getpwnam_r(username, &buf_pwent, buf, size, &pwent);
-        if (0 == ret)
-            pw_gid = pwent->pw_gid;
-        else if (ERANGE == ret)
-            continue;
-        else
-            pw_gid = -1;
+    TlmUserInfo *info = tlm_user_cache_get_by_name (username);
+    gid_t pw_gid = -1;
 
-        break;
+    if (info) {
+        pw_gid = info->gid;
+        tlm_user_info_free (info);
     }
-
-    if (buf)
-        g_free(buf);
-
     return pw_gid;
 }
 
 gchar *
 tlm_user_get_home_dir (const gchar *username)
 {
-    struct passwd *pwent;
-    struct passwd buf_pwent;
-    gchar *buf = NULL, *tmp = NULL, *pw_dir = NULL;
-    gsize size = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (size <= sizeof(struct passwd))
-        size = 1024;
+    TlmUserInfo *info = tlm_user_cache_get_by_name (username);
+    gchar *pw_dir = NULL;
 
-    for (; NULL != (tmp = g_realloc(buf, size)); size*=2)
-    {
-        buf = tmp;
+    if (info) {
+        pw_dir = g_strdup (info->home_dir);
+        tlm_user_info_free (info);
+    }
+    return pw_dir;
+}
 
-        if (ERANGE == getpwnam_r(username, &buf_pwent, buf, size, &pwent))
-            continue;
-        break;
+gchar *
+tlm_user_get_shell (const gchar *username)
+{
+    TlmUserInfo *info = tlm_user_cache_get_by_name (username);
+    gchar *pw_shell = NULL;
+
+    if (info) {
+        pw_shell = g_strdup (info->shell);
+        tlm_user_info_free (info);
     }
+    return pw_shell;
+}
 
-    if (pwent)
-    {
-        pw_dir = g_malloc(strlen(pwent->pw_dir)+1);
-        if (pw_dir)
-        {
-            memset(pw_dir, 0, strlen(pwent->pw_dir)+1);
-            strncpy(pw_dir, pwent->pw_dir, strlen(pwent->pw_dir));
-        }
+/* Directory tree removal.
+ *
+ * The tree is walked relative to open directory descriptors: every entry is
+ * looked up once by name in its parent, symbolic links are never followed
+ * and directories living on another file system are left alone. The root
+ * directory is pinned by descriptor when the removal is requested, so a
+ * directory created at the same path in the meantime is not touched. */
+
+#define DELETE_PROGRESS_STEP 1024
+
+typedef struct
+{
+    gchar *path;
+    int parent_fd;
+    int dir_fd;
+    gchar *name;
+    dev_t dev;
+    ino_t ino;
+    GCancellable *cancellable;
+    GMainContext *context;
+    TlmDeleteProgressCb progress_cb;
+    gpointer progress_data;
+    guint64 n_removed;
+    int error_code;
+} TlmDeleteData;
+
+typedef struct
+{
+    TlmDeleteProgressCb cb;
+    gpointer userdata;
+    guint64 n_removed;
+} TlmDeleteProgress;
+
+static gboolean
+_delete_progress_cb (gpointer user_data)
+{
+    TlmDeleteProgress *progress = (TlmDeleteProgress *) user_data;
+
+    progress->cb (progress->n_removed, progress->userdata);
+    return FALSE;
+}
+
+static void
+_delete_data_free (TlmDeleteData *data)
+{
+    if (!data) return;
+
+    if (data->dir_fd >= 0) close (data->dir_fd);
+    if (data->parent_fd >= 0) close (data->parent_fd);
+    if (data->cancellable) g_object_unref (data->cancellable);
+    if (data->context) g_main_context_unref (data->context);
+    g_free (data->path);
+    g_free (data->name);
+    g_slice_free (TlmDeleteData, data);
+}
+
+static TlmDeleteData *
+_delete_data_new (const gchar *dir)
+{
+    TlmDeleteData *data = g_slice_new0 (TlmDeleteData);
+    gchar *parent = NULL;
+    struct stat st;
+
+    data->path = g_strdup (dir);
+    data->parent_fd = data->dir_fd = -1;
+
+    parent = g_path_get_dirname (dir);
+    data->name = g_path_get_basename (dir);
+    data->parent_fd = open (parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    g_free (parent);
+    if (data->parent_fd < 0) {
+        data->error_code = errno;
+        return data;
     }
 
-    if (buf)
-        g_free(buf);
+    data->dir_fd = openat (data->parent_fd, data->name,
+            O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (data->dir_fd < 0 || fstat (data->dir_fd, &st) != 0) {
+        data->error_code = errno;
+        return data;
+    }
+    data->dev = st.st_dev;
+    data->ino = st.st_ino;
 
-    return pw_dir;
+    return data;
 }
 
-gchar *
-tlm_user_get_shell (const gchar *username)
+static void
+_delete_count (TlmDeleteData *data)
 {
-    struct passwd *pwent;
-    struct passwd buf_pwent;
-    gchar *buf = NULL, *tmp = NULL, *pw_shell = NULL;
-    gsize size = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (size <= sizeof(struct passwd))
-        size = 1024;
+    TlmDeleteProgress *progress = NULL;
 
-    for (; NULL != (tmp = g_realloc(buf, size)); size*=2)
-    {
-        buf = tmp;
+    if (++data->n_removed % DELETE_PROGRESS_STEP || !data->progress_cb)
+        return;
 
-        if (ERANGE == getpwnam_r(username, &buf_pwent, buf, size, &pwent))
-            continue;
-        break;
+    progress = g_new0 (TlmDeleteProgress, 1);
+    progress->cb = data->progress_cb;
+    progress->userdata = data->progress_data;
+    progress->n_removed = data->n_removed;
+    g_main_context_invoke_full (data->context, G_PRIORITY_DEFAULT,
+            _delete_progress_cb, progress, g_free);
+}
+
+/* Records the first failure, returns FALSE if there was nothing to fail */
+static gboolean
+_delete_failed (TlmDeleteData *data, int error_code)
+{
+    /* someone else removed it already */
+    if (error_code == ENOENT)
+        return FALSE;
+    if (!data->error_code)
+        data->error_code = error_code;
+    return TRUE;
+}
+
+static gboolean
+_delete_dir_at (TlmDeleteData *data, int parent_fd, const gchar *name);
+
+/* Removes everything below the directory dir_fd, consumes dir_fd */
+static gboolean
+_delete_dir_contents (TlmDeleteData *data, int dir_fd)
+{
+    DIR *dir = NULL;
+    struct dirent *ent = NULL;
+    struct stat st;
+    gboolean is_dir, res = TRUE;
+
+    if (!(dir = fdopendir (dir_fd))) {
+        close (dir_fd);
+        return !_delete_failed (data, errno);
     }
 
-    if (pwent)
-    {
-        pw_shell = g_malloc(strlen(pwent->pw_shell)+1);
-        if (pw_shell)
-        {
-            memset(pw_shell, 0, strlen(pwent->pw_shell)+1);
-            strncpy(pw_shell, pwent->pw_shell, strlen(pwent->pw_shell));
+    while ((ent = readdir (dir)) != NULL) {
+        if (g_strcmp0 (ent->d_name, ".") == 0 ||
+            g_strcmp0 (ent->d_name, "..") == 0) {
+            continue;
+        }
+        if (g_cancellable_is_cancelled (data->cancellable)) {
+            _delete_failed (data, ECANCELED);
+            res = FALSE;
+            break;
+        }
+
+        is_dir = (ent->d_type == DT_DIR);
+        if (ent->d_type == DT_UNKNOWN) {
+            if (fstatat (dirfd (dir), ent->d_name, &st,
+                         AT_SYMLINK_NOFOLLOW) != 0) {
+                if (_delete_failed (data, errno)) res = FALSE;
+                continue;
+            }
+            is_dir = S_ISDIR (st.st_mode);
+        }
+
+        if (is_dir) {
+            if (!_delete_dir_at (data, dirfd (dir), ent->d_name)) res = FALSE;
+        } else if (unlinkat (dirfd (dir), ent->d_name, 0) == 0) {
+            _delete_count (data);
+        } else if (_delete_failed (data, errno)) {
+            res = FALSE;
         }
     }
+    closedir (dir);
 
-    if (buf)
-        g_free(buf);
+    return res;
+}
 
-    return pw_shell;
+static gboolean
+_delete_dir_at (TlmDeleteData *data, int parent_fd, const gchar *name)
+{
+    struct stat st;
+    int fd = openat (parent_fd, name,
+            O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+    if (fd < 0)
+        return !_delete_failed (data, errno);
+
+    if (fstat (fd, &st) != 0) {
+        close (fd);
+        return !_delete_failed (data, errno);
+    }
+    if (st.st_dev != data->dev) {
+        WARN ("not descending into mount point '%s' below '%s'",
+              name, data->path);
+        close (fd);
+        return !_delete_failed (data, EXDEV);
+    }
+
+    if (!_delete_dir_contents (data, fd))
+        return FALSE;
+
+    if (unlinkat (parent_fd, name, AT_REMOVEDIR) != 0)
+        return !_delete_failed (data, errno);
+
+    _delete_count (data);
+    return TRUE;
+}
+
+static gboolean
+_delete_tree (TlmDeleteData *data)
+{
+    struct stat st;
+    int fd = data->dir_fd;
+
+    if (data->error_code)
+        return FALSE;
+
+    data->dir_fd = -1;
+    if (!_delete_dir_contents (data, fd))
+        return FALSE;
+
+    /* only remove the root if the path still refers to it */
+    if (fstatat (data->parent_fd, data->name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+        st.st_dev != data->dev || st.st_ino != data->ino)
+        return TRUE;
+
+    if (unlinkat (data->parent_fd, data->name, AT_REMOVEDIR) != 0)
+        return !_delete_failed (data, errno);
+
+    _delete_count (data);
+    return TRUE;
 }
 
 gboolean
 tlm_utils_delete_dir (
         const gchar *dir)
 {
-    GDir* gdir = NULL;
-    struct stat sent;
+    TlmDeleteData *data = NULL;
+    gboolean res;
+
+    if (!dir)
+        return FALSE;
+
+    data = _delete_data_new (dir);
+    res = _delete_tree (data);
+    _delete_data_free (data);
+
+    return res;
+}
+
+static void
+_delete_dir_thread (
+        GTask *task,
+        gpointer source_object,
+        gpointer task_data,
+        GCancellable *cancellable)
+{
+    TlmDeleteData *data = (TlmDeleteData *) task_data;
+
+    if (_delete_tree (data)) {
+        g_task_return_boolean (task, TRUE);
+        return;
+    }
+
+    if (g_task_return_error_if_cancelled (task))
+        return;
+    g_task_return_new_error (task, G_IO_ERROR,
+            g_io_error_from_errno (data->error_code),
+            "Failed to delete '%s': %s", data->path,
+            g_strerror (data->error_code));
+}
+
+void
+tlm_utils_delete_dir_async (
+        const gchar *dir,
+        GCancellable *cancellable,
+        TlmDeleteProgressCb progress_cb,
+        gpointer progress_data,
+        GAsyncReadyCallback callback,
+        gpointer userdata)
+{
+    GTask *task = NULL;
+    TlmDeleteData *data = NULL;
+
+    g_return_if_fail (dir != NULL);
+
+    task = g_task_new (NULL, cancellable, callback, userdata);
+
+    /* pin the directory now, the walk happens in a worker thread */
+    data = _delete_data_new (dir);
+    if (cancellable)
+        data->cancellable = g_object_ref (cancellable);
+    data->context = g_main_context_ref_thread_default ();
+    data->progress_cb = progress_cb;
+    data->progress_data = progress_data;
+    g_task_set_task_data (task, data, (GDestroyNotify) _delete_data_free);
+
+    g_task_run_in_thread (task, _delete_dir_thread);
+    g_object_unref (task);
+}
+
+gboolean
+tlm_utils_delete_dir_finish (
+        GAsyncResult *result,
+        GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+typedef struct _TlmPrefetchData
+{
+    gchar **files;
+    gchar *list_file;
+} TlmPrefetchData;
+
+static void
+_prefetch_data_free (TlmPrefetchData *data)
+{
+    g_strfreev (data->files);
+    g_free (data->list_file);
+    g_free (data);
+}
+
+/* Asks the kernel to start reading @path into the page cache */
+static gboolean
+_prefetch_file (const gchar *path, guint64 *bytes)
+{
+    struct stat st;
+    gboolean res = FALSE;
+    int fd;
 
-    if (!dir || !(gdir = g_dir_open(dir, 0, NULL))) {
+    fd = open (path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd < 0 && errno == EPERM)
+        fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
         return FALSE;
+
+    if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) &&
+        posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED) == 0) {
+        *bytes += st.st_size;
+        res = TRUE;
     }
+    close (fd);
 
-    const gchar *fname = NULL;
-    gint retval = 0;
-    gchar *filepath = NULL;
-    while ((fname = g_dir_read_name (gdir)) != NULL) {
-        if (g_strcmp0 (fname, ".") == 0 ||
-            g_strcmp0 (fname, "..") == 0) {
+    return res;
+}
+
+static gint
+_prefetch_list (
+        gchar **paths,
+        GHashTable *seen,
+        GCancellable *cancellable,
+        guint64 *bytes)
+{
+    gchar **path;
+    gint count = 0;
+
+    for (path = paths; path && *path; path++) {
+        gchar *name = g_strstrip (*path);
+        if (!*name || *name == '#' || g_hash_table_contains (seen, name))
             continue;
-        }
-        retval = -1;
-        filepath = g_build_filename (dir, fname, NULL);
-        if (filepath) {
-            retval = lstat(filepath, &sent);
-            if (retval == 0) {
-                /* recurse the directory */
-                if (S_ISDIR (sent.st_mode)) {
-                    retval = (gint)!tlm_utils_delete_dir (filepath);
-                } else {
-                    retval = g_remove (filepath);
-                }
-            }
-            g_free (filepath);
-        }
-        if (retval != 0) {
-            g_dir_close (gdir);
-            return FALSE;
-        }
+        if (g_cancellable_is_cancelled (cancellable))
+            break;
+        g_hash_table_add (seen, name);
+        if (_prefetch_file (name, bytes))
+            count++;
     }
-    g_dir_close (gdir);
 
-    if (g_remove (dir) != 0) {
-        return FALSE;
+    return count;
+}
+
+static void
+_prefetch_files_thread (
+        GTask *task,
+        gpointer source_object,
+        gpointer task_data,
+        GCancellable *cancellable)
+{
+    TlmPrefetchData *data = (TlmPrefetchData *) task_data;
+    GHashTable *seen = g_hash_table_new (g_str_hash, g_str_equal);
+    gchar *contents = NULL;
+    gchar **lines = NULL;
+    guint64 bytes = 0;
+    gint64 start = g_get_monotonic_time ();
+    gint count;
+
+    count = _prefetch_list (data->files, seen, cancellable, &bytes);
+    if (data->list_file) {
+        if (g_file_get_contents (data->list_file, &contents, NULL, NULL)) {
+            lines = g_strsplit (contents, "\n", -1);
+            count += _prefetch_list (lines, seen, cancellable, &bytes);
+        } else {
+            DBG ("prefetch list '%s' not available", data->list_file);
+        }
     }
+    DBG ("prefetching %d files, %" G_GUINT64_FORMAT " bytes, took %"
+         G_GINT64_FORMAT " us", count, bytes,
+         g_get_monotonic_time () - start);
+
+    /* the hash table points into the lists */
+    g_hash_table_unref (seen);
+    g_strfreev (lines);
+    g_free (contents);
+
+    if (g_task_return_error_if_cancelled (task))
+        return;
+    g_task_return_int (task, count);
+}
 
-    return TRUE;
+/*
+ * Starts reading @files and the files listed in @list_file, one path per
+ * line, into the page cache from a worker thread
+ */
+void
+tlm_utils_prefetch_files_async (
+        const gchar * const *files,
+        const gchar *list_file,
+        GCancellable *cancellable,
+        GAsyncReadyCallback callback,
+        gpointer userdata)
+{
+    GTask *task = NULL;
+    TlmPrefetchData *data = g_new0 (TlmPrefetchData, 1);
+
+    data->files = g_strdupv ((gchar **) files);
+    data->list_file = g_strdup (list_file);
+
+    task = g_task_new (NULL, cancellable, callback, userdata);
+    g_task_set_task_data (task, data, (GDestroyNotify) _prefetch_data_free);
+    g_task_run_in_thread (task, _prefetch_files_thread);
+    g_object_unref (task);
+}
+
+gint
+tlm_utils_prefetch_files_finish (
+        GAsyncResult *result,
+        GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), -1);
+
+    return (gint) g_task_propagate_int (G_TASK (result), error);
 }
 
 static gchar *
@@ -293,70 +622,37 @@ _get_tty_id (
     return id;
 }
 
+/* Address of the first configured non-loopback interface, IPv4 preferred.
+ * Only the local interface table is consulted, never the resolver. */
 static size_t
-_get_host_address (
-        const gchar *hostname, gchar** hostaddress)
+_get_host_address (struct in6_addr *hostaddress)
 {
-    struct addrinfo hints, *info = NULL;
+    struct ifaddrs *ifaddr = NULL, *ifa;
     size_t sz_hostaddress = 0;
 
-    if (!hostname) return 0;
-
-    memset (&hints, 0, sizeof (hints));
-    hints.ai_flags = AI_ADDRCONFIG;
-
-    if (getaddrinfo (hostname, NULL, &hints, &info) == 0) {
-        if (info) {
-            if (info->ai_family == AF_INET) {
-                struct sockaddr_in *sa = (struct sockaddr_in *) info->ai_addr;
-                sz_hostaddress = sizeof(struct in_addr);
-                *hostaddress = g_malloc0 (sz_hostaddress);
-                if (!*hostaddress) {
-                    CRITICAL("g_malloc0 memory allocation failure");
-                    freeaddrinfo (info);
-                    return 0;
-                }
-                memcpy (*hostaddress, &(sa->sin_addr), sz_hostaddress);
-            } else if (info->ai_family == AF_INET6) {
-                struct sockaddr_in6 *sa = (struct sockaddr_in6 *) info->ai_addr;
-                sz_hostaddress = sizeof(struct in6_addr);
-                *hostaddress = g_malloc0 (sz_hostaddress);
-                if (!*hostaddress) {
-                    CRITICAL("g_malloc0 memory allocation failure");
-                    freeaddrinfo (info);
-                    return 0;
-                }
-                memcpy (*hostaddress, &(sa->sin6_addr), sz_hostaddress);
-            }
-            freeaddrinfo (info);
+    if (getifaddrs (&ifaddr) != 0)
+        return 0;
+
+    for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || !(ifa->ifa_flags & IFF_UP) ||
+            (ifa->ifa_flags & IFF_LOOPBACK))
+            continue;
+        if (ifa->ifa_addr->sa_family == AF_INET) {
+            struct sockaddr_in *sa = (struct sockaddr_in *) ifa->ifa_addr;
+            sz_hostaddress = sizeof(struct in_addr);
+            memset (hostaddress, 0, sizeof (*hostaddress));
+            memcpy (hostaddress, &(sa->sin_addr), sz_hostaddress);
+            break;
+        } else if (ifa->ifa_addr->sa_family == AF_INET6 && !sz_hostaddress) {
+            struct sockaddr_in6 *sa = (struct sockaddr_in6 *) ifa->ifa_addr;
+            sz_hostaddress = sizeof(struct in6_addr);
+            memcpy (hostaddress, &(sa->sin6_addr), sz_hostaddress);
         }
     }
+    freeifaddrs (ifaddr);
     return sz_hostaddress;
 }
 
-static gboolean
-_is_tty_same (
-        const gchar *tty1_name,
-        const gchar *tty2_name)
-{
-    gchar *tty1 = NULL, *tty2 = NULL;
-    gboolean res = FALSE;
-
-    if (tty1_name == tty2_name) return TRUE;
-    if (!tty1_name || !tty2_name) return FALSE;
-
-    if (*tty1_name == '/') tty1 = g_strdup (tty1_name);
-    else tty1 = g_strdup_printf ("/dev/%s", tty1_name);
-    if (*tty2_name == '/') tty2 = g_strdup (tty2_name);
-    else tty2 = g_strdup_printf ("/dev/%s", tty2_name);
-
-    res = (g_strcmp0 (tty1_name, tty2_name) == 0);
-
-    g_free (tty1);
-    g_free (tty2);
-    return res;
-}
-
 static gchar *
 _get_host_name ()
 {
@@ -372,6 +668,22 @@ _get_host_name ()
     return name;
 }
 
+/* host name and address do not change over a session, look them up once */
+static gboolean host_info_cached = FALSE;
+static gchar *host_name = NULL;
+static struct in6_addr host_address;
+static size_t sz_host_address = 0;
+
+static void
+_cache_host_info ()
+{
+    if (host_info_cached)
+        return;
+    host_name = _get_host_name ();
+    sz_host_address = _get_host_address (&host_address);
+    host_info_cached = TRUE;
+}
+
 void
 tlm_utils_log_utmp_entry (const gchar *username)
 {
@@ -379,16 +691,13 @@ tlm_utils_log_utmp_entry (const gchar *username)
     pid_t pid;
     struct utmp ut_ent;
     struct utmp *ut_tmp = NULL;
-    gchar *hostname = NULL, *hostaddress = NULL;
-    size_t sz_hostaddress;
     const gchar *tty_name = NULL;
     gchar *tty_no_dev_name = NULL, *tty_id = NULL;
     gchar tty_name_buf[TTY_NAME_MAX+1] = {0,};
 
     DBG ("Log session entry to utmp/wtmp");
 
-    hostname = _get_host_name ();
-    sz_hostaddress = _get_host_address (hostname, &hostaddress);
+    _cache_host_info ();
 
     if (0 == ttyname_r(0, tty_name_buf, TTY_NAME_MAX+1))
         tty_name = tty_name_buf;
@@ -401,15 +710,23 @@ tlm_utils_log_utmp_entry (const gchar *username)
     pid = getpid ();
     utmpname (_PATH_UTMP);
 
+    /* look up the login entry of the line directly, entries left on the
+     * same line by earlier logins belong to other processes */
+    memset (&ut_ent, 0, sizeof (ut_ent));
+    if (tty_no_dev_name) {
+        strncpy (ut_ent.ut_line, tty_no_dev_name, sizeof (ut_ent.ut_line)-1);
+    } else if (tty_id) {
+        ut_ent.ut_type = LOGIN_PROCESS;
+        strncpy (ut_ent.ut_id, tty_id, sizeof (ut_ent.ut_id)-1);
+    }
     setutent ();
-    while ((ut_tmp = getutent())) {
-        if ( (ut_tmp->ut_pid == pid) &&
-             (ut_tmp->ut_id[0] != '\0') &&
-             (ut_tmp->ut_type == LOGIN_PROCESS ||
-                     ut_tmp->ut_type == USER_PROCESS) &&
-             (_is_tty_same (ut_tmp->ut_line, tty_name))) {
+    while ((tty_no_dev_name || tty_id) &&
+           (ut_tmp = tty_no_dev_name ? getutline (&ut_ent) :
+                                       getutid (&ut_ent)) != NULL) {
+        if (ut_tmp->ut_pid == pid)
             break;
-        }
+        /* the next lookup would return the cached entry again */
+        memset (ut_tmp, 0, sizeof (*ut_tmp));
     }
 
     if (ut_tmp) memcpy (&ut_ent, ut_tmp, sizeof (ut_ent));
@@ -423,10 +740,10 @@ tlm_utils_log_utmp_entry (const gchar *username)
         strncpy (ut_ent.ut_user, username, sizeof (ut_ent.ut_user)-1);
     if (tty_no_dev_name)
         strncpy (ut_ent.ut_line, tty_no_dev_name, sizeof (ut_ent.ut_line)-1);
-    if (hostname)
-        strncpy (ut_ent.ut_host, hostname, sizeof (ut_ent.ut_host)-1);
-    if (hostaddress)
-        memcpy (&ut_ent.ut_addr_v6, hostaddress, sz_hostaddress);
+    if (host_name)
+        strncpy (ut_ent.ut_host, host_name, sizeof (ut_ent.ut_host)-1);
+    if (sz_host_address)
+        memcpy (&ut_ent.ut_addr_v6, &host_address, sz_host_address);
 
     ut_ent.ut_session = getsid (0);
     gettimeofday (&tv, NULL);
@@ -442,309 +759,196 @@ tlm_utils_log_utmp_entry (const gchar *username)
 
     updwtmp (_PATH_WTMP, &ut_ent);
 
-    g_free (hostaddress);
-    g_free (hostname);
     g_free (tty_no_dev_name);
     g_free (tty_id);
 }
 
-static gchar **
-_split_command_line_with_regex(const char *command, GRegex *regex) {
-  gchar **temp_strv = NULL;
-  gchar **temp_iter = NULL, **args_iter = NULL;
-  gchar **argv = NULL;
-
-  temp_strv = regex ? g_regex_split (regex, command, G_REGEX_MATCH_NOTEMPTY)
-                    : g_strsplit (command, " ", -1);
-  if (!temp_strv) {
-    WARN("Failed to split command: %s", command);
-    return NULL;
-  }
+/* Whether a login of the user other than the one of pid is still running */
+gboolean
+tlm_utils_has_other_utmp_login (const gchar *username, pid_t pid)
+{
+    struct utmp *ut_tmp = NULL;
+    gboolean found = FALSE;
 
-  argv = g_new0 (gchar *, g_strv_length (temp_strv));
-  for (temp_iter = temp_strv, args_iter = argv;
-      *temp_iter != NULL;
-      temp_iter++) {
-    size_t item_len = 0;
-    gchar *item = g_strstrip (*temp_iter);
+    if (!username)
+        return FALSE;
 
-    item_len = strlen (item);
-    if (item_len == 0) {
-      continue;
+    utmpname (_PATH_UTMP);
+    setutent ();
+    while (!found && (ut_tmp = getutent ()) != NULL) {
+        if (ut_tmp->ut_type != USER_PROCESS || ut_tmp->ut_pid == pid ||
+            ut_tmp->ut_pid <= 0)
+            continue;
+        if (strncmp (ut_tmp->ut_user, username, sizeof (ut_tmp->ut_user)))
+            continue;
+        /* entries of crashed logins are never marked dead */
+        found = kill (ut_tmp->ut_pid, 0) == 0 || errno == EPERM;
     }
-    if ((item[0] == '\"' && item[item_len - 1] == '\"') ||
-        (item[0] == '\'' && item[item_len - 1] == '\'')) {
-      item[item_len - 1] = '\0';
-      memmove (item, item + 1, item_len - 1);
+    endutent ();
+
+    return found;
+}
+
+static void
+_add_command_argument (GPtrArray *args, const gchar *start, gsize len)
+{
+    gchar *item = g_strndup (start, len);
+
+    /* drop enclosing quotes */
+    if ((item[0] == '\"' && item[len - 1] == '\"') ||
+        (item[0] == '\'' && item[len - 1] == '\'')) {
+        item[len - 1] = '\0';
+        memmove (item, item + 1, len - 1);
     }
-    *args_iter = g_strcompress (item);
-    args_iter++;
-  }
-  g_strfreev (temp_strv);
+    g_ptr_array_add (args, g_strcompress (item));
+    g_free (item);
+}
+
+/*
+ * Splits a command line into arguments. An argument is either text enclosed
+ * in single or double quotes on one line, or a run of non-blank characters.
+ * Enclosing quotes are removed and C escapes expanded.
+ */
+static gchar **
+_split_command_line (const gchar *command)
+{
+    GPtrArray *args = g_ptr_array_new ();
+    const gchar *p = command, *q = NULL, *end = NULL;
+
+    while (*p) {
+        while (g_ascii_isspace (*p))
+            p++;
+        if (!*p)
+            break;
+
+        end = NULL;
+        if (*p == '\'' || *p == '\"') {
+            for (q = p + 1; *q && *q != *p && *q != '\n'; q++);
+            if (*q == *p)
+                end = q + 1;
+        }
+        if (!end)
+            for (end = p; *end && !g_ascii_isspace (*end); end++);
 
-  return argv;
+        _add_command_argument (args, p, end - p);
+        p = end;
+    }
+    g_ptr_array_add (args, NULL);
+
+    return (gchar **) g_ptr_array_free (args, FALSE);
 }
 
 gchar **
 tlm_utils_split_command_line(const gchar *command) {
-  const gchar *pattern = "('.*?'|\".*?\"|\\S+)";
-  GError *error = NULL;
-  GRegex *regex = NULL;
-  gchar **argv = NULL;
- 
   if (!command) {
     WARN("Cannot pase NULL arguments string");
     return NULL;
   }
- 
-  if (!(regex = g_regex_new(pattern, 0, G_REGEX_MATCH_NOTEMPTY, &error))) {
-    WARN("Failed to create regex: %s", error->message);
-    g_error_free(error);
-  }
-
-  argv = _split_command_line_with_regex (command, regex);
 
-  g_regex_unref (regex);
-
-  return argv;
+  return _split_command_line (command);
 }
 
 GList *
 tlm_utils_split_command_lines (const GList const *commands_list) {
-  const gchar *pattern = "('.*?'|\".*?\"|\\S+)";
-  GError *error = NULL;
-  GRegex *regex = NULL;
   GList *argv_list = NULL;
   const GList *tmp_list = NULL;
 
-  if (!commands_list) {
-    return NULL;
-  }
-
-  if (!(regex = g_regex_new(pattern, 0, G_REGEX_MATCH_NOTEMPTY, &error))) {
-    WARN("Failed to create regex: %s", error->message);
-    g_error_free(error);
-  }
-
   for (tmp_list = commands_list; tmp_list; tmp_list = tmp_list->next) {
-    argv_list = g_list_append (argv_list, _split_command_line_with_regex (
-                    (const gchar *)tmp_list->data, regex));
+    argv_list = g_list_append (argv_list, _split_command_line (
+                    (const gchar *)tmp_list->data));
   }
 
-  g_regex_unref (regex);
-
   return argv_list;
 }
 
-typedef struct {
-  int ifd;
-  GHashTable *dir_table; /* { gchar*: GList* } */
-  GHashTable *wd_table; /* { int: const gchar* } */
-  WatchCb cb;
-  gpointer userdata;
-} WatchInfo;
-
-static WatchInfo*
-_watch_info_new (
-    int ifd,
-    WatchCb cb,
-    gpointer userdata)
+const gchar *
+tlm_utils_get_session_path (TlmConfig *config)
 {
-  WatchInfo *info = g_slice_new0 (WatchInfo);
-  if (!info) {
-      CRITICAL("g_slice_new0 memory allocation failure");
-      return NULL;
-  }
-  info->ifd = ifd;
-  info->cb = cb;
-  info->userdata = userdata;
-  info->dir_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  info->wd_table = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, NULL);
-
-  return info;
-}
-
-static void
-_destroy_dir_table_entry (gpointer key, gpointer value, gpointer userdata) {
-  (void)key;
-  (void)userdata;
-  g_list_free_full ((GList *)value, g_free);
+    const gchar *path = tlm_config_get_string (config,
+                                               TLM_CONFIG_GENERAL,
+                                               TLM_CONFIG_GENERAL_SESSION_PATH);
+    return path ? path : TLM_DEFAULT_SESSION_PATH;
 }
 
-static void
-_destroy_wd_table_entry (gpointer key, gpointer value, gpointer userdata) {
-  (void)value;
-  int ifd = GPOINTER_TO_INT(userdata);
-  int wd = GPOINTER_TO_INT(key);
-
-  inotify_rm_watch (ifd, wd);
-}
-
-static void
-_watch_info_free (WatchInfo *info)
+/*
+ * Absolute path of an executable program, looked up in the colon separated
+ * search path unless it contains a slash.
+ */
+gchar *
+tlm_utils_find_program (const gchar *program, const gchar *search_path)
 {
-  if (!info) return;
-
-  if (info->dir_table) {
-    g_hash_table_foreach (info->dir_table, _destroy_dir_table_entry, NULL);
-    g_hash_table_unref (info->dir_table);
-  }
-  if (info->wd_table) {
-    g_hash_table_foreach (info->wd_table, _destroy_wd_table_entry,
-        GINT_TO_POINTER(info->ifd));
-    g_hash_table_unref (info->wd_table);
-  }
-  if (info->ifd) close(info->ifd);
-
-  g_slice_free (WatchInfo, info);
-}
-
-typedef enum {
-  WATCH_FAILED,
-  WATCH_ADDED,
-  WATCH_READY
-} AddWatchResults;
-  
-AddWatchResults
-_add_watch (int ifd, char *file_path, WatchInfo *info) {
-  GList *file_list = NULL;
-  int wd = 0;
-  gchar *file_name = NULL;
-  gchar *dir = NULL;
-  AddWatchResults res = WATCH_FAILED;
-
-  if (!file_path) return WATCH_FAILED;
-
-  file_name = g_path_get_basename (file_path);
-  if (!file_name) return WATCH_FAILED;
-
-  dir = g_path_get_dirname (file_path);
-  if (!dir) {
-    g_free (file_name);
-    return WATCH_FAILED;
-  }
-  if ((file_list = (GList *)g_hash_table_lookup (
-        info->dir_table, (gconstpointer)dir))) {
-    file_list = g_list_append (file_list, file_name);
-    g_free (dir);
-    return WATCH_ADDED;
-  }
-  file_list = g_list_append (NULL, file_name);
-  g_hash_table_insert (info->dir_table, g_strdup(dir), file_list);
-
-  /* add watch on directory if its not existing */
-  if (g_access (dir, 0)) {
-    return _add_watch (ifd, dir, info);
-  }
-
-  DBG("Adding watch for file '%s' in dir '%s'", file_name, dir);
-  if ((wd = inotify_add_watch (ifd, dir, IN_CREATE)) == -1) {
-    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
-    WARN ("failed to add inotify watch on %s: %s", dir, strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
-    res = WATCH_FAILED;
-    goto remove_and_return;
-  }
+    gchar **dirs = NULL, **dir = NULL;
+    gchar *candidate = NULL;
 
-  if (!g_access (file_path, 0)) {
-    /* socket is ready, need not have a inotify watch for this */
-    inotify_rm_watch (ifd, wd);
-    res = WATCH_READY;
-    goto remove_and_return;
-  }
-
-  g_hash_table_insert (info->wd_table, GINT_TO_POINTER(wd), dir);
+    if (!program || !*program)
+        return NULL;
 
-  return WATCH_ADDED;
+    if (strchr (program, '/'))
+        return g_access (program, X_OK) == 0 ? g_strdup (program) : NULL;
 
-remove_and_return:
-  g_hash_table_remove (info->dir_table, (gconstpointer)dir);
-  g_list_free_full (file_list, (GDestroyNotify)g_free);
+    dirs = g_strsplit (search_path ? search_path : TLM_DEFAULT_SESSION_PATH,
+                       ":", -1);
+    for (dir = dirs; *dir; dir++) {
+        if (!**dir)
+            continue;
+        candidate = g_build_filename (*dir, program, NULL);
+        if (g_access (candidate, X_OK) == 0 &&
+            g_file_test (candidate, G_FILE_TEST_IS_REGULAR))
+            break;
+        g_clear_string (&candidate);
+    }
+    g_strfreev (dirs);
 
-  return res;
+    return candidate;
 }
 
-static gboolean
-_inotify_watcher_cb (gint ifd, GIOCondition condition, gpointer userdata)
+/*
+ * Argument vector of the configured session command for a seat, with
+ * argv[0] resolved to an absolute path through search_path, the session PATH
+ * of the configuration if NULL. Returns NULL without setting error if no
+ * session command is configured.
+ */
+gchar **
+tlm_utils_get_session_command (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *search_path,
+        GError **error)
 {
-  WatchInfo *info = (WatchInfo *)userdata;
-  struct inotify_event *ie = NULL;
-  gsize size = sizeof (struct inotify_event) + PATH_MAX + 1;
-  guint nwatch = g_hash_table_size (info->wd_table);
-
-  ie = (struct inotify_event *) g_slice_alloc0(size);
-  if (!ie) {
-    CRITICAL("g_slice_alloc0 memory allocation failure");
-    return nwatch ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
-  }
+    const gchar *command = NULL;
+    gchar **argv = NULL;
+    gchar *program = NULL;
+
+    command = tlm_config_get_string (config, seat_id,
+                                     TLM_CONFIG_GENERAL_SESSION_CMD);
+    if (!command)
+        command = tlm_config_get_string (config, TLM_CONFIG_GENERAL,
+                                         TLM_CONFIG_GENERAL_SESSION_CMD);
+    if (!command)
+        return NULL;
 
-  while (nwatch &&
-         read (ifd, ie, size) > (ssize_t)sizeof (struct inotify_event)) {
-    GList *file_list = NULL;
-    GList *element = NULL;
-    GList *pending_list = NULL;
-    gboolean is_first = FALSE;
-    gchar *file_path = NULL;
-    const gchar *dir = NULL;
-
-    dir = (gchar *)g_hash_table_lookup (
-        info->wd_table, GINT_TO_POINTER(ie->wd));
-    if (!dir) continue;
-
-    file_list = g_hash_table_lookup (info->dir_table, (gconstpointer)dir);
-    element = g_list_find_custom (file_list,
-        (gpointer)ie->name, (GCompareFunc)g_strcmp0);
-    if (!element) {
-      DBG("Ignoring '%s' file creation", ie->name);
-      continue;
-    }
-    is_first = (file_list == element);
-
-    g_free (element->data);
-    file_list = g_list_delete_link(file_list, element);
-    if (!file_list) {
-      g_hash_table_remove (info->dir_table, dir);
-      g_hash_table_remove (info->wd_table, GINT_TO_POINTER(ie->wd));
-      inotify_rm_watch (ifd, ie->wd);
-      nwatch--;
-    } else if (is_first) {
-      g_hash_table_insert (info->dir_table, g_strdup (dir), file_list);
-    }
-
-    file_path = g_build_filename (dir, ie->name, NULL);
-    if ((pending_list = (GList *)g_hash_table_lookup (info->dir_table,
-          (gconstpointer)file_path)) != NULL) {
-      GList *tmp = NULL;
-
-      // as we are about add real inotify watch, first remove from dir_table
-      g_hash_table_steal (info->dir_table, (gconstpointer)file_path);
-
-      // Add watches to all the files depend on this directory
-      for (tmp = pending_list; tmp; tmp = tmp->next) {
-        gchar *file_name = (gchar *)tmp->data;
-        gchar *new_file_path = g_build_filename (file_path, file_name, NULL);
-        AddWatchResults res = _add_watch (ifd, new_file_path, info);
-        if (res == WATCH_READY) {
-          if (info->cb) {
-            info->cb (new_file_path, nwatch == 0, NULL, info->userdata);
-          }
-        } else if (res == WATCH_ADDED) nwatch++;
-        else {
-          WARN ("Couldn't add watch on '%s'", new_file_path);
-        }
-        g_free (file_name);
-        g_free (new_file_path);
-      }
-      g_list_free (pending_list);
-    } else {
-      DBG("%s", file_path);
-      if (info->cb) info->cb (file_path, nwatch == 0, NULL, info->userdata);
-    }
-    g_free (file_path);
-  }
+    argv = _split_command_line (command);
+    if (!argv[0]) {
+        g_set_error (error, TLM_ERROR, TLM_ERROR_INVALID_INPUT,
+                     "Empty session command");
+        g_strfreev (argv);
+        return NULL;
+    }
 
-  g_slice_free1 (size, ie);
+    if (!search_path)
+        search_path = tlm_utils_get_session_path (config);
+    program = tlm_utils_find_program (argv[0], search_path);
+    if (!program) {
+        g_set_error (error, TLM_ERROR, TLM_ERROR_INVALID_INPUT,
+                     "Session command '%s' not found in '%s'", argv[0],
+                     search_path);
+        g_strfreev (argv);
+        return NULL;
+    }
+    g_free (argv[0]);
+    argv[0] = program;
 
-  return nwatch ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    return argv;
 }
 
 gchar *
@@ -781,46 +985,485 @@ _expand_file_path (const gchar *file_path)
   return expanded_path;
 }
 
+/*
+ * All the file watches of the process share one inotify descriptor, read in
+ * batches from the main context. A directory is watched once however many
+ * files are waited for in it, and events reach the waiting items through
+ * the watch descriptor of the directory. Files followed for changes are
+ * watched themselves and share their descriptor the same way.
+ */
+
+#define WATCH_DIR_MASK (IN_CREATE | IN_MOVED_TO)
+#define WATCH_FILE_MASK (IN_MODIFY)
+#define WATCH_EVENT_MAX (sizeof (struct inotify_event) + NAME_MAX + 1)
+#define WATCH_READ_SIZE (64 * WATCH_EVENT_MAX)
+
+typedef struct _WatchDir WatchDir;
+
+typedef struct {
+    guint id;
+    WatchCb cb;
+    gpointer userdata;
+    guint pending; /* items not reported yet */
+    GList *items;
+} WatchSet;
+
+typedef struct {
+    WatchSet *set;
+    gchar *path;   /* the file waited for */
+    gchar *target; /* path, or its first missing parent */
+    gchar *name;   /* basename of target while attached */
+    gboolean changes; /* followed for changes, not waited for */
+    WatchDir *dir;
+} WatchItem;
+
+struct _WatchDir {
+    int wd;
+    gboolean removed; /* by the kernel */
+    GList *items;
+};
+
+typedef struct {
+    guint id;
+    gchar *path;
+    gboolean changed; /* the item stays watched */
+} WatchDone;
+
+static struct {
+    int fd;
+    guint source_id;
+    guint last_id;
+    GHashTable *sets; /* { id: WatchSet* } */
+    GHashTable *dirs; /* { wd: WatchDir* } */
+} _watcher = { -1, 0, 0, NULL, NULL };
+
+static void
+_watch_attach (WatchItem *item, int wd)
+{
+    WatchDir *dir = g_hash_table_lookup (_watcher.dirs, GINT_TO_POINTER (wd));
+
+    if (!dir) {
+        dir = g_slice_new0 (WatchDir);
+        dir->wd = wd;
+        g_hash_table_insert (_watcher.dirs, GINT_TO_POINTER (wd), dir);
+    }
+    dir->items = g_list_prepend (dir->items, item);
+    item->dir = dir;
+    item->name = g_path_get_basename (item->target);
+}
+
+static void
+_watch_detach (WatchItem *item)
+{
+    WatchDir *dir = item->dir;
+
+    if (!dir)
+        return;
+    dir->items = g_list_remove (dir->items, item);
+    if (!dir->items) {
+        if (!dir->removed)
+            inotify_rm_watch (_watcher.fd, dir->wd);
+        g_hash_table_remove (_watcher.dirs, GINT_TO_POINTER (dir->wd));
+    }
+    item->dir = NULL;
+    g_free (item->name);
+    item->name = NULL;
+}
+
+static void
+_watch_item_free (WatchItem *item)
+{
+    _watch_detach (item);
+    g_free (item->path);
+    g_free (item->target);
+    g_slice_free (WatchItem, item);
+}
+
+static void
+_watch_set_free (WatchSet *set)
+{
+    g_list_free_full (set->items, (GDestroyNotify) _watch_item_free);
+    g_slice_free (WatchSet, set);
+}
+
+static void
+_watch_dir_free (WatchDir *dir)
+{
+    g_list_free (dir->items);
+    g_slice_free (WatchDir, dir);
+}
+
+/* The item is there, queue its report and forget it */
+static void
+_watch_complete (WatchItem *item, GQueue *done)
+{
+    WatchDone *d = g_slice_new0 (WatchDone);
+
+    d->id = item->set->id;
+    d->path = item->path;
+    item->path = NULL;
+    g_queue_push_tail (done, d);
+
+    item->set->items = g_list_remove (item->set->items, item);
+    _watch_item_free (item);
+}
+
+/* The followed file changed, queue its report and keep watching it */
+static void
+_watch_changed (WatchItem *item, GQueue *done)
+{
+    WatchDone *d = g_slice_new0 (WatchDone);
+
+    d->id = item->set->id;
+    d->path = g_strdup (item->path);
+    d->changed = TRUE;
+    g_queue_push_tail (done, d);
+}
+
+static void
+_watch_drop (WatchItem *item)
+{
+    WARN ("Failed to watch for '%s'", item->path);
+    item->set->pending--;
+    item->set->items = g_list_remove (item->set->items, item);
+    _watch_item_free (item);
+}
+
+/*
+ * Watches the directory of the first missing component of the path of
+ * @item. The check for the component is done once the watch is in place,
+ * so that a file created meanwhile is not missed.
+ */
+static gboolean
+_watch_arm (WatchItem *item, GQueue *done)
+{
+    g_free (item->target);
+    item->target = g_strdup (item->path);
+
+    for (;;) {
+        gchar *dir = g_path_get_dirname (item->target);
+        int wd = inotify_add_watch (_watcher.fd, dir, WATCH_DIR_MASK);
+
+        if (wd < 0) {
+            gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+            if (errno == ENOENT && g_strcmp0 (dir, item->target) != 0) {
+                /* wait for the parent to be created first */
+                g_free (item->target);
+                item->target = dir;
+                continue;
+            }
+            WARN ("failed to add inotify watch on %s: %s", dir,
+                  strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+            g_free (dir);
+            return FALSE;
+        }
+        g_free (dir);
+
+        _watch_attach (item, wd);
+        if (g_access (item->target, F_OK) != 0)
+            return TRUE;
+        _watch_detach (item);
+
+        if (g_strcmp0 (item->target, item->path) == 0) {
+            _watch_complete (item, done);
+            return TRUE;
+        }
+        /* the parent is there, go on with the rest of the path */
+        g_free (item->target);
+        item->target = g_strdup (item->path);
+    }
+}
+
+static void
+_watch_advance (WatchItem *item, GQueue *done)
+{
+    _watch_detach (item);
+    if (g_strcmp0 (item->target, item->path) == 0)
+        _watch_complete (item, done);
+    else if (!_watch_arm (item, done))
+        _watch_drop (item);
+}
+
+static void
+_watch_rearm (GList *items, GQueue *done)
+{
+    for (; items; items = items->next) {
+        WatchItem *item = (WatchItem *) items->data;
+        if (item->changes) {
+            /* still in place, but a change may have been missed */
+            _watch_changed (item, done);
+            continue;
+        }
+        _watch_detach (item);
+        if (!_watch_arm (item, done))
+            _watch_drop (item);
+    }
+}
+
+static void
+_watch_dispatch_event (const struct inotify_event *ev, GQueue *done)
+{
+    WatchDir *dir = g_hash_table_lookup (_watcher.dirs,
+                                         GINT_TO_POINTER (ev->wd));
+    GList *items, *l;
+
+    if (!dir)
+        return;
+
+    if (ev->mask & IN_IGNORED) {
+        /* the directory is gone, wait for it to be created again; a file
+         * followed for changes is gone for good */
+        dir->removed = TRUE;
+        items = g_list_copy (dir->items);
+        for (l = items; l; l = l->next) {
+            WatchItem *item = (WatchItem *) l->data;
+            if (item->changes) {
+                _watch_complete (item, done);
+            } else {
+                _watch_detach (item);
+                if (!_watch_arm (item, done))
+                    _watch_drop (item);
+            }
+        }
+        g_list_free (items);
+        return;
+    }
+    if (ev->mask & IN_MODIFY) {
+        for (l = dir->items; l; l = l->next)
+            _watch_changed ((WatchItem *) l->data, done);
+        return;
+    }
+    if (!ev->len)
+        return;
+
+    /* completing an item may release the directory */
+    items = g_list_copy (dir->items);
+    for (l = items; l; l = l->next) {
+        WatchItem *item = (WatchItem *) l->data;
+        if (g_strcmp0 (item->name, ev->name) == 0)
+            _watch_advance (item, done);
+    }
+    g_list_free (items);
+}
+
+/* Events were lost, look at every item again */
+static void
+_watch_rearm_all (GQueue *done)
+{
+    GHashTableIter iter;
+    gpointer value;
+    GList *items = NULL;
+
+    g_hash_table_iter_init (&iter, _watcher.sets);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+        items = g_list_concat (items,
+                               g_list_copy (((WatchSet *) value)->items));
+    _watch_rearm (items, done);
+    g_list_free (items);
+}
+
+/* Runs the callbacks once the tables are consistent, they may add or
+ * remove watches */
+static void
+_watch_notify (GQueue *done)
+{
+    WatchDone *d;
+
+    while ((d = g_queue_pop_head (done)) != NULL) {
+        WatchSet *set = g_hash_table_lookup (_watcher.sets,
+                                             GUINT_TO_POINTER (d->id));
+        /* an earlier callback may have removed the watch */
+        if (set) {
+            WatchCb cb = set->cb;
+            gpointer userdata = set->userdata;
+            gboolean is_final = !d->changed && --set->pending == 0;
+
+            if (is_final)
+                g_hash_table_remove (_watcher.sets, GUINT_TO_POINTER (d->id));
+            DBG ("%s", d->path);
+            if (cb)
+                cb (d->path, is_final, NULL, userdata);
+        }
+        g_free (d->path);
+        g_slice_free (WatchDone, d);
+    }
+}
+
+static gboolean
+_watch_set_is_empty (gpointer key, gpointer value, gpointer userdata)
+{
+    (void) key;
+    (void) userdata;
+    return ((WatchSet *) value)->pending == 0;
+}
+
+static gboolean
+_on_watch_events (gint fd, GIOCondition condition, gpointer userdata)
+{
+    static gchar buf[WATCH_READ_SIZE]
+        __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    GQueue done = G_QUEUE_INIT;
+    ssize_t len;
+
+    while ((len = read (fd, buf, sizeof (buf))) > 0) {
+        gchar *ptr = buf;
+        while (ptr < buf + len) {
+            const struct inotify_event *ev =
+                (const struct inotify_event *) ptr;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                WARN ("inotify queue overflow, checking all watches");
+                _watch_rearm_all (&done);
+            } else {
+                _watch_dispatch_event (ev, &done);
+            }
+            ptr += sizeof (struct inotify_event) + ev->len;
+        }
+        /* room was left, the queue is drained */
+        if ((gsize) len <= sizeof (buf) - WATCH_EVENT_MAX)
+            break;
+    }
+    if (len < 0 && errno != EAGAIN && errno != EINTR) {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        WARN ("failed to read inotify events: %s",
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+    }
+
+    g_hash_table_foreach_remove (_watcher.sets, _watch_set_is_empty, NULL);
+    _watch_notify (&done);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+_watcher_init (void)
+{
+    if (_watcher.fd >= 0)
+        return TRUE;
+
+    if ((_watcher.fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        WARN ("Failed to start inotify: %s",
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        return FALSE;
+    }
+    _watcher.sets = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+            NULL, (GDestroyNotify) _watch_set_free);
+    _watcher.dirs = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+            NULL, (GDestroyNotify) _watch_dir_free);
+    _watcher.source_id = g_unix_fd_add (_watcher.fd, G_IO_IN,
+            _on_watch_events, NULL);
+
+    return TRUE;
+}
+
+static WatchSet *
+_watch_set_new (WatchCb cb, gpointer userdata)
+{
+    WatchSet *set = g_slice_new0 (WatchSet);
+
+    do {
+        set->id = ++_watcher.last_id;
+    } while (!set->id ||
+             g_hash_table_contains (_watcher.sets, GUINT_TO_POINTER (set->id)));
+    set->cb = cb;
+    set->userdata = userdata;
+    g_hash_table_insert (_watcher.sets, GUINT_TO_POINTER (set->id), set);
+
+    return set;
+}
+
+/*
+ * Calls @cb for each file of @watch_list as soon as it exists, with
+ * is_final set for the last one. Files already there are reported before
+ * returning. Returns the id to pass to tlm_utils_unwatch_files(), or 0 when
+ * nothing is left to wait for. To be used from the main context only.
+ */
 guint
 tlm_utils_watch_for_files (
     const gchar **watch_list,
     WatchCb cb,
     gpointer userdata)
 {
-  gint nwatch = 0;
-  int ifd = 0;
-  WatchInfo *w_info = NULL;
+    WatchSet *set = NULL;
+    GQueue done = G_QUEUE_INIT;
+    GList *items = NULL, *l = NULL;
+    guint id = 0;
+
+    if (!watch_list || !_watcher_init ())
+        return 0;
+
+    set = _watch_set_new (cb, userdata);
+
+    for (; *watch_list; watch_list++) {
+        WatchItem *item = g_slice_new0 (WatchItem);
+        item->set = set;
+        item->path = _expand_file_path (*watch_list);
+        set->items = g_list_append (set->items, item);
+        set->pending++;
+    }
 
-  if (!watch_list) return 0;
+    items = g_list_copy (set->items);
+    for (l = items; l; l = l->next) {
+        if (!_watch_arm ((WatchItem *) l->data, &done))
+            _watch_drop ((WatchItem *) l->data);
+    }
+    g_list_free (items);
 
-  if ((ifd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) < 0) {
-    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
-    WARN("Failed to start inotify: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
-    return 0;
-  }
+    if (set->pending > g_queue_get_length (&done))
+        id = set->id;
+    else if (!set->pending)
+        g_hash_table_remove (_watcher.sets, GUINT_TO_POINTER (set->id));
+    _watch_notify (&done);
 
-  w_info = _watch_info_new (ifd, cb, userdata);
+    return id;
+}
 
-  for (; *watch_list; watch_list++) {
-    char *socket_path  = _expand_file_path (*watch_list);
-    AddWatchResults res = _add_watch (ifd, socket_path, w_info);
-    if (res == WATCH_FAILED) {
-      WARN ("Failed to watch for '%s'", socket_path);
-    } else if (res == WATCH_READY) {
-      gboolean is_final = !nwatch && !*(watch_list + 1);
-      if (cb) cb (socket_path, is_final, NULL, userdata);
-    } else {
-      nwatch++;
+/*
+ * Calls @cb each time the existing file @path is modified, and a last time
+ * with is_final set once the file is removed. Returns the id to pass to
+ * tlm_utils_unwatch_files(), or 0 when the file cannot be watched. To be
+ * used from the main context only.
+ */
+guint
+tlm_utils_watch_file_changes (
+    const gchar *path,
+    WatchCb cb,
+    gpointer userdata)
+{
+    WatchSet *set = NULL;
+    WatchItem *item = NULL;
+    int wd;
+
+    if (!path || !_watcher_init ())
+        return 0;
+
+    if ((wd = inotify_add_watch (_watcher.fd, path, WATCH_FILE_MASK)) < 0) {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        DBG ("failed to add inotify watch on %s: %s", path,
+             strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        return 0;
     }
-  }
 
-  if (nwatch == 0) {
-    _watch_info_free (w_info);
-    return 0;
-  }
+    set = _watch_set_new (cb, userdata);
+    item = g_slice_new0 (WatchItem);
+    item->set = set;
+    item->path = g_strdup (path);
+    item->target = g_strdup (path);
+    item->changes = TRUE;
+    set->items = g_list_append (set->items, item);
+    set->pending = 1;
+    _watch_attach (item, wd);
+
+    return set->id;
+}
 
-  return g_unix_fd_add_full (G_PRIORITY_DEFAULT, ifd, G_IO_IN,
-      _inotify_watcher_cb, w_info, (GDestroyNotify)_watch_info_free);
+/* Stops waiting for the files of @watch_id, no more callbacks follow */
+void
+tlm_utils_unwatch_files (guint watch_id)
+{
+    if (!watch_id || !_watcher.sets)
+        return;
+    g_hash_table_remove (_watcher.sets, GUINT_TO_POINTER (watch_id));
 }
 
 typedef struct _TlmLoginInfo
@@ -868,6 +1511,171 @@ static int func_conv(
     return PAM_SUCCESS;
 }
 
+guint
+tlm_utils_get_terminate_timeout (TlmConfig *config)
+{
+    if (tlm_config_has_key (config,
+                            TLM_CONFIG_GENERAL,
+                            TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT_MS))
+        return tlm_config_get_uint (config,
+                                    TLM_CONFIG_GENERAL,
+                                    TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT_MS,
+                                    3000);
+
+    return tlm_config_get_uint (config,
+                                TLM_CONFIG_GENERAL,
+                                TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT,
+                                3) * 1000;
+}
+
+static gboolean
+_set_cloexec (int fd)
+{
+    int flags = fcntl (fd, F_GETFD);
+
+    if (flags < 0)
+        return errno == EBADF;
+    if (flags & FD_CLOEXEC)
+        return TRUE;
+    return fcntl (fd, F_SETFD, flags | FD_CLOEXEC) == 0;
+}
+
+/*
+ * Marks every descriptor from @lowfd upwards close-on-exec. Uses
+ * close_range(2) where the kernel supports it, otherwise walks
+ * /proc/self/fd so that only descriptors actually open are touched. Only
+ * when /proc is not mounted it falls back to probing up to _SC_OPEN_MAX.
+ */
+gboolean
+tlm_utils_set_cloexec_from (int lowfd)
+{
+    DIR *dir;
+    struct dirent *ent;
+    gboolean res = TRUE;
+    long open_max;
+    int fd;
+
+#   ifdef SYS_close_range
+    if (syscall (SYS_close_range, lowfd, ~0U, CLOSE_RANGE_CLOEXEC) == 0)
+        return TRUE;
+#   endif
+
+    dir = opendir ("/proc/self/fd");
+    if (dir) {
+        while ((ent = readdir (dir)) != NULL) {
+            if (ent->d_name[0] < '0' || ent->d_name[0] > '9')
+                continue;
+            fd = atoi (ent->d_name);
+            if (fd < lowfd || fd == dirfd (dir))
+                continue;
+            if (!_set_cloexec (fd))
+                res = FALSE;
+        }
+        closedir (dir);
+        return res;
+    }
+
+    open_max = sysconf (_SC_OPEN_MAX);
+    for (fd = lowfd; fd < open_max; fd++) {
+        if (!_set_cloexec (fd))
+            res = FALSE;
+    }
+    return res;
+}
+
+/*
+ * Parses an I/O priority given as "realtime:LEVEL", "best-effort:LEVEL" or
+ * "idle", a plain LEVEL (0 highest to 7 lowest) is taken as best-effort.
+ * Returns the value for tlm_utils_set_ioprio() or -1 if invalid.
+ */
+gint
+tlm_utils_parse_ioprio (const gchar *ioprio)
+{
+    gint class = IOPRIO_CLASS_BE;
+    const gchar *level = ioprio;
+    gchar *end = NULL;
+    gint64 data;
+
+    if (!ioprio)
+        return -1;
+    if (g_strcmp0 (ioprio, "idle") == 0)
+        return IOPRIO_PRIO_VALUE (IOPRIO_CLASS_IDLE, 0);
+    if (g_str_has_prefix (ioprio, "realtime:")) {
+        class = IOPRIO_CLASS_RT;
+        level = ioprio + strlen ("realtime:");
+    } else if (g_str_has_prefix (ioprio, "best-effort:")) {
+        level = ioprio + strlen ("best-effort:");
+    }
+
+    data = g_ascii_strtoll (level, &end, 10);
+    if (!*level || *end || data < 0 || data > 7)
+        return -1;
+    return IOPRIO_PRIO_VALUE (class, (gint) data);
+}
+
+gint
+tlm_utils_get_ioprio (pid_t tid)
+{
+    return syscall (SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid);
+}
+
+gboolean
+tlm_utils_set_ioprio (pid_t tid, gint ioprio)
+{
+    if (syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, ioprio) < 0) {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        DBG ("ioprio_set(%d, %d): %s", tid, ioprio,
+             strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Parses a list of CPUs in the cpuset format, e.g. "0-2,4", into @set.
+ * Returns FALSE if the list is empty or invalid.
+ */
+gboolean
+tlm_utils_parse_cpu_list (const gchar *cpus, cpu_set_t *set)
+{
+    gchar **ranges = NULL, **range = NULL;
+    gboolean res = TRUE;
+
+    g_return_val_if_fail (set, FALSE);
+
+    CPU_ZERO (set);
+    if (!cpus || !*cpus)
+        return FALSE;
+
+    ranges = g_strsplit (cpus, ",", -1);
+    for (range = ranges; *range && res; range++) {
+        gchar *end = NULL;
+        guint64 first, last, cpu;
+
+        first = g_ascii_strtoull (*range, &end, 10);
+        last = first;
+        if (end == *range) {
+            res = FALSE;
+            break;
+        }
+        if (*end == '-') {
+            const gchar *start = end + 1;
+            last = g_ascii_strtoull (start, &end, 10);
+            if (end == start)
+                res = FALSE;
+        }
+        if (!res || *end || first > last || last >= CPU_SETSIZE) {
+            res = FALSE;
+            break;
+        }
+        for (cpu = first; cpu <= last; cpu++)
+            CPU_SET ((int) cpu, set);
+    }
+    g_strfreev (ranges);
+
+    return res;
+}
+
 gboolean
 tlm_authenticate_user (
     TlmConfig *config,
@@ -28,7 +28,9 @@
 #define _TLM_UTILS_H
 
 #include <sys/types.h>
+#include <sched.h>
 #include <glib.h>
+#include <gio/gio.h>
 
 #include "tlm-config.h"
 
@@ -37,6 +39,23 @@ G_BEGIN_DECLS
 void
 g_clear_string (gchar **);
 
+typedef struct _TlmUserInfo
+{
+    gchar *name;
+    uid_t uid;
+    gid_t gid;
+    gchar *home_dir;
+    gchar *shell;
+    gid_t *groups;
+    gint n_groups;
+} TlmUserInfo;
+
+TlmUserInfo *
+tlm_user_info_new (const gchar *username);
+
+void
+tlm_user_info_free (TlmUserInfo *info);
+
 gchar *
 tlm_user_get_name (uid_t user_id);
 
@@ -55,20 +74,88 @@ tlm_user_get_shell (const gchar *username);
 gboolean
 tlm_utils_delete_dir (const gchar *dir);
 
+typedef void (*TlmDeleteProgressCb) (guint64 n_removed, gpointer userdata);
+
+void
+tlm_utils_delete_dir_async (const gchar *dir,
+                            GCancellable *cancellable,
+                            TlmDeleteProgressCb progress_cb,
+                            gpointer progress_data,
+                            GAsyncReadyCallback callback,
+                            gpointer userdata);
+
+gboolean
+tlm_utils_delete_dir_finish (GAsyncResult *result, GError **error);
+
+void
+tlm_utils_prefetch_files_async (const gchar * const *files,
+                                const gchar *list_file,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer userdata);
+
+gint
+tlm_utils_prefetch_files_finish (GAsyncResult *result, GError **error);
+
 void
 tlm_utils_log_utmp_entry (const gchar *username);
 
+gboolean
+tlm_utils_has_other_utmp_login (const gchar *username, pid_t pid);
+
 gchar **
 tlm_utils_split_command_line (const gchar *command);
 
 GList *
 tlm_utils_split_command_lines (const GList const *commands_list);
 
+#define TLM_DEFAULT_SESSION_PATH "/usr/local/bin:/usr/bin:/bin"
+
+const gchar *
+tlm_utils_get_session_path (TlmConfig *config);
+
+gchar *
+tlm_utils_find_program (const gchar *program, const gchar *search_path);
+
+gchar **
+tlm_utils_get_session_command (TlmConfig *config,
+                               const gchar *seat_id,
+                               const gchar *search_path,
+                               GError **error);
+
 typedef void (*WatchCb) (const gchar *found_item, gboolean is_final, GError *error, gpointer userdata);
 
 guint
 tlm_utils_watch_for_files (const gchar **watch_list, WatchCb cb, gpointer userdata);
 
+guint
+tlm_utils_watch_file_changes (const gchar *path, WatchCb cb, gpointer userdata);
+
+void
+tlm_utils_unwatch_files (guint watch_id);
+
+/* what the last termination stage waits for the kernel to reap the killed
+ * processes, even once the shutdown deadline has passed */
+#define TLM_TERMINATE_KILL_GRACE_MS 200
+
+guint
+tlm_utils_get_terminate_timeout (TlmConfig *config);
+
+gboolean
+tlm_utils_set_cloexec_from (int lowfd);
+
+gint
+tlm_utils_parse_ioprio (const gchar *ioprio);
+
+gint
+tlm_utils_get_ioprio (pid_t tid);
+
+gboolean
+tlm_utils_set_ioprio (pid_t tid, gint ioprio);
+
+gboolean
+tlm_utils_parse_cpu_list (const gchar *cpus, cpu_set_t *set);
+
 gboolean
 tlm_authenticate_user (TlmConfig *config, const gchar *username, const gchar *password);
 
@@ -37,6 +37,8 @@
 #include "tlm-log.h"
 #include "tlm-manager.h"
 #include "tlm-seat.h"
+#include "tlm-pam-stats.h"
+#include "tlm-user-cache.h"
 #include "tlm-config.h"
 #include "tlm-config-general.h"
 
@@ -78,6 +80,28 @@ _on_sighup_cb (gpointer data)
     return FALSE;
 }
 
+static void
+_dump_user_cache_stats (void)
+{
+    TlmUserCacheStats stats;
+
+    tlm_user_cache_get_stats (&stats);
+    g_message ("user cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+               " misses, %" G_GUINT64_FORMAT " invalidations, %u entries",
+               stats.hits, stats.misses, stats.invalidations, stats.entries);
+}
+
+static gboolean
+_on_sigusr1_cb (gpointer data)
+{
+    DBG ("SIGUSR1");
+
+    tlm_pam_stats_dump ();
+    _dump_user_cache_stats ();
+
+    return TRUE;
+}
+
 static void
 _setup_unix_signal_handlers (TlmManager *manager)
 {
@@ -89,6 +113,7 @@ _setup_unix_signal_handlers (TlmManager *manager)
 
     g_unix_signal_add (SIGTERM, _on_sigterm_cb, (gpointer) manager);
     g_unix_signal_add (SIGHUP, _on_sighup_cb, (gpointer) manager);
+    g_unix_signal_add (SIGUSR1, _on_sigusr1_cb, NULL);
 }
 
 int main(int argc, char *argv[])
@@ -152,6 +177,7 @@ int main(int argc, char *argv[])
         }
 
         g_object_unref (G_OBJECT(manager));
+        tlm_pam_stats_clear ();
 
         DBG ("clean shutdown");
     } else {
@@ -34,6 +34,7 @@
 #include "tlm-config-seat.h"
 #include "tlm-dbus-observer.h"
 #include "tlm-utils.h"
+#include "tlm-user-cache.h"
 #include "config.h"
 
 #include <glib.h>
@@ -43,6 +44,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
 #include <limits.h>
 #include <sys/inotify.h>
 
@@ -54,6 +56,7 @@ G_DEFINE_TYPE (TlmManager, tlm_manager, G_TYPE_OBJECT);
 #define LOGIND_BUS_NAME 	"org.freedesktop.login1"
 #define LOGIND_OBJECT_PATH 	"/org/freedesktop/login1"
 #define LOGIND_MANAGER_IFACE 	LOGIND_BUS_NAME".Manager"
+#define CONFIG_RELOAD_DELAY_MS 1000
 
 struct _TlmManagerPrivate
 {
@@ -68,6 +71,13 @@ struct _TlmManagerPrivate
 
     guint seat_added_id;
     guint seat_removed_id;
+
+    gint64 stop_time;
+    guint shutdown_timer_id;
+    gboolean stopped;
+
+    GFileMonitor *config_monitor; /* tlm.conf, with WATCH_CONFIG */
+    guint config_reload_id;
 };
 
 enum {
@@ -117,6 +127,20 @@ tlm_manager_dispose (GObject *self)
         tlm_manager_stop (manager);
     }
 
+    if (manager->priv->shutdown_timer_id) {
+        g_source_remove (manager->priv->shutdown_timer_id);
+        manager->priv->shutdown_timer_id = 0;
+    }
+
+    if (manager->priv->config_reload_id) {
+        g_source_remove (manager->priv->config_reload_id);
+        manager->priv->config_reload_id = 0;
+    }
+    if (manager->priv->config_monitor) {
+        g_file_monitor_cancel (manager->priv->config_monitor);
+        g_clear_object (&manager->priv->config_monitor);
+    }
+
     if (manager->priv->seats) {
         g_hash_table_unref (manager->priv->seats);
         manager->priv->seats = NULL;
@@ -451,10 +475,8 @@ _prepare_user_login_cb (TlmSeat *seat, const gchar *user_name, gpointer user_dat
 
     g_return_if_fail (user_data && TLM_IS_MANAGER(manager));
 
-    if (tlm_config_get_boolean (manager->priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_PREPARE_DEFAULT,
-                                FALSE)) {
+    if (tlm_config_get_seat_config (manager->priv->config,
+                                    tlm_seat_get_id (seat))->prepare_default) {
         DBG ("prepare for login for '%s'", user_name);
         if (!tlm_manager_setup_guest_user (manager, user_name)) {
             WARN ("failed to prepare for '%s'", user_name);
@@ -469,10 +491,8 @@ _prepare_user_logout_cb (TlmSeat *seat, const gchar *user_name, gpointer user_da
 
     g_return_if_fail (user_data && TLM_IS_MANAGER(manager));
 
-    if (tlm_config_get_boolean (manager->priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_PREPARE_DEFAULT,
-                                FALSE)) {
+    if (tlm_config_get_seat_config (manager->priv->config,
+                                    tlm_seat_get_id (seat))->prepare_default) {
         DBG ("prepare for logout for '%s'", user_name);
         if (!tlm_account_plugin_cleanup_guest_user (
                 manager->priv->account_plugin, user_name, FALSE)) {
@@ -503,10 +523,7 @@ _create_seat (TlmManager *manager,
     g_hash_table_insert (priv->seats, g_strdup (seat_id), seat);
     g_signal_emit (manager, signals[SIG_SEAT_ADDED], 0, seat, NULL);
 
-    if (tlm_config_get_boolean (priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_AUTO_LOGIN,
-                                TRUE) ||
+    if (tlm_config_get_seat_config (priv->config, seat_id)->auto_login ||
         priv->initial_user) {
         DBG("intial auto-login for user '%s'", priv->initial_user);
         if (!tlm_seat_create_session (seat,
@@ -553,29 +570,15 @@ _add_seat (TlmManager *manager, const gchar *seat_id, const gchar *seat_path)
     g_return_if_fail (manager && TLM_IS_MANAGER (manager));
 
     TlmManagerPrivate *priv = TLM_MANAGER_PRIV (manager);
+    const TlmSeatConfig *seat_config =
+            tlm_config_get_seat_config (priv->config, seat_id);
 
     // Do nothing if the seat is not active
-    if (!tlm_config_get_boolean (priv->config,
-                                 seat_id,
-                                 TLM_CONFIG_SEAT_ACTIVE,
-                                 TRUE))
+    if (!seat_config->active)
         return;
 
-    guint nwatch = tlm_config_get_uint (priv->config,
-                                        seat_id,
-                                        TLM_CONFIG_SEAT_NWATCH,
-                                        0);
-    if (nwatch) {
-        int x;
+    if (seat_config->nwatch) {
         int watch_id = 0;
-        gchar **watch_items = g_new0 (gchar *, nwatch + 1);
-        for (x = 0; x < nwatch; x++) {
-          gchar *watchx = g_strdup_printf ("%s%u", TLM_CONFIG_SEAT_WATCHX, x);
-          watch_items[x] = (char *)tlm_config_get_string (
-              priv->config, seat_id, watchx);
-          g_free (watchx);
-        }
-        watch_items[nwatch] = NULL;
         TlmSeatWatchClosure *watch_closure =
             g_new0 (TlmSeatWatchClosure, 1);
         watch_closure->manager = g_object_ref (manager);
@@ -583,8 +586,7 @@ _add_seat (TlmManager *manager, const gchar *seat_id, const gchar *seat_path)
         watch_closure->seat_path = g_strdup (seat_path);
 
         watch_id = tlm_utils_watch_for_files (
-            (const gchar **)watch_items, _seat_watch_cb, watch_closure);
-        g_free (watch_items);
+            (const gchar **)seat_config->watch, _seat_watch_cb, watch_closure);
         if (watch_id <= 0) {
             WARN ("Failed to add watch on seat %s", seat_id);
         } else {
@@ -608,7 +610,8 @@ _manager_hashify_seats (TlmManager *manager, GVariant *hash_map)
     g_variant_iter_init (&iter, hash_map);
     while (g_variant_iter_next (&iter, "(so)", &id, &path)) {
         DBG("found seat %s:%s", id, path);
-        _add_seat (manager, id, path);
+        if (!g_hash_table_contains (manager->priv->seats, id))
+            _add_seat (manager, id, path);
         g_free (id);
         g_free (path);
     }
@@ -748,11 +751,276 @@ _manager_unsubsribe_seat_changes (TlmManager *manager)
     }
 }
 
+static gboolean
+_is_plugin_group (const gchar *group)
+{
+    gchar *plugin_file_name = g_strdup_printf ("libtlm-plugin-%s", group);
+    gchar *plugin_file = g_module_build_path (_get_plugins_path (),
+                                              plugin_file_name);
+    gboolean res = g_file_test (plugin_file, G_FILE_TEST_IS_REGULAR);
+
+    g_free (plugin_file);
+    g_free (plugin_file_name);
+    return res;
+}
+
+static gboolean
+_keys_contain (gchar **keys, const gchar *key)
+{
+    for (; keys && *keys; keys++) {
+        if (g_strcmp0 (*keys, key) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* General group changes reach the seats that do not override them */
+static gboolean
+_seat_inherits_change (TlmConfig *config, const gchar *seat_id, gchar **keys)
+{
+    for (; keys && *keys; keys++) {
+        if (!tlm_config_has_key (config, seat_id, *keys))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Keys that only matter when a seat is added, see _add_seat() */
+static gboolean
+_has_seat_setup_key (gchar **keys)
+{
+    for (; keys && *keys; keys++) {
+        if (g_strcmp0 (*keys, TLM_CONFIG_SEAT_ACTIVE) == 0 ||
+            g_strcmp0 (*keys, TLM_CONFIG_SEAT_NWATCH) == 0 ||
+            g_str_has_prefix (*keys, TLM_CONFIG_SEAT_WATCHX))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Adds the seats that the configuration brings in or activates */
+static void
+_add_new_seats (TlmManager *manager)
+{
+    TlmManagerPrivate *priv = manager->priv;
+    guint nseats = tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
+                                        TLM_CONFIG_GENERAL_NSEATS, 0);
+    guint i;
+
+    /* logind keeps telling about its seats, sync with them again */
+    if (priv->seat_added_id) {
+        if (nseats)
+            WARN ("%s applies on restart", TLM_CONFIG_GENERAL_NSEATS);
+        _manager_sync_seats (manager);
+        return;
+    }
+
+    for (i = 0; i < nseats; i++) {
+        gchar *id = g_strdup_printf ("seat%u", i);
+        if (!g_hash_table_contains (priv->seats, id)) {
+            DBG ("adding virtual seat '%s'", id);
+            _add_seat (manager, id, NULL);
+        }
+        g_free (id);
+    }
+}
+
+/*
+ * Applies a reloaded configuration. Seats that are not running yet are
+ * added if the configuration now activates them. Running seats are kept
+ * until restart even if they are deactivated, along with their watches and
+ * the seats beyond a lowered NSEATS.
+ */
+static void
+_apply_config_changes (TlmManager *manager, GHashTable *changes)
+{
+    TlmManagerPrivate *priv = manager->priv;
+    const gchar *accounts_plugin = NULL;
+    gchar **general = g_hash_table_lookup (changes, TLM_CONFIG_GENERAL);
+    gboolean reload_accounts = FALSE;
+    gboolean reload_auth = FALSE;
+    gboolean add_seats = FALSE;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    if (!g_hash_table_size (changes)) {
+        DBG ("configuration unchanged");
+        return;
+    }
+
+    accounts_plugin = tlm_config_get_string_default (priv->config,
+                                        TLM_CONFIG_GENERAL,
+                                        TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN,
+                                        "default");
+    reload_accounts = _keys_contain (general,
+                                     TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN);
+    add_seats = _keys_contain (general, TLM_CONFIG_GENERAL_NSEATS) ||
+                _has_seat_setup_key (general);
+
+    g_hash_table_iter_init (&iter, changes);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        gchar *keys = g_strjoinv (" ", (gchar **) value);
+        DBG ("[%s] changed: %s", (gchar *) key, keys);
+        g_free (keys);
+
+        if (g_str_has_prefix (key, "seat")) {
+            if (!g_hash_table_contains (priv->seats, key))
+                add_seats = TRUE;
+            else if (_has_seat_setup_key ((gchar **) value))
+                WARN ("seat %s: %s and %s changes apply on restart",
+                      (gchar *) key, TLM_CONFIG_SEAT_ACTIVE,
+                      TLM_CONFIG_SEAT_NWATCH);
+            continue;
+        }
+        if (g_strcmp0 (key, TLM_CONFIG_GENERAL) == 0 ||
+            !_is_plugin_group (key))
+            continue;
+        if (g_strcmp0 (key, accounts_plugin) == 0)
+            reload_accounts = TRUE;
+        reload_auth = TRUE;
+    }
+
+    if (reload_accounts) {
+        DBG ("reloading account plugin '%s'", accounts_plugin);
+        g_clear_object (&priv->account_plugin);
+        _load_accounts_plugin (manager, accounts_plugin);
+    }
+    if (reload_auth) {
+        DBG ("reloading auth plugins");
+        g_list_free_full (priv->auth_plugins, _unref_auth_plugins);
+        priv->auth_plugins = NULL;
+        _load_auth_plugins (manager);
+    }
+
+    /* sessions take their configuration when they start, running ones are
+     * left alone */
+    g_hash_table_iter_init (&iter, priv->seats);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        if (!g_hash_table_contains (changes, key) &&
+            !_seat_inherits_change (priv->config, key, general))
+            continue;
+        DBG ("seat %s: configuration changes apply from its next session",
+             (gchar *) key);
+        tlm_seat_config_changed (TLM_SEAT (value));
+    }
+
+    if (add_seats && priv->is_started)
+        _add_new_seats (manager);
+}
+
+static void
+_update_config_monitor (TlmManager *manager);
+
+static void
+_update_user_cache (TlmManager *manager)
+{
+    tlm_user_cache_set_ttl (tlm_config_get_uint (manager->priv->config,
+                                TLM_CONFIG_GENERAL,
+                                TLM_CONFIG_GENERAL_USER_CACHE_TTL,
+                                TLM_USER_CACHE_DEFAULT_TTL));
+}
+
+static void
+_reload_config (TlmManager *manager)
+{
+    GError *error = NULL;
+    GHashTable *changes = NULL;
+
+    changes = tlm_config_reload_diff (manager->priv->config, &error);
+    if (!changes) {
+        WARN ("keeping the current configuration:\n%s", error->message);
+        g_error_free (error);
+        return;
+    }
+    _apply_config_changes (manager, changes);
+    g_hash_table_unref (changes);
+    _update_config_monitor (manager);
+    _update_user_cache (manager);
+}
+
+static gboolean
+_on_config_reload_timeout (gpointer user_data)
+{
+    TlmManager *manager = TLM_MANAGER (user_data);
+
+    manager->priv->config_reload_id = 0;
+    DBG ("configuration file changed");
+    _reload_config (manager);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_on_config_file_changed (
+        GFileMonitor *monitor,
+        GFile *file,
+        GFile *other_file,
+        GFileMonitorEvent event,
+        gpointer user_data)
+{
+    TlmManager *manager = TLM_MANAGER (user_data);
+
+    if (event == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+        return;
+
+    /* an editor or a configuration push makes a burst of events, reload
+     * once it is over */
+    if (manager->priv->config_reload_id)
+        g_source_remove (manager->priv->config_reload_id);
+    manager->priv->config_reload_id = g_timeout_add (CONFIG_RELOAD_DELAY_MS,
+            _on_config_reload_timeout, manager);
+}
+
+static void
+_update_config_monitor (TlmManager *manager)
+{
+    TlmManagerPrivate *priv = manager->priv;
+    const gchar *path = tlm_config_get_file_path (priv->config);
+    GError *error = NULL;
+    GFile *file = NULL;
+
+    if (!path || !tlm_config_get_boolean (priv->config, TLM_CONFIG_GENERAL,
+                                          TLM_CONFIG_GENERAL_WATCH_CONFIG,
+                                          FALSE)) {
+        if (priv->config_monitor) {
+            DBG ("stop watching the configuration file");
+            g_file_monitor_cancel (priv->config_monitor);
+            g_clear_object (&priv->config_monitor);
+        }
+        return;
+    }
+    if (priv->config_monitor)
+        return;
+
+    file = g_file_new_for_path (path);
+    priv->config_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE,
+                                                NULL, &error);
+    g_object_unref (file);
+    if (!priv->config_monitor) {
+        WARN ("unable to watch '%s': %s", path, error->message);
+        g_error_free (error);
+        return;
+    }
+    g_signal_connect (priv->config_monitor, "changed",
+                      G_CALLBACK (_on_config_file_changed), manager);
+    DBG ("watching '%s'", path);
+}
+
 gboolean
 tlm_manager_start (TlmManager *manager)
 {
+    GError *error = NULL;
+
     g_return_val_if_fail (manager && TLM_IS_MANAGER (manager), FALSE);
 
+    if (!tlm_config_validate (manager->priv->config, &error)) {
+        CRITICAL ("invalid configuration:\n%s", error->message);
+        g_error_free (error);
+        return FALSE;
+    }
+    _update_config_monitor (manager);
+    _update_user_cache (manager);
+
     guint nseats = tlm_config_get_uint (manager->priv->config,
                                         TLM_CONFIG_GENERAL,
                                         TLM_CONFIG_GENERAL_NSEATS,
@@ -776,22 +1044,72 @@ tlm_manager_start (TlmManager *manager)
 }
 
 
+static gint64
+_get_stop_elapsed_ms (TlmManager *manager)
+{
+    return (g_get_monotonic_time () - manager->priv->stop_time) / 1000;
+}
+
+static void
+_signal_stopped (TlmManager *manager)
+{
+    /* the deadline and the last seat going away may both get here */
+    if (manager->priv->stopped)
+        return;
+    manager->priv->stopped = TRUE;
+
+    if (manager->priv->shutdown_timer_id) {
+        g_source_remove (manager->priv->shutdown_timer_id);
+        manager->priv->shutdown_timer_id = 0;
+    }
+    DBG ("signalling stopped after %" G_GINT64_FORMAT " ms",
+         _get_stop_elapsed_ms (manager));
+    g_signal_emit (manager, signals[SIG_MANAGER_STOPPED], 0);
+}
+
 static gboolean
 _session_terminated_cb (GObject *emitter, const gchar *seat_id,
         TlmManager *manager)
 {
     g_return_val_if_fail (manager && TLM_IS_MANAGER (manager), TRUE);
+    gint sig = tlm_seat_get_termination_signal (TLM_SEAT (emitter));
+
     DBG("seatid %s", seat_id);
+    if (sig == SIGTERM || sig == SIGKILL) {
+        WARN ("seat '%s' needed escalation to %s, stopped after %"
+              G_GINT64_FORMAT " ms", seat_id,
+              sig == SIGKILL ? "SIGKILL" : "SIGTERM",
+              _get_stop_elapsed_ms (manager));
+    } else {
+        DBG ("seat '%s' stopped after %" G_GINT64_FORMAT " ms", seat_id,
+             _get_stop_elapsed_ms (manager));
+    }
 
     g_hash_table_remove (manager->priv->seats, seat_id);
-    if (g_hash_table_size (manager->priv->seats) == 0) {
-        DBG ("signalling stopped");
-        g_signal_emit (manager, signals[SIG_MANAGER_STOPPED], 0);
-    }
+    if (g_hash_table_size (manager->priv->seats) == 0)
+        _signal_stopped (manager);
 
     return TRUE;
 }
 
+static gboolean
+_shutdown_deadline_cb (gpointer user_data)
+{
+    TlmManager *manager = TLM_MANAGER (user_data);
+    GHashTableIter iter;
+    gpointer key;
+
+    manager->priv->shutdown_timer_id = 0;
+    g_hash_table_iter_init (&iter, manager->priv->seats);
+    while (g_hash_table_iter_next (&iter, &key, NULL)) {
+        WARN ("seat '%s' did not stop within the shutdown budget",
+              (const gchar *) key);
+    }
+    _signal_stopped (manager);
+
+    return G_SOURCE_REMOVE;
+}
+
 gboolean
 tlm_manager_stop (TlmManager *manager)
 {
@@ -801,8 +1119,20 @@ tlm_manager_stop (TlmManager *manager)
 
     GHashTableIter iter;
     gpointer key, value;
-    gboolean delayed = FALSE;
-
+    GList *idle_seats = NULL, *element = NULL;
+    guint budget;
+    gint64 deadline = 0;
+
+    budget = tlm_config_get_uint (manager->priv->config,
+                                  TLM_CONFIG_GENERAL,
+                                  TLM_CONFIG_GENERAL_SHUTDOWN_TIMEOUT,
+                                  0);
+    manager->priv->stop_time = g_get_monotonic_time ();
+    manager->priv->stopped = FALSE;
+    if (budget)
+        deadline = manager->priv->stop_time + (gint64) budget * 1000;
+
+    /* signal all sessions at once, they terminate in parallel */
     g_hash_table_iter_init (&iter, manager->priv->seats);
     while (g_hash_table_iter_next (&iter, &key, &value)) {
         DBG ("terminate seat '%s'", (const gchar *) key);
@@ -810,15 +1140,19 @@ tlm_manager_stop (TlmManager *manager)
                                   "session-terminated",
                                   G_CALLBACK (_session_terminated_cb),
                                   manager);
-        if (!tlm_seat_terminate_session ((TlmSeat *) value)) {
-            g_hash_table_remove (manager->priv->seats, key);
-            g_hash_table_iter_init (&iter, manager->priv->seats);
-        } else {
-            delayed = TRUE;
-        }
+        if (!tlm_seat_terminate_session_with_deadline ((TlmSeat *) value,
+                                                       deadline))
+            idle_seats = g_list_prepend (idle_seats, g_strdup (key));
     }
-    if (!delayed)
-        g_signal_emit (manager, signals[SIG_MANAGER_STOPPED], 0);
+    for (element = idle_seats; element; element = element->next)
+        g_hash_table_remove (manager->priv->seats, element->data);
+    g_list_free_full (idle_seats, g_free);
+
+    if (g_hash_table_size (manager->priv->seats) == 0)
+        _signal_stopped (manager);
+    else if (budget && !manager->priv->shutdown_timer_id)
+        manager->priv->shutdown_timer_id = g_timeout_add (budget,
+                _shutdown_deadline_cb, manager);
 
     manager->priv->is_started = FALSE;
 
@@ -866,13 +1200,7 @@ tlm_manager_sighup_received (TlmManager *manager)
 {
     g_return_if_fail (manager && TLM_IS_MANAGER (manager));
 
-    DBG ("sighup recvd. reload configuration and account plugin");
-    tlm_config_reload (manager->priv->config);
-    g_clear_object (&manager->priv->account_plugin);
-    _load_accounts_plugin (manager,
-                           tlm_config_get_string_default (manager->priv->config,
-                                                          TLM_CONFIG_GENERAL,
-                                                          TLM_CONFIG_GENERAL_ACCOUNTS_PLUGIN,
-                                                          "default"));
+    DBG ("sighup recvd. reload configuration");
+    _reload_config (manager);
 }
 
@@ -0,0 +1,173 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014-2015 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+/*
+ * Latency histograms of the PAM stages of all sessions started by this
+ * daemon, per PAM service. The timings are measured by tlm-sessiond and
+ * received with the pamTimings signal. Bucket n counts calls that took
+ * [2^n, 2^(n+1)) microseconds.
+ */
+
+#include "config.h"
+
+#include "common/tlm-log.h"
+#include "tlm-pam-stats.h"
+
+#define TLM_PAM_STATS_BUCKETS 32
+
+typedef struct
+{
+    guint64 count;
+    guint64 sum_usec;
+    guint64 max_usec;
+    guint64 buckets[TLM_PAM_STATS_BUCKETS];
+} TlmPamHistogram;
+
+/* service -> (stage -> TlmPamHistogram) */
+static GHashTable *pam_stats = NULL;
+
+static guint
+_bucket_for (guint64 usec)
+{
+    guint bucket = 0;
+
+    while (usec > 1 && bucket < TLM_PAM_STATS_BUCKETS - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void
+_histogram_add (TlmPamHistogram *hist, guint64 usec)
+{
+    hist->count++;
+    hist->sum_usec += usec;
+    hist->max_usec = MAX (hist->max_usec, usec);
+    hist->buckets[_bucket_for (usec)]++;
+}
+
+void
+tlm_pam_stats_add (const gchar *service, GVariant *timings)
+{
+    GHashTable *stages = NULL;
+    TlmPamHistogram *hist = NULL;
+    GVariantIter iter;
+    const gchar *stage = NULL;
+    guint64 usec = 0;
+
+    g_return_if_fail (service && timings);
+    g_return_if_fail (g_variant_is_of_type (timings,
+                                            G_VARIANT_TYPE ("a{st}")));
+
+    if (!pam_stats)
+        pam_stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                (GDestroyNotify) g_hash_table_unref);
+
+    stages = g_hash_table_lookup (pam_stats, service);
+    if (!stages) {
+        stages = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        g_free);
+        g_hash_table_insert (pam_stats, g_strdup (service), stages);
+    }
+
+    g_variant_iter_init (&iter, timings);
+    while (g_variant_iter_next (&iter, "{&st}", &stage, &usec)) {
+        DBG ("PAM service '%s' %s: %" G_GUINT64_FORMAT " us",
+             service, stage, usec);
+        hist = g_hash_table_lookup (stages, stage);
+        if (!hist) {
+            hist = g_new0 (TlmPamHistogram, 1);
+            g_hash_table_insert (stages, g_strdup (stage), hist);
+        }
+        _histogram_add (hist, usec);
+    }
+}
+
+static void
+_append_duration (GString *str, guint64 usec)
+{
+    if (usec < 1000)
+        g_string_append_printf (str, "%" G_GUINT64_FORMAT "us", usec);
+    else if (usec < 1000000)
+        g_string_append_printf (str, "%" G_GUINT64_FORMAT "ms", usec / 1000);
+    else
+        g_string_append_printf (str, "%" G_GUINT64_FORMAT "s", usec / 1000000);
+}
+
+static void
+_dump_histogram (const gchar *service, const gchar *stage,
+                 TlmPamHistogram *hist)
+{
+    GString *line = g_string_new (NULL);
+    guint i;
+
+    g_string_printf (line, "PAM '%s' %s: n=%" G_GUINT64_FORMAT " avg=",
+                     service, stage, hist->count);
+    _append_duration (line, hist->sum_usec / MAX (hist->count, 1));
+    g_string_append (line, " max=");
+    _append_duration (line, hist->max_usec);
+    g_string_append (line, " |");
+    for (i = 0; i < TLM_PAM_STATS_BUCKETS; i++) {
+        if (!hist->buckets[i])
+            continue;
+        g_string_append_c (line, ' ');
+        _append_duration (line, G_GUINT64_CONSTANT (1) << i);
+        g_string_append_printf (line, "+:%" G_GUINT64_FORMAT,
+                                hist->buckets[i]);
+    }
+    g_message ("%s", line->str);
+    g_string_free (line, TRUE);
+}
+
+void
+tlm_pam_stats_dump (void)
+{
+    GHashTableIter service_iter, stage_iter;
+    gpointer service, stages, stage, hist;
+
+    if (!pam_stats || !g_hash_table_size (pam_stats)) {
+        g_message ("no PAM timings recorded");
+        return;
+    }
+
+    g_hash_table_iter_init (&service_iter, pam_stats);
+    while (g_hash_table_iter_next (&service_iter, &service, &stages)) {
+        g_hash_table_iter_init (&stage_iter, (GHashTable *) stages);
+        while (g_hash_table_iter_next (&stage_iter, &stage, &hist))
+            _dump_histogram ((const gchar *) service, (const gchar *) stage,
+                             (TlmPamHistogram *) hist);
+    }
+}
+
+void
+tlm_pam_stats_clear (void)
+{
+    if (pam_stats) {
+        g_hash_table_unref (pam_stats);
+        pam_stats = NULL;
+    }
+}
@@ -32,7 +32,7 @@
 #include "config.h"
 
 #include "tlm-seat.h"
-#include "tlm-session-remote.h"
+#include "tlm-session-backend.h"
 #include "tlm-log.h"
 #include "tlm-error.h"
 #include "tlm-utils.h"
@@ -75,8 +75,15 @@ struct _TlmSeatPrivate
     GHashTable *next_environment;
     gint64 prev_time;
     gint32 prev_count;
+    gint64 login_start;
+    gint64 login_latency;
     gboolean default_active;
-    TlmSessionRemote *session;
+    gboolean default_user_stale; /* DEFAULT_USER changed while in use */
+    gint termination_signal;
+    TlmSessionBackend *session;
+    GList *draining; /* DrainingSession*, ended sessions still cleaning up */
+    struct _DelayClosure *deferred; /* login waiting for a draining session */
+    GCancellable *prefetch; /* page cache warming of the starting session */
     TlmDbusObserver *dbus_observer; /* dbus server accessed only by user who has
     active session */
     TlmDbusObserver *prev_dbus_observer;
@@ -91,6 +98,20 @@ typedef struct _DelayClosure
     GHashTable *environment;
 } DelayClosure;
 
+typedef struct _DrainingSession
+{
+    TlmSeat *seat;
+    TlmSessionBackend *session;
+    gchar *username;
+} DrainingSession;
+
+static gboolean
+_create_session (TlmSeat *seat,
+                 const gchar *service,
+                 const gchar *username,
+                 const gchar *password,
+                 GHashTable *environment);
+
 static void
 _disconnect_session_signals (
         TlmSeat *seat);
@@ -117,19 +138,136 @@ _handle_session_created (
 
     DBG ("sessionid: %s", sessionid);
 
+    self->priv->login_latency =
+        g_get_monotonic_time () - self->priv->login_start;
+    DBG ("seat %s: session usable %" G_GINT64_FORMAT " us after login",
+         self->priv->id, self->priv->login_latency);
+
     g_signal_emit (self, signals[SIG_SESSION_CREATED], 0, self->priv->id);
 
     g_clear_object (&self->priv->prev_dbus_observer);
 }
 
+static DelayClosure *
+_delay_closure_new (TlmSeat *seat,
+                    const gchar *service,
+                    const gchar *username,
+                    const gchar *password,
+                    GHashTable *environment)
+{
+    DelayClosure *closure = g_slice_new0 (DelayClosure);
+
+    closure->seat = g_object_ref (seat);
+    closure->service = g_strdup (service);
+    closure->username = g_strdup (username);
+    closure->password = g_strdup (password);
+    if (environment)
+        closure->environment = g_hash_table_ref (environment);
+    return closure;
+}
+
+static void
+_delay_closure_free (DelayClosure *closure)
+{
+    g_object_unref (closure->seat);
+    g_free (closure->service);
+    g_free (closure->username);
+    g_free (closure->password);
+    if (closure->environment)
+        g_hash_table_unref (closure->environment);
+    g_slice_free (DelayClosure, closure);
+}
+
+static void
+_draining_session_free (DrainingSession *draining)
+{
+    g_signal_handlers_disconnect_matched (draining->session,
+            G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, draining);
+    g_object_unref (draining->session);
+    g_free (draining->username);
+    g_slice_free (DrainingSession, draining);
+}
+
+static gboolean
+_is_user_draining (TlmSeatPrivate *priv, const gchar *username)
+{
+    GList *l;
+
+    for (l = priv->draining; l; l = l->next) {
+        if (g_strcmp0 (((DrainingSession *) l->data)->username, username) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+_on_session_drained (
+        TlmSessionBackend *session,
+        gpointer user_data)
+{
+    DrainingSession *draining = (DrainingSession *) user_data;
+    TlmSeat *seat = draining->seat;
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    DelayClosure *deferred = priv->deferred;
+
+    DBG ("session of '%s' on seat %s finished cleaning up",
+         draining->username, priv->id);
+    priv->draining = g_list_remove (priv->draining, draining);
+    _draining_session_free (draining);
+
+    if (!deferred || _is_user_draining (priv, deferred->username))
+        return;
+    priv->deferred = NULL;
+    /* the relogin throttling already let this one through, only the
+     * existing session check of tlm_seat_create_session() is left */
+    if (priv->session != NULL) {
+        WARN ("Session already exists on this seat(%s), dropping deferred "
+              "login of '%s'", priv->id, deferred->username);
+        g_signal_emit (seat, signals[SIG_SESSION_ERROR], 0,
+                TLM_ERROR_SESSION_ALREADY_EXISTS);
+    } else {
+        DBG ("starting deferred login of '%s'", deferred->username);
+        _create_session (seat, deferred->service, deferred->username,
+                         deferred->password, deferred->environment);
+    }
+    _delay_closure_free (deferred);
+}
+
+/*
+ * The session has ended but its backend may still be closing PAM and
+ * removing leftovers, keep it until it is done without holding up the seat
+ */
+static void
+_drain_session (TlmSeat *self, TlmSessionBackend *session)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (self);
+    DrainingSession *draining = NULL;
+
+    if (!tlm_session_backend_drain (session)) {
+        g_object_unref (session);
+        return;
+    }
+
+    draining = g_slice_new0 (DrainingSession);
+    draining->seat = self;
+    draining->session = session;
+    g_object_get (G_OBJECT (session), "username", &draining->username, NULL);
+    g_signal_connect (session, "drained",
+            G_CALLBACK (_on_session_drained), draining);
+    priv->draining = g_list_prepend (priv->draining, draining);
+}
+
 static void
 _close_active_session (TlmSeat *self)
 {
     TlmSeatPrivate *priv = TLM_SEAT_PRIV (self);
+    TlmSessionBackend *session = priv->session;
+
     _disconnect_session_signals (self);
-    if (priv->session) {
-        DBG("Clear session_remote object");
-        g_clear_object (&priv->session);
+    if (session) {
+        DBG("Clear session object");
+        priv->session = NULL;
+        _drain_session (self, session);
     }
 }
 
@@ -142,10 +280,14 @@ _handle_session_terminated (
 
     TlmSeat *seat = TLM_SEAT(self);
     TlmSeatPrivate *priv = TLM_SEAT_PRIV(seat);
+    const TlmSeatConfig *seat_config = NULL;
     gboolean stop = FALSE;
 
     DBG ("seat %p session %p", self, priv->session);
 
+    if (priv->session)
+        priv->termination_signal =
+            tlm_session_backend_get_termination_signal (priv->session);
     _close_active_session (seat);
 
     // NOTE: This "session-terminated" signal to seat object is caught by
@@ -162,11 +304,10 @@ _handle_session_terminated (
 
     g_clear_object (&priv->dbus_observer);
 
+    seat_config = tlm_config_get_seat_config (priv->config, priv->id);
+
     // If X11 session is used, kill self
-    if (tlm_config_get_boolean (priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_X11_SESSION,
-                                FALSE)) {
+    if (seat_config->x11_session) {
         DBG ("X11 session termination");
         if (kill (0, SIGTERM))
             WARN ("Failed to send TERM signal to process tree");
@@ -174,11 +315,7 @@ _handle_session_terminated (
     }
 
     // Auto re-login, if the auto-login option is set
-    if (tlm_config_get_boolean (priv->config,
-                                TLM_CONFIG_GENERAL,
-                                TLM_CONFIG_GENERAL_AUTO_LOGIN,
-                                TRUE) ||
-                                seat->priv->next_user) {
+    if (seat_config->auto_login || seat->priv->next_user) {
         DBG ("auto re-login with '%s'", seat->priv->next_user);
 
         tlm_seat_create_session (seat,
@@ -203,6 +340,7 @@ _handle_error (
 
     if (error->code == TLM_ERROR_PAM_AUTH_FAILURE ||
         error->code == TLM_ERROR_SESSION_CREATION_FAILURE ||
+        error->code == TLM_ERROR_SESSION_EXEC_FAILURE ||
         error->code == TLM_ERROR_SESSION_TERMINATION_FAILURE) {
         DBG ("Destroy the session in case of creation/termination failure");
         _close_active_session (self);
@@ -241,6 +379,17 @@ _connect_session_signals (
             G_CALLBACK(_handle_error), seat);
 }
 
+static const gchar *
+_get_dbus_socket_path ()
+{
+#   ifdef ENABLE_DEBUG
+    const gchar *path = g_getenv ("TLM_DBUS_SOCKET_PATH");
+    if (path)
+        return path;
+#   endif
+    return TLM_DBUS_SOCKET_PATH;
+}
+
 static gboolean
 _create_dbus_observer (
         TlmSeat *seat,
@@ -254,7 +403,7 @@ _create_dbus_observer (
     uid = tlm_user_get_uid (username);
     if (uid == -1) return FALSE;
 
-    address = g_strdup_printf ("unix:path=%s/%s-%d", TLM_DBUS_SOCKET_PATH,
+    address = g_strdup_printf ("unix:path=%s/%s-%d", _get_dbus_socket_path (),
             seat->priv->id, uid);
     seat->priv->dbus_observer = TLM_DBUS_OBSERVER (tlm_dbus_observer_new (
             NULL, seat, address, uid,
@@ -278,6 +427,17 @@ tlm_seat_dispose (GObject *self)
     _disconnect_session_signals (seat);
     if (seat->priv->session)
         g_clear_object (&seat->priv->session);
+    if (seat->priv->deferred) {
+        _delay_closure_free (seat->priv->deferred);
+        seat->priv->deferred = NULL;
+    }
+    g_list_free_full (seat->priv->draining,
+            (GDestroyNotify) _draining_session_free);
+    seat->priv->draining = NULL;
+    if (seat->priv->prefetch) {
+        g_cancellable_cancel (seat->priv->prefetch);
+        g_clear_object (&seat->priv->prefetch);
+    }
     if (seat->priv->config) {
         g_object_unref (seat->priv->config);
         seat->priv->config = NULL;
@@ -455,15 +615,40 @@ tlm_seat_get_id (TlmSeat *seat)
     return (const gchar*) seat->priv->id;
 }
 
+void
+tlm_seat_config_changed (TlmSeat *seat)
+{
+    g_return_if_fail (seat && TLM_IS_SEAT (seat));
+
+    /* the rest is looked up again by the next session, the running one
+     * keeps what it was started with */
+    seat->priv->default_user_stale = TRUE;
+}
+
+gint64
+tlm_seat_get_login_latency (TlmSeat *seat)
+{
+    g_return_val_if_fail (seat && TLM_IS_SEAT (seat), 0);
+
+    return seat->priv->login_latency;
+}
+
+gint
+tlm_seat_get_termination_signal (TlmSeat *seat)
+{
+    g_return_val_if_fail (seat && TLM_IS_SEAT (seat), 0);
+
+    return seat->priv->termination_signal;
+}
+
 gchar *
 tlm_seat_get_occupying_username (TlmSeat *seat) {
     TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
     if (!priv->session) return NULL;
 
-    TlmSessionRemote *sr = priv->session;
     gchar *username = NULL;
 
-    g_object_get(G_OBJECT(sr), "username", &username, NULL);
+    g_object_get(G_OBJECT(priv->session), "username", &username, NULL);
 
     return username;
 }
@@ -482,7 +667,8 @@ tlm_seat_switch_user (TlmSeat *seat,
 
     // If username & its password is not authenticated, immediately return FALSE
     // so that current session is not terminated.
-    if (!tlm_authenticate_user (priv->config, username, password)) {
+    if (!tlm_session_backend_authenticate_user (priv->config, username,
+                password)) {
         WARN("fail to tlm_authenticate_user");
         return FALSE;
     }
@@ -556,16 +742,76 @@ _delayed_session (gpointer user_data)
                              delay_closure->username,
                              delay_closure->password,
                              delay_closure->environment);
-    g_object_unref (delay_closure->seat);
-    g_free (delay_closure->service);
-    g_free (delay_closure->username);
-    g_free (delay_closure->password);
-    if (delay_closure->environment)
-        g_hash_table_unref (delay_closure->environment);
-    g_slice_free (DelayClosure, delay_closure);
+    _delay_closure_free (delay_closure);
     return G_SOURCE_REMOVE;
 }
 
+static void
+_on_prefetch_done (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    GError *error = NULL;
+    gint count = tlm_utils_prefetch_files_finish (result, &error);
+
+    if (error) {
+        DBG ("prefetch stopped: %s", error->message);
+        g_error_free (error);
+        return;
+    }
+    DBG ("prefetched %d session files", count);
+}
+
+/*
+ * Warms the page cache with what the session is going to run while
+ * sessiond starts up and authenticates
+ */
+static void
+_prefetch_session_files (TlmSeat *seat, GHashTable *environment)
+{
+    TlmSeatPrivate *priv = seat->priv;
+    const TlmSeatConfig *seat_config =
+            tlm_config_get_seat_config (priv->config, priv->id);
+    const gchar *files = seat_config->prefetch_files;
+    const gchar *list_file = seat_config->prefetch_list;
+    GPtrArray *paths = NULL;
+    gchar **file_list = NULL, **file = NULL;
+    gchar **command = NULL;
+    const gchar *search_path = NULL;
+
+    if (files && !*files)
+        files = NULL;
+    if (list_file && !*list_file)
+        list_file = NULL;
+    if (!files && !list_file)
+        return;
+
+    paths = g_ptr_array_new_with_free_func (g_free);
+    /* resolved the way sessiond does, a PATH given with the login request
+     * replaces the configured one in the session environment */
+    if (environment)
+        search_path = g_hash_table_lookup (environment, "PATH");
+    command = tlm_utils_get_session_command (priv->config, priv->id,
+                                             search_path, NULL);
+    if (command && command[0])
+        g_ptr_array_add (paths, g_strdup (command[0]));
+    g_strfreev (command);
+    if (files) {
+        file_list = g_strsplit (files, ";", -1);
+        for (file = file_list; *file; file++)
+            g_ptr_array_add (paths, g_strdup (*file));
+        g_strfreev (file_list);
+    }
+    g_ptr_array_add (paths, NULL);
+
+    if (priv->prefetch) {
+        g_cancellable_cancel (priv->prefetch);
+        g_object_unref (priv->prefetch);
+    }
+    priv->prefetch = g_cancellable_new ();
+    tlm_utils_prefetch_files_async ((const gchar * const *) paths->pdata,
+            list_file, priv->prefetch, _on_prefetch_done, NULL);
+    g_ptr_array_free (paths, TRUE);
+}
+
 gboolean
 tlm_seat_create_session (TlmSeat *seat,
                          const gchar *service,
@@ -592,17 +838,8 @@ tlm_seat_create_session (TlmSeat *seat,
         priv->prev_count++;
         if (priv->prev_count > 3) {
             WARN ("relogins spinning too fast, delay...");
-            DelayClosure *delay_closure = g_slice_new0 (DelayClosure);
-            if (!delay_closure) {
-              CRITICAL("g_slice_new0 memory allication failure");
-              return FALSE;
-            }
-            delay_closure->seat = g_object_ref (seat);
-            delay_closure->service = g_strdup (service);
-            delay_closure->username = g_strdup (username);
-            delay_closure->password = g_strdup (password);
-            if (environment)
-                delay_closure->environment = g_hash_table_ref (environment);
+            DelayClosure *delay_closure = _delay_closure_new (seat, service,
+                    username, password, environment);
             g_timeout_add_seconds (10, _delayed_session, delay_closure);
             return TRUE;
         }
@@ -611,38 +848,42 @@ tlm_seat_create_session (TlmSeat *seat,
         priv->prev_count = 1;
     }
 
+    return _create_session (seat, service, username, password, environment);
+}
+
+static gboolean
+_create_session (TlmSeat *seat,
+                 const gchar *service,
+                 const gchar *username,
+                 const gchar *password,
+                 GHashTable *environment)
+{
+    TlmSeatPrivate *priv = TLM_SEAT_PRIV (seat);
+    const TlmSeatConfig *seat_config =
+            tlm_config_get_seat_config (priv->config, priv->id);
+    const gchar *login_user = NULL;
+    gchar *pam_service = NULL;
+
     // Check for function arguments
     // service: if NULL, get default service
+    // (copied, the seat configuration may be reloaded by signal handlers)
     if (!service) {
         DBG ("PAM service not defined, looking up configuration");
-        service = tlm_config_get_string (priv->config,
-                                         priv->id,
-                                         username ? TLM_CONFIG_GENERAL_PAM_SERVICE : TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE);
-        if (!service)
-            service = tlm_config_get_string (priv->config,
-                                             TLM_CONFIG_GENERAL,
-                                             username ? TLM_CONFIG_GENERAL_PAM_SERVICE : TLM_CONFIG_GENERAL_DEFAULT_PAM_SERVICE);
-        if (!service)
-            service = username ? "tlm-login" : "tlm-default-login";
+        service = username ? seat_config->pam_service :
+                             seat_config->default_pam_service;
     }
-    DBG ("using PAM service %s for seat %s", service, priv->id);
+    pam_service = g_strdup (service);
+    DBG ("using PAM service %s for seat %s", pam_service, priv->id);
 
     // username: if NULL, get default user
     if (!username) {
-        if (!priv->default_user) {
-            const gchar *name_tmpl =
-                    tlm_config_get_string_default (priv->config,
-                            priv->id,
-                            TLM_CONFIG_GENERAL_DEFAULT_USER,
-                            "guest");
-            if (!name_tmpl)
-                name_tmpl = tlm_config_get_string_default (priv->config,
-                        TLM_CONFIG_GENERAL,
-                        TLM_CONFIG_GENERAL_DEFAULT_USER,
-                        "guest");
-            if (name_tmpl)
-                priv->default_user = _build_user_name (name_tmpl, priv->id);
+        if (priv->default_user_stale && !priv->default_active) {
+            g_clear_string (&priv->default_user);
+            priv->default_user_stale = FALSE;
         }
+        if (!priv->default_user)
+            priv->default_user = _build_user_name (seat_config->default_user,
+                                                   priv->id);
         if (priv->default_user) {
             priv->default_active = TRUE;
             g_signal_emit (seat,
@@ -652,11 +893,28 @@ tlm_seat_create_session (TlmSeat *seat,
         }
     }
 
-    // Create a session_remote object (It creates actual remote session process)
-    priv->session = tlm_session_remote_new (priv->config,
+    // The previous session of the same user still holds resources that
+    // the new one sets up again (runtime dir, PAM session), wait for it
+    login_user = priv->default_active ? priv->default_user : username;
+    if (_is_user_draining (priv, login_user)) {
+        DBG ("previous session of '%s' is still closing, deferring login",
+             login_user);
+        if (priv->deferred)
+            _delay_closure_free (priv->deferred);
+        priv->deferred = _delay_closure_new (seat, pam_service, login_user,
+                password, environment);
+        g_free (pam_service);
+        return TRUE;
+    }
+
+    // Create a session object (the default backend spawns a remote session
+    // process)
+    priv->termination_signal = 0;
+    priv->session = tlm_session_backend_new (priv->config,
             priv->id,
-            service,
-            priv->default_active ? priv->default_user : username);
+            pam_service,
+            login_user);
+    g_free (pam_service);
     if (!priv->session) {
 
         g_signal_emit (seat, signals[SIG_SESSION_ERROR], 0,
@@ -669,10 +927,9 @@ tlm_seat_create_session (TlmSeat *seat,
     // TODO: process this prev_dbus_observer somewhere!
     seat->priv->prev_dbus_observer = seat->priv->dbus_observer;
     seat->priv->dbus_observer = NULL;
-    if (!_create_dbus_observer (seat,
-            priv->default_active ? priv->default_user : username)) {
+    if (!_create_dbus_observer (seat, login_user)) {
         if (priv->session) {
-            DBG("Clear session_remote object");
+            DBG("Clear session object");
             g_clear_object (&priv->session);
         }
         g_signal_emit (seat, signals[SIG_SESSION_ERROR],  0,
@@ -681,12 +938,20 @@ tlm_seat_create_session (TlmSeat *seat,
     }
 
     _connect_session_signals (seat);
-    tlm_session_remote_create (priv->session, password, environment);
+    priv->login_start = g_get_monotonic_time ();
+    _prefetch_session_files (seat, environment);
+    tlm_session_backend_create (priv->session, password, environment);
     return TRUE;
 }
 
 gboolean
 tlm_seat_terminate_session (TlmSeat *seat)
+{
+    return tlm_seat_terminate_session_with_deadline (seat, 0);
+}
+
+gboolean
+tlm_seat_terminate_session_with_deadline (TlmSeat *seat, gint64 deadline)
 {
     g_return_val_if_fail (seat && TLM_IS_SEAT(seat), FALSE);
     g_return_val_if_fail (seat->priv, FALSE);
@@ -700,7 +965,7 @@ tlm_seat_terminate_session (TlmSeat *seat)
     }
 
     if (!seat->priv->session ||
-        !tlm_session_remote_terminate (seat->priv->session)) {
+        !tlm_session_backend_terminate (seat->priv->session, deadline)) {
         WARN ("No active session to terminate");
         g_signal_emit (seat, signals[SIG_SESSION_ERROR], 0,
                 TLM_ERROR_SESSION_NOT_VALID);
@@ -719,6 +984,17 @@ tlm_seat_new (TlmConfig *config,
                          "id", id,
                          "path", path,
                          NULL);
+    GError *error = NULL;
+    gchar **args = NULL;
+
+    /* catch a broken session command when the configuration is loaded
+     * rather than at each login */
+    args = tlm_utils_get_session_command (config, id, NULL, &error);
+    if (error) {
+        WARN ("seat %s: %s", id, error->message);
+        g_error_free (error);
+    }
+    g_strfreev (args);
     return seat;
 }
 
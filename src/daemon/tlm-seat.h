@@ -67,6 +67,25 @@ tlm_seat_new (TlmConfig *config,
 const gchar *
 tlm_seat_get_id (TlmSeat *seat);
 
+/** Tell the seat that its configuration has changed, the new one is used
+ * from the next session on
+ */
+void
+tlm_seat_config_changed (TlmSeat *seat);
+
+/** Get the time from the last login request to its session being created,
+ * which includes waiting for the session readiness condition
+ * @return  Latency in microseconds, 0 before the first session
+ */
+gint64
+tlm_seat_get_login_latency (TlmSeat *seat);
+
+/** Get the last signal sent to the session that terminated last
+ * @return  0 if the session terminated without being signalled
+ */
+gint
+tlm_seat_get_termination_signal (TlmSeat *seat);
+
 /** Get the username who occupies the seat
  * @return  The name of the user who holds the seat (to be freed)
  * @return  NULL if nobody occupies the seat
@@ -91,6 +110,9 @@ tlm_seat_create_session (TlmSeat *seat,
 gboolean
 tlm_seat_terminate_session (TlmSeat *seat);
 
+gboolean
+tlm_seat_terminate_session_with_deadline (TlmSeat *seat, gint64 deadline);
+
 G_END_DECLS
 
 #endif /* _TLM_SEAT_H */
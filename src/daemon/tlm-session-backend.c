@@ -0,0 +1,223 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014-2015 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "config.h"
+
+#include "common/tlm-log.h"
+#include "common/tlm-config-general.h"
+#include "common/tlm-utils.h"
+#include "tlm-session-backend.h"
+#include "tlm-session-remote.h"
+#include "tlm-session-fake.h"
+
+G_DEFINE_INTERFACE (TlmSessionBackend, tlm_session_backend, 0);
+
+enum {
+    SIG_SESSION_CREATED,
+    SIG_SESSION_TERMINATED,
+    SIG_AUTHENTICATED,
+    SIG_SESSION_ERROR,
+    SIG_DRAINED,
+    SIG_MAX
+};
+
+static guint signals[SIG_MAX];
+
+static void
+tlm_session_backend_default_init (
+        TlmSessionBackendInterface *g_class)
+{
+    g_object_interface_install_property (g_class, g_param_spec_string (
+            "username",
+            "Username",
+            "Username",
+            "" /* default value */,
+            G_PARAM_READWRITE |
+            G_PARAM_STATIC_STRINGS));
+
+    signals[SIG_SESSION_CREATED] = g_signal_new ("session-created",
+                                G_TYPE_FROM_CLASS (g_class), G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL, G_TYPE_NONE,
+                                1, G_TYPE_STRING);
+
+    signals[SIG_SESSION_TERMINATED] = g_signal_new ("session-terminated",
+                                G_TYPE_FROM_CLASS (g_class), G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL, G_TYPE_NONE,
+                                0, G_TYPE_NONE);
+
+    signals[SIG_AUTHENTICATED] = g_signal_new ("authenticated",
+                                G_TYPE_FROM_CLASS (g_class), G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL, G_TYPE_NONE,
+                                0, G_TYPE_NONE);
+
+    signals[SIG_SESSION_ERROR] = g_signal_new ("session-error",
+                                G_TYPE_FROM_CLASS (g_class), G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL, G_TYPE_NONE,
+                                1, G_TYPE_ERROR);
+
+    signals[SIG_DRAINED] = g_signal_new ("drained",
+                                G_TYPE_FROM_CLASS (g_class), G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL, G_TYPE_NONE,
+                                0, G_TYPE_NONE);
+}
+
+TlmSessionBackend *
+tlm_session_backend_new (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username)
+{
+    const gchar *backend = tlm_config_get_string (config,
+                                                  TLM_CONFIG_GENERAL,
+                                                  TLM_CONFIG_GENERAL_SESSION_BACKEND);
+
+#   ifdef ENABLE_DEBUG
+    if (g_strcmp0 (backend, "fake") == 0) {
+        DBG ("using fake session backend for seat %s", seat_id);
+        return TLM_SESSION_BACKEND (tlm_session_fake_new (config, seat_id,
+                service, username));
+    }
+#   endif
+
+    if (g_strcmp0 (backend, "lite") == 0) {
+        DBG ("using tlm-sessiond-lite for seat %s", seat_id);
+        return TLM_SESSION_BACKEND (tlm_session_remote_new_lite (config,
+                seat_id, service, username));
+    }
+
+    return TLM_SESSION_BACKEND (tlm_session_remote_new (config, seat_id,
+            service, username));
+}
+
+/*
+ * Checks the credentials of a user switch the way the configured backend
+ * would authenticate the session
+ */
+gboolean
+tlm_session_backend_authenticate_user (
+        TlmConfig *config,
+        const gchar *username,
+        const gchar *password)
+{
+#   ifdef ENABLE_DEBUG
+    const gchar *backend = tlm_config_get_string (config,
+                                                  TLM_CONFIG_GENERAL,
+                                                  TLM_CONFIG_GENERAL_SESSION_BACKEND);
+
+    if (g_strcmp0 (backend, "fake") == 0)
+        return tlm_session_fake_authenticate_user (config, username,
+                password);
+#   endif
+
+    return tlm_authenticate_user (config, username, password);
+}
+
+void
+tlm_session_backend_create (
+        TlmSessionBackend *self,
+        const gchar *password,
+        GHashTable *environment)
+{
+    g_return_if_fail (TLM_IS_SESSION_BACKEND (self));
+
+    TLM_SESSION_BACKEND_GET_INTERFACE (self)->create (self, password,
+            environment);
+}
+
+gboolean
+tlm_session_backend_terminate (
+        TlmSessionBackend *self,
+        gint64 deadline)
+{
+    g_return_val_if_fail (TLM_IS_SESSION_BACKEND (self), FALSE);
+
+    return TLM_SESSION_BACKEND_GET_INTERFACE (self)->terminate (self,
+            deadline);
+}
+
+gint
+tlm_session_backend_get_termination_signal (
+        TlmSessionBackend *self)
+{
+    g_return_val_if_fail (TLM_IS_SESSION_BACKEND (self), 0);
+
+    return TLM_SESSION_BACKEND_GET_INTERFACE (self)->get_termination_signal (
+            self);
+}
+
+/*
+ * Lets the backend finish the cleanup of a session it reported terminated.
+ * Returns FALSE if nothing is left to do, otherwise "drained" is emitted once
+ * the cleanup is over or was given up.
+ */
+gboolean
+tlm_session_backend_drain (
+        TlmSessionBackend *self)
+{
+    g_return_val_if_fail (TLM_IS_SESSION_BACKEND (self), FALSE);
+
+    if (!TLM_SESSION_BACKEND_GET_INTERFACE (self)->drain)
+        return FALSE;
+    return TLM_SESSION_BACKEND_GET_INTERFACE (self)->drain (self);
+}
+
+void
+tlm_session_backend_emit_session_created (
+        TlmSessionBackend *self,
+        const gchar *sessionid)
+{
+    g_signal_emit (self, signals[SIG_SESSION_CREATED], 0, sessionid);
+}
+
+void
+tlm_session_backend_emit_session_terminated (
+        TlmSessionBackend *self)
+{
+    g_signal_emit (self, signals[SIG_SESSION_TERMINATED], 0);
+}
+
+void
+tlm_session_backend_emit_authenticated (
+        TlmSessionBackend *self)
+{
+    g_signal_emit (self, signals[SIG_AUTHENTICATED], 0);
+}
+
+void
+tlm_session_backend_emit_drained (
+        TlmSessionBackend *self)
+{
+    g_signal_emit (self, signals[SIG_DRAINED], 0);
+}
+
+void
+tlm_session_backend_emit_session_error (
+        TlmSessionBackend *self,
+        GError *error)
+{
+    g_signal_emit (self, signals[SIG_SESSION_ERROR], 0, error);
+}
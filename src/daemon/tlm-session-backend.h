@@ -0,0 +1,132 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014-2015 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef __TLM_SESSION_BACKEND_H_
+#define __TLM_SESSION_BACKEND_H_
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "common/tlm-config.h"
+
+G_BEGIN_DECLS
+
+#define TLM_TYPE_SESSION_BACKEND    (tlm_session_backend_get_type ())
+#define TLM_SESSION_BACKEND(obj)    (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+        TLM_TYPE_SESSION_BACKEND, TlmSessionBackend))
+#define TLM_IS_SESSION_BACKEND(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+        TLM_TYPE_SESSION_BACKEND))
+#define TLM_SESSION_BACKEND_GET_INTERFACE(inst) \
+        (G_TYPE_INSTANCE_GET_INTERFACE ((inst), TLM_TYPE_SESSION_BACKEND, \
+        TlmSessionBackendInterface))
+
+typedef struct _TlmSessionBackend TlmSessionBackend; /* dummy object */
+typedef struct _TlmSessionBackendInterface TlmSessionBackendInterface;
+
+struct _TlmSessionBackendInterface {
+
+    GTypeInterface parent;
+
+    void
+    (*create) (
+            TlmSessionBackend *self,
+            const gchar *password,
+            GHashTable *environment);
+
+    gboolean
+    (*terminate) (
+            TlmSessionBackend *self,
+            gint64 deadline);
+
+    gint
+    (*get_termination_signal) (
+            TlmSessionBackend *self);
+
+    gboolean
+    (*drain) (
+            TlmSessionBackend *self);
+};
+
+GType
+tlm_session_backend_get_type ();
+
+TlmSessionBackend *
+tlm_session_backend_new (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username);
+
+gboolean
+tlm_session_backend_authenticate_user (
+        TlmConfig *config,
+        const gchar *username,
+        const gchar *password);
+
+void
+tlm_session_backend_create (
+        TlmSessionBackend *self,
+        const gchar *password,
+        GHashTable *environment);
+
+gboolean
+tlm_session_backend_terminate (
+        TlmSessionBackend *self,
+        gint64 deadline);
+
+gint
+tlm_session_backend_get_termination_signal (
+        TlmSessionBackend *self);
+
+gboolean
+tlm_session_backend_drain (
+        TlmSessionBackend *self);
+
+void
+tlm_session_backend_emit_session_created (
+        TlmSessionBackend *self,
+        const gchar *sessionid);
+
+void
+tlm_session_backend_emit_session_terminated (
+        TlmSessionBackend *self);
+
+void
+tlm_session_backend_emit_authenticated (
+        TlmSessionBackend *self);
+
+void
+tlm_session_backend_emit_drained (
+        TlmSessionBackend *self);
+
+void
+tlm_session_backend_emit_session_error (
+        TlmSessionBackend *self,
+        GError *error);
+
+G_END_DECLS
+
+#endif /* __TLM_SESSION_BACKEND_H_ */
@@ -0,0 +1,448 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014-2015 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "config.h"
+
+#include <signal.h>
+
+#include "common/tlm-log.h"
+#include "common/tlm-error.h"
+#include "tlm-session-fake.h"
+
+enum
+{
+    PROP_0,
+    PROP_CONFIG,
+    PROP_SEATID,
+    PROP_SERVICE,
+    PROP_SESSIONID,
+    N_PROPERTIES,
+
+    IFACE_PROP_USERNAME = N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+struct _TlmSessionFakePrivate
+{
+    TlmConfig *config;
+    gchar *seat_id;
+    gchar *service;
+    gchar *username;
+    gchar *sessionid;
+    gboolean is_up;
+    gint last_sig;
+    gint64 deadline;
+    guint create_timer_id;
+    guint terminate_timer_id;
+    guint exit_timer_id;
+    guint drain_timer_id;
+};
+
+static void
+_tlm_session_fake_backend_init (
+        TlmSessionBackendInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TlmSessionFake, tlm_session_fake, G_TYPE_OBJECT,
+        G_IMPLEMENT_INTERFACE (TLM_TYPE_SESSION_BACKEND,
+                _tlm_session_fake_backend_init));
+
+#define TLM_SESSION_FAKE_PRIV(obj) \
+    (G_TYPE_INSTANCE_GET_PRIVATE ((obj), TLM_TYPE_SESSION_FAKE, \
+            TlmSessionFakePrivate))
+
+static guint sessions_created = 0;
+
+static guint
+_get_delay (
+        TlmSessionFakePrivate *priv,
+        const gchar *key)
+{
+    return tlm_config_get_uint (priv->config, TLM_CONFIG_FAKE_SESSION, key, 0);
+}
+
+static gboolean
+_is_failing_user (TlmSessionFakePrivate *priv)
+{
+    const gchar *users = tlm_config_get_string (priv->config,
+            TLM_CONFIG_FAKE_SESSION, TLM_CONFIG_FAKE_SESSION_FAIL_USERS);
+    gchar **list, **user;
+    gboolean found = FALSE;
+
+    if (!users || !priv->username)
+        return FALSE;
+    list = g_strsplit (users, ",", -1);
+    for (user = list; *user && !found; user++)
+        found = g_strcmp0 (g_strstrip (*user), priv->username) == 0;
+    g_strfreev (list);
+    return found;
+}
+
+static void
+_session_ended (TlmSessionFake *self)
+{
+    TlmSessionFakePrivate *priv = self->priv;
+
+    priv->is_up = FALSE;
+    if (priv->exit_timer_id) {
+        g_source_remove (priv->exit_timer_id);
+        priv->exit_timer_id = 0;
+    }
+    if (priv->terminate_timer_id) {
+        g_source_remove (priv->terminate_timer_id);
+        priv->terminate_timer_id = 0;
+    }
+    tlm_session_backend_emit_session_terminated (TLM_SESSION_BACKEND (self));
+}
+
+static gboolean
+_on_exit_timeout (gpointer user_data)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (user_data);
+
+    DBG ("fake session %s exited", self->priv->sessionid);
+    self->priv->exit_timer_id = 0;
+    _session_ended (self);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_on_terminate_timeout (gpointer user_data)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (user_data);
+
+    DBG ("fake session %s terminated", self->priv->sessionid);
+    self->priv->terminate_timer_id = 0;
+    _session_ended (self);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_on_create_timeout (gpointer user_data)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (user_data);
+    TlmSessionFakePrivate *priv = self->priv;
+    guint exit_after;
+
+    priv->create_timer_id = 0;
+
+    if (_is_failing_user (priv)) {
+        GError *error = TLM_GET_ERROR_FOR_ID (
+                tlm_config_get_uint (priv->config, TLM_CONFIG_FAKE_SESSION,
+                        TLM_CONFIG_FAKE_SESSION_FAIL_ERROR,
+                        TLM_ERROR_SESSION_CREATION_FAILURE),
+                "Fake session creation failure");
+        DBG ("failing fake session for '%s'", priv->username);
+        tlm_session_backend_emit_session_error (TLM_SESSION_BACKEND (self),
+                error);
+        g_error_free (error);
+        return G_SOURCE_REMOVE;
+    }
+
+    priv->sessionid = g_strdup_printf ("fake%u", ++sessions_created);
+    priv->is_up = TRUE;
+    DBG ("fake session %s created for '%s'", priv->sessionid, priv->username);
+
+    exit_after = _get_delay (priv, TLM_CONFIG_FAKE_SESSION_EXIT_AFTER);
+    if (exit_after)
+        priv->exit_timer_id = g_timeout_add (exit_after, _on_exit_timeout,
+                self);
+
+    tlm_session_backend_emit_authenticated (TLM_SESSION_BACKEND (self));
+    tlm_session_backend_emit_session_created (TLM_SESSION_BACKEND (self),
+            priv->sessionid);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+tlm_session_fake_set_property (
+        GObject *object,
+        guint property_id,
+        const GValue *value,
+        GParamSpec *pspec)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (object);
+
+    switch (property_id) {
+        case PROP_CONFIG:
+            self->priv->config = g_value_dup_object (value);
+            break;
+        case PROP_SEATID:
+            g_free (self->priv->seat_id);
+            self->priv->seat_id = g_value_dup_string (value);
+            break;
+        case PROP_SERVICE:
+            g_free (self->priv->service);
+            self->priv->service = g_value_dup_string (value);
+            break;
+        case IFACE_PROP_USERNAME:
+            g_free (self->priv->username);
+            self->priv->username = g_value_dup_string (value);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+tlm_session_fake_get_property (
+        GObject *object,
+        guint property_id,
+        GValue *value,
+        GParamSpec *pspec)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (object);
+
+    switch (property_id) {
+        case PROP_CONFIG:
+            g_value_set_object (value, self->priv->config);
+            break;
+        case PROP_SEATID:
+            g_value_set_string (value, self->priv->seat_id);
+            break;
+        case PROP_SERVICE:
+            g_value_set_string (value, self->priv->service);
+            break;
+        case IFACE_PROP_USERNAME:
+            g_value_set_string (value, self->priv->username);
+            break;
+        case PROP_SESSIONID:
+            g_value_set_string (value, self->priv->sessionid);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+tlm_session_fake_dispose (GObject *object)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (object);
+    TlmSessionFakePrivate *priv = self->priv;
+
+    DBG ("self %p", self);
+    if (priv->create_timer_id) {
+        g_source_remove (priv->create_timer_id);
+        priv->create_timer_id = 0;
+    }
+    if (priv->terminate_timer_id) {
+        g_source_remove (priv->terminate_timer_id);
+        priv->terminate_timer_id = 0;
+    }
+    if (priv->exit_timer_id) {
+        g_source_remove (priv->exit_timer_id);
+        priv->exit_timer_id = 0;
+    }
+    if (priv->drain_timer_id) {
+        g_source_remove (priv->drain_timer_id);
+        priv->drain_timer_id = 0;
+    }
+    g_clear_object (&priv->config);
+
+    G_OBJECT_CLASS (tlm_session_fake_parent_class)->dispose (object);
+}
+
+static void
+tlm_session_fake_finalize (GObject *object)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (object);
+
+    g_free (self->priv->seat_id);
+    g_free (self->priv->service);
+    g_free (self->priv->username);
+    g_free (self->priv->sessionid);
+
+    G_OBJECT_CLASS (tlm_session_fake_parent_class)->finalize (object);
+}
+
+static void
+tlm_session_fake_class_init (TlmSessionFakeClass *klass)
+{
+    GObjectClass* object_class = G_OBJECT_CLASS (klass);
+
+    g_type_class_add_private (object_class, sizeof (TlmSessionFakePrivate));
+
+    object_class->get_property = tlm_session_fake_get_property;
+    object_class->set_property = tlm_session_fake_set_property;
+    object_class->dispose = tlm_session_fake_dispose;
+    object_class->finalize = tlm_session_fake_finalize;
+
+    properties[PROP_CONFIG] = g_param_spec_object ("config",
+                             "config object",
+                             "Configuration object",
+                             TLM_TYPE_CONFIG,
+                             G_PARAM_READWRITE|G_PARAM_CONSTRUCT_ONLY|
+                             G_PARAM_STATIC_STRINGS);
+    properties[PROP_SEATID] = g_param_spec_string ("seatid",
+            "SeatId",
+            "Id of the seat",
+            "seat0" /* default value */,
+            G_PARAM_READWRITE |
+            G_PARAM_STATIC_STRINGS);
+    properties[PROP_SERVICE] = g_param_spec_string ("service",
+            "Service",
+            "Service",
+            "" /* default value */,
+            G_PARAM_READWRITE |
+            G_PARAM_STATIC_STRINGS);
+    properties[PROP_SESSIONID] = g_param_spec_string ("sessionid",
+            "SessionId",
+            "Id of the session",
+            "" /* default value */,
+            G_PARAM_READABLE |
+            G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+
+    g_object_class_override_property (object_class, IFACE_PROP_USERNAME,
+            "username");
+}
+
+static void
+tlm_session_fake_init (TlmSessionFake *self)
+{
+    self->priv = TLM_SESSION_FAKE_PRIV (self);
+}
+
+static void
+_backend_create (
+        TlmSessionBackend *backend,
+        const gchar *password,
+        GHashTable *environment)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (backend);
+    TlmSessionFakePrivate *priv = self->priv;
+
+    g_return_if_fail (!priv->is_up && !priv->create_timer_id);
+
+    priv->create_timer_id = g_timeout_add (
+            _get_delay (priv, TLM_CONFIG_FAKE_SESSION_CREATE_DELAY),
+            _on_create_timeout, self);
+}
+
+static gboolean
+_backend_terminate (
+        TlmSessionBackend *backend,
+        gint64 deadline)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (backend);
+    TlmSessionFakePrivate *priv = self->priv;
+    guint delay;
+
+    if (!priv->is_up) {
+        WARN ("fake session is not running");
+        return FALSE;
+    }
+
+    if (priv->terminate_timer_id && !deadline)
+        return TRUE;
+    if (deadline && (!priv->deadline || deadline < priv->deadline))
+        priv->deadline = deadline;
+
+    delay = _get_delay (priv, TLM_CONFIG_FAKE_SESSION_TERMINATE_DELAY);
+    if (priv->deadline) {
+        gint64 remaining = (priv->deadline - g_get_monotonic_time ()) / 1000;
+        delay = (guint) CLAMP (remaining, 0, (gint64) delay);
+    }
+
+    if (priv->terminate_timer_id)
+        g_source_remove (priv->terminate_timer_id);
+    priv->last_sig = SIGHUP;
+    priv->terminate_timer_id = g_timeout_add (delay, _on_terminate_timeout,
+            self);
+    return TRUE;
+}
+
+static gint
+_backend_get_termination_signal (
+        TlmSessionBackend *backend)
+{
+    return TLM_SESSION_FAKE (backend)->priv->last_sig;
+}
+
+static gboolean
+_on_drain_timeout (gpointer user_data)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (user_data);
+
+    DBG ("fake session %s drained", self->priv->sessionid);
+    self->priv->drain_timer_id = 0;
+    tlm_session_backend_emit_drained (TLM_SESSION_BACKEND (self));
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_backend_drain (
+        TlmSessionBackend *backend)
+{
+    TlmSessionFake *self = TLM_SESSION_FAKE (backend);
+    guint delay = _get_delay (self->priv, TLM_CONFIG_FAKE_SESSION_DRAIN_DELAY);
+
+    if (!delay || self->priv->drain_timer_id)
+        return self->priv->drain_timer_id != 0;
+    self->priv->drain_timer_id = g_timeout_add (delay, _on_drain_timeout,
+            self);
+    return TRUE;
+}
+
+static void
+_tlm_session_fake_backend_init (
+        TlmSessionBackendInterface *iface)
+{
+    iface->create = _backend_create;
+    iface->terminate = _backend_terminate;
+    iface->get_termination_signal = _backend_get_termination_signal;
+    iface->drain = _backend_drain;
+}
+
+TlmSessionFake *
+tlm_session_fake_new (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username)
+{
+    return g_object_new (TLM_TYPE_SESSION_FAKE,
+            "config", config,
+            "seatid", seat_id,
+            "service", service,
+            "username", username,
+            NULL);
+}
+
+/* there is no PAM behind the fake, any user with a password gets in */
+gboolean
+tlm_session_fake_authenticate_user (
+        TlmConfig *config,
+        const gchar *username,
+        const gchar *password)
+{
+    if (!username || !password) {
+        WARN ("username or password would be NULL");
+        return FALSE;
+    }
+    return TRUE;
+}
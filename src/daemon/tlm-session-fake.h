@@ -0,0 +1,100 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014-2015 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef __TLM_SESSION_FAKE_H_
+#define __TLM_SESSION_FAKE_H_
+
+#include <glib.h>
+#include "common/tlm-config.h"
+#include "tlm-session-backend.h"
+
+G_BEGIN_DECLS
+
+/* Configuration of the fake session backend */
+#define TLM_CONFIG_FAKE_SESSION                 "FakeSession"
+/* Delay in milliseconds before the session reports itself created */
+#define TLM_CONFIG_FAKE_SESSION_CREATE_DELAY    "CREATE_DELAY"
+/* Delay in milliseconds between termination request and termination */
+#define TLM_CONFIG_FAKE_SESSION_TERMINATE_DELAY "TERMINATE_DELAY"
+/* Comma separated list of users whose session creation fails */
+#define TLM_CONFIG_FAKE_SESSION_FAIL_USERS      "FAIL_USERS"
+/* TlmError code reported for failing users, defaults to creation failure */
+#define TLM_CONFIG_FAKE_SESSION_FAIL_ERROR      "FAIL_ERROR"
+/* Lifetime in milliseconds after which the session exits by itself */
+#define TLM_CONFIG_FAKE_SESSION_EXIT_AFTER      "EXIT_AFTER"
+/* Time in milliseconds the session takes to clean up after terminating */
+#define TLM_CONFIG_FAKE_SESSION_DRAIN_DELAY     "DRAIN_DELAY"
+
+#define TLM_TYPE_SESSION_FAKE (tlm_session_fake_get_type())
+#define TLM_SESSION_FAKE(obj)  (G_TYPE_CHECK_INSTANCE_CAST((obj),\
+    TLM_TYPE_SESSION_FAKE, TlmSessionFake))
+#define TLM_SESSION_FAKE_CLASS(klass)\
+    (G_TYPE_CHECK_CLASS_CAST((klass), TLM_TYPE_SESSION_FAKE, \
+    TlmSessionFakeClass))
+#define TLM_IS_SESSION_FAKE(obj)         \
+    (G_TYPE_CHECK_INSTANCE_TYPE((obj), TLM_TYPE_SESSION_FAKE))
+#define TLM_IS_SESSION_FAKE_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_TYPE((klass), TLM_TYPE_SESSION_FAKE))
+#define TLM_SESSION_FAKE_GET_CLASS(obj)  \
+    (G_TYPE_INSTANCE_GET_CLASS((obj), TLM_TYPE_SESSION_FAKE, \
+    TlmSessionFakeClass))
+
+typedef struct _TlmSessionFake TlmSessionFake;
+typedef struct _TlmSessionFakeClass TlmSessionFakeClass;
+typedef struct _TlmSessionFakePrivate TlmSessionFakePrivate;
+
+struct _TlmSessionFake
+{
+    GObject parent;
+
+    /* priv */
+    TlmSessionFakePrivate *priv;
+};
+
+struct _TlmSessionFakeClass
+{
+    GObjectClass parent_class;
+};
+
+GType
+tlm_session_fake_get_type (void) G_GNUC_CONST;
+
+TlmSessionFake *
+tlm_session_fake_new (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username);
+
+gboolean
+tlm_session_fake_authenticate_user (
+        TlmConfig *config,
+        const gchar *username,
+        const gchar *password);
+
+G_END_DECLS
+
+#endif /* __TLM_SESSION_FAKE_H_ */
@@ -27,18 +27,26 @@
 
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <glib-unix.h>
 
 #include "common/tlm-log.h"
 #include "common/tlm-error.h"
 #include "common/tlm-config.h"
 #include "common/tlm-config-general.h"
 #include "common/tlm-pipe-stream.h"
+#include "common/tlm-utils.h"
+#include "common/tlm-cgroup.h"
+#include "common/tlm-session-protocol.h"
 #include "common/dbus/tlm-dbus.h"
 #include "common/dbus/tlm-dbus-utils.h"
 #include "common/dbus/tlm-dbus-session-gen.h"
 #include "tlm-session-remote.h"
+#include "tlm-pam-stats.h"
 
 #define TLM_SESSIOND_NAME "tlm-sessiond"
+#define TLM_SESSIOND_LITE_NAME "tlm-sessiond-lite"
 
 enum
 {
@@ -46,9 +54,10 @@ enum
     PROP_CONFIG,
     PROP_SEATID,
     PROP_SERVICE,
-    PROP_USERNAME,
     PROP_SESSIONID,
-    N_PROPERTIES
+    N_PROPERTIES,
+
+    IFACE_PROP_USERNAME = N_PROPERTIES
 };
 
 static GParamSpec *properties[N_PROPERTIES];
@@ -63,29 +72,183 @@ struct _TlmSessionRemotePrivate
     gboolean is_sessiond_up;
     int last_sig;
     guint timer_id;
+    gint64 deadline;
+    gboolean terminate_requested;
     gboolean can_emit_signal;
+    gchar *cgroup;
+    guint cgroup_watch_id;
+    gboolean draining;
+
+    /* tlm-sessiond-lite, talked to over the line protocol */
+    gboolean lite;
+    gint to_sessiond_fd;
+    gint from_sessiond_fd;
+    guint input_watch_id;
+    GString *input;
+    gchar *seat_id;
+    gchar *service;
+    gchar *username;
+    gchar *sessionid;
 
     /* Signals */
     gulong signal_session_created;
     gulong signal_session_terminated;
     gulong signal_authenticated;
     gulong signal_error;
+    gulong signal_pam_timings;
 };
 
-G_DEFINE_TYPE (TlmSessionRemote, tlm_session_remote, G_TYPE_OBJECT);
+static void
+_tlm_session_remote_backend_init (
+        TlmSessionBackendInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TlmSessionRemote, tlm_session_remote, G_TYPE_OBJECT,
+        G_IMPLEMENT_INTERFACE (TLM_TYPE_SESSION_BACKEND,
+                _tlm_session_remote_backend_init));
 
 #define TLM_SESSION_REMOTE_PRIV(obj) \
     (G_TYPE_INSTANCE_GET_PRIVATE ((obj), TLM_TYPE_SESSION_REMOTE, \
             TlmSessionRemotePrivate))
-enum {
-    SIG_SESSION_CREATED,
-    SIG_SESSION_TERMINATED,
-    SIG_AUTHENTICATED,
-    SIG_SESSION_ERROR,
-    SIG_MAX
-};
 
-static guint signals[SIG_MAX];
+static gboolean
+_terminate_timeout (gpointer user_data);
+
+static guint
+_get_stage_timeout (
+        TlmSessionRemotePrivate *priv,
+        gint stages_left)
+{
+    guint timeout = tlm_utils_get_terminate_timeout (priv->config);
+    gint64 remaining;
+
+    if (!priv->deadline)
+        return timeout;
+
+    /* leave room for the stages still to come */
+    remaining = (priv->deadline - g_get_monotonic_time ()) / 1000;
+    remaining = MAX (remaining / stages_left, 0);
+    /* SIGKILL is not instant, the last stage never runs out entirely */
+    if (stages_left == 1)
+        remaining = MAX (remaining, TLM_TERMINATE_KILL_GRACE_MS);
+    return (guint) MIN ((gint64) timeout, remaining);
+}
+
+static void
+_schedule_terminate_timeout (TlmSessionRemote *self)
+{
+    TlmSessionRemotePrivate *priv = self->priv;
+    gint stages_left;
+
+    switch (priv->last_sig) {
+        case SIGHUP:
+            stages_left = 3;
+            break;
+        case SIGTERM:
+            stages_left = 2;
+            break;
+        default:
+            stages_left = 1;
+    }
+    if (priv->timer_id)
+        g_source_remove (priv->timer_id);
+    priv->timer_id = g_timeout_add (_get_stage_timeout (priv, stages_left),
+            _terminate_timeout, self);
+}
+
+/* The session process tree is gone, tell whoever waits for it */
+static void
+_session_gone (TlmSessionRemote *session)
+{
+    if (session->priv->draining) {
+        session->priv->draining = FALSE;
+        tlm_session_backend_emit_drained (TLM_SESSION_BACKEND (session));
+    } else if (session->priv->can_emit_signal) {
+        tlm_session_backend_emit_session_terminated (
+                TLM_SESSION_BACKEND (session));
+    }
+}
+
+/* Cleanup could not be completed, a draining session is given up */
+static void
+_session_stuck (TlmSessionRemote *session)
+{
+    if (session->priv->draining) {
+        session->priv->draining = FALSE;
+        tlm_session_backend_emit_drained (TLM_SESSION_BACKEND (session));
+    } else if (session->priv->can_emit_signal) {
+        GError *error = TLM_GET_ERROR_FOR_ID (
+                TLM_ERROR_SESSION_TERMINATION_FAILURE,
+                "Unable to terminate session - process is stuck in kernel");
+        tlm_session_backend_emit_session_error (
+                TLM_SESSION_BACKEND (session), error);
+        g_error_free (error);
+    }
+}
+
+static void
+_on_cgroup_empty_cb (
+        const gchar *cgroup,
+        gpointer data)
+{
+    TlmSessionRemote *session = TLM_SESSION_REMOTE (data);
+
+    DBG ("session cgroup '%s' is empty", cgroup);
+    session->priv->cgroup_watch_id = 0;
+    if (session->priv->timer_id) {
+        g_source_remove (session->priv->timer_id);
+        session->priv->timer_id = 0;
+    }
+    tlm_cgroup_remove (session->priv->cgroup);
+    _session_gone (session);
+}
+
+static gboolean
+_cgroup_drain_timeout (gpointer user_data)
+{
+    TlmSessionRemote *session = TLM_SESSION_REMOTE (user_data);
+
+    WARN ("processes of '%s' are stuck in kernel", session->priv->cgroup);
+    session->priv->timer_id = 0;
+    if (session->priv->cgroup_watch_id) {
+        tlm_cgroup_unwatch (session->priv->cgroup_watch_id);
+        session->priv->cgroup_watch_id = 0;
+    }
+    _session_stuck (session);
+    return G_SOURCE_REMOVE;
+}
+
+/* sessiond exits with a dedicated status when a PAM call ran past its
+ * deadline, it cannot send the error itself */
+static void
+_report_pam_timeout (TlmSessionRemote *session, gint status)
+{
+    const gchar *stage = NULL;
+    GError *error = NULL;
+
+    if (!WIFEXITED (status) || !session->priv->can_emit_signal)
+        return;
+    switch (WEXITSTATUS (status)) {
+        case TLM_SESSION_EXIT_PAM_AUTHENTICATE_TIMEOUT:
+            stage = "authenticate";
+            break;
+        case TLM_SESSION_EXIT_PAM_SETCRED_TIMEOUT:
+            stage = "setcred";
+            break;
+        case TLM_SESSION_EXIT_PAM_OPEN_SESSION_TIMEOUT:
+            stage = "open_session";
+            break;
+        default:
+            return;
+    }
+
+    WARN ("PAM %s for service '%s' timed out", stage, session->priv->service);
+    error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_PAM_TIMEOUT,
+            "PAM %s for service '%s' timed out", stage,
+            session->priv->service);
+    tlm_session_backend_emit_session_error (TLM_SESSION_BACKEND (session),
+            error);
+    g_error_free (error);
+}
 
 static void
 _on_child_down_cb (
@@ -106,8 +269,26 @@ _on_child_down_cb (
         g_source_remove (session->priv->timer_id);
         session->priv->timer_id = 0;
     }
-    if (session->priv->can_emit_signal)
-        g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0);
+    _report_pam_timeout (session, status);
+
+    /* sessiond did not get to clean up its session cgroup, e.g. it was
+     * killed, make sure nothing of the user session survives it */
+    if (session->priv->cgroup &&
+        tlm_cgroup_is_populated (session->priv->cgroup)) {
+        WARN ("sessiond left processes behind in '%s'",
+              session->priv->cgroup);
+        tlm_cgroup_kill (session->priv->cgroup);
+        session->priv->cgroup_watch_id = tlm_cgroup_watch_empty (
+                session->priv->cgroup, _on_cgroup_empty_cb, session);
+        session->priv->timer_id = g_timeout_add (
+                _get_stage_timeout (session->priv, 1),
+                _cgroup_drain_timeout, session);
+        return;
+    }
+    if (session->priv->cgroup)
+        tlm_cgroup_remove (session->priv->cgroup);
+
+    _session_gone (session);
 }
 
 static void
@@ -123,9 +304,16 @@ tlm_session_remote_set_property (
            self->priv->config = g_value_dup_object (value);
            break;
 		case PROP_SEATID:
-		case PROP_USERNAME:
+		case IFACE_PROP_USERNAME:
 		case PROP_SERVICE: {
-			if (self->priv->dbus_session_proxy) {
+			if (self->priv->lite) {
+				gchar **prop = property_id == PROP_SEATID ?
+						&self->priv->seat_id :
+						property_id == PROP_SERVICE ?
+						&self->priv->service : &self->priv->username;
+				g_free (*prop);
+				*prop = g_value_dup_string (value);
+			} else if (self->priv->dbus_session_proxy) {
 				g_object_set_property (G_OBJECT(self->priv->dbus_session_proxy),
 						pspec->name, value);
 			}
@@ -150,10 +338,16 @@ tlm_session_remote_get_property (
             g_value_set_object (value, self->priv->config);
             break;
         case PROP_SEATID:
-        case PROP_USERNAME:
+        case IFACE_PROP_USERNAME:
         case PROP_SERVICE:
         case PROP_SESSIONID: {
-            if (self->priv->dbus_session_proxy) {
+            if (self->priv->lite) {
+                g_value_set_string (value,
+                        property_id == PROP_SEATID ? self->priv->seat_id :
+                        property_id == PROP_SERVICE ? self->priv->service :
+                        property_id == PROP_SESSIONID ? self->priv->sessionid :
+                        self->priv->username);
+            } else if (self->priv->dbus_session_proxy) {
                 g_object_get_property (G_OBJECT(self->priv->dbus_session_proxy),
                         pspec->name, value);
             }
@@ -184,7 +378,9 @@ _terminate_timeout (gpointer user_data)
                       strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
             }
             priv->last_sig = SIGTERM;
-            return G_SOURCE_CONTINUE;
+            priv->timer_id = 0;
+            _schedule_terminate_timeout (self);
+            return G_SOURCE_REMOVE;
         case SIGTERM:
             DBG ("child %u didn't respond to SIGTERM, sending SIGKILL",
                  priv->cpid);
@@ -195,19 +391,14 @@ _terminate_timeout (gpointer user_data)
                       strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
             }
             priv->last_sig = SIGKILL;
-            return G_SOURCE_CONTINUE;
+            priv->timer_id = 0;
+            _schedule_terminate_timeout (self);
+            return G_SOURCE_REMOVE;
         case SIGKILL:
             DBG ("child %u didn't respond to SIGKILL, "
                     "process is stuck in kernel",  priv->cpid);
             priv->timer_id = 0;
-            if (self->priv->can_emit_signal) {
-                GError *error = TLM_GET_ERROR_FOR_ID (
-                        TLM_ERROR_SESSION_TERMINATION_FAILURE,
-                        "Unable to terminate session - process is stuck"
-                        " in kernel");
-                g_signal_emit (self, signals[SIG_SESSION_ERROR], 0, error);
-                g_error_free (error);
-            }
+            _session_stuck (self);
             return G_SOURCE_REMOVE;
         default:
             WARN ("%d has unknown signaling state %d",
@@ -224,13 +415,20 @@ tlm_session_remote_dispose (GObject *object)
     self->priv->can_emit_signal = FALSE;
 
     DBG("self %p", self);
+    self->priv->draining = FALSE;
     if (self->priv->is_sessiond_up) {
-        tlm_session_remote_terminate (self);
-        while (self->priv->is_sessiond_up)
+        /* do not start over once the termination ladder gave up */
+        if (!self->priv->timer_id && self->priv->last_sig != SIGKILL)
+            tlm_session_remote_terminate (self);
+        /* the termination ladder gives up once sessiond is stuck in kernel */
+        while (self->priv->is_sessiond_up && self->priv->timer_id)
             g_main_context_iteration(NULL, TRUE);
         DBG ("Sessiond DESTROYED");
     }
 
+    while (self->priv->cgroup_watch_id)
+        g_main_context_iteration(NULL, TRUE);
+
     if (self->priv->timer_id) {
         g_source_remove (self->priv->timer_id);
         self->priv->timer_id = 0;
@@ -238,6 +436,7 @@ tlm_session_remote_dispose (GObject *object)
 
     self->priv->cpid = 0;
     self->priv->last_sig = 0;
+    g_clear_string (&self->priv->cgroup);
 
     if (self->priv->child_watch_id > 0) {
         g_source_remove (self->priv->child_watch_id);
@@ -246,6 +445,19 @@ tlm_session_remote_dispose (GObject *object)
 
     g_clear_object (&self->priv->config);
 
+    if (self->priv->input_watch_id) {
+        g_source_remove (self->priv->input_watch_id);
+        self->priv->input_watch_id = 0;
+    }
+    if (self->priv->to_sessiond_fd >= 0) {
+        close (self->priv->to_sessiond_fd);
+        self->priv->to_sessiond_fd = -1;
+    }
+    if (self->priv->from_sessiond_fd >= 0) {
+        close (self->priv->from_sessiond_fd);
+        self->priv->from_sessiond_fd = -1;
+    }
+
     if (self->priv->dbus_session_proxy) {
         g_signal_handler_disconnect (self->priv->dbus_session_proxy,
                 self->priv->signal_session_created);
@@ -255,6 +467,8 @@ tlm_session_remote_dispose (GObject *object)
                 self->priv->signal_error);
         g_signal_handler_disconnect (self->priv->dbus_session_proxy,
                 self->priv->signal_authenticated);
+        g_signal_handler_disconnect (self->priv->dbus_session_proxy,
+                self->priv->signal_pam_timings);
         g_object_unref (self->priv->dbus_session_proxy);
         self->priv->dbus_session_proxy = NULL;
     }
@@ -280,7 +494,14 @@ tlm_session_remote_dispose (GObject *object)
 static void
 tlm_session_remote_finalize (GObject *object)
 {
-    //TlmSessionRemote *self = TLM_SESSION_REMOTE (object);
+    TlmSessionRemote *self = TLM_SESSION_REMOTE (object);
+
+    if (self->priv->input)
+        g_string_free (self->priv->input, TRUE);
+    g_free (self->priv->seat_id);
+    g_free (self->priv->service);
+    g_free (self->priv->username);
+    g_free (self->priv->sessionid);
 
     G_OBJECT_CLASS (tlm_session_remote_parent_class)->finalize (object);
 }
@@ -316,12 +537,6 @@ tlm_session_remote_class_init (TlmSessionRemoteClass *klass)
             "" /* default value */,
             G_PARAM_READWRITE |
             G_PARAM_STATIC_STRINGS);
-    properties[PROP_USERNAME] = g_param_spec_string ("username",
-            "Username",
-            "Username",
-            "" /* default value */,
-            G_PARAM_READWRITE |
-            G_PARAM_STATIC_STRINGS);
     properties[PROP_SESSIONID] = g_param_spec_string ("sessionid",
             "SessionId",
             "Id of the session",
@@ -331,25 +546,8 @@ tlm_session_remote_class_init (TlmSessionRemoteClass *klass)
 
     g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 
-    signals[SIG_SESSION_CREATED] = g_signal_new ("session-created",
-                                TLM_TYPE_SESSION_REMOTE, G_SIGNAL_RUN_LAST,
-                                0, NULL, NULL, NULL, G_TYPE_NONE,
-                                1, G_TYPE_STRING);
-
-    signals[SIG_SESSION_TERMINATED] = g_signal_new ("session-terminated",
-                                TLM_TYPE_SESSION_REMOTE, G_SIGNAL_RUN_LAST,
-                                0, NULL, NULL, NULL, G_TYPE_NONE,
-                                0, G_TYPE_NONE);
-
-    signals[SIG_AUTHENTICATED] = g_signal_new ("authenticated",
-                                TLM_TYPE_SESSION_REMOTE, G_SIGNAL_RUN_LAST,
-                                0, NULL, NULL, NULL, G_TYPE_NONE,
-                                0, G_TYPE_NONE);
-
-    signals[SIG_SESSION_ERROR] = g_signal_new ("session-error",
-                                TLM_TYPE_SESSION_REMOTE, G_SIGNAL_RUN_LAST,
-                                0, NULL, NULL, NULL, G_TYPE_NONE,
-                                1, G_TYPE_ERROR);
+    g_object_class_override_property (object_class, IFACE_PROP_USERNAME,
+            "username");
 }
 
 static void
@@ -364,6 +562,19 @@ tlm_session_remote_init (TlmSessionRemote *self)
     self->priv->is_sessiond_up = FALSE;
     self->priv->last_sig = 0;
     self->priv->timer_id = 0;
+    self->priv->deadline = 0;
+    self->priv->terminate_requested = FALSE;
+    self->priv->cgroup = NULL;
+    self->priv->cgroup_watch_id = 0;
+    self->priv->lite = FALSE;
+    self->priv->to_sessiond_fd = -1;
+    self->priv->from_sessiond_fd = -1;
+    self->priv->input_watch_id = 0;
+    self->priv->input = NULL;
+    self->priv->seat_id = NULL;
+    self->priv->service = NULL;
+    self->priv->username = NULL;
+    self->priv->sessionid = NULL;
 }
 
 static void
@@ -380,11 +591,42 @@ _session_created_async_cb (
             res, &error);
     if (error) {
         WARN("session creation request failed");
-        g_signal_emit (self, signals[SIG_SESSION_ERROR],  0, error);
+        tlm_session_backend_emit_session_error (
+                TLM_SESSION_BACKEND (self), error);
         g_error_free (error);
     }
 }
 
+static void
+_create_lite (
+        TlmSessionRemote *session,
+        const gchar *password,
+        GHashTable *environment,
+        GVariant *config)
+{
+    TlmSessionRemotePrivate *priv = session->priv;
+    GString *out = g_string_new (NULL);
+
+    tlm_session_protocol_append_config (out, config);
+    tlm_session_protocol_append_environment (out, environment);
+    tlm_session_protocol_append (out, TLM_SESSION_MSG_CREATE,
+            priv->seat_id ? priv->seat_id : "",
+            priv->service ? priv->service : "",
+            priv->username ? priv->username : "", password, NULL);
+
+    if (!tlm_session_protocol_write (priv->to_sessiond_fd, out)) {
+        GError *error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
+                "Unable to send session creation request");
+        WARN("session creation request failed");
+        tlm_session_backend_emit_session_error (
+                TLM_SESSION_BACKEND (session), error);
+        g_error_free (error);
+    }
+    /* the request carried the password */
+    memset (out->str, 0, out->allocated_len);
+    g_string_free (out, TRUE);
+}
+
 void
 tlm_session_remote_create (
     TlmSessionRemote *session,
@@ -392,15 +634,33 @@ tlm_session_remote_create (
     GHashTable *environment)
 {
     GVariant *data = NULL;
+    GVariant *config = NULL;
+    gchar *seat_id = NULL;
+    gchar *service = NULL;
     gchar *pass = g_strdup (password);
-    if (environment) data = tlm_dbus_utils_hash_table_to_variant (environment);
-    if (!data) data = g_variant_new ("a{ss}", NULL);
+
+    /* sessiond works from this snapshot instead of parsing tlm.conf again,
+     * a group named after the PAM service may override PAM settings */
+    g_object_get (G_OBJECT (session), "seatid", &seat_id, "service", &service,
+                  NULL);
+    const gchar *groups[] = { TLM_CONFIG_GENERAL, seat_id, service, NULL };
+    config = tlm_config_to_variant (session->priv->config, groups);
 
     if (!pass) pass = g_strdup ("");
-    tlm_dbus_session_call_session_create (
-            session->priv->dbus_session_proxy, pass, data, NULL,
-            _session_created_async_cb, session);
+    if (session->priv->lite) {
+        _create_lite (session, pass, environment, config);
+        g_variant_unref (g_variant_ref_sink (config));
+    } else {
+        if (environment)
+            data = tlm_dbus_utils_hash_table_to_variant (environment);
+        if (!data) data = g_variant_new ("a{ss}", NULL);
+        tlm_dbus_session_call_session_create (
+                session->priv->dbus_session_proxy, pass, data, config, NULL,
+                _session_created_async_cb, session);
+    }
     g_free (pass);
+    g_free (seat_id);
+    g_free (service);
 }
 
 /* signals */
@@ -412,7 +672,18 @@ _on_session_created_cb (
 {
     g_return_if_fail (self && TLM_IS_SESSION_REMOTE (self));
     DBG("sessionid: %s", sessionid ? sessionid : "NULL");
-    g_signal_emit (self, signals[SIG_SESSION_CREATED], 0, sessionid);
+
+    /* sessiond has its final cgroup now, remember where the session lives
+     * in case sessiond itself does not survive the teardown */
+    if (!self->priv->cgroup) {
+        gchar *seat_id = NULL;
+        g_object_get (G_OBJECT (self), "seatid", &seat_id, NULL);
+        self->priv->cgroup = tlm_cgroup_get_session_path (self->priv->config,
+                seat_id, self->priv->cpid);
+        g_free (seat_id);
+    }
+    tlm_session_backend_emit_session_created (
+            TLM_SESSION_BACKEND (self), sessionid);
 }
 
 static void
@@ -422,8 +693,17 @@ _on_session_terminated_cb (
 {
     g_return_if_fail (self && TLM_IS_SESSION_REMOTE (self));
     DBG ("dbus-session-proxy got a session-terminated signal");
+    if (self->priv->terminate_requested && self->priv->timer_id &&
+        self->priv->last_sig == SIGHUP) {
+        /* sessiond ended the session within the time it was given, it is
+         * asked to exit the usual way once the session is released */
+        g_source_remove (self->priv->timer_id);
+        self->priv->timer_id = 0;
+        self->priv->last_sig = 0;
+    }
     if (self->priv->can_emit_signal)
-        g_signal_emit (self, signals[SIG_SESSION_TERMINATED], 0);
+        tlm_session_backend_emit_session_terminated (
+                TLM_SESSION_BACKEND (self));
 }
 
 static void
@@ -432,7 +712,7 @@ _on_authenticated_cb (
         gpointer user_data)
 {
     g_return_if_fail (self && TLM_IS_SESSION_REMOTE (self));
-    g_signal_emit (self, signals[SIG_AUTHENTICATED], 0);
+    tlm_session_backend_emit_authenticated (TLM_SESSION_BACKEND (self));
 }
 
 static void
@@ -446,23 +726,95 @@ _on_error_cb (
     GError *gerror = tlm_error_new_from_variant (error);
     WARN("error %d:%s", gerror->code, gerror->message);
     if (self->priv->can_emit_signal)
-        g_signal_emit (self, signals[SIG_SESSION_ERROR],  0, gerror);
+        tlm_session_backend_emit_session_error (
+                TLM_SESSION_BACKEND (self), gerror);
     g_error_free (gerror);
 }
 
-TlmSessionRemote *
-tlm_session_remote_new (
-        TlmConfig *config,
-        const gchar *seat_id,
+static void
+_on_pam_timings_cb (
+        TlmSessionRemote *self,
         const gchar *service,
-        const gchar *username)
+        GVariant *timings,
+        gpointer user_data)
+{
+    g_return_if_fail (self && TLM_IS_SESSION_REMOTE (self));
+
+    tlm_pam_stats_add (service, timings);
+}
+
+static void
+_dispatch_lite_message (
+        TlmSessionRemote *self,
+        gchar **msg)
+{
+    if (g_strcmp0 (msg[0], TLM_SESSION_MSG_CREATED) == 0 && msg[1]) {
+        g_free (self->priv->sessionid);
+        self->priv->sessionid = g_strdup (msg[1]);
+        _on_session_created_cb (self, msg[1], NULL);
+    } else if (g_strcmp0 (msg[0], TLM_SESSION_MSG_TERMINATED) == 0) {
+        _on_session_terminated_cb (self, NULL);
+    } else if (g_strcmp0 (msg[0], TLM_SESSION_MSG_AUTHENTICATED) == 0) {
+        _on_authenticated_cb (self, NULL);
+    } else if (g_strcmp0 (msg[0], TLM_SESSION_MSG_ERROR) == 0) {
+        GVariant *error = tlm_session_protocol_parse_error (msg);
+        if (error) {
+            g_variant_ref_sink (error);
+            _on_error_cb (self, error, NULL);
+            g_variant_unref (error);
+        }
+    } else if (g_strcmp0 (msg[0], TLM_SESSION_MSG_PAM_TIMINGS) == 0) {
+        const gchar *service = NULL;
+        GVariant *timings = tlm_session_protocol_parse_pam_timings (msg,
+                &service);
+        if (timings) {
+            g_variant_ref_sink (timings);
+            _on_pam_timings_cb (self, service, timings, NULL);
+            g_variant_unref (timings);
+        }
+    } else {
+        WARN ("unexpected message '%s' from sessiond",
+              msg[0] ? msg[0] : "");
+    }
+}
+
+static gboolean
+_on_lite_input (
+        gint fd,
+        GIOCondition condition,
+        gpointer user_data)
+{
+    TlmSessionRemote *self = TLM_SESSION_REMOTE (user_data);
+    gboolean up = tlm_session_protocol_read (fd, self->priv->input);
+    gchar **msg;
+
+    /* the handlers may drop the last reference held by the seat */
+    g_object_ref (self);
+    while ((msg = tlm_session_protocol_pop (self->priv->input)) != NULL) {
+        _dispatch_lite_message (self, msg);
+        g_strfreev (msg);
+    }
+    if (!up) {
+        /* sessiond going away is handled by the child watch */
+        DBG ("sessiond closed its end of the pipe");
+        self->priv->input_watch_id = 0;
+    }
+    g_object_unref (self);
+
+    return up ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static TlmSessionRemote *
+_spawn_sessiond (
+        TlmConfig *config,
+        const gchar *sessiond_name,
+        gint *cin_fd,
+        gint *cout_fd)
 {
     GError *error = NULL;
     GPid cpid = 0;
     gchar **argv;
-    gint cin_fd, cout_fd;
     TlmSessionRemote *session = NULL;
-    TlmPipeStream *stream = NULL;
     gboolean ret = FALSE;
     const gchar *bin_path = TLM_BIN_DIR;
 
@@ -484,10 +836,10 @@ tlm_session_remote_new (
 
     /* Spawn child process */
     argv = g_new0 (gchar *, 1 + 1);
-    argv[0] = g_build_filename (bin_path, TLM_SESSIOND_NAME, NULL);
+    argv[0] = g_build_filename (bin_path, sessiond_name, NULL);
     ret = g_spawn_async_with_pipes (NULL, argv, NULL,
             G_SPAWN_DO_NOT_REAP_CHILD, NULL,
-            NULL, &cpid, &cin_fd, &cout_fd, NULL, &error);
+            NULL, &cpid, cin_fd, cout_fd, NULL, &error);
     g_strfreev (argv);
     if (ret == FALSE || (kill(cpid, 0) != 0)) {
         DBG ("failed to start sessiond: error %s(%d)",
@@ -496,7 +848,6 @@ tlm_session_remote_new (
         return NULL;
     }
 
-    /* Create dbus session object */
     session = TLM_SESSION_REMOTE (g_object_new (TLM_TYPE_SESSION_REMOTE,
             "config", config, NULL));
 
@@ -505,6 +856,25 @@ tlm_session_remote_new (
     session->priv->cpid = cpid;
     session->priv->is_sessiond_up = TRUE;
 
+    return session;
+}
+
+TlmSessionRemote *
+tlm_session_remote_new (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username)
+{
+    GError *error = NULL;
+    gint cin_fd, cout_fd;
+    TlmSessionRemote *session = NULL;
+    TlmPipeStream *stream = NULL;
+
+    session = _spawn_sessiond (config, TLM_SESSIOND_NAME, &cin_fd, &cout_fd);
+    if (!session)
+        return NULL;
+
     /* Create dbus connection */
     stream = tlm_pipe_stream_new (cout_fd, cin_fd, TRUE);
     session->priv->connection = g_dbus_connection_new_sync (
@@ -541,6 +911,38 @@ tlm_session_remote_new (
     session->priv->signal_error = g_signal_connect_swapped (
             session->priv->dbus_session_proxy, "error",
             G_CALLBACK(_on_error_cb), session);
+    session->priv->signal_pam_timings = g_signal_connect_swapped (
+            session->priv->dbus_session_proxy, "pam-timings",
+            G_CALLBACK(_on_pam_timings_cb), session);
+
+    g_object_set (G_OBJECT (session), "seatid", seat_id, "service", service,
+            "username", username, NULL);
+
+    session->priv->can_emit_signal = TRUE;
+    return session;
+}
+
+TlmSessionRemote *
+tlm_session_remote_new_lite (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username)
+{
+    gint cin_fd, cout_fd;
+    TlmSessionRemote *session = NULL;
+
+    session = _spawn_sessiond (config, TLM_SESSIOND_LITE_NAME, &cin_fd,
+            &cout_fd);
+    if (!session)
+        return NULL;
+
+    session->priv->lite = TRUE;
+    session->priv->to_sessiond_fd = cin_fd;
+    session->priv->from_sessiond_fd = cout_fd;
+    session->priv->input = g_string_new (NULL);
+    session->priv->input_watch_id = g_unix_fd_add (cout_fd,
+            G_IO_IN | G_IO_HUP | G_IO_ERR, _on_lite_input, session);
 
     g_object_set (G_OBJECT (session), "seatid", seat_id, "service", service,
             "username", username, NULL);
@@ -552,6 +954,48 @@ tlm_session_remote_new (
 gboolean
 tlm_session_remote_terminate (
         TlmSessionRemote *self)
+{
+    return tlm_session_remote_terminate_with_deadline (self, 0);
+}
+
+/*
+ * Hands the termination over to sessiond together with the part of the
+ * deadline it may spend on its own ladder, it only gets signalled if it does
+ * not manage within that time
+ */
+static gboolean
+_request_terminate (
+        TlmSessionRemote *self,
+        guint timeout)
+{
+    TlmSessionRemotePrivate *priv = self->priv;
+    gchar *str = NULL;
+    GString *out = NULL;
+    gboolean res = FALSE;
+
+    if (!priv->lite) {
+        if (!priv->dbus_session_proxy)
+            return FALSE;
+        tlm_dbus_session_call_session_terminate (priv->dbus_session_proxy,
+                timeout, NULL, NULL, NULL);
+        return TRUE;
+    }
+
+    if (priv->to_sessiond_fd < 0)
+        return FALSE;
+    str = g_strdup_printf ("%u", timeout);
+    out = g_string_new (NULL);
+    tlm_session_protocol_append (out, TLM_SESSION_MSG_TERMINATE, str, NULL);
+    res = tlm_session_protocol_write (priv->to_sessiond_fd, out);
+    g_string_free (out, TRUE);
+    g_free (str);
+    return res;
+}
+
+gboolean
+tlm_session_remote_terminate_with_deadline (
+        TlmSessionRemote *self,
+        gint64 deadline)
 {
     g_return_val_if_fail (self && TLM_IS_SESSION_REMOTE(self), FALSE);
     TlmSessionRemotePrivate *priv = TLM_SESSION_REMOTE_PRIV(self);
@@ -561,6 +1005,28 @@ tlm_session_remote_terminate (
         return FALSE;
     }
 
+    if (deadline && (!priv->deadline || deadline < priv->deadline))
+        priv->deadline = deadline;
+
+    if (priv->timer_id) {
+        /* already terminating, fit the current stage to the deadline */
+        DBG ("termination in progress, last signal %d", priv->last_sig);
+        _schedule_terminate_timeout (self);
+        return TRUE;
+    }
+
+    if (priv->deadline && !priv->terminate_requested) {
+        /* sessiond runs its ladder within the first stage of ours */
+        guint timeout = MAX (_get_stage_timeout (priv, 3), 1);
+        DBG ("Request session termination within %u ms", timeout);
+        if (_request_terminate (self, timeout)) {
+            priv->terminate_requested = TRUE;
+            priv->last_sig = SIGHUP;
+            _schedule_terminate_timeout (self);
+            return TRUE;
+        }
+    }
+
     DBG ("Terminate child session process");
     if (kill (priv->cpid, SIGHUP) < 0)
     {
@@ -568,10 +1034,75 @@ tlm_session_remote_terminate (
         WARN ("kill(%u, SIGHUP): %s", priv->cpid, strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
     }
     priv->last_sig = SIGHUP;
-    priv->timer_id = g_timeout_add_seconds (
-            tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
-                    TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3),
-            _terminate_timeout, self);
+    _schedule_terminate_timeout (self);
+    return TRUE;
+}
+
+gint
+tlm_session_remote_get_termination_signal (
+        TlmSessionRemote *self)
+{
+    g_return_val_if_fail (self && TLM_IS_SESSION_REMOTE(self), 0);
+
+    return self->priv->last_sig;
+}
+
+static void
+_backend_create (
+        TlmSessionBackend *self,
+        const gchar *password,
+        GHashTable *environment)
+{
+    tlm_session_remote_create (TLM_SESSION_REMOTE (self), password,
+            environment);
+}
+
+static gboolean
+_backend_terminate (
+        TlmSessionBackend *self,
+        gint64 deadline)
+{
+    return tlm_session_remote_terminate_with_deadline (
+            TLM_SESSION_REMOTE (self), deadline);
+}
+
+static gint
+_backend_get_termination_signal (
+        TlmSessionBackend *self)
+{
+    return tlm_session_remote_get_termination_signal (
+            TLM_SESSION_REMOTE (self));
+}
+
+/*
+ * sessiond reports the session terminated before it closes PAM and removes
+ * what is left of the session, it is asked to exit once done and given the
+ * usual termination ladder for that
+ */
+static gboolean
+_backend_drain (
+        TlmSessionBackend *self)
+{
+    TlmSessionRemotePrivate *priv = TLM_SESSION_REMOTE (self)->priv;
+
+    if (!priv->is_sessiond_up && !priv->cgroup_watch_id)
+        return FALSE;
+
+    priv->draining = TRUE;
+    if (priv->is_sessiond_up && !priv->timer_id &&
+        !tlm_session_remote_terminate (TLM_SESSION_REMOTE (self))) {
+        priv->draining = FALSE;
+        return FALSE;
+    }
     return TRUE;
 }
 
+static void
+_tlm_session_remote_backend_init (
+        TlmSessionBackendInterface *iface)
+{
+    iface->create = _backend_create;
+    iface->terminate = _backend_terminate;
+    iface->get_termination_signal = _backend_get_termination_signal;
+    iface->drain = _backend_drain;
+}
@@ -28,6 +28,7 @@
 
 #include <glib.h>
 #include "common/tlm-config.h"
+#include "tlm-session-backend.h"
 
 G_BEGIN_DECLS
 
@@ -72,6 +73,13 @@ tlm_session_remote_new (
         const gchar *service,
         const gchar *username);
 
+TlmSessionRemote *
+tlm_session_remote_new_lite (
+        TlmConfig *config,
+        const gchar *seat_id,
+        const gchar *service,
+        const gchar *username);
+
 void
 tlm_session_remote_create (
     TlmSessionRemote *session,
@@ -82,6 +90,15 @@ gboolean
 tlm_session_remote_terminate (
         TlmSessionRemote *session);
 
+gboolean
+tlm_session_remote_terminate_with_deadline (
+        TlmSessionRemote *session,
+        gint64 deadline);
+
+gint
+tlm_session_remote_get_termination_signal (
+        TlmSessionRemote *session);
+
 G_END_DECLS
 
 #endif /* __TLM_SESSION_REMOTE_H_ */
@@ -23,7 +23,6 @@
  * 02110-1301 USA
  */
 
-#include <pwd.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
@@ -32,6 +31,8 @@
 
 #include "tlm-account-plugin-default.h"
 #include "tlm-log.h"
+#include "tlm-utils.h"
+#include "tlm-user-cache.h"
 
 /**
  * SECTION:tlm-account-plugin-default
@@ -42,7 +43,8 @@
  * - setting up guest account is performed by running 'useradd'
  * - cleaning up guest account is performed by running 'rm -rf' on the account's
  * home directory
- * - check the account validity is done using getpwnam().
+ * - check the account validity is done using getpwnam(), through the user
+ * cache of tlm.
  *
  * It is recommended to use a GUM plugin instead: see #TlmAccountPluginGumd.
  *
@@ -85,6 +87,7 @@ _setup_guest_account (TlmAccountPlugin *plugin, const gchar *user_name)
     res = system (command);
 
     g_free (command);
+    tlm_user_cache_invalidate (user_name);
 
     return res != -1;
 }
@@ -94,14 +97,9 @@ _cleanup_guest_user (TlmAccountPlugin *plugin,
                      const gchar *user_name,
                      gboolean delete)
 {
-    struct passwd *pwd_entry = NULL;
-    struct passwd buf_pwd;
+    gchar *home_dir = NULL;
     gchar *command = NULL;
     int res;
-    gchar *buf = NULL, *tmp = NULL;
-    gsize size = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (size < sizeof(struct passwd))
-        size = 1024;
 
     (void) delete;
 
@@ -109,45 +107,19 @@ _cleanup_guest_user (TlmAccountPlugin *plugin,
     g_return_val_if_fail (TLM_IS_ACCOUNT_PLUGIN_DEFAULT(plugin), FALSE);
     g_return_val_if_fail (user_name && user_name[0], FALSE);
 
-    /* clear error */
-    errno = 0;
-
-    for (; NULL != (tmp = g_realloc(buf, size)); size*=2)
-    {
-        buf = tmp;
-
-        if (ERANGE == getpwnam_r(user_name, &buf_pwd, buf, size, &pwd_entry))
-            continue;
-        break;
-    }
-
-    if (!pwd_entry) {
-        DBG("Could not get info for user '%s', error : %s", 
-            user_name, strerror(errno));
-
-        if (buf)
-            g_free(buf);
-
-        return FALSE;
-    }
-
-    if (!pwd_entry->pw_dir) {
+    home_dir = tlm_user_get_home_dir (user_name);
+    if (!home_dir || !home_dir[0]) {
         DBG("No home folder entry found for user '%s'", user_name);
-
-        if (buf)
-            g_free(buf);
-
+        g_free (home_dir);
         return FALSE;
     }
 
-    command = g_strdup_printf ("rm -rf %s/*", pwd_entry->pw_dir);
+    command = g_strdup_printf ("rm -rf %s/*", home_dir);
 
     res = system (command);
 
     g_free (command);
-
-    if (buf)
-        g_free(buf);
+    g_free (home_dir);
 
     return res != -1;
 }
@@ -155,42 +127,15 @@ _cleanup_guest_user (TlmAccountPlugin *plugin,
 static gboolean
 _is_valid_user (TlmAccountPlugin *plugin, const gchar *user_name)
 {
-    struct passwd *pwd_entry = NULL;
-    struct passwd pwd_buf;
-    gchar *buf = NULL, *tmp = NULL;
-    gsize size = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (size < sizeof(struct passwd))
-        size = 1024;
-
     g_return_val_if_fail (plugin, FALSE);
     g_return_val_if_fail (TLM_IS_ACCOUNT_PLUGIN_DEFAULT(plugin), FALSE);
     g_return_val_if_fail (user_name && user_name[0], FALSE);
 
-    /* clear error */
-    errno = 0;
-
-    for (; NULL != (tmp = g_realloc(buf, size)); size*=2)
-    {
-        buf = tmp;
-
-        if (ERANGE == getpwnam_r(user_name, &pwd_buf, buf, size, &pwd_entry))
-            continue;
-        break;
-    }
-
-    if (!pwd_entry) {
-        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
-        strerror_r(errno, strerr_buf, MAX_STRERROR_LEN);
-        DBG("Could not get info for user '%s', error : %s",
-            user_name, strerr_buf);
-        if (buf)
-            g_free(buf);
+    if (tlm_user_get_uid (user_name) == (uid_t) -1) {
+        DBG("Could not get info for user '%s'", user_name);
         return FALSE;
     }
 
-    if (buf)
-        g_free(buf);
-
     return TRUE;
 }
 
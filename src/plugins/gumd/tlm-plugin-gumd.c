@@ -35,6 +35,7 @@
 
 #include "tlm-plugin-gumd.h"
 #include "tlm-log.h"
+#include "tlm-user-cache.h"
 
 /**
  * SECTION:tlm-plugin-gumd
@@ -87,6 +88,8 @@ _setup_guest_account (
     }
 
     g_object_unref (guser);
+    /* gumd has changed the account, do not wait for the passwd watch */
+    tlm_user_cache_invalidate (user_name);
 
     return TRUE;
 }
@@ -125,6 +128,7 @@ _cleanup_guest_user (
     if (!gum_file_create_home_dir (home_dir, uid, gid, umask, &error)) {
         goto _finished;
     }
+    tlm_user_cache_invalidate (user_name);
     ret = TRUE;
 
 _finished:
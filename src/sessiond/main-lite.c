@@ -0,0 +1,308 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2013-2015 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *          Jussi Laako <jussi.laako@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * tlm-sessiond-lite runs a session exactly like tlm-sessiond does, but
+ * talks to the daemon over the line protocol of tlm-session-protocol.h
+ * on its stdin and stdout instead of a peer to peer D-Bus connection.
+ * Built with TLM_SESSIOND_LITE, it does not ask logind over the system bus
+ * for a session id PAM and sd_pid_get_session() did not provide.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <glib.h>
+#include <sys/prctl.h>
+
+#include "common/tlm-log.h"
+#include "common/tlm-error.h"
+#include "common/tlm-config.h"
+#include "common/tlm-session-protocol.h"
+#include "tlm-session.h"
+
+typedef struct {
+    GMainLoop *main_loop;
+    TlmSession *session;
+    gint in_fd;
+    gint out_fd;
+    GString *input;
+    GString *output;
+    GVariantBuilder *config;
+    GHashTable *environment;
+} SessiondLite;
+
+static SessiondLite _lite;
+
+static void
+_send (void)
+{
+    if (!tlm_session_protocol_write (_lite.out_fd, _lite.output))
+        WARN ("failed to reach the daemon");
+}
+
+static void
+_handle_create (gchar **msg)
+{
+    GVariant *config = NULL;
+    TlmConfig *session_config = NULL;
+
+    if (g_strv_length (msg) != 5) {
+        WARN ("malformed session creation request");
+        return;
+    }
+
+    if (!_lite.config)
+        _lite.config = g_variant_builder_new (G_VARIANT_TYPE ("a{sa{ss}}"));
+    config = g_variant_ref_sink (g_variant_builder_end (_lite.config));
+    g_variant_builder_unref (_lite.config);
+    _lite.config = NULL;
+    session_config = tlm_config_new_from_variant (config);
+    g_variant_unref (config);
+    g_object_set (_lite.session, "config", session_config, NULL);
+    g_object_unref (session_config);
+
+    if (!_lite.environment)
+        _lite.environment = g_hash_table_new_full (g_str_hash, g_str_equal,
+                g_free, g_free);
+
+    tlm_session_start (_lite.session, msg[1], msg[2], msg[3], msg[4],
+            _lite.environment);
+}
+
+static void
+_handle_message (gchar **msg)
+{
+    if (g_strcmp0 (msg[0], TLM_SESSION_MSG_CONFIG) == 0) {
+        if (!_lite.config)
+            _lite.config = g_variant_builder_new (
+                    G_VARIANT_TYPE ("a{sa{ss}}"));
+        if (!tlm_session_protocol_parse_config (msg, _lite.config))
+            WARN ("malformed configuration");
+    } else if (g_strcmp0 (msg[0], TLM_SESSION_MSG_ENVIRONMENT) == 0) {
+        GHashTable *environment =
+                tlm_session_protocol_parse_environment (msg);
+        if (!environment) {
+            WARN ("malformed environment");
+            return;
+        }
+        if (_lite.environment)
+            g_hash_table_unref (_lite.environment);
+        _lite.environment = environment;
+    } else if (g_strcmp0 (msg[0], TLM_SESSION_MSG_CREATE) == 0) {
+        _handle_create (msg);
+    } else if (g_strcmp0 (msg[0], TLM_SESSION_MSG_TERMINATE) == 0) {
+        /* optional timeout, the part of its deadline the daemon leaves us */
+        guint timeout = msg[1] ? (guint) g_ascii_strtoull (msg[1], NULL, 10)
+                : 0;
+        tlm_session_terminate_within (_lite.session, timeout);
+    } else {
+        WARN ("unexpected message '%s' from daemon", msg[0] ? msg[0] : "");
+    }
+}
+
+static gboolean
+_on_input (
+        gint fd,
+        GIOCondition condition,
+        gpointer user_data)
+{
+    gboolean up = tlm_session_protocol_read (fd, _lite.input);
+    gchar **msg;
+
+    while ((msg = tlm_session_protocol_pop (_lite.input)) != NULL) {
+        _handle_message (msg);
+        /* the creation request carries the password */
+        if (g_strcmp0 (msg[0], TLM_SESSION_MSG_CREATE) == 0 &&
+            g_strv_length (msg) == 5)
+            memset (msg[4], 0, strlen (msg[4]));
+        g_strfreev (msg);
+    }
+    if (up)
+        return G_SOURCE_CONTINUE;
+
+    DBG ("daemon closed its end of the pipe");
+    g_main_loop_quit (_lite.main_loop);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_on_session_created (
+        TlmSession *session,
+        const gchar *sessionid,
+        gpointer user_data)
+{
+    DBG ("sessionid: %s", sessionid);
+    tlm_session_protocol_append (_lite.output, TLM_SESSION_MSG_CREATED,
+            sessionid, NULL);
+    _send ();
+}
+
+static void
+_on_session_terminated (
+        TlmSession *session,
+        gpointer user_data)
+{
+    tlm_session_protocol_append (_lite.output, TLM_SESSION_MSG_TERMINATED,
+            NULL);
+    _send ();
+}
+
+static void
+_on_authenticated (
+        TlmSession *session,
+        gpointer user_data)
+{
+    tlm_session_protocol_append (_lite.output,
+            TLM_SESSION_MSG_AUTHENTICATED, NULL);
+    _send ();
+}
+
+static void
+_on_pam_timings (
+        TlmSession *session,
+        const gchar *service,
+        GVariant *timings,
+        gpointer user_data)
+{
+    tlm_session_protocol_append_pam_timings (_lite.output, service, timings);
+    _send ();
+}
+
+static void
+_on_session_error (
+        TlmSession *session,
+        GError *gerror,
+        gpointer user_data)
+{
+    GVariant *error = g_variant_ref_sink (tlm_error_to_variant (gerror));
+
+    DBG ("error %d:%s", gerror->code, gerror->message);
+    tlm_session_protocol_append_error (_lite.output, error);
+    g_variant_unref (error);
+    _send ();
+}
+
+static gboolean
+_handle_quit_signal (gpointer user_data)
+{
+    DBG ("Received quit signal");
+    g_main_loop_quit (_lite.main_loop);
+
+    return FALSE;
+}
+
+static void
+_install_sighandlers (void)
+{
+    if (signal (SIGINT, SIG_IGN) == SIG_ERR)
+    {
+        gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+        WARN ("failed to ignore SIGINT: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+    }
+
+    g_unix_signal_add (SIGTERM, _handle_quit_signal, NULL);
+    g_unix_signal_add (SIGHUP, _handle_quit_signal, NULL);
+
+    if (prctl(PR_SET_PDEATHSIG, SIGHUP))
+        WARN ("failed to set parent death signal");
+}
+
+int main (int argc, char **argv)
+{
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+
+    /* Keep the pipes to the daemon and point stdin and stdout to
+     * /dev/null to avoid anyone writing to them */
+    _lite.in_fd = dup(0);
+    if (_lite.in_fd == -1) {
+        WARN ("Failed to dup stdin : %s(%d)", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN), errno);
+        _lite.in_fd = 0;
+    }
+    if (!freopen("/dev/null", "r+", stdin)) {
+        WARN ("Unable to redirect stdin to /dev/null");
+    }
+
+    _lite.out_fd = dup(1);
+    if (_lite.out_fd == -1) {
+        WARN ("Failed to dup stdout : %s(%d)", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN), errno);
+        _lite.out_fd = 1;
+    }
+    if (!freopen("/dev/null", "w+", stdout)) {
+        WARN ("Unable to redirect stdout to /dev/null");
+    }
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    tlm_log_init(G_LOG_DOMAIN);
+
+    _lite.session = tlm_session_new ();
+    if (!_lite.session) {
+        DBG ("failed to create session object");
+        return -1;
+    }
+    _lite.input = g_string_new (NULL);
+    _lite.output = g_string_new (NULL);
+
+    g_signal_connect (_lite.session, "session-created",
+            G_CALLBACK (_on_session_created), NULL);
+    g_signal_connect (_lite.session, "session-terminated",
+            G_CALLBACK (_on_session_terminated), NULL);
+    g_signal_connect (_lite.session, "authenticated",
+            G_CALLBACK (_on_authenticated), NULL);
+    g_signal_connect (_lite.session, "session-error",
+            G_CALLBACK (_on_session_error), NULL);
+    g_signal_connect (_lite.session, "pam-timings",
+            G_CALLBACK (_on_pam_timings), NULL);
+
+    _lite.main_loop = g_main_loop_new (NULL, FALSE);
+    _install_sighandlers ();
+    g_unix_fd_add (_lite.in_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, _on_input,
+            NULL);
+
+    DBG ("Entering main event loop");
+
+    g_main_loop_run (_lite.main_loop);
+
+    g_object_unref (_lite.session);
+    if (_lite.config)
+        g_variant_builder_unref (_lite.config);
+    if (_lite.environment)
+        g_hash_table_unref (_lite.environment);
+    g_string_free (_lite.input, TRUE);
+    g_string_free (_lite.output, TRUE);
+    g_main_loop_unref (_lite.main_loop);
+
+    tlm_log_close (NULL);
+    return 0;
+}
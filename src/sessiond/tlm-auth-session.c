@@ -24,6 +24,8 @@
  * 02110-1301 USA
  */
 
+#include "config.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <malloc.h>
@@ -36,6 +38,9 @@
 #include <security/pam_appl.h>
 #include <security/pam_misc.h>
 #include <gio/gio.h>
+#ifdef HAVE_LIBSYSTEMD
+#include <systemd/sd-login.h>
+#endif
 
 #include "tlm-auth-session.h"
 #include "common/tlm-log.h"
@@ -44,6 +49,8 @@
 
 G_DEFINE_TYPE (TlmAuthSession, tlm_auth_session, G_TYPE_OBJECT);
 
+#define LOGIND_SESSION_PATH_PREFIX "/org/freedesktop/login1/session/"
+
 #define TLM_AUTH_SESSION_PRIV(obj) \
     G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
         TLM_TYPE_AUTH_SESSION, TlmAuthSessionPrivate)
@@ -58,6 +65,23 @@ enum {
 };
 static GParamSpec *pspecs[N_PROPERTIES];
 
+typedef enum {
+    PAM_STAGE_START = 0,
+    PAM_STAGE_AUTHENTICATE,
+    PAM_STAGE_ESTABLISH_CRED,
+    PAM_STAGE_OPEN_SESSION,
+    PAM_STAGE_REINITIALIZE_CRED,
+    PAM_STAGE_MAX
+} PamStage;
+
+static const gchar *pam_stage_names[PAM_STAGE_MAX] = {
+    "start",
+    "authenticate",
+    "establish_cred",
+    "open_session",
+    "reinitialize_cred"
+};
+
 struct _TlmAuthSessionPrivate
 {
     gchar *service;
@@ -66,6 +90,25 @@ struct _TlmAuthSessionPrivate
     gchar *tty_name;
     gchar *session_id; /* logind session path */
     pam_handle_t *pam_handle;
+
+    /* monotonic timings of the PAM calls, -1 if not run */
+    gint stage;
+    gint64 stage_begin;
+    gint64 stage_usec[PAM_STAGE_MAX];
+    /* last conversation message within each stage and when it came */
+    gint64 conv_usec[PAM_STAGE_MAX];
+    gchar *conv_msg[PAM_STAGE_MAX];
+
+    /* deadline watchdog, runs while the main thread is inside PAM */
+    guint stage_timeout_ms[PAM_STAGE_MAX];
+    TlmAuthSessionTimeoutCb timeout_cb;
+    gpointer timeout_data;
+    GThread *watchdog;
+    GMutex watch_lock;
+    GCond watch_cond;
+    gint64 watch_deadline;
+    gint watch_stage;
+    gboolean watch_quit;
 };
 
 static void
@@ -102,6 +145,15 @@ tlm_auth_session_dispose (GObject *self)
     TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION_PRIV (auth_session);
     DBG ("disposing auth_session: %s:%s", priv->service, priv->username);
 
+    if (priv->watchdog) {
+        g_mutex_lock (&priv->watch_lock);
+        priv->watch_quit = TRUE;
+        g_cond_signal (&priv->watch_cond);
+        g_mutex_unlock (&priv->watch_lock);
+        g_thread_join (priv->watchdog);
+        priv->watchdog = NULL;
+    }
+
     if (priv->pam_handle)
         _auth_session_stop (auth_session);
 
@@ -112,12 +164,17 @@ static void
 tlm_auth_session_finalize (GObject *self)
 {
     TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION (self)->priv;
+    gint i;
 
     g_clear_string (&priv->service);
     g_clear_string (&priv->username);
     g_clear_string (&priv->password);
     g_clear_string (&priv->tty_name);
     g_clear_string (&priv->session_id);
+    for (i = 0; i < PAM_STAGE_MAX; i++)
+        g_clear_string (&priv->conv_msg[i]);
+    g_mutex_clear (&priv->watch_lock);
+    g_cond_clear (&priv->watch_cond);
 
     G_OBJECT_CLASS (tlm_auth_session_parent_class)->finalize (self);
 }
@@ -226,49 +283,200 @@ static void
 tlm_auth_session_init (TlmAuthSession *auth_session)
 {
     TlmAuthSessionPrivate *priv = TLM_AUTH_SESSION_PRIV (auth_session);
+    gint i;
 
     priv->service = priv->username = NULL;
+    priv->stage = -1;
+    for (i = 0; i < PAM_STAGE_MAX; i++)
+        priv->stage_usec[i] = priv->conv_usec[i] = -1;
+    g_mutex_init (&priv->watch_lock);
+    g_cond_init (&priv->watch_cond);
 
     auth_session->priv = priv;
 }
 
+static gpointer
+_auth_session_watchdog (gpointer data)
+{
+    TlmAuthSession *auth_session = TLM_AUTH_SESSION (data);
+    TlmAuthSessionPrivate *priv = auth_session->priv;
+    gint stage;
+
+    g_mutex_lock (&priv->watch_lock);
+    while (!priv->watch_quit) {
+        if (!priv->watch_deadline) {
+            g_cond_wait (&priv->watch_cond, &priv->watch_lock);
+            continue;
+        }
+        if (g_cond_wait_until (&priv->watch_cond, &priv->watch_lock,
+                               priv->watch_deadline))
+            continue;
+        if (!priv->watch_deadline ||
+            g_get_monotonic_time () < priv->watch_deadline)
+            continue;
+
+        stage = priv->watch_stage;
+        priv->watch_deadline = 0;
+        g_mutex_unlock (&priv->watch_lock);
+        /* no logging, the stuck main thread may hold the log lock */
+        priv->timeout_cb (auth_session, pam_stage_names[stage],
+                          priv->timeout_data);
+        g_mutex_lock (&priv->watch_lock);
+    }
+    g_mutex_unlock (&priv->watch_lock);
 
+    return NULL;
+}
+
+static void
+_auth_session_stage_begin (TlmAuthSessionPrivate *priv, PamStage stage)
+{
+    priv->stage = stage;
+    priv->stage_begin = g_get_monotonic_time ();
+
+    if (!priv->watchdog || !priv->stage_timeout_ms[stage])
+        return;
+    g_mutex_lock (&priv->watch_lock);
+    priv->watch_stage = stage;
+    priv->watch_deadline = priv->stage_begin +
+                           (gint64) priv->stage_timeout_ms[stage] * 1000;
+    g_cond_signal (&priv->watch_cond);
+    g_mutex_unlock (&priv->watch_lock);
+}
+
+static void
+_auth_session_stage_end (TlmAuthSessionPrivate *priv)
+{
+    if (priv->stage < 0)
+        return;
+    if (priv->watchdog) {
+        g_mutex_lock (&priv->watch_lock);
+        priv->watch_deadline = 0;
+        g_mutex_unlock (&priv->watch_lock);
+    }
+    priv->stage_usec[priv->stage] = g_get_monotonic_time () -
+                                    priv->stage_begin;
+    DBG ("PAM %s took %" G_GINT64_FORMAT " us",
+         pam_stage_names[priv->stage], priv->stage_usec[priv->stage]);
+    priv->stage = -1;
+}
+
+
+#ifndef TLM_SESSIOND_LITE
+/* shared by all lookups of this process, created on first use */
+static GDBusConnection *system_bus = NULL;
+#endif
+
+/* logind object path for a session id, escaped the way logind does it */
 static gchar *
-_auth_session_get_logind_session_id (GError **error)
+_auth_session_build_session_path (const gchar *id)
 {
-    GDBusConnection *bus;
-    GVariant *result;
-    gchar *session_id;
+    GString *path = g_string_new (LOGIND_SESSION_PATH_PREFIX);
+    const gchar *ch;
+
+    for (ch = id; *ch; ch++) {
+        if (g_ascii_isalpha (*ch) || (ch > id && g_ascii_isdigit (*ch)))
+            g_string_append_c (path, *ch);
+        else
+            g_string_append_printf (path, "_%02x", (guchar) *ch);
+    }
+    return g_string_free (path, FALSE);
+}
 
-    bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, error);
-    if (!bus)
-        return NULL;
+static gchar *
+_auth_session_get_local_session_id (TlmAuthSessionPrivate *priv)
+{
+    const gchar *id = pam_getenv (priv->pam_handle, "XDG_SESSION_ID");
+    gchar *session_id = NULL;
 
-    DBG ("trying to get session id");
-    result = g_dbus_connection_call_sync (bus,
-                                          "org.freedesktop.login1",
-                                          "/org/freedesktop/login1",
-                                          "org.freedesktop.login1.Manager",
-                                          "GetSessionByPID",
-                                          g_variant_new("(u)", getpid()),
-                                          G_VARIANT_TYPE("(o)"),
-                                          G_DBUS_CALL_FLAGS_NONE,
-                                          -1,
-                                          NULL,
-                                          error);
-    g_object_unref (bus);
+    if (id && *id) {
+        session_id = _auth_session_build_session_path (id);
+    }
+#ifdef HAVE_LIBSYSTEMD
+    else {
+        char *sd_id = NULL;
+        if (sd_pid_get_session (getpid (), &sd_id) >= 0 && sd_id && *sd_id)
+            session_id = _auth_session_build_session_path (sd_id);
+        free (sd_id);
+    }
+#endif
+
+    if (session_id)
+        DBG ("logind session : %s", session_id);
+    return session_id;
+}
+
+#ifndef TLM_SESSIOND_LITE
+static void
+_on_get_session_by_pid_reply (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GTask *task = G_TASK (user_data);
+    TlmAuthSession *auth_session = g_task_get_source_object (task);
+    GError *error = NULL;
+    GVariant *result;
+
+    result = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res,
+            &error);
     if (!result) {
         DBG ("failed to get session id");
-        return NULL;
+        g_task_return_error (task, error);
+        g_object_unref (task);
+        return;
     }
 
-    g_variant_get (result, "(o)", &session_id);
+    g_clear_string (&auth_session->priv->session_id);
+    g_variant_get (result, "(o)", &auth_session->priv->session_id);
     g_variant_unref (result);
+    DBG ("logind session : %s", auth_session->priv->session_id);
 
-    DBG ("logind session : %s", session_id);
+    g_task_return_boolean (task, TRUE);
+    g_object_unref (task);
+}
 
-    return session_id;
+static void
+_auth_session_call_get_session_by_pid (GTask *task)
+{
+    DBG ("trying to get session id");
+    g_dbus_connection_call (system_bus,
+                            "org.freedesktop.login1",
+                            "/org/freedesktop/login1",
+                            "org.freedesktop.login1.Manager",
+                            "GetSessionByPID",
+                            g_variant_new("(u)", getpid()),
+                            G_VARIANT_TYPE("(o)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            g_task_get_cancellable (task),
+                            _on_get_session_by_pid_reply,
+                            task);
+}
+
+static void
+_on_system_bus_ready (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    GTask *task = G_TASK (user_data);
+    GError *error = NULL;
+    GDBusConnection *bus = g_bus_get_finish (res, &error);
+
+    if (!bus) {
+        g_task_return_error (task, error);
+        g_object_unref (task);
+        return;
+    }
+    if (!system_bus)
+        system_bus = bus;
+    else
+        g_object_unref (bus);
+
+    _auth_session_call_get_session_by_pid (task);
 }
+#endif
 
 static int
 _auth_session_pam_conversation_cb (int n_msgs,
@@ -279,9 +487,17 @@ _auth_session_pam_conversation_cb (int n_msgs,
     int i;
     TlmAuthSession *auth_session = TLM_AUTH_SESSION (appdata_ptr);
 
-    (void) auth_session;
     DBG (" n_msgs : %d", n_msgs);
 
+    /* remember what the running stage was doing last */
+    if (auth_session->priv->stage >= 0 && n_msgs > 0) {
+        gint stage = auth_session->priv->stage;
+        auth_session->priv->conv_usec[stage] = g_get_monotonic_time () -
+                                               auth_session->priv->stage_begin;
+        g_free (auth_session->priv->conv_msg[stage]);
+        auth_session->priv->conv_msg[stage] = g_strdup (msgs[n_msgs - 1]->msg);
+    }
+
     *resps = calloc (n_msgs, sizeof(struct pam_response));
     for (i=0; i < n_msgs; i++) {
         const struct pam_message *msg = msgs[i];
@@ -387,7 +603,10 @@ tlm_auth_session_authenticate (TlmAuthSession *auth_session, GError **error)
     pam_get_item (priv->pam_handle, PAM_USER, (const void **)&p_uname);
     DBG ("PAM service : '%s', PAM username : '%s'", p_service, p_uname);
     DBG ("starting pam authentication for user '%s'", priv->username);
-    if((res = pam_authenticate (priv->pam_handle, PAM_SILENT)) != PAM_SUCCESS) {
+    _auth_session_stage_begin (priv, PAM_STAGE_AUTHENTICATE);
+    res = pam_authenticate (priv->pam_handle, PAM_SILENT);
+    _auth_session_stage_end (priv);
+    if (res != PAM_SUCCESS) {
         WARN ("PAM authentication failure: %s",
               pam_strerror (priv->pam_handle, res));
         if (error)
@@ -419,21 +638,27 @@ tlm_auth_session_open (TlmAuthSession *auth_session, GError **error)
         return FALSE;
     }*/
 
+    _auth_session_stage_begin (priv, PAM_STAGE_ESTABLISH_CRED);
     res = pam_setcred (priv->pam_handle, PAM_ESTABLISH_CRED);
+    _auth_session_stage_end (priv);
     if (res != PAM_SUCCESS) {
         WARN ("Failed to establish pam credentials: %s",
                 pam_strerror (priv->pam_handle, res));
         return FALSE;
     }
 
+    _auth_session_stage_begin (priv, PAM_STAGE_OPEN_SESSION);
     res = pam_open_session (priv->pam_handle, 0);
+    _auth_session_stage_end (priv);
     if (res != PAM_SUCCESS) {
         WARN ("Failed to open pam session: %s",
                 pam_strerror (priv->pam_handle, res));
         return FALSE;
     }
 
+    _auth_session_stage_begin (priv, PAM_STAGE_REINITIALIZE_CRED);
     res = pam_setcred (priv->pam_handle, PAM_REINITIALIZE_CRED);
+    _auth_session_stage_end (priv);
     if (res != PAM_SUCCESS) {
         WARN ("Failed to reinitialize pam credentials: %s",
                 pam_strerror (priv->pam_handle, res));
@@ -441,11 +666,50 @@ tlm_auth_session_open (TlmAuthSession *auth_session, GError **error)
         return FALSE;
     }
 
-    priv->session_id = _auth_session_get_logind_session_id (error);
+    priv->session_id = _auth_session_get_local_session_id (priv);
 
     return TRUE;
 }
 
+#ifndef TLM_SESSIOND_LITE
+/*
+ * Looks up the logind session of this process asynchronously, for the case
+ * tlm_auth_session_open() could not determine it locally.
+ */
+void
+tlm_auth_session_resolve_sessionid (
+        TlmAuthSession *auth_session,
+        GCancellable *cancellable,
+        GAsyncReadyCallback callback,
+        gpointer user_data)
+{
+    g_return_if_fail (TLM_IS_AUTH_SESSION (auth_session));
+    GTask *task = g_task_new (auth_session, cancellable, callback, user_data);
+
+    if (auth_session->priv->session_id) {
+        g_task_return_boolean (task, TRUE);
+        g_object_unref (task);
+        return;
+    }
+
+    if (system_bus)
+        _auth_session_call_get_session_by_pid (task);
+    else
+        g_bus_get (G_BUS_TYPE_SYSTEM, cancellable, _on_system_bus_ready, task);
+}
+
+gboolean
+tlm_auth_session_resolve_sessionid_finish (
+        TlmAuthSession *auth_session,
+        GAsyncResult *result,
+        GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, auth_session), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+#endif
+
 TlmAuthSession *
 tlm_auth_session_new (const gchar *service,
                       const gchar *username,
@@ -465,8 +729,10 @@ tlm_auth_session_new (const gchar *service,
     struct pam_conv conv = { _auth_session_pam_conversation_cb,
                              auth_session };
     DBG ("loading pam for service '%s'", priv->service);
+    _auth_session_stage_begin (priv, PAM_STAGE_START);
     res = pam_start (priv->service, priv->username,
                      &conv, &priv->pam_handle);
+    _auth_session_stage_end (priv);
     if (res != PAM_SUCCESS) {
         WARN ("pam initialization failed: %s", pam_strerror (NULL, res));
         g_object_unref (auth_session);
@@ -509,3 +775,97 @@ tlm_auth_session_set_env (TlmAuthSession *auth_session, const gchar *key,
     pam_misc_setenv (auth_session->priv->pam_handle, key, value, 0);
 }
 
+/*
+ * Durations of the PAM calls made so far, in microseconds, as a{st} keyed by
+ * stage name.
+ */
+GVariant *
+tlm_auth_session_get_timings (TlmAuthSession *auth_session)
+{
+    GVariantBuilder builder;
+    gint i;
+
+    g_return_val_if_fail (TLM_IS_AUTH_SESSION (auth_session), NULL);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+    for (i = 0; i < PAM_STAGE_MAX; i++) {
+        if (auth_session->priv->stage_usec[i] < 0)
+            continue;
+        g_variant_builder_add (&builder, "{st}", pam_stage_names[i],
+                               (guint64) auth_session->priv->stage_usec[i]);
+    }
+    return g_variant_builder_end (&builder);
+}
+
+/*
+ * Reports the PAM calls that took at least threshold_ms, with the last
+ * conversation message seen during the call to tell which module was busy.
+ */
+void
+tlm_auth_session_log_slow_stages (TlmAuthSession *auth_session,
+                                  guint threshold_ms)
+{
+    TlmAuthSessionPrivate *priv = NULL;
+    gint i;
+
+    g_return_if_fail (TLM_IS_AUTH_SESSION (auth_session));
+    priv = auth_session->priv;
+
+    for (i = 0; i < PAM_STAGE_MAX; i++) {
+        if (priv->stage_usec[i] < (gint64) threshold_ms * 1000)
+            continue;
+        if (priv->conv_msg[i])
+            WARN ("slow PAM %s for service '%s': %" G_GINT64_FORMAT " ms, "
+                  "last message '%s' at %" G_GINT64_FORMAT " ms",
+                  pam_stage_names[i], priv->service,
+                  priv->stage_usec[i] / 1000, priv->conv_msg[i],
+                  priv->conv_usec[i] / 1000);
+        else
+            WARN ("slow PAM %s for service '%s': %" G_GINT64_FORMAT " ms",
+                  pam_stage_names[i], priv->service,
+                  priv->stage_usec[i] / 1000);
+    }
+}
+
+/*
+ * Sets a deadline for the PAM calls of a stage, 0 for none. When a call
+ * runs past it, callback is invoked from a watchdog thread while the calling
+ * thread is still inside PAM; it is up to the callback to abandon the
+ * process.
+ */
+gboolean
+tlm_auth_session_set_stage_timeout (TlmAuthSession *auth_session,
+                                    const gchar *stage,
+                                    guint timeout_ms,
+                                    TlmAuthSessionTimeoutCb callback,
+                                    gpointer user_data)
+{
+    TlmAuthSessionPrivate *priv = NULL;
+    gboolean known = FALSE;
+    gint i;
+
+    g_return_val_if_fail (TLM_IS_AUTH_SESSION (auth_session), FALSE);
+    g_return_val_if_fail (callback != NULL, FALSE);
+    priv = auth_session->priv;
+
+    /* both pam_setcred calls share the "setcred" deadline */
+    for (i = 0; i < PAM_STAGE_MAX; i++) {
+        if (g_strcmp0 (stage, pam_stage_names[i]) == 0 ||
+            (g_strcmp0 (stage, "setcred") == 0 &&
+             (i == PAM_STAGE_ESTABLISH_CRED ||
+              i == PAM_STAGE_REINITIALIZE_CRED))) {
+            priv->stage_timeout_ms[i] = timeout_ms;
+            known = TRUE;
+        }
+    }
+    if (!known || !timeout_ms)
+        return known;
+
+    priv->timeout_cb = callback;
+    priv->timeout_data = user_data;
+    if (!priv->watchdog)
+        priv->watchdog = g_thread_new ("pam-watchdog", _auth_session_watchdog,
+                                       auth_session);
+
+    return TRUE;
+}
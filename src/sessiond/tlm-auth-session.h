@@ -28,6 +28,7 @@
 #define _TLM_AUTH_SESSION_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -59,6 +60,10 @@ struct _TlmAuthSessionClass
 
 GType tlm_auth_session_get_type(void);
 
+typedef void (*TlmAuthSessionTimeoutCb) (TlmAuthSession *auth_session,
+                                         const gchar *stage,
+                                         gpointer user_data);
+
 TlmAuthSession *
 tlm_auth_session_new (const gchar *service,
                       const gchar *username,
@@ -82,6 +87,19 @@ tlm_auth_session_get_username (TlmAuthSession *auth_session);
 const gchar *
 tlm_auth_session_get_sessionid (TlmAuthSession *auth_session);
 
+#ifndef TLM_SESSIOND_LITE
+void
+tlm_auth_session_resolve_sessionid (TlmAuthSession *auth_session,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+
+gboolean
+tlm_auth_session_resolve_sessionid_finish (TlmAuthSession *auth_session,
+                                           GAsyncResult *result,
+                                           GError **error);
+#endif
+
 gchar **
 tlm_auth_session_get_envlist (TlmAuthSession *auth_session);
 
@@ -89,6 +107,20 @@ void
 tlm_auth_session_set_env (TlmAuthSession *auth_session, const gchar *key,
                           const gchar *value);
 
+GVariant *
+tlm_auth_session_get_timings (TlmAuthSession *auth_session);
+
+void
+tlm_auth_session_log_slow_stages (TlmAuthSession *auth_session,
+                                  guint threshold_ms);
+
+gboolean
+tlm_auth_session_set_stage_timeout (TlmAuthSession *auth_session,
+                                    const gchar *stage,
+                                    guint timeout_ms,
+                                    TlmAuthSessionTimeoutCb callback,
+                                    gpointer user_data);
+
 G_END_DECLS
 
 #endif /* _TLM_AUTH_SESSION_H */
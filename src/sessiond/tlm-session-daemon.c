@@ -25,6 +25,7 @@
 
 #include "common/tlm-log.h"
 #include "common/tlm-error.h"
+#include "common/tlm-config.h"
 #include "common/tlm-pipe-stream.h"
 #include "common/dbus/tlm-dbus-session-gen.h"
 #include "common/dbus/tlm-dbus-utils.h"
@@ -125,6 +126,7 @@ _handle_session_create_from_dbus (
         GDBusMethodInvocation *invocation,
         const gchar *password,
         GVariant *environment,
+        GVariant *config,
         gpointer user_data)
 {
     g_return_val_if_fail (self && TLM_IS_SESSION_DAEMON (self), FALSE);
@@ -132,6 +134,7 @@ _handle_session_create_from_dbus (
     gchar *service = NULL;
     gchar *username = NULL;
     GHashTable *data = NULL;
+    TlmConfig *session_config = NULL;
 
     tlm_dbus_session_complete_session_create (
             self->priv->dbus_session, invocation);
@@ -144,6 +147,10 @@ _handle_session_create_from_dbus (
     g_object_get (self->priv->dbus_session, "seatid", &seatid,
             "username", &username, "service", &service, NULL);
 
+    session_config = tlm_config_new_from_variant (config);
+    g_object_set (self->priv->session, "config", session_config, NULL);
+    g_object_unref (session_config);
+
     tlm_session_start (self->priv->session, seatid, service, username,
             password, data);
 
@@ -158,6 +165,7 @@ static gboolean
 _handle_session_terminate_from_dbus (
         TlmSessionDaemon *self,
         GDBusMethodInvocation *invocation,
+        guint timeout,
         gpointer user_data)
 {
     g_return_val_if_fail (self && TLM_IS_SESSION_DAEMON (self), FALSE);
@@ -165,7 +173,8 @@ _handle_session_terminate_from_dbus (
     tlm_dbus_session_complete_session_terminate (self->priv->dbus_session,
             invocation);
 
-    tlm_session_terminate (self->priv->session);
+    /* the daemon has a deadline of its own, timeout is what it leaves us */
+    tlm_session_terminate_within (self->priv->session, timeout);
     return TRUE;
 }
 
@@ -204,6 +213,19 @@ _handle_authenticated_from_session (
     tlm_dbus_session_emit_authenticated (self->priv->dbus_session);
 }
 
+static void
+_handle_pam_timings_from_session (
+        TlmSessionDaemon *self,
+        const gchar *service,
+        GVariant *timings,
+        gpointer user_data)
+{
+    g_return_if_fail (self && TLM_IS_SESSION_DAEMON (self));
+
+    tlm_dbus_session_emit_pam_timings (self->priv->dbus_session, service,
+            timings);
+}
+
 static void
 _handle_error_from_session (
         TlmSessionDaemon *self,
@@ -267,6 +289,8 @@ tlm_session_daemon_new (
             G_CALLBACK(_handle_authenticated_from_session), daemon);
     g_signal_connect_swapped (daemon->priv->session, "session-error",
             G_CALLBACK(_handle_error_from_session), daemon);
+    g_signal_connect_swapped (daemon->priv->session, "pam-timings",
+            G_CALLBACK(_handle_pam_timings_from_session), daemon);
 
     g_signal_connect (daemon->priv->connection, "closed",
             G_CALLBACK(_on_connection_closed), daemon);
@@ -39,27 +39,77 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/resource.h>
 #include <ctype.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <sys/un.h>
 #include <linux/kd.h>
+#include <dirent.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
+#ifdef HAVE_LIBSYSTEMD
+#include <systemd/sd-login.h>
+#endif
 
 #include "tlm-session.h"
 #include "tlm-auth-session.h"
 #include "common/tlm-log.h"
 #include "common/tlm-utils.h"
+#include "common/tlm-cgroup.h"
 #include "common/tlm-error.h"
 #include "common/tlm-config-general.h"
 #include "common/tlm-config-seat.h"
+#include "common/tlm-session-protocol.h"
 
 G_DEFINE_TYPE (TlmSession, tlm_session, G_TYPE_OBJECT);
 
 #define TLM_SESSION_PRIV(obj) \
     G_TYPE_INSTANCE_GET_PRIVATE ((obj), TLM_TYPE_SESSION, TlmSessionPrivate)
 
+#define RUNTIME_DIR_BASE "/run/user"
+#define SYSTEMD_PROGRAM_PATH "/usr/lib/systemd:/lib/systemd"
+#define RUNTIME_DIR_STALE_PREFIX ".tlm-stale-"
+
+/* PAM stages with a configurable deadline and the exit status sessiond
+ * reports their timeout with */
+static const struct {
+    const gchar *stage;
+    const gchar *key;
+    int exit_status;
+} pam_deadlines[] = {
+    { "authenticate", TLM_CONFIG_GENERAL_PAM_AUTHENTICATE_TIMEOUT_MS,
+      TLM_SESSION_EXIT_PAM_AUTHENTICATE_TIMEOUT },
+    { "setcred", TLM_CONFIG_GENERAL_PAM_SETCRED_TIMEOUT_MS,
+      TLM_SESSION_EXIT_PAM_SETCRED_TIMEOUT },
+    { "open_session", TLM_CONFIG_GENERAL_PAM_OPEN_SESSION_TIMEOUT_MS,
+      TLM_SESSION_EXIT_PAM_OPEN_SESSION_TIMEOUT },
+};
+#define PAM_DEADLINE_MAX G_N_ELEMENTS (pam_deadlines)
+
+typedef enum {
+    RUNTIME_DIR_CLEANUP_DELETE = 0,
+    RUNTIME_DIR_CLEANUP_RENAME,
+    RUNTIME_DIR_CLEANUP_REUSE
+} RuntimeDirCleanup;
+
+#define SESSION_READY_NOTIFY_ENV "TLM_NOTIFY_FD"
+#define SESSION_READY_POLL_INTERVAL 50
+/* __SO_ACCEPTCON, set in /proc/net/unix for listening sockets */
+#define SESSION_SOCKET_ACCEPTCON (1 << 16)
+#define SESSION_READY_DEFAULT_TIMEOUT 10000
+#define LOGIN_BOOST_DEFAULT_TIMEOUT 10000
+
+typedef enum {
+    SESSION_READY_NONE = 0,
+    SESSION_READY_NOTIFY,
+    SESSION_READY_SOCKET,
+    SESSION_READY_FILE
+} SessionReady;
+
 enum {
     PROP_0,
     PROP_CONFIG,
@@ -76,6 +126,7 @@ enum {
     SIG_SESSION_TERMINATED,
     SIG_AUTHENTICATED,
     SIG_SESSION_ERROR,
+    SIG_PAM_TIMINGS,
     SIG_MAX
 };
 static guint signals[SIG_MAX];
@@ -92,32 +143,73 @@ struct _TlmSessionPrivate
     gchar *seat_id;
     gchar *service;
     gchar *username;
+    TlmUserInfo *user_info;
     GHashTable *env_hash;
     TlmAuthSession *auth_session;
     int last_sig;
     guint timer_id;
+    gint64 terminate_deadline;
     guint child_watch_id;
     gchar *sessionid;
     gchar *xdg_runtime_dir;
+    gchar *cgroup;
+    guint cgroup_watch_id;
+    guint utmp_idle_id;
+    guint pending_deletes;
     gboolean setup_runtime_dir;
+    RuntimeDirCleanup runtime_dir_cleanup;
+    gboolean runtime_dir_mounted;
     gboolean can_emit_signal;
     gboolean is_child_up;
     gboolean session_pause;
+    gboolean sessionid_pending;
+    SessionReady ready_mode;
+    gchar *ready_path;
+    int notify_fd;
+    guint ready_watch_id;
+    guint ready_files_id;
+    guint ready_timeout_id;
+    gint64 exec_time;
+    gboolean ready_pending;
+    gboolean boosted;
+    gint boost_nice;
+    gint boost_ioprio;
+    guint boost_cpu_weight;
+    gint saved_nice;
+    gint saved_ioprio;
+    gchar *saved_cpu_weight;
+    guint boost_timeout_id;
+    gboolean set_affinity;
+    cpu_set_t affinity;
+    gboolean set_oom_score_adj;
+    gint oom_score_adj;
+    gboolean cgroup_policy_set;
     int kb_mode;
 };
 
+static void
+_end_login_boost (TlmSession *session);
+
 static void
 tlm_session_dispose (GObject *self)
 {
     TlmSession *session = TLM_SESSION(self);
     TlmSessionPrivate *priv = session->priv;
+    guint i;
     DBG("disposing session: %s", priv->service);
     priv->can_emit_signal = FALSE;
 
     tlm_session_terminate (session);
     while (priv->is_child_up)
         g_main_context_iteration(NULL, TRUE);
+    while (priv->pending_deletes)
+        g_main_context_iteration(NULL, TRUE);
+    _end_login_boost (session);
 
+    if (priv->utmp_idle_id) {
+        g_source_remove (priv->utmp_idle_id);
+        priv->utmp_idle_id = 0;
+    }
     g_clear_object (&session->priv->config);
 
     G_OBJECT_CLASS (tlm_session_parent_class)->dispose (self);
@@ -141,6 +233,7 @@ _session_set_property (GObject *obj,
 
     switch (property_id) {
         case PROP_CONFIG:
+            g_clear_object (&priv->config);
             priv->config = g_value_dup_object (value);
             break;
         case PROP_SEAT:
@@ -258,6 +351,11 @@ tlm_session_class_init (TlmSessionClass *klass)
                                 0, NULL, NULL, NULL, G_TYPE_NONE,
                                 1, G_TYPE_ERROR);
 
+    signals[SIG_PAM_TIMINGS] = g_signal_new ("pam-timings",
+                                TLM_TYPE_SESSION, G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL, G_TYPE_NONE,
+                                2, G_TYPE_STRING, G_TYPE_VARIANT);
+
 }
 
 static void
@@ -273,25 +371,14 @@ tlm_session_init (TlmSession *session)
     priv->child_watch_id = 0;
     priv->is_child_up = FALSE;
     priv->can_emit_signal = TRUE;
-    priv->config = tlm_config_new ();
+    priv->config = NULL;
     priv->kb_mode = -1;
+    priv->notify_fd = -1;
+    priv->boost_ioprio = -1;
 
     session->priv = priv;
 }
 
-static void
-_setenv_to_session (const gchar *key, const gchar *val,
-                    TlmSessionPrivate *user_data)
-{
-    TlmSessionPrivate *priv = (TlmSessionPrivate *) user_data;
-    if (priv->session_pause)
-        tlm_auth_session_set_env (priv->auth_session,
-                                  (const gchar *) key,
-                                  (const gchar *) val);
-    else
-        setenv ((const char *) key, (const char *) val, 1);
-}
-
 static int
 _prepare_terminal (TlmSessionPrivate *priv)
 {
@@ -349,7 +436,7 @@ _prepare_terminal (TlmSessionPrivate *priv)
     if (ioctl (tty_fd, TCGETS, &priv->tty_state) < 0)
         WARN ("ioctl(TCGETS) failed: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
 
-    if (fchown (tty_fd, tlm_user_get_uid (priv->username), -1)) {
+    if (fchown (tty_fd, priv->user_info->uid, -1)) {
         WARN ("Changing TTY access rights failed");
     }
 
@@ -425,48 +512,46 @@ reset_exit:
     g_clear_string (&priv->tty_dev);
 }
 
-static gboolean
-_set_environment (TlmSessionPrivate *priv)
+/* Environment of the user session, built before forking */
+static gchar **
+_build_environment (TlmSessionPrivate *priv)
 {
-	gchar **envlist = tlm_auth_session_get_envlist(priv->auth_session);
-    gchar *home_dir = NULL, *shell = NULL;
+    gchar **envp = g_get_environ ();
+    gchar **envlist = tlm_auth_session_get_envlist (priv->auth_session);
+    gchar *sep = NULL;
+    GHashTableIter iter;
+    gpointer key, value;
 
     if (envlist) {
         gchar **env = 0;
         for (env = envlist; *env != NULL; ++env) {
             DBG ("ENV : %s", *env);
-            putenv(*env);
+            if ((sep = strchr (*env, '=')) != NULL) {
+                *sep = '\0';
+                envp = g_environ_setenv (envp, *env, sep + 1, TRUE);
+            } else {
+                envp = g_environ_unsetenv (envp, *env);
+            }
             g_free (*env);
         }
         g_free (envlist);
     }
 
-    const gchar *path = tlm_config_get_string (priv->config,
-                                               TLM_CONFIG_GENERAL,
-                                               TLM_CONFIG_GENERAL_SESSION_PATH);
-    if (!path)
-        path = "/usr/local/bin:/usr/bin:/bin";
-    _setenv_to_session ("PATH", path, priv);
-
-    _setenv_to_session ("USER", priv->username, priv);
-    _setenv_to_session ("LOGNAME", priv->username, priv);
-    home_dir = tlm_user_get_home_dir (priv->username);
-    if (home_dir)
-    {
-        _setenv_to_session ("HOME", home_dir, priv);
-        g_free(home_dir);
-    }
-    shell = tlm_user_get_shell (priv->username);
-    if (shell)
-    {
-        _setenv_to_session ("SHELL", shell, priv);
-        g_free(shell);
-    }
+    envp = g_environ_setenv (envp, "PATH",
+                             tlm_utils_get_session_path (priv->config), TRUE);
+
+    envp = g_environ_setenv (envp, "USER", priv->username, TRUE);
+    envp = g_environ_setenv (envp, "LOGNAME", priv->username, TRUE);
+    if (priv->user_info->home_dir)
+        envp = g_environ_setenv (envp, "HOME", priv->user_info->home_dir,
+                                 TRUE);
+    if (priv->user_info->shell)
+        envp = g_environ_setenv (envp, "SHELL", priv->user_info->shell, TRUE);
 
     if (!tlm_config_has_key (priv->config,
                              TLM_CONFIG_GENERAL,
                              TLM_CONFIG_GENERAL_NSEATS))
-        _setenv_to_session ("XDG_SEAT", priv->seat_id, priv);
+        envp = g_environ_setenv (envp, "XDG_SEAT", priv->seat_id, TRUE);
 
     const gchar *xdg_data_dirs =
         tlm_config_get_string (priv->config,
@@ -474,39 +559,557 @@ _set_environment (TlmSessionPrivate *priv)
                                TLM_CONFIG_GENERAL_DATA_DIRS);
     if (!xdg_data_dirs)
         xdg_data_dirs = "/usr/share:/usr/local/share";
-    _setenv_to_session ("XDG_DATA_DIRS", xdg_data_dirs, priv);
+    envp = g_environ_setenv (envp, "XDG_DATA_DIRS", xdg_data_dirs, TRUE);
 
     if (priv->xdg_runtime_dir)
-        _setenv_to_session ("XDG_RUNTIME_DIR", priv->xdg_runtime_dir, priv);
+        envp = g_environ_setenv (envp, "XDG_RUNTIME_DIR",
+                                 priv->xdg_runtime_dir, TRUE);
+
+    if (priv->env_hash) {
+        g_hash_table_iter_init (&iter, priv->env_hash);
+        while (g_hash_table_iter_next (&iter, &key, &value))
+            envp = g_environ_setenv (envp, (const gchar *) key,
+                                     (const gchar *) value, TRUE);
+    }
+
+    return envp;
+}
+
+/*
+ * Argument vector of the user session with an absolute program path, NULL
+ * if the configured session command is unusable.
+ */
+static gchar **
+_build_session_args (TlmSessionPrivate *priv, gchar **envp)
+{
+    GError *error = NULL;
+    const gchar *env_shell = NULL;
+    const gchar *env_path = g_environ_getenv (envp, "PATH");
+    gchar **args = NULL;
+    gchar *program = NULL;
+
+    /* the PATH the session ends up with, PAM or the request may set it */
+    args = tlm_utils_get_session_command (priv->config, priv->seat_id,
+                                          env_path, &error);
+    if (args)
+        return args;
+    if (error) {
+        WARN ("%s", error->message);
+        g_error_free (error);
+        return NULL;
+    }
+
+    if ((env_shell = g_environ_getenv (envp, "SHELL"))) {
+        /* use shell if no override configured */
+        args = g_new0 (gchar *, 2);
+        args[0] = g_strdup (env_shell);
+    } else {
+        /* in case shell is not defined, fall back to systemd --user,
+         * execve() needs it with its full path */
+        program = tlm_utils_find_program ("systemd", env_path);
+        if (!program)
+            program = tlm_utils_find_program ("systemd",
+                                              SYSTEMD_PROGRAM_PATH);
+        if (!program) {
+            WARN ("no shell and no systemd to run the session");
+            return NULL;
+        }
+        args = g_new0 (gchar *, 3);
+        args[0] = program;
+        args[1] = g_strdup ("--user");
+    }
+    return args;
+}
+
+static void
+_on_runtime_dir_deleted (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+    GError *error = NULL;
+
+    if (!tlm_utils_delete_dir_finish (res, &error)) {
+        WARN ("runtime dir cleanup failed: %s", error->message);
+        g_error_free (error);
+    }
+    session->priv->pending_deletes--;
+}
+
+/* A tmpfs runtime directory goes away with its mount, whatever it holds */
+static void
+_unmount_runtime_dir (const gchar *dir)
+{
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+
+    if (umount2 (dir, MNT_DETACH) != 0) {
+        if (errno != EINVAL && errno != ENOENT)
+            WARN ("umount2(\"%s\"): %s", dir,
+                  strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        return;
+    }
+    if (g_rmdir (dir) != 0)
+        WARN ("rmdir(\"%s\"): %s", dir,
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+}
+
+/*
+ * The runtime directory belongs to the user, not to the session: another
+ * session of the same user on a different seat keeps using it
+ */
+static gboolean
+_is_runtime_dir_shared (TlmSessionPrivate *priv)
+{
+#ifdef HAVE_LIBSYSTEMD
+    char **sessions = NULL;
+    char *own = NULL;
+    gboolean shared = FALSE;
+    int i, count;
+
+    count = sd_uid_get_sessions (priv->user_info->uid, 0, &sessions);
+    if (count >= 0) {
+        if (sd_pid_get_session (getpid (), &own) < 0)
+            own = NULL;
+        for (i = 0; i < count; i++) {
+            char *state = NULL;
+            if (!shared && g_strcmp0 (sessions[i], own) != 0 &&
+                sd_session_get_state (sessions[i], &state) >= 0 &&
+                g_strcmp0 (state, "closing") != 0)
+                shared = TRUE;
+            free (state);
+            free (sessions[i]);
+        }
+        free (sessions);
+        free (own);
+        return shared;
+    }
+#endif
+    return tlm_utils_has_other_utmp_login (priv->username, getpid ());
+}
+
+/* dispose waits for the removals started here to finish */
+static void
+_delete_dir_in_background (TlmSession *session, const gchar *dir)
+{
+    session->priv->pending_deletes++;
+    tlm_utils_delete_dir_async (dir, NULL, NULL, NULL,
+                                _on_runtime_dir_deleted, session);
+}
+
+static void
+_stop_ready_wait (TlmSessionPrivate *priv)
+{
+    if (priv->ready_files_id) {
+        tlm_utils_unwatch_files (priv->ready_files_id);
+        priv->ready_files_id = 0;
+    }
+    if (priv->ready_watch_id) {
+        g_source_remove (priv->ready_watch_id);
+        priv->ready_watch_id = 0;
+    }
+    if (priv->ready_timeout_id) {
+        g_source_remove (priv->ready_timeout_id);
+        priv->ready_timeout_id = 0;
+    }
+    if (priv->notify_fd >= 0) {
+        close (priv->notify_fd);
+        priv->notify_fd = -1;
+    }
+}
+
+typedef void (*TaskFunc) (TlmSessionPrivate *priv, pid_t tid);
+
+static void
+_foreach_task (TlmSessionPrivate *priv, pid_t pid, TaskFunc func)
+{
+    gchar *task_path = g_strdup_printf ("/proc/%d/task", pid);
+    DIR *dir = opendir (task_path);
+    struct dirent *ent;
+
+    g_free (task_path);
+    if (!dir)
+        return;
+    while ((ent = readdir (dir)) != NULL) {
+        if (ent->d_name[0] >= '0' && ent->d_name[0] <= '9')
+            func (priv, atoi (ent->d_name));
+    }
+    closedir (dir);
+}
+
+/* Visits every thread of the running session, sessiond not included */
+static void
+_foreach_session_task (TlmSessionPrivate *priv, TaskFunc func)
+{
+    gchar *threads = NULL;
+    gchar **tids = NULL, **tid = NULL;
+    DIR *dir;
+    struct dirent *ent;
+
+    if (priv->cgroup) {
+        threads = tlm_cgroup_get_attribute (priv->cgroup, "cgroup.threads");
+        if (threads) {
+            tids = g_strsplit (threads, "\n", -1);
+            for (tid = tids; *tid; tid++) {
+                if (**tid)
+                    func (priv, atoi (*tid));
+            }
+            g_strfreev (tids);
+            g_free (threads);
+            return;
+        }
+    }
+
+    /* without a cgroup the session is whatever stayed in its setsid() */
+    if (priv->child_pid <= 0 || !(dir = opendir ("/proc")))
+        return;
+    while ((ent = readdir (dir)) != NULL) {
+        pid_t pid;
+        if (ent->d_name[0] < '0' || ent->d_name[0] > '9')
+            continue;
+        pid = atoi (ent->d_name);
+        if (getsid (pid) == priv->child_pid)
+            _foreach_task (priv, pid, func);
+    }
+    closedir (dir);
+}
+
+static void
+_boost_task (TlmSessionPrivate *priv, pid_t tid)
+{
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+
+    if (priv->boost_nice && setpriority (PRIO_PROCESS, tid, priv->boost_nice))
+        DBG ("setpriority(%d): %s", tid,
+             strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+    if (priv->boost_ioprio >= 0)
+        tlm_utils_set_ioprio (tid, priv->boost_ioprio);
+}
+
+/* threads which changed their priority meanwhile are left alone */
+static void
+_unboost_task (TlmSessionPrivate *priv, pid_t tid)
+{
+    if (priv->boost_nice) {
+        errno = 0;
+        if (getpriority (PRIO_PROCESS, tid) == priv->boost_nice && !errno)
+            setpriority (PRIO_PROCESS, tid, priv->saved_nice);
+    }
+    if (priv->boost_ioprio >= 0 &&
+        tlm_utils_get_ioprio (tid) == priv->boost_ioprio)
+        tlm_utils_set_ioprio (tid, priv->saved_ioprio);
+}
+
+static gint
+_get_boost_option (TlmSessionPrivate *priv, const gchar *key, gint value)
+{
+    if (tlm_config_has_key (priv->config, priv->seat_id, key))
+        return tlm_config_get_int (priv->config, priv->seat_id, key, value);
+    return tlm_config_get_int (priv->config, TLM_CONFIG_GENERAL, key, value);
+}
+
+static void
+_end_login_boost (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+
+    if (priv->boost_timeout_id) {
+        g_source_remove (priv->boost_timeout_id);
+        priv->boost_timeout_id = 0;
+    }
+    if (!priv->boosted)
+        return;
+
+    DBG ("ending login boost");
+    priv->boosted = FALSE;
+    _foreach_task (priv, getpid (), _unboost_task);
+    if (priv->boost_nice || priv->boost_ioprio >= 0)
+        _foreach_session_task (priv, _unboost_task);
+    if (priv->cgroup && priv->saved_cpu_weight)
+        tlm_cgroup_set_attribute (priv->cgroup, "cpu.weight",
+                                  priv->saved_cpu_weight);
+    g_clear_string (&priv->saved_cpu_weight);
+}
+
+static gboolean
+_on_boost_timeout (gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+
+    session->priv->boost_timeout_id = 0;
+    _end_login_boost (session);
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Raises the priority of sessiond for the login, the session inherits it
+ * when forked; it drops once the session is ready or the boost times out
+ */
+static void
+_start_login_boost (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+    const gchar *ioprio = NULL;
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+    guint timeout;
+
+    priv->boost_nice = _get_boost_option (priv,
+            TLM_CONFIG_GENERAL_LOGIN_BOOST_NICE, 0);
+    priv->boost_cpu_weight = (guint) MAX (0, _get_boost_option (priv,
+            TLM_CONFIG_GENERAL_LOGIN_BOOST_CPU_WEIGHT, 0));
+    ioprio = tlm_config_get_string (priv->config, priv->seat_id,
+                                    TLM_CONFIG_GENERAL_LOGIN_BOOST_IOPRIO);
+    if (!ioprio)
+        ioprio = tlm_config_get_string (priv->config, TLM_CONFIG_GENERAL,
+                                        TLM_CONFIG_GENERAL_LOGIN_BOOST_IOPRIO);
+    priv->boost_ioprio = -1;
+    if (ioprio && (priv->boost_ioprio = tlm_utils_parse_ioprio (ioprio)) < 0)
+        WARN ("ignoring invalid %s '%s'",
+              TLM_CONFIG_GENERAL_LOGIN_BOOST_IOPRIO, ioprio);
+
+    if (priv->boost_nice) {
+        errno = 0;
+        priv->saved_nice = getpriority (PRIO_PROCESS, 0);
+        if (errno) {
+            WARN ("getpriority(): %s",
+                  strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+            priv->boost_nice = 0;
+        }
+    }
+    if (priv->boost_ioprio >= 0 &&
+        (priv->saved_ioprio = tlm_utils_get_ioprio (0)) < 0) {
+        WARN ("ioprio_get(): %s",
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        priv->boost_ioprio = -1;
+    }
+    if (!priv->boost_nice && priv->boost_ioprio < 0 &&
+        !priv->boost_cpu_weight)
+        return;
+
+    DBG ("login boost: nice %d, ioprio %d, cpu.weight %u", priv->boost_nice,
+         priv->boost_ioprio, priv->boost_cpu_weight);
+    priv->boosted = TRUE;
+    /* PAM may already run helper threads */
+    _foreach_task (priv, getpid (), _boost_task);
+
+    timeout = (guint) MAX (0, _get_boost_option (priv,
+            TLM_CONFIG_GENERAL_LOGIN_BOOST_TIMEOUT_MS,
+            LOGIN_BOOST_DEFAULT_TIMEOUT));
+    if (timeout)
+        priv->boost_timeout_id = g_timeout_add (timeout, _on_boost_timeout,
+                                                session);
+}
+
+/* the session cgroup exists only once the session is about to be forked */
+static void
+_boost_session_cgroup (TlmSessionPrivate *priv)
+{
+    gchar weight[16];
+
+    if (!priv->boosted || !priv->boost_cpu_weight || !priv->cgroup ||
+        !tlm_cgroup_enable_controller (priv->cgroup, "cpu"))
+        return;
+
+    priv->saved_cpu_weight = tlm_cgroup_get_attribute (priv->cgroup,
+                                                       "cpu.weight");
+    g_snprintf (weight, sizeof (weight), "%u", priv->boost_cpu_weight);
+    if (!priv->saved_cpu_weight ||
+        !tlm_cgroup_set_attribute (priv->cgroup, "cpu.weight", weight)) {
+        WARN ("Failed to raise cpu.weight of '%s'", priv->cgroup);
+        g_clear_string (&priv->saved_cpu_weight);
+    }
+}
+
+/* Resource policy keys of a seat and the session cgroup files they set */
+static const struct {
+    const gchar *key;
+    const gchar *controller;
+    const gchar *file;
+} cgroup_policy[] = {
+    { TLM_CONFIG_SEAT_CPU_AFFINITY, "cpuset", "cpuset.cpus" },
+    { TLM_CONFIG_SEAT_CPU_WEIGHT, "cpu", "cpu.weight" },
+    { TLM_CONFIG_SEAT_CPU_MAX, "cpu", "cpu.max" },
+    { TLM_CONFIG_SEAT_IO_WEIGHT, "io", "io.weight" },
+    { TLM_CONFIG_SEAT_MEMORY_HIGH, "memory", "memory.high" },
+    { TLM_CONFIG_SEAT_MEMORY_MAX, "memory", "memory.max" },
+};
+
+/*
+ * Sets up the resource policy of the seat on the session cgroup and reads
+ * what the session process applies to itself before exec
+ */
+static gboolean
+_apply_resource_policy (TlmSessionPrivate *priv, GError **error)
+{
+    const gchar *value = NULL;
+    gchar *end = NULL;
+    gint64 adj;
+    guint i;
+
+    priv->set_affinity = FALSE;
+    priv->set_oom_score_adj = FALSE;
+    priv->cgroup_policy_set = FALSE;
+
+    for (i = 0; i < G_N_ELEMENTS (cgroup_policy); i++) {
+        value = tlm_config_get_string (priv->config, priv->seat_id,
+                                       cgroup_policy[i].key);
+        if (!value || !*value)
+            continue;
+        if (!priv->cgroup) {
+            if (g_strcmp0 (cgroup_policy[i].key,
+                           TLM_CONFIG_SEAT_CPU_AFFINITY) == 0)
+                continue;
+            g_set_error (error, TLM_ERROR, TLM_ERROR_SESSION_CREATION_FAILURE,
+                         "%s of seat %s needs a session cgroup",
+                         cgroup_policy[i].key, priv->seat_id);
+            return FALSE;
+        }
+        if (!tlm_cgroup_enable_controller (priv->cgroup,
+                                           cgroup_policy[i].controller) ||
+            !tlm_cgroup_set_attribute (priv->cgroup, cgroup_policy[i].file,
+                                       value)) {
+            g_set_error (error, TLM_ERROR, TLM_ERROR_SESSION_CREATION_FAILURE,
+                         "Unable to set %s of the session to '%s'",
+                         cgroup_policy[i].file, value);
+            return FALSE;
+        }
+        DBG ("%s of '%s' set to '%s'", cgroup_policy[i].file, priv->cgroup,
+             value);
+        priv->cgroup_policy_set = TRUE;
+    }
 
-    if (priv->env_hash)
-        g_hash_table_foreach (priv->env_hash,
-                              (GHFunc) _setenv_to_session,
-                              priv);
+    /* cpuset.cpus holds the session already, the affinity could be reset */
+    value = tlm_config_get_string (priv->config, priv->seat_id,
+                                   TLM_CONFIG_SEAT_CPU_AFFINITY);
+    if (value && *value && !priv->cgroup) {
+        if (!tlm_utils_parse_cpu_list (value, &priv->affinity)) {
+            g_set_error (error, TLM_ERROR, TLM_ERROR_SESSION_CREATION_FAILURE,
+                         "Invalid %s '%s'", TLM_CONFIG_SEAT_CPU_AFFINITY,
+                         value);
+            return FALSE;
+        }
+        priv->set_affinity = TRUE;
+    }
+
+    value = tlm_config_get_string (priv->config, priv->seat_id,
+                                   TLM_CONFIG_SEAT_OOM_SCORE_ADJ);
+    if (value && *value) {
+        adj = g_ascii_strtoll (value, &end, 10);
+        if (*end || adj < -1000 || adj > 1000) {
+            g_set_error (error, TLM_ERROR, TLM_ERROR_SESSION_CREATION_FAILURE,
+                         "Invalid %s '%s'", TLM_CONFIG_SEAT_OOM_SCORE_ADJ,
+                         value);
+            return FALSE;
+        }
+        priv->oom_score_adj = (gint) adj;
+        priv->set_oom_score_adj = TRUE;
+    }
 
     return TRUE;
 }
 
+/* Runs in the forked session process, while it still is privileged */
+static int
+_apply_process_policy (TlmSessionPrivate *priv)
+{
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+    gchar adj[16];
+    int err, fd;
+
+    if (priv->set_affinity &&
+        sched_setaffinity (0, sizeof (priv->affinity), &priv->affinity) < 0) {
+        err = errno;
+        WARN ("sched_setaffinity(): %s",
+              strerror_r(err, strerr_buf, MAX_STRERROR_LEN));
+        return err;
+    }
+
+    if (priv->set_oom_score_adj) {
+        g_snprintf (adj, sizeof (adj), "%d", priv->oom_score_adj);
+        fd = open ("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write (fd, adj, strlen (adj)) < 0) {
+            err = errno;
+            WARN ("setting oom_score_adj: %s",
+                  strerror_r(err, strerr_buf, MAX_STRERROR_LEN));
+            if (fd >= 0)
+                close (fd);
+            return err;
+        }
+        close (fd);
+    }
+
+    return 0;
+}
+
 static void
-_clear_session (TlmSession *session)
+_set_aside_runtime_dir (TlmSession *session);
+
+/*
+ * Hands back what the next session of the seat or of the user sets up again,
+ * quickly enough to be done before the session is reported terminated
+ */
+static void
+_release_session_resources (TlmSession *session)
 {
     TlmSessionPrivate *priv = TLM_SESSION_PRIV (session);
 
     _reset_terminal (priv);
 
-    if (priv->setup_runtime_dir)
-        tlm_utils_delete_dir (priv->xdg_runtime_dir);
+    /* the session is over, do not hold up its teardown on the removal */
+    if ((priv->runtime_dir_mounted || priv->setup_runtime_dir) &&
+        priv->xdg_runtime_dir && _is_runtime_dir_shared (priv)) {
+        DBG ("%s is still in use by another session",
+             priv->xdg_runtime_dir);
+    } else if (priv->runtime_dir_mounted) {
+        _unmount_runtime_dir (priv->xdg_runtime_dir);
+    } else if (priv->setup_runtime_dir && priv->xdg_runtime_dir &&
+        priv->runtime_dir_cleanup != RUNTIME_DIR_CLEANUP_REUSE) {
+        /* out of the path of the next session in one step */
+        _set_aside_runtime_dir (session);
+    }
+    priv->runtime_dir_mounted = FALSE;
+    priv->setup_runtime_dir = FALSE;
+}
+
+/* Drops the rest of the session state once its resources are released */
+static void
+_clear_session_state (TlmSession *session)
+{
+    TlmSessionPrivate *priv = TLM_SESSION_PRIV (session);
 
     if (priv->timer_id) {
         g_source_remove (priv->timer_id);
         priv->timer_id = 0;
     }
+    priv->last_sig = 0;
+    priv->terminate_deadline = 0;
 
     if (priv->child_watch_id) {
         g_source_remove (priv->child_watch_id);
         priv->child_watch_id = 0;
     }
 
+    if (priv->cgroup_watch_id) {
+        tlm_cgroup_unwatch (priv->cgroup_watch_id);
+        priv->cgroup_watch_id = 0;
+    }
+
+    if (priv->utmp_idle_id) {
+        g_source_remove (priv->utmp_idle_id);
+        priv->utmp_idle_id = 0;
+    }
+
+    _stop_ready_wait (priv);
+    _end_login_boost (session);
+    priv->ready_pending = FALSE;
+    priv->ready_mode = SESSION_READY_NONE;
+    g_clear_string (&priv->ready_path);
+
+    if (priv->cgroup) {
+        tlm_cgroup_remove (priv->cgroup);
+        g_clear_string (&priv->cgroup);
+    }
+
     if (priv->auth_session)
         g_clear_object (&priv->auth_session);
 
@@ -517,10 +1120,397 @@ _clear_session (TlmSession *session)
     g_clear_string (&priv->seat_id);
     g_clear_string (&priv->service);
     g_clear_string (&priv->username);
+    if (priv->user_info) {
+        tlm_user_info_free (priv->user_info);
+        priv->user_info = NULL;
+    }
     g_clear_string (&priv->sessionid);
     g_clear_string (&priv->xdg_runtime_dir);
 }
 
+static void
+_clear_session (TlmSession *session)
+{
+    _release_session_resources (session);
+    _clear_session_state (session);
+}
+
+static gboolean
+_terminate_timeout (gpointer user_data);
+
+/* Stage timeout of the termination ladder, the stages left share what is
+ * left of the deadline given by the daemon, if any */
+static guint
+_get_stage_timeout (
+        TlmSessionPrivate *priv,
+        gint stages_left)
+{
+    guint timeout = tlm_utils_get_terminate_timeout (priv->config);
+    gint64 remaining;
+
+    if (!priv->terminate_deadline)
+        return timeout;
+
+    remaining = (priv->terminate_deadline - g_get_monotonic_time ()) / 1000;
+    remaining = MAX (remaining / stages_left, 0);
+    /* SIGKILL is not instant, the last stage never runs out entirely */
+    if (stages_left == 1)
+        remaining = MAX (remaining, TLM_TERMINATE_KILL_GRACE_MS);
+    return (guint) MIN ((gint64) timeout, remaining);
+}
+
+static void
+_schedule_terminate_timeout (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+    gint stages_left;
+
+    switch (priv->last_sig) {
+        case SIGHUP:
+            stages_left = 3;
+            break;
+        case SIGTERM:
+            stages_left = 2;
+            break;
+        default:
+            stages_left = 1;
+    }
+    if (priv->timer_id)
+        g_source_remove (priv->timer_id);
+    priv->timer_id = g_timeout_add (_get_stage_timeout (priv, stages_left),
+            _terminate_timeout, session);
+}
+
+static gboolean
+_log_utmp_idle_cb (gpointer user_data)
+{
+    TlmSessionPrivate *priv = TLM_SESSION_PRIV (TLM_SESSION (user_data));
+
+    priv->utmp_idle_id = 0;
+    tlm_utils_log_utmp_entry (priv->username);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_report_session_created (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+
+    /* the readiness wait reports once the session is usable */
+    if (priv->ready_pending)
+        return;
+
+    g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
+                   priv->sessionid ? priv->sessionid : "");
+    if (priv->session_pause) {
+        pause ();
+        exit (0);
+    }
+}
+
+static void
+_session_ready (TlmSession *session, gboolean ready)
+{
+    TlmSessionPrivate *priv = session->priv;
+    gint64 latency = (g_get_monotonic_time () - priv->exec_time) / 1000;
+
+    priv->ready_pending = FALSE;
+    _stop_ready_wait (priv);
+    _end_login_boost (session);
+    if (ready)
+        DBG ("session ready %" G_GINT64_FORMAT " ms after exec", latency);
+    else
+        WARN ("session not confirmed ready after %" G_GINT64_FORMAT " ms",
+              latency);
+
+    if (!priv->sessionid_pending)
+        _report_session_created (session);
+}
+
+static gboolean
+_on_ready_timeout (gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+
+    session->priv->ready_timeout_id = 0;
+    _session_ready (session, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_on_ready_notify (gint fd, GIOCondition condition, gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+    gchar buf[256];
+    gchar **lines = NULL, **line = NULL;
+    gboolean ready = FALSE;
+    ssize_t len;
+
+    len = recv (fd, buf, sizeof (buf) - 1, MSG_DONTWAIT);
+    if (len < 0 && (errno == EAGAIN || errno == EINTR))
+        return G_SOURCE_CONTINUE;
+    if (len > 0) {
+        buf[len] = '\0';
+        lines = g_strsplit (buf, "\n", -1);
+        for (line = lines; *line && !ready; line++)
+            ready = g_strcmp0 (g_strstrip (*line), "READY=1") == 0;
+        g_strfreev (lines);
+        if (!ready)
+            return G_SOURCE_CONTINUE;
+    } else {
+        DBG ("session closed its readiness descriptor");
+    }
+
+    session->priv->ready_watch_id = 0;
+    _session_ready (session, ready);
+    return G_SOURCE_REMOVE;
+}
+
+/* Looks the socket up in /proc/net/unix instead of connecting to it, as a
+ * probing connection would show up as a client to the session */
+static gboolean
+_is_socket_listening (const gchar *path)
+{
+    gchar *contents = NULL;
+    gchar **lines = NULL, **line = NULL;
+    gulong flags = 0;
+    gboolean res = FALSE;
+    int pos;
+
+    if (!g_file_get_contents ("/proc/net/unix", &contents, NULL, NULL))
+        return FALSE;
+
+    lines = g_strsplit (contents, "\n", -1);
+    /* skip the header, the bound path follows the inode number */
+    for (line = lines + 1; *line && !res; line++) {
+        pos = 0;
+        if (sscanf (*line, "%*s %*x %*x %lx %*x %*x %*u %n",
+                    &flags, &pos) < 1 || !pos)
+            continue;
+        res = (flags & SESSION_SOCKET_ACCEPTCON) &&
+              g_strcmp0 (g_strchomp (*line + pos), path) == 0;
+    }
+
+    g_strfreev (lines);
+    g_free (contents);
+    return res;
+}
+
+static gboolean
+_on_ready_poll (gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+
+    if (!_is_socket_listening (session->priv->ready_path))
+        return G_SOURCE_CONTINUE;
+
+    session->priv->ready_watch_id = 0;
+    _session_ready (session, TRUE);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_on_ready_file (
+        const gchar *found_item,
+        gboolean is_final,
+        GError *error,
+        gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+    TlmSessionPrivate *priv = session->priv;
+
+    /* the watch goes away by itself after the last file */
+    if (is_final)
+        priv->ready_files_id = 0;
+    if (!priv->ready_pending)
+        return;
+
+    if (priv->ready_mode != SESSION_READY_SOCKET ||
+        _is_socket_listening (priv->ready_path)) {
+        _session_ready (session, TRUE);
+        return;
+    }
+    /* bound but not listening yet, which does not take long */
+    if (!priv->ready_watch_id)
+        priv->ready_watch_id = g_timeout_add (SESSION_READY_POLL_INTERVAL,
+                _on_ready_poll, session);
+}
+
+/* Reads the readiness condition of the session about to be started */
+static void
+_setup_session_ready (TlmSessionPrivate *priv)
+{
+    const gchar *cond = NULL, *path = NULL;
+    struct sockaddr_un addr;
+
+    priv->ready_mode = SESSION_READY_NONE;
+    g_clear_string (&priv->ready_path);
+
+    cond = tlm_config_get_string (priv->config, priv->seat_id,
+                                  TLM_CONFIG_GENERAL_SESSION_READY);
+    if (!cond)
+        cond = tlm_config_get_string (priv->config, TLM_CONFIG_GENERAL,
+                                      TLM_CONFIG_GENERAL_SESSION_READY);
+    if (!cond || !*cond)
+        return;
+
+    if (g_strcmp0 (cond, "notify") == 0) {
+        priv->ready_mode = SESSION_READY_NOTIFY;
+        return;
+    }
+    if (g_str_has_prefix (cond, "socket:")) {
+        priv->ready_mode = SESSION_READY_SOCKET;
+        path = cond + strlen ("socket:");
+    } else if (g_str_has_prefix (cond, "file:")) {
+        priv->ready_mode = SESSION_READY_FILE;
+        path = cond + strlen ("file:");
+    } else {
+        WARN ("Unknown session readiness condition '%s'", cond);
+        return;
+    }
+
+    if (g_path_is_absolute (path))
+        priv->ready_path = g_strdup (path);
+    else if (*path && priv->xdg_runtime_dir)
+        priv->ready_path = g_build_filename (priv->xdg_runtime_dir, path,
+                                             NULL);
+    if (!priv->ready_path ||
+        (priv->ready_mode == SESSION_READY_SOCKET &&
+         strlen (priv->ready_path) >= sizeof (addr.sun_path))) {
+        WARN ("Invalid path in session readiness condition '%s'", cond);
+        priv->ready_mode = SESSION_READY_NONE;
+        g_clear_string (&priv->ready_path);
+    }
+}
+
+/* Starts waiting for the readiness condition of the executed session */
+static void
+_wait_session_ready (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+    const gchar *watch_list[2] = { NULL, NULL };
+    guint timeout = SESSION_READY_DEFAULT_TIMEOUT;
+    guint watch_id = 0;
+
+    priv->exec_time = g_get_monotonic_time ();
+    if (priv->ready_mode == SESSION_READY_NONE)
+        return;
+
+    if (tlm_config_has_key (priv->config, priv->seat_id,
+                            TLM_CONFIG_GENERAL_SESSION_READY_TIMEOUT_MS))
+        timeout = tlm_config_get_uint (priv->config, priv->seat_id,
+                TLM_CONFIG_GENERAL_SESSION_READY_TIMEOUT_MS, timeout);
+    else
+        timeout = tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
+                TLM_CONFIG_GENERAL_SESSION_READY_TIMEOUT_MS, timeout);
+
+    switch (priv->ready_mode) {
+        case SESSION_READY_NOTIFY:
+            if (priv->notify_fd >= 0)
+                priv->ready_watch_id = g_unix_fd_add (priv->notify_fd,
+                        G_IO_IN | G_IO_HUP | G_IO_ERR, _on_ready_notify,
+                        session);
+            break;
+        case SESSION_READY_SOCKET:
+        case SESSION_READY_FILE:
+            watch_list[0] = priv->ready_path;
+            /* no watch is left if the file is already there, in which case
+             * the caller reports the session right away */
+            watch_id = tlm_utils_watch_for_files (watch_list, _on_ready_file,
+                                                  session);
+            if (!watch_id && g_file_test (priv->ready_path,
+                                          G_FILE_TEST_EXISTS)) {
+                if (priv->ready_mode == SESSION_READY_FILE ||
+                    _is_socket_listening (priv->ready_path)) {
+                    DBG ("session ready at exec");
+                    return;
+                }
+                priv->ready_watch_id = g_timeout_add (
+                        SESSION_READY_POLL_INTERVAL, _on_ready_poll, session);
+            }
+            priv->ready_files_id = watch_id;
+            break;
+        default:
+            break;
+    }
+
+    priv->ready_pending = TRUE;
+    if (timeout)
+        priv->ready_timeout_id = g_timeout_add (timeout, _on_ready_timeout,
+                                                session);
+}
+
+#ifndef TLM_SESSIOND_LITE
+static void
+_on_sessionid_resolved (
+        GObject *source,
+        GAsyncResult *res,
+        gpointer user_data)
+{
+    TlmSession *session = TLM_SESSION (user_data);
+    TlmSessionPrivate *priv = session->priv;
+    GError *error = NULL;
+
+    priv->sessionid_pending = FALSE;
+    if (!tlm_auth_session_resolve_sessionid_finish (TLM_AUTH_SESSION (source),
+                                                    res, &error)) {
+        WARN ("failed to get logind session id: %s", error->message);
+        g_error_free (error);
+    } else if (priv->auth_session == TLM_AUTH_SESSION (source)) {
+        priv->sessionid = g_strdup (tlm_auth_session_get_sessionid (
+                priv->auth_session));
+    }
+
+    /* report only if the session was not torn down in the meantime */
+    if (priv->auth_session == TLM_AUTH_SESSION (source))
+        _report_session_created (session);
+    g_object_unref (session);
+}
+#endif
+
+/*
+ * The seat can start its next session as soon as it knows about the end of
+ * this one, only closing PAM and the remaining cleanup are left for after
+ */
+static void
+_session_ended (TlmSession *session)
+{
+    session->priv->is_child_up = FALSE;
+    _release_session_resources (session);
+    if (session->priv->can_emit_signal)
+        g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0);
+    _clear_session_state (session);
+}
+
+static void
+_on_cgroup_empty_cb (
+        const gchar *cgroup,
+        gpointer data)
+{
+    TlmSession *session = TLM_SESSION (data);
+
+    session->priv->cgroup_watch_id = 0;
+    /* session leader not reaped yet, the child watch completes teardown */
+    if (session->priv->child_pid)
+        return;
+
+    DBG ("session cgroup '%s' is empty", cgroup);
+    _session_ended (session);
+}
+
+static void
+_kill_session_cgroup (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+
+    if (!tlm_cgroup_kill (priv->cgroup))
+        WARN ("Failed to kill processes of '%s'", priv->cgroup);
+    priv->last_sig = SIGKILL;
+    if (!priv->cgroup_watch_id)
+        priv->cgroup_watch_id = tlm_cgroup_watch_empty (priv->cgroup,
+                _on_cgroup_empty_cb, session);
+}
+
 static void
 _on_child_down_cb (
         GPid  pid,
@@ -530,38 +1520,241 @@ _on_child_down_cb (
     g_spawn_close_pid (pid);
 
     TlmSession *session = TLM_SESSION (data);
+    TlmSessionPrivate *priv = session->priv;
 
     DBG ("Sessiond(%p) with pid (%d) closed with status %d", session, pid,
             status);
 
-    session->priv->child_pid = 0;
-    session->priv->is_child_up = FALSE;
-    _clear_session (session);
-    if (session->priv->can_emit_signal)
-        g_signal_emit (session, signals[SIG_SESSION_TERMINATED], 0);
+    priv->child_pid = 0;
+    priv->child_watch_id = 0;
+    if (priv->cgroup && tlm_cgroup_is_populated (priv->cgroup)) {
+        /* leader is gone but processes escaped from its process group are
+         * still around, the session is over once the cgroup drains */
+        if (priv->last_sig != SIGKILL) {
+            /* they get the same grace period as the session leader */
+            DBG ("terminating leftover processes of '%s'", priv->cgroup);
+            tlm_cgroup_signal (priv->cgroup, SIGTERM);
+            priv->last_sig = SIGTERM;
+            _schedule_terminate_timeout (session);
+        }
+        if (!priv->cgroup_watch_id)
+            priv->cgroup_watch_id = tlm_cgroup_watch_empty (priv->cgroup,
+                    _on_cgroup_empty_cb, session);
+        return;
+    }
+
+    _session_ended (session);
+}
+
+static RuntimeDirCleanup
+_get_runtime_dir_cleanup (TlmSessionPrivate *priv)
+{
+    const gchar *mode = tlm_config_get_string (priv->config,
+                                               priv->seat_id,
+                                               TLM_CONFIG_GENERAL_RUNTIME_DIR_CLEANUP);
+    if (!mode)
+        mode = tlm_config_get_string (priv->config,
+                                      TLM_CONFIG_GENERAL,
+                                      TLM_CONFIG_GENERAL_RUNTIME_DIR_CLEANUP);
+
+    if (!mode || g_strcmp0 (mode, "delete") == 0)
+        return RUNTIME_DIR_CLEANUP_DELETE;
+    if (g_strcmp0 (mode, "rename") == 0)
+        return RUNTIME_DIR_CLEANUP_RENAME;
+    if (g_strcmp0 (mode, "reuse") == 0)
+        return RUNTIME_DIR_CLEANUP_REUSE;
+
+    WARN ("unknown runtime dir cleanup mode '%s'", mode);
+    return RUNTIME_DIR_CLEANUP_DELETE;
+}
+
+/* Removes copies set aside by earlier sessions, including ones whose
+ * removal was interrupted */
+static void
+_collect_stale_runtime_dirs (TlmSession *session)
+{
+    GDir *dir = g_dir_open (RUNTIME_DIR_BASE, 0, NULL);
+    const gchar *name = NULL;
+    gchar *path = NULL;
+
+    if (!dir)
+        return;
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        if (!g_str_has_prefix (name, RUNTIME_DIR_STALE_PREFIX))
+            continue;
+        path = g_build_filename (RUNTIME_DIR_BASE, name, NULL);
+        _delete_dir_in_background (session, path);
+        g_free (path);
+    }
+    g_dir_close (dir);
 }
 
+/* Moves the previous runtime directory out of the way in one step, its
+ * contents are removed in the background */
 static void
+_set_aside_runtime_dir (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+    struct stat st;
+    gchar *stale = NULL;
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+
+    if (lstat (priv->xdg_runtime_dir, &st) != 0)
+        goto collect;
+
+    if (!S_ISDIR (st.st_mode)) {
+        if (g_unlink (priv->xdg_runtime_dir))
+            WARN ("unlink(\"%s\"): %s", priv->xdg_runtime_dir,
+                  strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        goto collect;
+    }
+
+    stale = g_strdup_printf ("%s/%s%u.%d.%" G_GINT64_FORMAT, RUNTIME_DIR_BASE,
+                             RUNTIME_DIR_STALE_PREFIX, priv->user_info->uid,
+                             getpid (), g_get_real_time ());
+    if (rename (priv->xdg_runtime_dir, stale) != 0) {
+        WARN ("rename(\"%s\"): %s", priv->xdg_runtime_dir,
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        tlm_utils_delete_dir (priv->xdg_runtime_dir);
+    } else {
+        DBG ("moved previous runtime dir to %s", stale);
+    }
+    g_free (stale);
+
+collect:
+    _collect_stale_runtime_dirs (session);
+}
+
+static const gchar *
+_get_runtime_dir_option (TlmSessionPrivate *priv, const gchar *key)
+{
+    const gchar *value = tlm_config_get_string (priv->config,
+                                                priv->seat_id, key);
+    if (!value)
+        value = tlm_config_get_string (priv->config, TLM_CONFIG_GENERAL, key);
+    if (value && strchr (value, ',')) {
+        WARN ("ignoring invalid %s '%s'", key, value);
+        return NULL;
+    }
+    return value;
+}
+
+static gboolean
+_get_runtime_dir_tmpfs (TlmSessionPrivate *priv)
+{
+    if (tlm_config_has_key (priv->config, priv->seat_id,
+                            TLM_CONFIG_GENERAL_RUNTIME_DIR_TMPFS))
+        return tlm_config_get_boolean (priv->config, priv->seat_id,
+                            TLM_CONFIG_GENERAL_RUNTIME_DIR_TMPFS, FALSE);
+    return tlm_config_get_boolean (priv->config, TLM_CONFIG_GENERAL,
+                            TLM_CONFIG_GENERAL_RUNTIME_DIR_TMPFS, FALSE);
+}
+
+/* Mounts a private tmpfs over the runtime directory so that the session
+ * cannot exhaust /run for others */
+static gboolean
+_mount_runtime_dir (TlmSessionPrivate *priv, guint perm)
+{
+    const gchar *size = _get_runtime_dir_option (priv,
+            TLM_CONFIG_GENERAL_RUNTIME_DIR_SIZE);
+    const gchar *inodes = _get_runtime_dir_option (priv,
+            TLM_CONFIG_GENERAL_RUNTIME_DIR_INODES);
+    GString *options = g_string_new (NULL);
+    gboolean res = TRUE;
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+
+    g_string_printf (options, "mode=%o,uid=%u,gid=%u", perm,
+                     priv->user_info->uid, priv->user_info->gid);
+    if (size)
+        g_string_append_printf (options, ",size=%s", size);
+    if (inodes)
+        g_string_append_printf (options, ",nr_inodes=%s", inodes);
+
+    DBG ("mounting tmpfs on %s (%s)", priv->xdg_runtime_dir, options->str);
+    if (mount ("tmpfs", priv->xdg_runtime_dir, "tmpfs", MS_NOSUID | MS_NODEV,
+               options->str) != 0) {
+        WARN ("mount(\"%s\"): %s", priv->xdg_runtime_dir,
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        res = FALSE;
+    }
+    g_string_free (options, TRUE);
+
+    return res;
+}
+
+/* Keeps the runtime directory of a previous session of the same user */
+static gboolean
+_reuse_runtime_dir (TlmSessionPrivate *priv, guint perm)
+{
+    struct stat st;
+    gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
+
+    if (lstat (priv->xdg_runtime_dir, &st) != 0 || !S_ISDIR (st.st_mode) ||
+        st.st_uid != priv->user_info->uid)
+        return FALSE;
+
+    if (chmod (priv->xdg_runtime_dir, perm))
+        WARN ("chmod(\"%s\"): %s", priv->xdg_runtime_dir,
+              strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+    DBG ("reusing XDG_RUNTIME_DIR=%s", priv->xdg_runtime_dir);
+    return TRUE;
+}
+
+/* Runs in the forked child, hands errno to the parent and never returns */
+static void
+_report_exec_failure (int fd, int err)
+{
+    ssize_t res;
+
+    do {
+        res = write (fd, &err, sizeof (err));
+    } while (res < 0 && errno == EINTR);
+    _exit (EXIT_FAILURE);
+}
+
+/*
+ * Blocks until the child either execs, which closes the CLOEXEC pipe, or
+ * writes the errno of the failure. Returns 0 on success.
+ */
+static int
+_wait_exec_result (int fd)
+{
+    int err = 0;
+    ssize_t res;
+
+    do {
+        res = read (fd, &err, sizeof (err));
+    } while (res < 0 && errno == EINTR);
+    if (res < 0)
+        return errno;
+    if (res != sizeof (err))
+        return 0;
+    return err ? err : EIO;
+}
+
+static gboolean
 _exec_user_session (
-		TlmSession *session)
+		TlmSession *session,
+		GError **error)
 {
     int tty_fd = -1;
+    int exec_pipe[2] = { -1, -1 };
+    int exec_err = 0;
+    int notify_fds[2] = { -1, -1 };
     gint i;
     guint rtdir_perm = 0700;
     const gchar *rtdir_perm_str;
-    const char *home;
-    const char *shell = NULL;
-    const char *env_shell = NULL;
+    gboolean use_tmpfs = FALSE;
     gchar *uid_str;
     gchar **args = NULL;
     gchar **args_iter = NULL;
+    gchar **envp = NULL;
+    const gchar *home_dir = NULL;
     TlmSessionPrivate *priv = session->priv;
     gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
 
     priv = session->priv;
-    if (!priv->username)
-        priv->username = g_strdup (tlm_auth_session_get_username (
-                priv->auth_session));
     DBG ("session ID : %s", priv->sessionid);
 
     if (tlm_config_has_key (priv->config,
@@ -584,27 +1777,51 @@ _exec_user_session (
         rtdir_perm_str = tlm_config_get_string (priv->config,
                                                TLM_CONFIG_GENERAL,
                                                TLM_CONFIG_GENERAL_RUNTIME_MODE);
-    uid_str = g_strdup_printf ("%u", tlm_user_get_uid (priv->username));
-    priv->xdg_runtime_dir = g_build_filename ("/run/user",
+    uid_str = g_strdup_printf ("%u", priv->user_info->uid);
+    priv->xdg_runtime_dir = g_build_filename (RUNTIME_DIR_BASE,
                                               uid_str,
                                               NULL);
     g_free (uid_str);
-    if (priv->setup_runtime_dir) {
-        tlm_utils_delete_dir (priv->xdg_runtime_dir);
-        if (g_mkdir_with_parents ("/run/user", 0755))
-            WARN ("g_mkdir_with_parents(\"/run/user\") failed");
+    if (priv->setup_runtime_dir && _is_runtime_dir_shared (priv)) {
+        /* set up by an earlier session of the user that is still running,
+         * the last one of them to end cleans up */
+        DBG ("keeping XDG_RUNTIME_DIR=%s of another session",
+             priv->xdg_runtime_dir);
+        priv->runtime_dir_cleanup = _get_runtime_dir_cleanup (priv);
+        priv->runtime_dir_mounted = _get_runtime_dir_tmpfs (priv);
+    } else if (priv->setup_runtime_dir) {
+        priv->runtime_dir_cleanup = _get_runtime_dir_cleanup (priv);
+        if (g_mkdir_with_parents (RUNTIME_DIR_BASE, 0755))
+            WARN ("g_mkdir_with_parents(\"%s\") failed", RUNTIME_DIR_BASE);
         if (rtdir_perm_str)
             sscanf(rtdir_perm_str, "%o", &rtdir_perm);
-        DBG ("setting up XDG_RUNTIME_DIR=%s mode=%o",
-             priv->xdg_runtime_dir, rtdir_perm);
-        if (g_mkdir (priv->xdg_runtime_dir, rtdir_perm))
-            WARN ("g_mkdir(\"%s\") failed", priv->xdg_runtime_dir);
-        if (chown (priv->xdg_runtime_dir,
-               tlm_user_get_uid (priv->username),
-               tlm_user_get_gid (priv->username)))
-            WARN ("chown(\"%s\"): %s", priv->xdg_runtime_dir, strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
-        if (chmod (priv->xdg_runtime_dir, rtdir_perm))
-            WARN ("chmod(\"%s\"): %s", priv->xdg_runtime_dir, strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        use_tmpfs = _get_runtime_dir_tmpfs (priv);
+        /* no other session of the user is left, a mount still there was
+         * left behind by an interrupted one */
+        if (use_tmpfs)
+            _unmount_runtime_dir (priv->xdg_runtime_dir);
+
+        if (use_tmpfs ||
+            priv->runtime_dir_cleanup != RUNTIME_DIR_CLEANUP_REUSE ||
+            !_reuse_runtime_dir (priv, rtdir_perm)) {
+            if (priv->runtime_dir_cleanup == RUNTIME_DIR_CLEANUP_DELETE)
+                tlm_utils_delete_dir (priv->xdg_runtime_dir);
+            else
+                _set_aside_runtime_dir (session);
+            DBG ("setting up XDG_RUNTIME_DIR=%s mode=%o",
+                 priv->xdg_runtime_dir, rtdir_perm);
+            if (g_mkdir (priv->xdg_runtime_dir, rtdir_perm))
+                WARN ("g_mkdir(\"%s\") failed", priv->xdg_runtime_dir);
+            if (chown (priv->xdg_runtime_dir,
+                   priv->user_info->uid,
+                   priv->user_info->gid))
+                WARN ("chown(\"%s\"): %s", priv->xdg_runtime_dir, strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+            if (chmod (priv->xdg_runtime_dir, rtdir_perm))
+                WARN ("chmod(\"%s\"): %s", priv->xdg_runtime_dir, strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+            if (use_tmpfs)
+                priv->runtime_dir_mounted = _mount_runtime_dir (priv,
+                                                                rtdir_perm);
+        }
     } else {
         DBG ("not setting up XDG_RUNTIME_DIR");
     }
@@ -627,39 +1844,123 @@ _exec_user_session (
         tty_fd = _prepare_terminal (priv);
         if (tty_fd < 0) {
             WARN ("Failed to prepare terminal");
-            return;
+            g_set_error (error, TLM_ERROR, TLM_ERROR_SESSION_CREATION_FAILURE,
+                         "Unable to prepare terminal");
+            return FALSE;
         }
     }
 
+    priv->cgroup = tlm_cgroup_get_session_path (priv->config, priv->seat_id,
+                                                getpid ());
+    if (priv->cgroup && !tlm_cgroup_create (priv->cgroup)) {
+        WARN ("Session cgroup not available, using process group only");
+        g_clear_string (&priv->cgroup);
+    }
+    /* the parent hands controllers down only while no process is in it */
+    if (priv->cgroup && !tlm_cgroup_leave_parent (priv->cgroup, getpid ()))
+        WARN ("Failed to move out of the parent of '%s'", priv->cgroup);
+    if (!_apply_resource_policy (priv, error)) {
+        WARN ("%s", (*error)->message);
+        if (tty_fd >= 0)
+            close (tty_fd);
+        return FALSE;
+    }
+    _boost_session_cgroup (priv);
+
+    /* everything the child needs is prepared before forking */
+    envp = _build_environment (priv);
+    args = _build_session_args (priv, envp);
+
+    _setup_session_ready (priv);
+    if (priv->ready_mode == SESSION_READY_NOTIFY) {
+        if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0,
+                        notify_fds) < 0) {
+            WARN ("socketpair(): %s",
+                  strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+            notify_fds[0] = notify_fds[1] = -1;
+        } else {
+            gchar *fd_str = g_strdup_printf ("%d", notify_fds[1]);
+            envp = g_environ_setenv (envp, SESSION_READY_NOTIFY_ENV, fd_str,
+                                     TRUE);
+            g_free (fd_str);
+        }
+    }
+
+    /* the write end is closed by a successful exec, anything read from the
+     * pipe is the errno of a failed one */
+    if (pipe2 (exec_pipe, O_CLOEXEC) < 0) {
+        WARN ("pipe2(): %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+        exec_pipe[0] = exec_pipe[1] = -1;
+    }
+
     priv->child_pid = fork ();
+    /* before anything else gets to overwrite it */
+    if (priv->child_pid < 0)
+        exec_err = errno;
     if (priv->child_pid) {
+        int status = 0;
+
+        g_strfreev (args);
+        g_strfreev (envp);
         if (tty_fd >= 0)
             close (tty_fd);
+        if (exec_pipe[1] >= 0)
+            close (exec_pipe[1]);
+        if (priv->child_pid < 0) {
+            priv->child_pid = 0;
+        } else if (exec_pipe[0] >= 0) {
+            exec_err = _wait_exec_result (exec_pipe[0]);
+            if (exec_err) {
+                while (waitpid (priv->child_pid, &status, 0) < 0 &&
+                       errno == EINTR);
+                priv->child_pid = 0;
+            }
+        }
+        if (exec_pipe[0] >= 0)
+            close (exec_pipe[0]);
+        if (notify_fds[1] >= 0)
+            close (notify_fds[1]);
+        priv->notify_fd = notify_fds[0];
+        if (exec_err) {
+            WARN ("Failed to start user session: %s",
+                  strerror_r(exec_err, strerr_buf, MAX_STRERROR_LEN));
+            g_set_error (error, TLM_ERROR, TLM_ERROR_SESSION_EXEC_FAILURE,
+                         "Unable to execute session command: %s",
+                         strerror_r(exec_err, strerr_buf, MAX_STRERROR_LEN));
+            return FALSE;
+        }
         DBG ("establish handler for the child pid %u", priv->child_pid);
         session->priv->child_watch_id = g_child_watch_add (priv->child_pid,
                     (GChildWatchFunc)_on_child_down_cb, session);
         session->priv->is_child_up = TRUE;
-        return;
+        _wait_session_ready (session);
+        return TRUE;
     }
 
     /* ==================================
      * this is child process here onwards
      * ================================== */
 
-    gint open_max;
-    gint fd;
-
     //close all open descriptors other than stdin, stdout, stderr
-    open_max = sysconf (_SC_OPEN_MAX);
-    for (fd = 3; fd < open_max; fd++) {
-        if (fcntl (fd, F_SETFD, FD_CLOEXEC) < -1) {
-            WARN ("Failed to close desriptor '%d', error: %s",
-                fd, strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
-        }
+    if (!tlm_utils_set_cloexec_from (3))
+        WARN ("Failed to close inherited descriptors");
+    if (notify_fds[1] >= 0 && fcntl (notify_fds[1], F_SETFD, 0) < 0)
+        WARN ("Failed to pass readiness descriptor");
+
+    if (priv->cgroup && !tlm_cgroup_attach (priv->cgroup, getpid ())) {
+        exec_err = errno;
+        WARN ("Failed to move session into '%s'", priv->cgroup);
+        /* the session would run without the policy of its seat */
+        if (priv->cgroup_policy_set)
+            _report_exec_failure (exec_pipe[1], exec_err);
     }
 
-    uid_t target_uid = tlm_user_get_uid (priv->username);
-    gid_t target_gid = tlm_user_get_gid (priv->username);
+    exec_err = _apply_process_policy (priv);
+    if (exec_err)
+        _report_exec_failure (exec_pipe[1], exec_err);
+
+    uid_t target_uid = priv->user_info->uid;
+    gid_t target_gid = priv->user_info->gid;
 
     /*if (getppid() == 1) {
         if (setsid () == (pid_t) -1)
@@ -679,70 +1980,51 @@ _exec_user_session (
         _setup_terminal (priv, tty_fd);
     }
 
-    if (initgroups (priv->username, target_gid))
-        WARN ("initgroups() failed: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
+    if (setgroups (priv->user_info->n_groups, priv->user_info->groups))
+        WARN ("setgroups() failed: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
     if (setregid (target_gid, target_gid))
         WARN ("setregid() failed: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
     if (setreuid (target_uid, target_uid))
         WARN ("setreuid() failed: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
 
-    int grouplist_len = NGROUPS_MAX;
-    gid_t grouplist[NGROUPS_MAX];
-    grouplist_len = getgroups (grouplist_len, grouplist);
     DBG ("group membership:");
-    for (i = 0; i < grouplist_len; i++)
-        DBG ("\t%s", getgrgid (grouplist[i])->gr_name);
+    for (i = 0; i < priv->user_info->n_groups; i++)
+        DBG ("\t%u", priv->user_info->groups[i]);
 
     DBG (" state:\n\truid=%d, euid=%d, rgid=%d, egid=%d (%s)",
          getuid(), geteuid(), getgid(), getegid(), priv->username);
-    _set_environment (priv);
     umask(0077);
 
-    home = getenv("HOME");
-    if (home) {
-        DBG ("changing directory to : %s", home);
-        if (chdir (home) < 0)
+    /* HOME as the session sees it, PAM or the request may override it */
+    home_dir = g_environ_getenv (envp, "HOME");
+    if (!home_dir)
+        home_dir = priv->user_info->home_dir;
+    if (home_dir) {
+        DBG ("changing directory to : %s", home_dir);
+        if (chdir (home_dir) < 0)
             WARN ("Failed to change directroy : %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
     } else WARN ("Could not get home directory");
 
-    shell = tlm_config_get_string (priv->config,
-                                   priv->seat_id,
-                                   TLM_CONFIG_GENERAL_SESSION_CMD);
-    if (!shell)
-        shell = tlm_config_get_string (priv->config,
-                                       TLM_CONFIG_GENERAL,
-                                       TLM_CONFIG_GENERAL_SESSION_CMD);
-    if (shell) {
-        args = tlm_utils_split_command_line (shell);
-    }
+    if (signal (SIGINT, SIG_DFL) == SIG_ERR)
+        WARN ("failed reset SIGINT: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
 
     if (!args) {
-        if((env_shell = getenv("SHELL"))) {
-            /* use shell if no override configured */
-            args = g_new0 (gchar *, 2);
-            args[0] = g_strdup (env_shell);
-        } else {
-            /* in case shell is not defined, fall back to systemd --user */
-            args = g_new0 (gchar *, 3);
-            args[0] = g_strdup ("systemd");
-            args[1] = g_strdup ("--user");
-        }
+        WARN ("no usable session command");
+        _report_exec_failure (exec_pipe[1], ENOENT);
     }
 
-    if (signal (SIGINT, SIG_DFL) == SIG_ERR)
-        WARN ("failed reset SIGINT: %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
-
     DBG ("executing: ");
     args_iter = args;
     while (args_iter && *args_iter) {
         DBG ("\targv[%d]: %s", i, *args_iter);
         args_iter++; i++;
     }
-    execvp (args[0], args);
+    execve (args[0], args, envp);
     /* we reach here only in case of error */
-    g_strfreev (args);
-    DBG ("execl(): %s", strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
-    exit (0);
+    exec_err = errno;
+    DBG ("execve(): %s", strerror_r(exec_err, strerr_buf, MAX_STRERROR_LEN));
+    _report_exec_failure (exec_pipe[1], exec_err);
+    return FALSE;
 }
 
 TlmSession *
@@ -752,6 +2034,68 @@ tlm_session_new ()
     return g_object_new (TLM_TYPE_SESSION, NULL);
 }
 
+/*
+ * Runs in the PAM watchdog thread while the main thread is stuck in PAM and
+ * may hold any lock, the log and the connection to the daemon included. The
+ * exit status tells the daemon which stage timed out. logind ends a
+ * half-opened session once the process holding it is gone.
+ */
+static void
+_on_pam_timeout (
+        TlmAuthSession *auth_session,
+        const gchar *stage,
+        gpointer user_data)
+{
+    guint i;
+
+    /* both pam_setcred stages share the "setcred" deadline */
+    for (i = 0; i < PAM_DEADLINE_MAX; i++) {
+        if (strcmp (stage, pam_deadlines[i].stage) == 0 ||
+            (strcmp (pam_deadlines[i].stage, "setcred") == 0 &&
+             g_str_has_suffix (stage, "_cred")))
+            _exit (pam_deadlines[i].exit_status);
+    }
+    _exit (EXIT_FAILURE);
+}
+
+static void
+_setup_pam_deadlines (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+    guint i, timeout;
+
+    for (i = 0; i < PAM_DEADLINE_MAX; i++) {
+        /* a group named after the PAM service overrides [General] */
+        if (tlm_config_has_key (priv->config, priv->service,
+                                pam_deadlines[i].key))
+            timeout = tlm_config_get_uint (priv->config, priv->service,
+                                           pam_deadlines[i].key, 0);
+        else
+            timeout = tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
+                                           pam_deadlines[i].key, 0);
+        if (!timeout)
+            continue;
+
+        tlm_auth_session_set_stage_timeout (priv->auth_session,
+                pam_deadlines[i].stage, timeout, _on_pam_timeout, session);
+    }
+}
+
+static void
+_report_pam_timings (TlmSession *session)
+{
+    TlmSessionPrivate *priv = session->priv;
+    guint threshold = tlm_config_get_uint (priv->config,
+                                  TLM_CONFIG_GENERAL,
+                                  TLM_CONFIG_GENERAL_PAM_SLOW_THRESHOLD_MS,
+                                  0);
+
+    if (threshold)
+        tlm_auth_session_log_slow_stages (priv->auth_session, threshold);
+    g_signal_emit (session, signals[SIG_PAM_TIMINGS], 0, priv->service,
+                   tlm_auth_session_get_timings (priv->auth_session));
+}
+
 gboolean
 tlm_session_start (TlmSession *session,
                    const gchar *seat_id, const gchar *service,
@@ -776,6 +2120,12 @@ tlm_session_start (TlmSession *session,
     g_object_set (G_OBJECT (session), "seat", seat_id, "service", service,
             "username", username, "environment", environment, NULL);
 
+    if (!priv->config) {
+        WARN ("no configuration received, reading configuration file");
+        priv->config = tlm_config_new ();
+    }
+    _start_login_boost (session);
+
     priv->vtnr = tlm_config_get_uint (priv->config,
                                       priv->seat_id,
                                       TLM_CONFIG_SEAT_VTNR,
@@ -793,6 +2143,7 @@ tlm_session_start (TlmSession *session,
         g_error_free (error);
         return FALSE;
     }
+    _setup_pam_deadlines (session);
 
     session_type = tlm_config_get_string (priv->config,
                                           priv->seat_id,
@@ -824,6 +2175,7 @@ tlm_session_start (TlmSession *session,
     }
 
     if (!tlm_auth_session_authenticate (priv->auth_session, &error)) {
+        _report_pam_timings (session);
         if (error) {
             //consistant error message flow
             GError *err = TLM_GET_ERROR_FOR_ID (
@@ -841,7 +2193,22 @@ tlm_session_start (TlmSession *session,
     }
     g_signal_emit (session, signals[SIG_AUTHENTICATED], 0);
 
+    /* PAM may have mapped the user, resolve the final one once for the
+     * session setup and the user process */
+    if (!priv->username)
+        priv->username = g_strdup (tlm_auth_session_get_username (
+                priv->auth_session));
+    priv->user_info = tlm_user_info_new (priv->username);
+    if (!priv->user_info) {
+        error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
+                "Unable to resolve user '%s'", priv->username);
+        g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
+        g_error_free (error);
+        return FALSE;
+    }
+
     if (!tlm_auth_session_open (priv->auth_session, &error)) {
+        _report_pam_timings (session);
         if (!error) {
             error = TLM_GET_ERROR_FOR_ID (TLM_ERROR_SESSION_CREATION_FAILURE,
                     "Unable to open PAM sesssion");
@@ -850,24 +2217,50 @@ tlm_session_start (TlmSession *session,
         g_error_free (error);
         return FALSE;
     }
+    _report_pam_timings (session);
     priv->sessionid = g_strdup (tlm_auth_session_get_sessionid (
             priv->auth_session));
-    tlm_utils_log_utmp_entry (priv->username);
 
     priv->session_pause =  tlm_config_get_boolean (priv->config,
                                              TLM_CONFIG_GENERAL,
                                              TLM_CONFIG_GENERAL_PAUSE_SESSION,
                                              FALSE);
     if (!priv->session_pause) {
-        _exec_user_session (session);
-        g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
-                       priv->sessionid ? priv->sessionid : "");
+        if (!_exec_user_session (session, &error)) {
+            _clear_session (session);
+            g_signal_emit (session, signals[SIG_SESSION_ERROR], 0, error);
+            g_error_free (error);
+            return FALSE;
+        }
+        /* utmp/wtmp accounting is not needed to start the session, do it
+         * once the user session is running */
+        priv->utmp_idle_id = g_idle_add_full (G_PRIORITY_LOW,
+                _log_utmp_idle_cb, session, NULL);
     } else {
-        g_signal_emit (session, signals[SIG_SESSION_CREATED], 0,
-                       priv->sessionid ? priv->sessionid : "");
-        pause ();
-        exit (0);
+        /* paused sessions never return to the main loop */
+        tlm_utils_log_utmp_entry (priv->username);
+    }
+
+#ifdef TLM_SESSIOND_LITE
+    /* the lite helper stays off the system bus, a session id neither PAM
+     * nor sd_pid_get_session() knew about is left unknown */
+    _report_session_created (session);
+#else
+    if (priv->sessionid) {
+        _report_session_created (session);
+        return TRUE;
     }
+
+    /* not known locally, ask logind while the session starts up */
+    priv->sessionid_pending = TRUE;
+    tlm_auth_session_resolve_sessionid (priv->auth_session, NULL,
+                                        _on_sessionid_resolved,
+                                        g_object_ref (session));
+    if (priv->session_pause) {
+        while (priv->sessionid_pending)
+            g_main_context_iteration (NULL, TRUE);
+    }
+#endif
     return TRUE;
 }
 
@@ -881,6 +2274,12 @@ _terminate_timeout (gpointer user_data)
     switch (priv->last_sig)
     {
         case SIGHUP:
+            if (priv->cgroup) {
+                DBG ("child %u didn't respond to SIGHUP, killing '%s'",
+                     priv->child_pid, priv->cgroup);
+                _kill_session_cgroup (session);
+                break;
+            }
             DBG ("child %u didn't respond to SIGHUP, sending SIGTERM",
                  priv->child_pid);
             if (killpg (getpgid (priv->child_pid), SIGTERM))
@@ -888,8 +2287,14 @@ _terminate_timeout (gpointer user_data)
                       getpgid (priv->child_pid),
                       strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
             priv->last_sig = SIGTERM;
-            return G_SOURCE_CONTINUE;
+            break;
         case SIGTERM:
+            if (priv->cgroup) {
+                DBG ("session didn't respond to SIGTERM, killing '%s'",
+                     priv->cgroup);
+                _kill_session_cgroup (session);
+                break;
+            }
             DBG ("child %u didn't respond to SIGTERM, sending SIGKILL",
                  priv->child_pid);
             if (killpg (getpgid (priv->child_pid), SIGKILL))
@@ -897,11 +2302,13 @@ _terminate_timeout (gpointer user_data)
                       getpgid (priv->child_pid),
                       strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
             priv->last_sig = SIGKILL;
-            return G_SOURCE_CONTINUE;
+            break;
         case SIGKILL:
             DBG ("child %u didn't respond to SIGKILL, process is stuck in kernel",
                  priv->child_pid);
             priv->timer_id = 0;
+            if (!priv->child_pid)
+                priv->is_child_up = FALSE;
             _clear_session (session);
             if (session->priv->can_emit_signal) {
                 GError *error = TLM_GET_ERROR_FOR_ID (
@@ -916,17 +2323,29 @@ _terminate_timeout (gpointer user_data)
             WARN ("%d has unknown signaling state %d",
                   priv->child_pid,
                   priv->last_sig);
+            return G_SOURCE_REMOVE;
     }
+    /* next stage, its timeout fitted to what is left of the deadline */
+    priv->timer_id = 0;
+    _schedule_terminate_timeout (session);
     return G_SOURCE_REMOVE;
 }
 
 void
 tlm_session_terminate (TlmSession *session)
+{
+    tlm_session_terminate_within (session, 0);
+}
+
+void
+tlm_session_terminate_within (
+        TlmSession *session,
+        guint timeout_ms)
 {
     g_return_if_fail (session && TLM_IS_SESSION(session));
     TlmSessionPrivate *priv = TLM_SESSION_PRIV(session);
 
-    DBG ("Session Terminate");
+    DBG ("Session Terminate within %u ms", timeout_ms);
 
     if (!priv->is_child_up) {
         DBG ("no child process is running - closing pam session");
@@ -936,6 +2355,21 @@ tlm_session_terminate (TlmSession *session)
         return;
     }
 
+    if (timeout_ms) {
+        gint64 deadline = g_get_monotonic_time () +
+                (gint64) timeout_ms * 1000;
+        if (!priv->terminate_deadline || deadline < priv->terminate_deadline)
+            priv->terminate_deadline = deadline;
+    }
+
+    if (priv->timer_id) {
+        /* already terminating, fit the current stage to the deadline */
+        DBG ("session termination already in progress");
+        if (timeout_ms)
+            _schedule_terminate_timeout (session);
+        return;
+    }
+
     if (killpg (getpgid (priv->child_pid), SIGHUP) < 0)
     {
         gchar strerr_buf[MAX_STRERROR_LEN] = {0,};
@@ -944,10 +2378,6 @@ tlm_session_terminate (TlmSession *session)
               strerror_r(errno, strerr_buf, MAX_STRERROR_LEN));
     }
     priv->last_sig = SIGHUP;
-    priv->timer_id = g_timeout_add_seconds (
-            tlm_config_get_uint (priv->config, TLM_CONFIG_GENERAL,
-                    TLM_CONFIG_GENERAL_TERMINATE_TIMEOUT, 3),
-            _terminate_timeout,
-            session);
+    _schedule_terminate_timeout (session);
 }
 
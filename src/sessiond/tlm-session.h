@@ -72,6 +72,9 @@ tlm_session_start (TlmSession *session,
 void
 tlm_session_terminate (TlmSession *session);
 
+void
+tlm_session_terminate_within (TlmSession *session, guint timeout_ms);
+
 G_END_DECLS
 
 #endif /* _TLM_SESSION_H */
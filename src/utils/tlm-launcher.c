@@ -86,7 +86,7 @@ _tlm_launcher_deinit (TlmLauncher *l)
   l->childs = 0;
 
   if (l->socket_watcher) {
-    g_source_remove (l->socket_watcher);
+    tlm_utils_unwatch_files (l->socket_watcher);
     l->socket_watcher = 0;
   }
 }
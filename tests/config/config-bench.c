@@ -0,0 +1,101 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm
+ *
+ * Copyright (C) 2014 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+/*
+ * Compares what a login used to cost in configuration lookups, resolving
+ * each key through the seat group, the General group and the default,
+ * with reading the compiled seat configuration.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tlm-config.h"
+#include "tlm-config-general.h"
+#include "tlm-config-seat.h"
+
+#define ITERATIONS 1000000
+
+static const gchar *
+_lookup_string (TlmConfig *config, const gchar *seat_id, const gchar *key,
+                const gchar *fallback)
+{
+    const gchar *value = tlm_config_get_string (config, seat_id, key);
+    if (!value)
+        value = tlm_config_get_string (config, TLM_CONFIG_GENERAL, key);
+    return value ? value : fallback;
+}
+
+static gdouble
+_ns_per_login (gint64 start)
+{
+    return (g_get_monotonic_time () - start) * 1000.0 / ITERATIONS;
+}
+
+int main (int argc, char **argv)
+{
+    TlmConfig *config = NULL;
+    const TlmSeatConfig *seat = NULL;
+    const gchar *seat_id = argc > 1 ? argv[1] : "seat0";
+    volatile guint sink = 0;
+    gint64 start;
+    guint i;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    config = tlm_config_new ();
+    tlm_config_set_string (config, seat_id, TLM_CONFIG_GENERAL_DEFAULT_USER,
+                           "guest%S");
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < ITERATIONS; i++) {
+        sink += tlm_config_get_boolean (config, seat_id,
+                                        TLM_CONFIG_SEAT_ACTIVE, TRUE);
+        sink += tlm_config_get_boolean (config, TLM_CONFIG_GENERAL,
+                                        TLM_CONFIG_GENERAL_AUTO_LOGIN, TRUE);
+        sink += tlm_config_get_boolean (config, TLM_CONFIG_GENERAL,
+                                        TLM_CONFIG_GENERAL_PREPARE_DEFAULT,
+                                        FALSE);
+        sink += *_lookup_string (config, seat_id,
+                                 TLM_CONFIG_GENERAL_PAM_SERVICE,
+                                 "tlm-login");
+        sink += *_lookup_string (config, seat_id,
+                                 TLM_CONFIG_GENERAL_DEFAULT_USER, "guest");
+    }
+    printf ("key lookups:      %8.1f ns per login\n", _ns_per_login (start));
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < ITERATIONS; i++) {
+        seat = tlm_config_get_seat_config (config, seat_id);
+        sink += seat->active + seat->auto_login + seat->prepare_default;
+        sink += *seat->pam_service + *seat->default_user;
+    }
+    printf ("compiled config:  %8.1f ns per login\n", _ns_per_login (start));
+
+    g_object_unref (config);
+    return sink == 0;
+}
@@ -25,7 +25,10 @@
 
 #include <check.h>
 #include <stdlib.h>
+#include <glib/gstdio.h>
 #include "tlm-config.h"
+#include "tlm-config-general.h"
+#include "tlm-config-seat.h"
 
 #define TLM_GROUP   "tlm-test"
 #define STR_KEY     "str_key"
@@ -116,6 +119,193 @@ START_TEST(test_config)
 }
 END_TEST
 
+START_TEST(test_config_snapshot)
+{
+    const gchar *groups[] = { TLM_GROUP, NULL };
+    TlmConfig *config = NULL;
+    TlmConfig *copy = NULL;
+    GVariant *snapshot = NULL;
+
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+    tlm_config_set_string (config, "other", STR_KEY, STR_VALUE);
+
+    snapshot = g_variant_ref_sink (tlm_config_to_variant (config, groups));
+    fail_if (snapshot == NULL);
+    copy = tlm_config_new_from_variant (snapshot);
+    g_variant_unref (snapshot);
+    fail_if (copy == NULL, "Failed to create config from snapshot");
+
+    fail_if (g_strcmp0 (tlm_config_get_string (copy, TLM_GROUP, STR_KEY),
+                        STR_VALUE) != 0);
+    fail_if (tlm_config_get_int (copy, TLM_GROUP, INT_KEY, -1) != INT_VALUE);
+    fail_if (g_hash_table_size (tlm_config_get_group (copy, TLM_GROUP)) !=
+             g_hash_table_size (tlm_config_get_group (config, TLM_GROUP)));
+    fail_if (tlm_config_has_group (copy, "other"),
+             "Group not asked for is in the snapshot");
+    g_object_unref (copy);
+
+    /* all groups */
+    snapshot = g_variant_ref_sink (tlm_config_to_variant (config, NULL));
+    copy = tlm_config_new_from_variant (snapshot);
+    g_variant_unref (snapshot);
+    fail_if (g_strcmp0 (tlm_config_get_string (copy, "other", STR_KEY),
+                        STR_VALUE) != 0);
+    g_object_unref (copy);
+
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST(test_seat_config)
+{
+    TlmConfig *config = NULL;
+    const TlmSeatConfig *seat = NULL;
+    GError *error = NULL;
+
+    config = tlm_config_new ();
+    fail_if (config == NULL, "Failed to create config object");
+    fail_unless (tlm_config_validate (config, NULL));
+
+    /* built-in defaults */
+    seat = tlm_config_get_seat_config (config, "seat0");
+    fail_unless (seat->active && seat->auto_login && !seat->x11_session);
+    fail_if (g_strcmp0 (seat->pam_service, "tlm-login") != 0);
+    fail_if (g_strcmp0 (seat->default_user, "guest") != 0);
+    fail_unless (seat->nwatch == 0 && seat->watch && !seat->watch[0]);
+    fail_unless (tlm_config_get_seat_config (config, "seat0") == seat,
+                 "Seat configuration compiled again");
+
+    /* seat group over General group */
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+                           TLM_CONFIG_GENERAL_PAM_SERVICE, "general-login");
+    tlm_config_set_string (config, "seat1",
+                           TLM_CONFIG_GENERAL_PAM_SERVICE, "seat-login");
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+                            TLM_CONFIG_GENERAL_AUTO_LOGIN, FALSE);
+    seat = tlm_config_get_seat_config (config, "seat1");
+    fail_if (g_strcmp0 (seat->pam_service, "seat-login") != 0);
+    fail_if (seat->auto_login);
+    seat = tlm_config_get_seat_config (config, "seat0");
+    fail_if (g_strcmp0 (seat->pam_service, "general-login") != 0);
+    seat = tlm_config_get_seat_config (config, NULL);
+    fail_if (g_strcmp0 (seat->pam_service, "general-login") != 0);
+
+    /* watch items */
+    tlm_config_set_uint (config, "seat1", TLM_CONFIG_SEAT_NWATCH, 2);
+    tlm_config_set_string (config, "seat1", "WATCH0", "/run/a");
+    tlm_config_set_string (config, "seat1", "WATCH1", "/run/b");
+    seat = tlm_config_get_seat_config (config, "seat1");
+    fail_unless (seat->nwatch == 2);
+    fail_if (g_strcmp0 (seat->watch[1], "/run/b") != 0 || seat->watch[2]);
+
+    /* invalid values fall back to the default */
+    tlm_config_set_string (config, "seat1", TLM_CONFIG_SEAT_ACTIVE, "maybe");
+    fail_if (tlm_config_validate (config, &error));
+    fail_unless (g_error_matches (error, G_KEY_FILE_ERROR,
+                                  G_KEY_FILE_ERROR_INVALID_VALUE));
+    fail_if (strstr (error->message, TLM_CONFIG_SEAT_ACTIVE) == NULL,
+             "Unexpected error: %s", error->message);
+    g_clear_error (&error);
+    fail_unless (tlm_config_get_seat_config (config, "seat1")->active);
+
+    g_object_unref (config);
+}
+END_TEST
+
+START_TEST(test_config_validate)
+{
+    TlmConfig *config = NULL;
+    GError *error = NULL;
+    gchar *dir = g_path_get_dirname (g_getenv ("TLM_CONF_FILE"));
+    gchar *conf_file = g_build_filename (dir, "invalid.conf", NULL);
+    gchar *saved = g_strdup (g_getenv ("TLM_CONF_FILE"));
+
+    g_setenv ("TLM_CONF_FILE", conf_file, TRUE);
+    config = tlm_config_new ();
+    g_setenv ("TLM_CONF_FILE", saved, TRUE);
+
+    fail_if (tlm_config_validate (config, &error));
+    fail_if (strstr (error->message, "invalid.conf:2:") == NULL,
+             "No line for AUTO_LOGIN: %s", error->message);
+    fail_if (strstr (error->message, "invalid.conf:7:") == NULL,
+             "No line for NWATCH: %s", error->message);
+    fail_if (strstr (error->message, "invalid.conf:3:") != NULL,
+             "Valid value reported: %s", error->message);
+    g_error_free (error);
+
+    /* the values set by the daemon replace the bad ones */
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+                            TLM_CONFIG_GENERAL_AUTO_LOGIN, TRUE);
+    tlm_config_set_uint (config, "seat0", TLM_CONFIG_SEAT_NWATCH, 0);
+    fail_unless (tlm_config_validate (config, NULL));
+
+    g_object_unref (config);
+    g_free (saved);
+    g_free (conf_file);
+    g_free (dir);
+}
+END_TEST
+
+START_TEST(test_config_reload_diff)
+{
+    TlmConfig *config = NULL;
+    GHashTable *changes = NULL;
+    GError *error = NULL;
+    gchar **keys = NULL;
+    gchar *saved = g_strdup (g_getenv ("TLM_CONF_FILE"));
+    gchar *conf_file = g_build_filename (g_get_tmp_dir (),
+                                         "tlm-reload-test.conf", NULL);
+
+    fail_unless (g_file_set_contents (conf_file,
+                 "[General]\nAUTO_LOGIN=1\nPAM_SERVICE=tlm-login\n"
+                 "SETUP_TERMINAL=0\n[seat0]\nDEFAULT_USER=app\n", -1, NULL));
+    g_setenv ("TLM_CONF_FILE", conf_file, TRUE);
+    config = tlm_config_new ();
+
+    /* same meaning, a changed, a removed and a new key, a new group */
+    fail_unless (g_file_set_contents (conf_file,
+                 "[General]\nAUTO_LOGIN=true\nPAM_SERVICE=other-login\n"
+                 "[seat0]\nDEFAULT_USER=app\n[seat1]\nACTIVE=0\n", -1,
+                 NULL));
+    changes = tlm_config_reload_diff (config, &error);
+    fail_if (changes == NULL, "Reload failed: %s",
+             error ? error->message : "");
+    fail_unless (g_hash_table_size (changes) == 2);
+    fail_if (g_hash_table_contains (changes, "seat0"));
+    keys = g_hash_table_lookup (changes, TLM_CONFIG_GENERAL);
+    fail_unless (keys && g_strv_length (keys) == 2);
+    fail_unless ((g_strcmp0 (keys[0], TLM_CONFIG_GENERAL_PAM_SERVICE) == 0 &&
+                  g_strcmp0 (keys[1], TLM_CONFIG_GENERAL_SETUP_TERMINAL) == 0) ||
+                 (g_strcmp0 (keys[1], TLM_CONFIG_GENERAL_PAM_SERVICE) == 0 &&
+                  g_strcmp0 (keys[0], TLM_CONFIG_GENERAL_SETUP_TERMINAL) == 0));
+    keys = g_hash_table_lookup (changes, "seat1");
+    fail_unless (keys && g_strv_length (keys) == 1);
+    g_hash_table_unref (changes);
+    fail_if (g_strcmp0 (tlm_config_get_seat_config (config, "seat0")->
+                        pam_service, "other-login") != 0);
+
+    /* nothing changed */
+    changes = tlm_config_reload_diff (config, NULL);
+    fail_unless (changes && g_hash_table_size (changes) == 0);
+    g_hash_table_unref (changes);
+
+    /* an invalid configuration is not taken */
+    fail_unless (g_file_set_contents (conf_file,
+                 "[General]\nAUTO_LOGIN=sometimes\n", -1, NULL));
+    fail_unless (tlm_config_reload_diff (config, &error) == NULL);
+    g_clear_error (&error);
+    fail_if (g_strcmp0 (tlm_config_get_string (config, TLM_CONFIG_GENERAL,
+                        TLM_CONFIG_GENERAL_PAM_SERVICE), "other-login") != 0);
+
+    g_setenv ("TLM_CONF_FILE", saved, TRUE);
+    g_object_unref (config);
+    g_unlink (conf_file);
+    g_free (conf_file);
+    g_free (saved);
+}
+END_TEST
+
 int main (void)
 {
     int number_failed;
@@ -127,6 +317,10 @@ int main (void)
     TCase *tc = tcase_create ("Config");
 
     tcase_add_test (tc, test_config);
+    tcase_add_test (tc, test_config_snapshot);
+    tcase_add_test (tc, test_seat_config);
+    tcase_add_test (tc, test_config_validate);
+    tcase_add_test (tc, test_config_reload_diff);
     suite_add_tcase (s, tc);
 
     sr = srunner_create(s);
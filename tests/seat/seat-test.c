@@ -0,0 +1,720 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <glib.h>
+#include <glib-object.h>
+
+#include "common/tlm-log.h"
+#include "common/tlm-config.h"
+#include "common/tlm-config-general.h"
+#include "common/tlm-config-seat.h"
+#include "common/tlm-error.h"
+#include "daemon/tlm-seat.h"
+#include "daemon/tlm-session-fake.h"
+
+#define THROUGHPUT_SEATS 200
+
+static GMainLoop *main_loop = NULL;
+static TlmConfig *config = NULL;
+static guint created = 0;
+static guint terminated = 0;
+static guint errors = 0;
+static guint pending = 0;
+static guint relogins = 0;
+static gchar *switch_to = NULL;
+static gchar *last_user = NULL;
+static gchar *ready_dir = NULL;
+static gchar *ready_path = NULL;
+static int ready_fd = -1;
+
+static void
+_create_mainloop ()
+{
+    if (main_loop == NULL) {
+        main_loop = g_main_loop_new (NULL, FALSE);
+    }
+    config = tlm_config_new ();
+    created = terminated = errors = pending = relogins = 0;
+}
+
+static void
+_stop_mainloop ()
+{
+    if (main_loop) {
+        g_main_loop_quit (main_loop);
+        g_main_loop_unref (main_loop);
+        main_loop = NULL;
+    }
+    g_clear_object (&config);
+    g_free (switch_to);
+    switch_to = NULL;
+    g_free (last_user);
+    last_user = NULL;
+    if (ready_fd >= 0) {
+        close (ready_fd);
+        ready_fd = -1;
+    }
+    if (ready_path) {
+        unlink (ready_path);
+        g_free (ready_path);
+        ready_path = NULL;
+    }
+    if (ready_dir) {
+        rmdir (ready_dir);
+        g_free (ready_dir);
+        ready_dir = NULL;
+    }
+}
+
+static gboolean
+_on_timeout (gpointer user_data)
+{
+    gboolean *timed_out = (gboolean *) user_data;
+
+    *timed_out = TRUE;
+    g_main_loop_quit (main_loop);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_run_mainloop (guint timeout)
+{
+    gboolean timed_out = FALSE;
+    guint timer_id = g_timeout_add_seconds (timeout, _on_timeout, &timed_out);
+
+    g_main_loop_run (main_loop);
+    if (!timed_out)
+        g_source_remove (timer_id);
+    return !timed_out;
+}
+
+static void
+_done_one ()
+{
+    if (--pending == 0)
+        g_main_loop_quit (main_loop);
+}
+
+static void
+_on_session_created (
+        TlmSeat *seat,
+        const gchar *seat_id,
+        gpointer user_data)
+{
+    created++;
+    g_free (last_user);
+    last_user = tlm_seat_get_occupying_username (seat);
+
+    if (switch_to) {
+        GHashTable *environment = g_hash_table_new (g_str_hash, g_str_equal);
+        gchar *username = switch_to;
+
+        switch_to = NULL;
+        fail_unless (tlm_seat_switch_user (seat, NULL, username, "secret",
+                environment), "failed to switch user on %s", seat_id);
+        g_hash_table_unref (environment);
+        g_free (username);
+        return;
+    }
+    fail_unless (tlm_seat_terminate_session (seat),
+            "failed to terminate session on %s", seat_id);
+}
+
+static gboolean
+_on_session_terminated (
+        TlmSeat *seat,
+        const gchar *seat_id,
+        gpointer user_data)
+{
+    terminated++;
+    if (relogins > 0) {
+        relogins--;
+        return FALSE;
+    }
+    _done_one ();
+    /* no relogin */
+    return TRUE;
+}
+
+static void
+_on_session_error (
+        TlmSeat *seat,
+        guint error,
+        gpointer user_data)
+{
+    DBG ("session error %u", error);
+    errors++;
+    if (error == TLM_ERROR_SESSION_CREATION_FAILURE ||
+        error == TLM_ERROR_SESSION_EXEC_FAILURE)
+        _done_one ();
+}
+
+static TlmSeat *
+_create_seat (const gchar *seat_id)
+{
+    TlmSeat *seat = tlm_seat_new (config, seat_id, NULL);
+
+    g_signal_connect (seat, "session-created",
+            G_CALLBACK (_on_session_created), NULL);
+    g_signal_connect (seat, "session-terminated",
+            G_CALLBACK (_on_session_terminated), NULL);
+    g_signal_connect (seat, "session-error",
+            G_CALLBACK (_on_session_error), NULL);
+    return seat;
+}
+
+START_TEST (test_session_cycle)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, g_get_user_name (),
+            NULL, NULL));
+    fail_unless (_run_mainloop (5), "session cycle timed out");
+
+    fail_unless (created == 1);
+    fail_unless (terminated == 1);
+    fail_unless (errors == 0);
+    fail_unless (tlm_seat_get_termination_signal (seat) == SIGHUP);
+    fail_unless (tlm_seat_get_login_latency (seat) >= 1000);
+    fail_unless (tlm_seat_get_occupying_username (seat) == NULL);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_session_relogin)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_AUTO_LOGIN, TRUE);
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_DEFAULT_USER, g_get_user_name ());
+
+    /* the default user is logged in again after each logout, up to the
+     * point the short relogin guard holds it back */
+    relogins = 2;
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, NULL, NULL, NULL));
+    fail_unless (_run_mainloop (5), "relogin timed out");
+
+    fail_unless (created == 3);
+    fail_unless (terminated == 3);
+    fail_unless (errors == 0);
+    fail_unless (g_strcmp0 (last_user, g_get_user_name ()) == 0);
+    fail_unless (tlm_seat_get_occupying_username (seat) == NULL);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_session_switch_user)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    /* the running session ends and the seat logs in the new user */
+    switch_to = g_strdup ("tlm-test-other");
+    relogins = 1;
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, g_get_user_name (),
+            NULL, NULL));
+    fail_unless (_run_mainloop (5), "user switch timed out");
+
+    fail_unless (created == 2);
+    fail_unless (terminated == 2);
+    fail_unless (errors == 0);
+    fail_unless (g_strcmp0 (last_user, "tlm-test-other") == 0);
+
+    /* no credentials, no switch */
+    fail_if (tlm_seat_switch_user (seat, NULL, "tlm-test-other", NULL, NULL));
+    fail_if (_run_mainloop (1), "unexpected seat activity");
+    fail_unless (created == 2);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_session_queued_login)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    tlm_config_set_uint (config, TLM_CONFIG_FAKE_SESSION,
+            TLM_CONFIG_FAKE_SESSION_DRAIN_DELAY, 500);
+
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, "tlm-test-other",
+            NULL, NULL));
+    fail_unless (_run_mainloop (5), "session cycle timed out");
+
+    /* logins of the user queue up behind the draining session, only the
+     * latest one is started once it is gone */
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, "tlm-test-other",
+            NULL, NULL));
+    fail_unless (tlm_seat_create_session (seat, NULL, "tlm-test-other",
+            NULL, NULL));
+    fail_unless (tlm_seat_get_occupying_username (seat) == NULL);
+    fail_unless (_run_mainloop (5), "queued login timed out");
+    fail_if (_run_mainloop (1), "unexpected seat activity");
+
+    fail_unless (created == 2);
+    fail_unless (terminated == 2);
+    fail_unless (errors == 0);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_session_failure)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    tlm_config_set_string (config, TLM_CONFIG_FAKE_SESSION,
+            TLM_CONFIG_FAKE_SESSION_FAIL_USERS, g_get_user_name ());
+
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, g_get_user_name (),
+            NULL, NULL));
+    fail_unless (_run_mainloop (5), "session failure timed out");
+
+    fail_unless (created == 0);
+    fail_unless (terminated == 0);
+    fail_unless (errors == 1);
+    fail_unless (tlm_seat_get_occupying_username (seat) == NULL);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_session_exec_failure)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_AUTO_LOGIN, TRUE);
+    tlm_config_set_string (config, TLM_CONFIG_FAKE_SESSION,
+            TLM_CONFIG_FAKE_SESSION_FAIL_USERS, g_get_user_name ());
+    tlm_config_set_uint (config, TLM_CONFIG_FAKE_SESSION,
+            TLM_CONFIG_FAKE_SESSION_FAIL_ERROR,
+            TLM_ERROR_SESSION_EXEC_FAILURE);
+
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, g_get_user_name (),
+            NULL, NULL));
+    fail_unless (_run_mainloop (5), "session exec failure timed out");
+
+    /* a session that cannot be executed is not retried */
+    fail_if (_run_mainloop (1), "unexpected seat activity");
+    fail_unless (created == 0);
+    fail_unless (terminated == 0);
+    fail_unless (errors == 1);
+    fail_unless (tlm_seat_get_occupying_username (seat) == NULL);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_session_drain)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+    gint64 start;
+
+    tlm_config_set_uint (config, TLM_CONFIG_FAKE_SESSION,
+            TLM_CONFIG_FAKE_SESSION_DRAIN_DELAY, 500);
+
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, g_get_user_name (),
+            NULL, NULL));
+    fail_unless (_run_mainloop (5), "session cycle timed out");
+
+    /* another user does not wait for the cleanup of the previous session */
+    pending = 1;
+    start = g_get_monotonic_time ();
+    fail_unless (tlm_seat_create_session (seat, NULL, "tlm-test-other",
+            NULL, NULL));
+    fail_unless (_run_mainloop (5), "session cycle timed out");
+    fail_unless (g_get_monotonic_time () - start < 400000,
+            "login waited for the previous session of another user");
+
+    /* the same user does, the first session drains by now */
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, "tlm-test-other",
+            NULL, NULL));
+    fail_unless (_run_mainloop (5), "session cycle timed out");
+    fail_unless (g_get_monotonic_time () - start >= 500000,
+            "login did not wait for the previous session of the user");
+
+    fail_unless (created == 3);
+    fail_unless (terminated == 3);
+    fail_unless (errors == 0);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_session_throughput)
+{
+    TlmSeat *seats[THROUGHPUT_SEATS];
+    gint64 start, elapsed;
+    guint i;
+
+    for (i = 0; i < THROUGHPUT_SEATS; i++) {
+        gchar *seat_id = g_strdup_printf ("seat%u", i);
+        seats[i] = _create_seat (seat_id);
+        g_free (seat_id);
+    }
+
+    pending = THROUGHPUT_SEATS;
+    start = g_get_monotonic_time ();
+    for (i = 0; i < THROUGHPUT_SEATS; i++)
+        fail_unless (tlm_seat_create_session (seats[i], NULL,
+                g_get_user_name (), NULL, NULL));
+    fail_unless (_run_mainloop (30), "session cycles timed out");
+    elapsed = g_get_monotonic_time () - start;
+
+    fail_unless (created == THROUGHPUT_SEATS);
+    fail_unless (terminated == THROUGHPUT_SEATS);
+    fail_unless (errors == 0);
+    g_print ("%u login/logout cycles in %" G_GINT64_FORMAT " us, "
+            "%.1f cycles/s\n", THROUGHPUT_SEATS, elapsed,
+            THROUGHPUT_SEATS * 1000000.0 / MAX (elapsed, 1));
+
+    for (i = 0; i < THROUGHPUT_SEATS; i++)
+        g_object_unref (seats[i]);
+}
+END_TEST
+
+/*
+ * The sessiond tests run real sessions, once through tlm-sessiond and once
+ * through tlm-sessiond-lite (the loop index picks the backend), which needs
+ * root and a PAM service that lets the user in without a password, named by
+ * TLM_TEST_PAM_SERVICE
+ */
+static const gchar *sessiond_backends[] = { "sessiond", "lite" };
+
+static void
+_use_sessiond (gint backend, const gchar *command)
+{
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_BACKEND, sessiond_backends[backend]);
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_PAM_SERVICE, g_getenv ("TLM_TEST_PAM_SERVICE"));
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SETUP_TERMINAL, FALSE);
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_CMD, command);
+}
+
+START_TEST (test_sessiond_cycle)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    _use_sessiond (_i, "sleep 30");
+
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, g_get_user_name (),
+            NULL, NULL));
+    fail_unless (_run_mainloop (30), "session cycle timed out");
+
+    fail_unless (created == 1);
+    fail_unless (terminated == 1);
+    fail_unless (errors == 0);
+    fail_unless (tlm_seat_get_termination_signal (seat) == SIGHUP);
+    fail_unless (tlm_seat_get_occupying_username (seat) == NULL);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_sessiond_exec_failure)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    _use_sessiond (_i, "/nonexistent/tlm-no-such-command");
+
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, g_get_user_name (),
+            NULL, NULL));
+    fail_unless (_run_mainloop (20), "session exec failure timed out");
+
+    fail_unless (created == 0);
+    fail_unless (terminated == 0);
+    fail_unless (errors == 1);
+    fail_unless (tlm_seat_get_occupying_username (seat) == NULL);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+static void
+_use_session_ready (const gchar *mode, guint timeout)
+{
+    gchar *cond = NULL;
+
+    ready_dir = g_dir_make_tmp ("tlm-ready-XXXXXX", NULL);
+    fail_unless (ready_dir != NULL);
+    ready_path = g_build_filename (ready_dir, "ready", NULL);
+
+    if (g_strcmp0 (mode, "notify") == 0)
+        cond = g_strdup (mode);
+    else
+        cond = g_strdup_printf ("%s:%s", mode, ready_path);
+    tlm_config_set_string (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_READY, cond);
+    tlm_config_set_uint (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_READY_TIMEOUT_MS, timeout);
+    g_free (cond);
+}
+
+static gboolean
+_make_ready_file (gpointer user_data)
+{
+    fail_unless (g_file_set_contents (ready_path, "", 0, NULL));
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_make_ready_socket (gpointer user_data)
+{
+    struct sockaddr_un addr;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    g_strlcpy (addr.sun_path, ready_path, sizeof (addr.sun_path));
+
+    ready_fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    fail_unless (ready_fd >= 0);
+    fail_unless (bind (ready_fd, (struct sockaddr *) &addr,
+            sizeof (addr)) == 0);
+    fail_unless (listen (ready_fd, 1) == 0);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_run_ready_session (TlmSeat *seat)
+{
+    pending = 1;
+    fail_unless (tlm_seat_create_session (seat, NULL, g_get_user_name (),
+            NULL, NULL));
+    fail_unless (_run_mainloop (30), "session cycle timed out");
+
+    fail_unless (created == 1);
+    fail_unless (terminated == 1);
+    fail_unless (errors == 0);
+}
+
+START_TEST (test_sessiond_ready_notify)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    _use_sessiond (_i,
+            "sh -c 'echo READY=1 >&$TLM_NOTIFY_FD; exec sleep 30'");
+    _use_session_ready ("notify", 20000);
+
+    _run_ready_session (seat);
+    fail_unless (tlm_seat_get_login_latency (seat) < G_USEC_PER_SEC * 20);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_sessiond_ready_file)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    _use_sessiond (_i, "sleep 30");
+    _use_session_ready ("file", 20000);
+    g_timeout_add (1000, _make_ready_file, NULL);
+
+    _run_ready_session (seat);
+    fail_unless (tlm_seat_get_login_latency (seat) >= G_USEC_PER_SEC);
+    fail_unless (tlm_seat_get_login_latency (seat) < G_USEC_PER_SEC * 20);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_sessiond_ready_socket)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    _use_sessiond (_i, "sleep 30");
+    _use_session_ready ("socket", 20000);
+    g_timeout_add (1000, _make_ready_socket, NULL);
+
+    _run_ready_session (seat);
+    fail_unless (tlm_seat_get_login_latency (seat) >= G_USEC_PER_SEC);
+    fail_unless (tlm_seat_get_login_latency (seat) < G_USEC_PER_SEC * 20);
+    /* readiness is checked without connecting to the socket */
+    fail_unless (accept (ready_fd, NULL, NULL) < 0 && errno == EAGAIN);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+START_TEST (test_sessiond_ready_timeout)
+{
+    TlmSeat *seat = _create_seat ("seat0");
+
+    _use_sessiond (_i, "sleep 30");
+    _use_session_ready ("file", 500);
+
+    /* the session is reported anyway once the wait runs out */
+    _run_ready_session (seat);
+    fail_unless (tlm_seat_get_login_latency (seat) >= 500 * 1000);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+static gboolean
+_has_cgroup_controller (const gchar *controller)
+{
+    gchar *contents = NULL;
+    gchar **names = NULL, **name = NULL;
+    gboolean res = FALSE;
+
+    if (!g_file_get_contents ("/sys/fs/cgroup/cgroup.controllers", &contents,
+                              NULL, NULL))
+        return FALSE;
+    names = g_strsplit (g_strstrip (contents), " ", -1);
+    for (name = names; *name && !res; name++)
+        res = g_strcmp0 (*name, controller) == 0;
+    g_strfreev (names);
+    g_free (contents);
+    return res;
+}
+
+START_TEST (test_sessiond_cgroup_policy)
+{
+    TlmSeat *seat = NULL;
+    gchar *command = NULL;
+    gchar *contents = NULL;
+
+    if (!_has_cgroup_controller ("memory")) {
+        g_print ("no cgroup v2 memory controller, policy test skipped\n");
+        return;
+    }
+    seat = _create_seat ("seat0");
+
+    /* the session reports the limit it runs under through the ready file */
+    _use_session_ready ("file", 20000);
+    command = g_strdup_printf ("sh -c 'cat /sys/fs/cgroup"
+            "$(sed -n s/^0:://p /proc/self/cgroup)/memory.max > $0.tmp && "
+            "mv $0.tmp $0; exec sleep 30' %s", ready_path);
+    _use_sessiond (_i, command);
+    g_free (command);
+    tlm_config_set_boolean (config, TLM_CONFIG_GENERAL,
+            TLM_CONFIG_GENERAL_SESSION_CGROUP, TRUE);
+    tlm_config_set_string (config, "seat0", TLM_CONFIG_SEAT_MEMORY_MAX,
+            "268435456");
+
+    _run_ready_session (seat);
+    fail_unless (g_file_get_contents (ready_path, &contents, NULL, NULL));
+    fail_unless (g_strcmp0 (g_strstrip (contents), "268435456") == 0,
+            "session runs with memory.max '%s'", contents);
+    g_free (contents);
+
+    g_object_unref (seat);
+}
+END_TEST
+
+Suite* seat_suite (void)
+{
+    TCase *tc = NULL;
+
+    Suite *s = suite_create ("Tlm seat");
+
+    tc = tcase_create ("Seat tests");
+    tcase_set_timeout(tc, 60);
+    tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
+
+    tcase_add_test (tc, test_session_cycle);
+    tcase_add_test (tc, test_session_relogin);
+    tcase_add_test (tc, test_session_switch_user);
+    tcase_add_test (tc, test_session_queued_login);
+    tcase_add_test (tc, test_session_failure);
+    tcase_add_test (tc, test_session_exec_failure);
+    tcase_add_test (tc, test_session_drain);
+    tcase_add_test (tc, test_session_throughput);
+    suite_add_tcase (s, tc);
+
+    if (geteuid () != 0 || !g_getenv ("TLM_TEST_PAM_SERVICE")) {
+        g_print ("sessiond tests need root and TLM_TEST_PAM_SERVICE, "
+                 "skipped\n");
+        return s;
+    }
+    tc = tcase_create ("Sessiond tests");
+    tcase_set_timeout(tc, 60);
+    tcase_add_checked_fixture (tc, _create_mainloop, _stop_mainloop);
+
+    tcase_add_loop_test (tc, test_sessiond_cycle, 0,
+            G_N_ELEMENTS (sessiond_backends));
+    tcase_add_loop_test (tc, test_sessiond_exec_failure, 0,
+            G_N_ELEMENTS (sessiond_backends));
+    tcase_add_loop_test (tc, test_sessiond_ready_notify, 0,
+            G_N_ELEMENTS (sessiond_backends));
+    tcase_add_loop_test (tc, test_sessiond_ready_file, 0,
+            G_N_ELEMENTS (sessiond_backends));
+    tcase_add_loop_test (tc, test_sessiond_ready_socket, 0,
+            G_N_ELEMENTS (sessiond_backends));
+    tcase_add_loop_test (tc, test_sessiond_ready_timeout, 0,
+            G_N_ELEMENTS (sessiond_backends));
+    tcase_add_loop_test (tc, test_sessiond_cgroup_policy, 0,
+            G_N_ELEMENTS (sessiond_backends));
+    suite_add_tcase (s, tc);
+
+    return s;
+}
+
+int main (int argc, char *argv[])
+{
+    int number_failed;
+    Suite *s = 0;
+    SRunner *sr = 0;
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+    g_type_init ();
+#endif
+
+    s = seat_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,111 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Times tlm_utils_delete_dir() on a generated tree.
+ *
+ *   deletebench [n_files] [files_per_dir] [base_dir]
+ *
+ * Defaults to 100000 files, 1000 per directory, below $TMPDIR. */
+
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common/tlm-utils.h"
+
+static gboolean
+_populate (const gchar *root, guint n_files, guint per_dir)
+{
+    gchar *dir = NULL, *file = NULL;
+    guint i;
+    int fd;
+
+    for (i = 0; i < n_files; i++) {
+        if (i % per_dir == 0) {
+            g_free (dir);
+            dir = g_strdup_printf ("%s/%u/%u", root, i / per_dir % 16,
+                                   i / per_dir);
+            if (g_mkdir_with_parents (dir, 0700) != 0) {
+                g_free (dir);
+                return FALSE;
+            }
+        }
+        file = g_strdup_printf ("%s/%u", dir, i);
+        fd = open (file, O_CREAT | O_WRONLY | O_CLOEXEC, 0600);
+        g_free (file);
+        if (fd < 0) {
+            g_free (dir);
+            return FALSE;
+        }
+        close (fd);
+    }
+    g_free (dir);
+    return TRUE;
+}
+
+int main (int argc, char *argv[])
+{
+    guint n_files = argc > 1 ? atoi (argv[1]) : 100000;
+    guint per_dir = argc > 2 ? atoi (argv[2]) : 1000;
+    gchar *base = NULL, *root = NULL;
+    gint64 start;
+    gboolean res;
+
+    if (!n_files || !per_dir) {
+        fprintf (stderr, "usage: %s [n_files] [files_per_dir] [base_dir]\n",
+                 argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (argc > 3)
+        base = g_strdup (argv[3]);
+    else
+        base = g_dir_make_tmp ("tlm-bench-XXXXXX", NULL);
+    if (!base)
+        return EXIT_FAILURE;
+    root = g_build_filename (base, "tree", NULL);
+
+    if (!_populate (root, n_files, per_dir)) {
+        fprintf (stderr, "failed to populate %s\n", root);
+        return EXIT_FAILURE;
+    }
+    sync ();
+
+    start = g_get_monotonic_time ();
+    res = tlm_utils_delete_dir (root);
+    printf ("removed %u files in %u directories: %s, %.3f ms\n",
+            n_files, (n_files + per_dir - 1) / per_dir,
+            res ? "ok" : "FAILED",
+            (g_get_monotonic_time () - start) / 1000.0);
+
+    if (argc <= 3)
+        g_rmdir (base);
+    g_free (root);
+    g_free (base);
+
+    return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
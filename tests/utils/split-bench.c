@@ -0,0 +1,112 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+/* Compares tlm_utils_split_command_line() against the former GRegex based
+ * tokenizer.
+ *
+ *   splitbench [iterations] [command]
+ *
+ * Defaults to 100000 iterations of a typical session command. */
+
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "common/tlm-utils.h"
+
+#define DEFAULT_COMMAND \
+    "/usr/bin/weston --tty=1 --log='/tmp/weston log.txt' \"--idle-time=0\""
+
+static gchar **
+_regex_split (const gchar *command)
+{
+    GRegex *regex = g_regex_new ("('.*?'|\".*?\"|\\S+)", 0,
+                                 G_REGEX_MATCH_NOTEMPTY, NULL);
+    gchar **temp_strv = NULL, **temp_iter = NULL, **args_iter = NULL;
+    gchar **argv = NULL;
+
+    temp_strv = g_regex_split (regex, command, G_REGEX_MATCH_NOTEMPTY);
+    g_regex_unref (regex);
+
+    argv = g_new0 (gchar *, g_strv_length (temp_strv));
+    for (temp_iter = temp_strv, args_iter = argv; *temp_iter; temp_iter++) {
+        gchar *item = g_strstrip (*temp_iter);
+        size_t item_len = strlen (item);
+
+        if (item_len == 0)
+            continue;
+        if ((item[0] == '\"' && item[item_len - 1] == '\"') ||
+            (item[0] == '\'' && item[item_len - 1] == '\'')) {
+            item[item_len - 1] = '\0';
+            memmove (item, item + 1, item_len - 1);
+        }
+        *args_iter++ = g_strcompress (item);
+    }
+    g_strfreev (temp_strv);
+
+    return argv;
+}
+
+static gdouble
+_run (gchar ** (*split) (const gchar *), const gchar *command, guint n)
+{
+    gint64 start = g_get_monotonic_time ();
+    guint i;
+
+    for (i = 0; i < n; i++)
+        g_strfreev (split (command));
+
+    return (g_get_monotonic_time () - start) / 1000.0;
+}
+
+int main (int argc, char *argv[])
+{
+    guint n = argc > 1 ? atoi (argv[1]) : 100000;
+    const gchar *command = argc > 2 ? argv[2] : DEFAULT_COMMAND;
+    gchar **a = NULL, **b = NULL;
+    gboolean same = TRUE;
+    guint i;
+
+    if (!n) {
+        fprintf (stderr, "usage: %s [iterations] [command]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    a = _regex_split (command);
+    b = tlm_utils_split_command_line (command);
+    same = g_strv_length (a) == g_strv_length (b);
+    for (i = 0; same && a[i]; i++)
+        same = g_strcmp0 (a[i], b[i]) == 0;
+    g_strfreev (a);
+    g_strfreev (b);
+
+    printf ("regex:   %.3f ms\n", _run (_regex_split, command, n));
+    printf ("scanner: %.3f ms\n",
+            _run (tlm_utils_split_command_line, command, n));
+    printf ("results %s\n", same ? "match" : "DIFFER");
+
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
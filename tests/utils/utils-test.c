@@ -0,0 +1,684 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of tlm (Tiny Login Manager)
+ *
+ * Copyright (C) 2015 Intel Corporation.
+ *
+ * Contact: Imran Zaman <imran.zaman@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common/tlm-utils.h"
+#include "common/tlm-user-cache.h"
+#include "common/tlm-error.h"
+#include "common/tlm-session-protocol.h"
+
+#define COUNT_FDS_ARG "--count-fds"
+#define HIGH_FD 1000
+
+/* Runs in the exec'ed child, reports descriptors above stderr */
+static int
+_count_fds ()
+{
+    long open_max = sysconf (_SC_OPEN_MAX);
+    int fd, count = 0;
+
+    for (fd = 3; fd < open_max && fd < 65536; fd++) {
+        if (fcntl (fd, F_GETFD) >= 0)
+            count++;
+    }
+    return MIN (count, 100);
+}
+
+START_TEST (test_set_cloexec_from)
+{
+    int fds[3];
+    int status = 0, i;
+    pid_t pid;
+
+    for (i = 0; i < 3; i++) {
+        fds[i] = open ("/dev/null", O_RDONLY);
+        fail_if (fds[i] < 0);
+    }
+    fail_if (dup2 (fds[0], HIGH_FD) != HIGH_FD);
+
+    pid = fork ();
+    fail_if (pid < 0);
+    if (pid == 0) {
+        if (!tlm_utils_set_cloexec_from (3))
+            _exit (101);
+        execl ("/proc/self/exe", "utilstest", COUNT_FDS_ARG, NULL);
+        _exit (102);
+    }
+
+    fail_if (waitpid (pid, &status, 0) != pid);
+    fail_unless (WIFEXITED (status));
+    fail_unless (WEXITSTATUS (status) == 0,
+            "%d unexpected descriptors reached exec", WEXITSTATUS (status));
+
+    /* the calling process is not affected until exec */
+    for (i = 0; i < 3; i++) {
+        fail_unless (fcntl (fds[i], F_GETFD) >= 0);
+        close (fds[i]);
+    }
+    close (HIGH_FD);
+}
+END_TEST
+
+START_TEST (test_set_cloexec_from_keeps_low_fds)
+{
+    int fd = open ("/dev/null", O_RDONLY);
+    int high;
+
+    fail_if (fd < 0);
+    high = dup2 (fd, HIGH_FD);
+    fail_if (high != HIGH_FD);
+
+    fail_unless (tlm_utils_set_cloexec_from (HIGH_FD));
+    fail_unless (fcntl (fd, F_GETFD) == 0, "descriptor below range changed");
+    fail_unless (fcntl (high, F_GETFD) & FD_CLOEXEC);
+
+    close (fd);
+    close (high);
+}
+END_TEST
+
+START_TEST (test_user_info)
+{
+    TlmUserInfo *info = tlm_user_info_new (g_get_user_name ());
+    gint i;
+    gboolean has_primary = FALSE;
+
+    fail_if (info == NULL);
+    fail_unless (info->uid == getuid ());
+    fail_unless (g_strcmp0 (info->name, g_get_user_name ()) == 0);
+    fail_unless (info->home_dir != NULL);
+    fail_unless (info->n_groups > 0);
+    for (i = 0; i < info->n_groups; i++)
+        has_primary |= info->groups[i] == info->gid;
+    fail_unless (has_primary, "primary group missing from group list");
+    tlm_user_info_free (info);
+
+    fail_unless (tlm_user_info_new ("tlm-no-such-user") == NULL);
+}
+END_TEST
+
+START_TEST (test_user_cache)
+{
+    TlmUserCacheStats before, after;
+    TlmUserInfo *info = NULL;
+    gchar *name = NULL;
+
+    tlm_user_cache_invalidate (NULL);
+    tlm_user_cache_get_stats (&before);
+    fail_unless (before.entries == 0);
+
+    info = tlm_user_info_new (g_get_user_name ());
+    fail_if (info == NULL);
+    tlm_user_info_free (info);
+    info = tlm_user_info_new (g_get_user_name ());
+    fail_if (info == NULL);
+    fail_unless (info->uid == getuid ());
+    tlm_user_info_free (info);
+
+    name = tlm_user_get_name (getuid ());
+    fail_unless (g_strcmp0 (name, g_get_user_name ()) == 0);
+    g_free (name);
+
+    tlm_user_cache_get_stats (&after);
+    fail_unless (after.misses == before.misses + 1);
+    fail_unless (after.hits >= before.hits + 2);
+    fail_unless (after.entries == 1);
+
+    /* unknown users are remembered as well */
+    fail_unless (tlm_user_get_uid ("tlm-no-such-user") == (uid_t) -1);
+    fail_unless (tlm_user_get_uid ("tlm-no-such-user") == (uid_t) -1);
+    tlm_user_cache_get_stats (&before);
+    fail_unless (before.hits == after.hits + 1);
+
+    tlm_user_cache_invalidate (g_get_user_name ());
+    tlm_user_cache_get_stats (&after);
+    fail_unless (after.invalidations == before.invalidations + 1);
+    fail_unless (after.entries == before.entries - 1);
+
+    tlm_user_cache_set_ttl (0);
+    fail_unless (tlm_user_get_uid (g_get_user_name ()) == getuid ());
+    tlm_user_cache_get_stats (&after);
+    fail_unless (after.entries == 0);
+    tlm_user_cache_set_ttl (TLM_USER_CACHE_DEFAULT_TTL);
+}
+END_TEST
+
+static void
+_make_tree (const gchar *root, guint n_dirs, guint n_files)
+{
+    gchar *path = NULL, *file = NULL;
+    guint i, j;
+
+    for (i = 0; i < n_dirs; i++) {
+        path = g_strdup_printf ("%s/d%u/sub", root, i);
+        fail_unless (g_mkdir_with_parents (path, 0700) == 0);
+        for (j = 0; j < n_files; j++) {
+            file = g_strdup_printf ("%s/f%u", path, j);
+            fail_unless (g_file_set_contents (file, "x", 1, NULL));
+            g_free (file);
+        }
+        g_free (path);
+    }
+}
+
+START_TEST (test_delete_dir)
+{
+    gchar *base = g_dir_make_tmp ("tlm-test-XXXXXX", NULL);
+    gchar *tree = NULL, *outside = NULL, *keep = NULL, *link = NULL;
+
+    fail_if (base == NULL);
+    tree = g_build_filename (base, "tree", NULL);
+    outside = g_build_filename (base, "outside", NULL);
+    keep = g_build_filename (outside, "keep", NULL);
+    _make_tree (tree, 4, 8);
+    fail_unless (g_mkdir (outside, 0700) == 0);
+    fail_unless (g_file_set_contents (keep, "x", 1, NULL));
+
+    /* links are removed, never followed */
+    link = g_build_filename (tree, "d0", "link", NULL);
+    fail_unless (symlink (outside, link) == 0);
+    g_free (link);
+
+    fail_unless (tlm_utils_delete_dir (tree));
+    fail_if (g_file_test (tree, G_FILE_TEST_EXISTS));
+    fail_unless (g_file_test (keep, G_FILE_TEST_EXISTS));
+
+    /* a link as the root itself is refused */
+    link = g_build_filename (base, "link", NULL);
+    fail_unless (symlink (outside, link) == 0);
+    fail_if (tlm_utils_delete_dir (link));
+    fail_unless (g_file_test (keep, G_FILE_TEST_EXISTS));
+
+    fail_unless (tlm_utils_delete_dir (base));
+    fail_if (tlm_utils_delete_dir (base));
+
+    g_free (link);
+    g_free (keep);
+    g_free (outside);
+    g_free (tree);
+    g_free (base);
+}
+END_TEST
+
+static void
+_on_delete_progress (guint64 n_removed, gpointer userdata)
+{
+    guint64 *last = (guint64 *) userdata;
+
+    fail_unless (n_removed > *last);
+    *last = n_removed;
+}
+
+static void
+_on_delete_done (GObject *source, GAsyncResult *res, gpointer userdata)
+{
+    GError *error = NULL;
+
+    fail_unless (tlm_utils_delete_dir_finish (res, &error));
+    fail_unless (error == NULL);
+    g_main_loop_quit ((GMainLoop *) userdata);
+}
+
+START_TEST (test_delete_dir_async)
+{
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    gchar *base = g_dir_make_tmp ("tlm-test-XXXXXX", NULL);
+    guint64 last = 0;
+
+    fail_if (base == NULL);
+    _make_tree (base, 8, 512);
+
+    tlm_utils_delete_dir_async (base, NULL, _on_delete_progress, &last,
+                                _on_delete_done, loop);
+    g_main_loop_run (loop);
+
+    fail_if (g_file_test (base, G_FILE_TEST_EXISTS));
+    fail_unless (last >= 4096, "progress not reported");
+
+    g_free (base);
+    g_main_loop_unref (loop);
+}
+END_TEST
+
+START_TEST (test_split_command_line)
+{
+    gchar **argv = NULL;
+
+    argv = tlm_utils_split_command_line ("  /bin/sh -c 'echo a  b' \"x y\"  ");
+    fail_unless (argv != NULL);
+    fail_unless (g_strv_length (argv) == 4);
+    fail_unless (g_strcmp0 (argv[0], "/bin/sh") == 0);
+    fail_unless (g_strcmp0 (argv[1], "-c") == 0);
+    fail_unless (g_strcmp0 (argv[2], "echo a  b") == 0);
+    fail_unless (g_strcmp0 (argv[3], "x y") == 0);
+    g_strfreev (argv);
+
+    /* escapes are expanded, unterminated quotes split on blanks */
+    argv = tlm_utils_split_command_line ("prog a\\tb 'open ended");
+    fail_unless (g_strv_length (argv) == 4);
+    fail_unless (g_strcmp0 (argv[1], "a\tb") == 0);
+    fail_unless (g_strcmp0 (argv[2], "'open") == 0);
+    fail_unless (g_strcmp0 (argv[3], "ended") == 0);
+    g_strfreev (argv);
+
+    argv = tlm_utils_split_command_line ("   ");
+    fail_unless (argv != NULL && argv[0] == NULL);
+    g_strfreev (argv);
+
+    fail_unless (tlm_utils_split_command_line (NULL) == NULL);
+}
+END_TEST
+
+START_TEST (test_find_program)
+{
+    gchar *path = NULL;
+
+    path = tlm_utils_find_program ("sh", "/nonexistent::/bin:/usr/bin");
+    fail_unless (path != NULL);
+    fail_unless (g_path_is_absolute (path));
+    g_free (path);
+
+    path = tlm_utils_find_program ("/bin/sh", NULL);
+    fail_unless (g_strcmp0 (path, "/bin/sh") == 0);
+    g_free (path);
+
+    fail_unless (tlm_utils_find_program ("tlm-no-such-program", NULL) == NULL);
+    fail_unless (tlm_utils_find_program ("", NULL) == NULL);
+}
+END_TEST
+
+/* Payloads must reach the other end exactly as the D-Bus variants would */
+START_TEST (test_session_protocol)
+{
+    GString *buf = g_string_new (NULL);
+    GVariantBuilder builder;
+    GVariant *sent, *received;
+    GHashTable *env;
+    GError *error;
+    const gchar *service = NULL;
+    gchar **msg;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{ss}}"));
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sa{ss}}"));
+    g_variant_builder_add (&builder, "s", "General");
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{ss}"));
+    g_variant_builder_add (&builder, "{ss}", "SESSION_CMD",
+            "/bin/sh -c \"echo 100%\"");
+    g_variant_builder_add (&builder, "{ss}", "EMPTY", "");
+    g_variant_builder_add (&builder, "{ss}", "CONTROL", "a\nb\tc\r");
+    g_variant_builder_close (&builder);
+    g_variant_builder_close (&builder);
+    g_variant_builder_add_parsed (&builder, "{'seat 0', @a{ss} {}}");
+    sent = g_variant_ref_sink (g_variant_builder_end (&builder));
+    tlm_session_protocol_append_config (buf, sent);
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{ss}}"));
+    while ((msg = tlm_session_protocol_pop (buf)) != NULL) {
+        fail_unless (tlm_session_protocol_parse_config (msg, &builder));
+        g_strfreev (msg);
+    }
+    received = g_variant_ref_sink (g_variant_builder_end (&builder));
+    fail_unless (g_variant_equal (sent, received));
+    g_variant_unref (sent);
+    g_variant_unref (received);
+
+    env = g_hash_table_new (g_str_hash, g_str_equal);
+    g_hash_table_insert (env, "PATH", "/usr/bin:/bin");
+    g_hash_table_insert (env, "GREETING", "h\xc3\xa9llo w%rld");
+    g_hash_table_insert (env, "EMPTY", "");
+    tlm_session_protocol_append_environment (buf, env);
+    msg = tlm_session_protocol_pop (buf);
+    g_hash_table_unref (env);
+    env = tlm_session_protocol_parse_environment (msg);
+    g_strfreev (msg);
+    fail_unless (env != NULL && g_hash_table_size (env) == 3);
+    fail_unless (g_strcmp0 (g_hash_table_lookup (env, "GREETING"),
+            "h\xc3\xa9llo w%rld") == 0);
+    fail_unless (g_strcmp0 (g_hash_table_lookup (env, "EMPTY"), "") == 0);
+    g_hash_table_unref (env);
+
+    error = g_error_new_literal (TLM_ERROR, TLM_ERROR_PAM_AUTH_FAILURE,
+            "Authentication failed: bad password");
+    sent = g_variant_ref_sink (tlm_error_to_variant (error));
+    g_error_free (error);
+    tlm_session_protocol_append_error (buf, sent);
+    msg = tlm_session_protocol_pop (buf);
+    received = g_variant_ref_sink (tlm_session_protocol_parse_error (msg));
+    g_strfreev (msg);
+    fail_unless (g_variant_equal (sent, received));
+    g_variant_unref (sent);
+    g_variant_unref (received);
+
+    sent = g_variant_ref_sink (g_variant_new_parsed (
+            "@a{st} {'authenticate': 1500, 'open_session': 0}"));
+    tlm_session_protocol_append_pam_timings (buf, "tlm-login", sent);
+    msg = tlm_session_protocol_pop (buf);
+    received = g_variant_ref_sink (
+            tlm_session_protocol_parse_pam_timings (msg, &service));
+    fail_unless (g_strcmp0 (service, "tlm-login") == 0);
+    g_strfreev (msg);
+    fail_unless (g_variant_equal (sent, received));
+    g_variant_unref (sent);
+    g_variant_unref (received);
+
+    /* messages may arrive in pieces */
+    tlm_session_protocol_append (buf, TLM_SESSION_MSG_CREATE, "seat0",
+            "tlm-login", "user", "", NULL);
+    g_string_truncate (buf, buf->len - 1);
+    fail_unless (tlm_session_protocol_pop (buf) == NULL);
+    g_string_append (buf, "\n" TLM_SESSION_MSG_TERMINATED "\n");
+    msg = tlm_session_protocol_pop (buf);
+    fail_unless (g_strv_length (msg) == 5);
+    fail_unless (g_strcmp0 (msg[3], "user") == 0);
+    fail_unless (g_strcmp0 (msg[4], "") == 0);
+    g_strfreev (msg);
+    msg = tlm_session_protocol_pop (buf);
+    fail_unless (g_strcmp0 (msg[0], TLM_SESSION_MSG_TERMINATED) == 0 &&
+            msg[1] == NULL);
+    g_strfreev (msg);
+    fail_unless (buf->len == 0);
+
+    g_string_free (buf, TRUE);
+}
+END_TEST
+
+START_TEST (test_ioprio)
+{
+    gint saved, lowest;
+
+    fail_unless (tlm_utils_parse_ioprio ("best-effort:0") ==
+                 tlm_utils_parse_ioprio ("0"));
+    fail_unless (tlm_utils_parse_ioprio ("realtime:4") >= 0);
+    fail_unless (tlm_utils_parse_ioprio ("idle") >= 0);
+    fail_unless (tlm_utils_parse_ioprio ("8") == -1);
+    fail_unless (tlm_utils_parse_ioprio ("best-effort:") == -1);
+    fail_unless (tlm_utils_parse_ioprio ("fast") == -1);
+    fail_unless (tlm_utils_parse_ioprio (NULL) == -1);
+
+    /* lowering our own priority needs no privileges */
+    saved = tlm_utils_get_ioprio (0);
+    fail_unless (saved >= 0);
+    lowest = tlm_utils_parse_ioprio ("best-effort:7");
+    fail_unless (tlm_utils_set_ioprio (0, lowest));
+    fail_unless (tlm_utils_get_ioprio (0) == lowest);
+    tlm_utils_set_ioprio (0, saved);
+}
+END_TEST
+
+static void
+_on_prefetch_done (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    gint *count = (gint *) userdata;
+
+    *count = tlm_utils_prefetch_files_finish (result, NULL);
+}
+
+START_TEST (test_parse_cpu_list)
+{
+    cpu_set_t set;
+
+    fail_unless (tlm_utils_parse_cpu_list ("0-2,4", &set));
+    fail_unless (CPU_COUNT (&set) == 4);
+    fail_unless (CPU_ISSET (0, &set) && CPU_ISSET (1, &set) &&
+                 CPU_ISSET (2, &set) && CPU_ISSET (4, &set));
+    fail_unless (tlm_utils_parse_cpu_list ("3", &set));
+    fail_unless (CPU_COUNT (&set) == 1 && CPU_ISSET (3, &set));
+
+    fail_if (tlm_utils_parse_cpu_list ("", &set));
+    fail_if (tlm_utils_parse_cpu_list ("3-1", &set));
+    fail_if (tlm_utils_parse_cpu_list ("a", &set));
+    fail_if (tlm_utils_parse_cpu_list ("1,", &set));
+    fail_if (tlm_utils_parse_cpu_list ("0-", &set));
+}
+END_TEST
+
+START_TEST (test_prefetch_files)
+{
+    gchar *base = g_dir_make_tmp ("tlm-test-XXXXXX", NULL);
+    gchar *file_a, *file_b, *list, *contents;
+    const gchar *files[] = { NULL, NULL, "/nonexistent", NULL };
+    gint count = -2;
+
+    fail_if (base == NULL);
+    file_a = g_build_filename (base, "a", NULL);
+    file_b = g_build_filename (base, "b", NULL);
+    list = g_build_filename (base, "list", NULL);
+    fail_unless (g_file_set_contents (file_a, "a", -1, NULL));
+    fail_unless (g_file_set_contents (file_b, "b", -1, NULL));
+
+    /* directories, comments and duplicates are skipped */
+    contents = g_strdup_printf ("# learned\n%s\n\n  %s  \n%s\n", file_b,
+                                file_a, base);
+    fail_unless (g_file_set_contents (list, contents, -1, NULL));
+    files[0] = file_a;
+    files[1] = base;
+
+    tlm_utils_prefetch_files_async (files, list, NULL, _on_prefetch_done,
+                                    &count);
+    while (count == -2)
+        g_main_context_iteration (NULL, TRUE);
+    fail_unless (count == 2, "prefetched %d files", count);
+
+    tlm_utils_delete_dir (base);
+    g_free (contents);
+    g_free (list);
+    g_free (file_b);
+    g_free (file_a);
+    g_free (base);
+}
+END_TEST
+
+typedef struct {
+    guint found;
+    gboolean final;
+} WatchResult;
+
+static void
+_on_watch (const gchar *found_item, gboolean is_final, GError *error,
+           gpointer userdata)
+{
+    WatchResult *res = (WatchResult *) userdata;
+
+    fail_unless (g_file_test (found_item, G_FILE_TEST_EXISTS));
+    fail_if (res->final);
+    res->found++;
+    res->final = is_final;
+}
+
+static void
+_iterate_until (gboolean *done)
+{
+    gint64 end = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+
+    while (!*done && g_get_monotonic_time () < end)
+        g_main_context_iteration (NULL, FALSE);
+}
+
+START_TEST (test_watch_for_files)
+{
+    gchar *root = g_dir_make_tmp ("tlm-watch-XXXXXX", NULL);
+    gchar *file = g_build_filename (root, "file", NULL);
+    gchar *old = g_build_filename (root, "old", NULL);
+    gchar *sub = g_build_filename (root, "a", "b", NULL);
+    gchar *nested = g_build_filename (sub, "nested", NULL);
+    gchar *cancelled = g_build_filename (root, "cancelled", NULL);
+    const gchar *watch_list[] = { old, file, nested, NULL };
+    const gchar *cancel_list[] = { cancelled, NULL };
+    WatchResult res = { 0, FALSE }, cancel_res = { 0, FALSE };
+    guint id, cancel_id;
+
+    fail_unless (g_file_set_contents (old, "x", 1, NULL));
+
+    /* existing files are reported right away */
+    id = tlm_utils_watch_for_files (watch_list, _on_watch, &res);
+    fail_unless (id != 0);
+    fail_unless (res.found == 1 && !res.final);
+
+    cancel_id = tlm_utils_watch_for_files (cancel_list, _on_watch,
+                                           &cancel_res);
+    fail_unless (cancel_id != 0 && cancel_id != id);
+    tlm_utils_unwatch_files (cancel_id);
+    fail_unless (g_file_set_contents (cancelled, "x", 1, NULL));
+
+    fail_unless (g_file_set_contents (file, "x", 1, NULL));
+    fail_unless (g_mkdir_with_parents (sub, 0700) == 0);
+    fail_unless (g_file_set_contents (nested, "x", 1, NULL));
+    _iterate_until (&res.final);
+    fail_unless (res.final);
+    fail_unless (res.found == 3);
+    fail_unless (cancel_res.found == 0);
+
+    /* nothing left to wait for */
+    res.found = 0;
+    res.final = FALSE;
+    fail_unless (tlm_utils_watch_for_files (watch_list, _on_watch, &res) == 0);
+    fail_unless (res.found == 3 && res.final);
+
+    fail_unless (tlm_utils_delete_dir (root));
+    g_free (cancelled);
+    g_free (nested);
+    g_free (sub);
+    g_free (old);
+    g_free (file);
+    g_free (root);
+}
+END_TEST
+
+static void
+_on_change (const gchar *path, gboolean is_final, GError *error,
+            gpointer userdata)
+{
+    WatchResult *res = (WatchResult *) userdata;
+
+    fail_if (res->final);
+    res->found++;
+    res->final = is_final;
+}
+
+static void
+_append (const gchar *path)
+{
+    FILE *fp = fopen (path, "a");
+
+    fail_unless (fp != NULL);
+    fputs ("x", fp);
+    fclose (fp);
+}
+
+START_TEST (test_watch_file_changes)
+{
+    gchar *root = g_dir_make_tmp ("tlm-watch-XXXXXX", NULL);
+    gchar *file = g_build_filename (root, "file", NULL);
+    gchar *missing = g_build_filename (root, "missing", NULL);
+    WatchResult res = { 0, FALSE }, cancel_res = { 0, FALSE };
+    gint64 end;
+    guint id, cancel_id;
+
+    fail_unless (tlm_utils_watch_file_changes (missing, _on_change,
+                                               &res) == 0);
+
+    fail_unless (g_file_set_contents (file, "x", 1, NULL));
+    id = tlm_utils_watch_file_changes (file, _on_change, &res);
+    fail_unless (id != 0);
+    cancel_id = tlm_utils_watch_file_changes (file, _on_change, &cancel_res);
+    fail_unless (cancel_id != 0 && cancel_id != id);
+    tlm_utils_unwatch_files (cancel_id);
+    fail_unless (res.found == 0);
+
+    /* every change is reported, the watch stays */
+    _append (file);
+    end = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+    while (!res.found && g_get_monotonic_time () < end)
+        g_main_context_iteration (NULL, FALSE);
+    fail_unless (res.found > 0 && !res.final);
+
+    /* removing the file ends the watch */
+    fail_unless (g_unlink (file) == 0);
+    _iterate_until (&res.final);
+    fail_unless (res.final);
+    fail_unless (cancel_res.found == 0);
+
+    fail_unless (tlm_utils_delete_dir (root));
+    g_free (missing);
+    g_free (file);
+    g_free (root);
+}
+END_TEST
+
+Suite* utils_suite (void)
+{
+    TCase *tc = NULL;
+
+    Suite *s = suite_create ("Tlm utils");
+
+    tc = tcase_create ("Utils tests");
+    tcase_add_test (tc, test_set_cloexec_from);
+    tcase_add_test (tc, test_set_cloexec_from_keeps_low_fds);
+    tcase_add_test (tc, test_user_info);
+    tcase_add_test (tc, test_user_cache);
+    tcase_add_test (tc, test_delete_dir);
+    tcase_add_test (tc, test_delete_dir_async);
+    tcase_add_test (tc, test_split_command_line);
+    tcase_add_test (tc, test_find_program);
+    tcase_add_test (tc, test_session_protocol);
+    tcase_add_test (tc, test_ioprio);
+    tcase_add_test (tc, test_prefetch_files);
+    tcase_add_test (tc, test_parse_cpu_list);
+    tcase_add_test (tc, test_watch_for_files);
+    tcase_add_test (tc, test_watch_file_changes);
+    suite_add_tcase (s, tc);
+
+    return s;
+}
+
+int main (int argc, char *argv[])
+{
+    int number_failed;
+    Suite *s = 0;
+    SRunner *sr = 0;
+
+    if (argc > 1 && g_strcmp0 (argv[1], COUNT_FDS_ARG) == 0)
+        return _count_fds ();
+
+    s = utils_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_VERBOSE);
+
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
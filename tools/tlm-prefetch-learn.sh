@@ -0,0 +1,55 @@
+#!/bin/sh
+# Records the files read while a session starts, for PREFETCH_LIST in tlm.conf
+#
+# Attaches strace to the running tlm daemon, following sessiond and the
+# session it starts, for the given number of seconds. Log in (or trigger
+# the automatic login) on the seat while it runs. Regular files that were
+# opened or executed successfully are written to <output>, in the order
+# they were first used.
+
+usage() {
+    echo "Usage: $0 [-p <tlm pid>] [-t <seconds>] <output>"
+    echo "Defaults: the pid of the running tlm, 30 seconds"
+    exit 1
+}
+
+pid=""
+seconds=30
+while getopts "p:t:" opt; do
+    case $opt in
+        p) pid=$OPTARG ;;
+        t) seconds=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 1 ] || usage
+output=$1
+
+if ! command -v strace >/dev/null 2>&1; then
+    echo "strace is needed to record the session start"
+    exit 1
+fi
+[ -n "$pid" ] || pid=`pidof -s tlm`
+if [ -z "$pid" ]; then
+    echo "tlm is not running"
+    exit 1
+fi
+
+trace=`mktemp /tmp/tlm-prefetch-XXXXXX`
+trap 'rm -f "$trace"' EXIT
+
+echo "Tracing tlm ($pid) for $seconds seconds, start the session now"
+timeout -s INT "$seconds" strace -f -qq -e trace=open,openat,execve \
+    -o "$trace" -p "$pid"
+
+# keep successful calls, take the first quoted argument as the path
+grep -E '(open|openat|execve)\(' "$trace" | grep -v '= -1 ' | \
+    sed -n 's/^[^"]*"\([^"]*\)".*/\1/p' | \
+    grep -v -E '^/(proc|sys|dev|run|tmp)/' | \
+    awk '!seen[$0]++' | \
+    while read -r file; do
+        [ -f "$file" ] && echo "$file"
+    done > "$output"
+
+echo "`wc -l < "$output"` files written to $output"